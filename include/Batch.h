@@ -0,0 +1,697 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+// Needs Vector.h, Matrix.h, and DualQuaternion.h, but this file is not intended
+// to be included directly.  Just include Math.h and everything will be set up
+// correctly.
+
+#include "Simd.h"
+#include "Fast.h"
+
+#include <cassert>
+#include <cstddef>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Batch operations on contiguous arrays.
+      //
+      // These do the same thing as looping over the single element operators,
+      // but without building a temporary Vector4 per element and with the
+      // matrix elements held in registers for the whole array.  The float
+      // versions work on 4 elements at a time with SSE, and the float 3D
+      // transforms on 8 or 16 at a time with AVX2 or AVX-512 when
+      // simd_level() (see Simd.h) says so.
+      //
+      // In all of these in and out may be the same array (in place
+      // operation), but they must not otherwise overlap.
+      //
+      // transform_points()      out[i] = M * (in[i], 1), dropping the last
+      //                         element.  The bottom row of M is ignored, so
+      //                         this is only meaningful for affine M; there is
+      //                         no homogeneous divide.
+      // transform_directions()  out[i] = M * (in[i], 0), dropping the last
+      //                         element.  This ignores the translation.
+      //
+      // Both take a Matrix44 or Matrix34 with Vector3 arrays, or a Matrix33
+      // with Vector2 arrays (2D homogeneous coordinates).
+      // transform_directions() also takes a Matrix33 with Vector3 arrays,
+      // which is just out[i] = M * in[i].
+      //
+      // skin_points()           Dual quaternion skinning.  out[i] is in[i]
+      //                         transformed by the blend() of the k bones
+      //                         bones[index[i*k + j]] with weights
+      //                         weight[i*k + j], j = 0..k-1.  Unused influences
+      //                         can be given weight 0.
+      //
+      // get_rot_mat33_batch()        out[i] = get_rot_mat33(angles[i], axes[i]),
+      // get_rot_mat44_batch()        and the same for get_rot_mat44() and
+      // get_transform_mat44_batch()  get_transform_mat44(angles[i], axes[i],
+      //                              translations[i]) (see Transform.h).
+      //                              For float the sines and cosines come
+      //                              from fast::sincos() (see Fast.h), so the
+      //                              angles should be within its domain and
+      //                              the last bits can differ from the single
+      //                              matrix versions.
+
+      namespace detail
+	 {
+	 // out[i] = A * in[i] + t for a 3x3 column major A.  Used by all of the
+	 // 3D batch transforms so that the SIMD versions share one loop.  The
+	 // _scalar versions also handle the unaligned heads and the tails of the
+	 // SIMD loops.
+	 template <typename T>
+	 inline void transform3_scalar(T const * a, T const * t,
+				       Vector3<T> const * in, Vector3<T> * out, size_t n)
+	    {
+	    T const a0 = a[0], a1 = a[1], a2 = a[2];
+	    T const a3 = a[3], a4 = a[4], a5 = a[5];
+	    T const a6 = a[6], a7 = a[7], a8 = a[8];
+	    T const t0 = t[0], t1 = t[1], t2 = t[2];
+	    size_t i;
+	    for (i=0; i<n; ++i)
+	       {
+	       T const x = in[i].x, y = in[i].y, z = in[i].z;
+	       out[i].x = a0*x + a3*y + a6*z + t0;
+	       out[i].y = a1*x + a4*y + a7*z + t1;
+	       out[i].z = a2*x + a5*y + a8*z + t2;
+	       }
+	    }
+
+	 // out[i] = A * in[i] + t for a 2x2 column major A.
+	 template <typename T>
+	 inline void transform2_scalar(T const * a, T const * t,
+				       Vector2<T> const * in, Vector2<T> * out, size_t n)
+	    {
+	    T const a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+	    T const t0 = t[0], t1 = t[1];
+	    size_t i;
+	    for (i=0; i<n; ++i)
+	       {
+	       T const x = in[i].x, y = in[i].y;
+	       out[i].x = a0*x + a2*y + t0;
+	       out[i].y = a1*x + a3*y + t1;
+	       }
+	    }
+
+	 template <typename T>
+	 inline void transform3(T const * a, T const * t,
+				Vector3<T> const * in, Vector3<T> * out, size_t n)
+	    { transform3_scalar(a, t, in, out, n); }
+
+	 template <typename T>
+	 inline void transform2(T const * a, T const * t,
+				Vector2<T> const * in, Vector2<T> * out, size_t n)
+	    { transform2_scalar(a, t, in, out, n); }
+
+#if defined(ARDA_MATH_DISPATCH)
+	 // The run time dispatched versions of transform3<float>, 8 and 16
+	 // vectors at a time.  They return how many vectors they did, always a
+	 // multiple of the block size, and leave the rest to the SSE version.
+	 ARDA_MATH_TARGET_AVX2
+	 inline size_t transform3_avx2(float const * a, float const * t,
+				       Vector3<float> const * in, Vector3<float> * out, size_t n)
+	    {
+	    __m256 const a0 = _mm256_set1_ps(a[0]), a1 = _mm256_set1_ps(a[1]), a2 = _mm256_set1_ps(a[2]);
+	    __m256 const a3 = _mm256_set1_ps(a[3]), a4 = _mm256_set1_ps(a[4]), a5 = _mm256_set1_ps(a[5]);
+	    __m256 const a6 = _mm256_set1_ps(a[6]), a7 = _mm256_set1_ps(a[7]), a8 = _mm256_set1_ps(a[8]);
+	    __m256 const t0 = _mm256_set1_ps(t[0]), t1 = _mm256_set1_ps(t[1]), t2 = _mm256_set1_ps(t[2]);
+	    size_t i;
+	    for (i=0; i+8<=n; i+=8)
+	       {
+	       __m256 p0, p1, p2, x, y, z;
+	       simd::load3x8(&in[i].x, p0, p1, p2);
+	       simd::deinterleave3(p0, p1, p2, x, y, z);
+	       __m256 const rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a0, x),
+							     _mm256_mul_ps(a3, y)), _mm256_mul_ps(a6, z)), t0);
+	       __m256 const ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a1, x),
+							     _mm256_mul_ps(a4, y)), _mm256_mul_ps(a7, z)), t1);
+	       __m256 const rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a2, x),
+							     _mm256_mul_ps(a5, y)), _mm256_mul_ps(a8, z)), t2);
+	       simd::interleave3(rx, ry, rz, p0, p1, p2);
+	       simd::store3x8(&out[i].x, p0, p1, p2);
+	       }
+	    return i;
+	    }
+
+	 ARDA_MATH_TARGET_AVX512
+	 inline size_t transform3_avx512(float const * a, float const * t,
+					 Vector3<float> const * in, Vector3<float> * out, size_t n)
+	    {
+	    __m512 const a0 = _mm512_set1_ps(a[0]), a1 = _mm512_set1_ps(a[1]), a2 = _mm512_set1_ps(a[2]);
+	    __m512 const a3 = _mm512_set1_ps(a[3]), a4 = _mm512_set1_ps(a[4]), a5 = _mm512_set1_ps(a[5]);
+	    __m512 const a6 = _mm512_set1_ps(a[6]), a7 = _mm512_set1_ps(a[7]), a8 = _mm512_set1_ps(a[8]);
+	    __m512 const t0 = _mm512_set1_ps(t[0]), t1 = _mm512_set1_ps(t[1]), t2 = _mm512_set1_ps(t[2]);
+	    size_t i;
+	    for (i=0; i+16<=n; i+=16)
+	       {
+	       float const * src = &in[i].x;
+	       float * dst = &out[i].x;
+	       __m512 x, y, z;
+	       simd::deinterleave3(_mm512_loadu_ps(src), _mm512_loadu_ps(src + 16), _mm512_loadu_ps(src + 32),
+				   x, y, z);
+	       __m512 const rx = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a0, x),
+							     _mm512_mul_ps(a3, y)), _mm512_mul_ps(a6, z)), t0);
+	       __m512 const ry = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a1, x),
+							     _mm512_mul_ps(a4, y)), _mm512_mul_ps(a7, z)), t1);
+	       __m512 const rz = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a2, x),
+							     _mm512_mul_ps(a5, y)), _mm512_mul_ps(a8, z)), t2);
+	       __m512 r0, r1, r2;
+	       simd::interleave3(rx, ry, rz, r0, r1, r2);
+	       _mm512_storeu_ps(dst, r0);
+	       _mm512_storeu_ps(dst + 16, r1);
+	       _mm512_storeu_ps(dst + 32, r2);
+	       }
+	    return i;
+	    }
+#endif // ARDA_MATH_DISPATCH
+
+#if defined(ARDA_MATH_SSE2)
+	 template <>
+	 inline void transform3<float>(float const * a, float const * t,
+				       Vector3<float> const * in, Vector3<float> * out, size_t n)
+	    {
+#if defined(ARDA_MATH_DISPATCH)
+	    size_t done = 0;
+	    SimdLevel const level = simd_level();
+	    if (level == SimdLevel::AVX512)
+	       done = transform3_avx512(a, t, in, out, n);
+	    else if (level == SimdLevel::AVX2)
+	       done = transform3_avx2(a, t, in, out, n);
+	    in += done;
+	    out += done;
+	    n -= done;
+#endif
+
+	    // Scalar until out is 16 byte aligned (at most 3 elements), then
+	    // blocks of 4 vectors, i.e. 3 registers, then a scalar tail.  Each
+	    // block is fully loaded before it is stored, which is what makes
+	    // in place operation safe.
+	    size_t head = 0;
+	    while (head < n && ((size_t) (out + head) & 15) != 0)
+	       ++head;
+	    if (((size_t) out & 3) != 0)
+	       head = n;
+	    transform3_scalar(a, t, in, out, head);
+
+	    __m128 const a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+	    __m128 const a3 = _mm_set1_ps(a[3]), a4 = _mm_set1_ps(a[4]), a5 = _mm_set1_ps(a[5]);
+	    __m128 const a6 = _mm_set1_ps(a[6]), a7 = _mm_set1_ps(a[7]), a8 = _mm_set1_ps(a[8]);
+	    __m128 const t0 = _mm_set1_ps(t[0]), t1 = _mm_set1_ps(t[1]), t2 = _mm_set1_ps(t[2]);
+	    size_t i;
+	    for (i=head; i+4<=n; i+=4)
+	       {
+	       float const * src = &in[i].x;
+	       float * dst = &out[i].x;
+	       __m128 x, y, z;
+	       simd::deinterleave3(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8),
+				   x, y, z);
+	       __m128 const rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, x),
+						      _mm_mul_ps(a3, y)), _mm_mul_ps(a6, z)), t0);
+	       __m128 const ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a1, x),
+						      _mm_mul_ps(a4, y)), _mm_mul_ps(a7, z)), t1);
+	       __m128 const rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a2, x),
+						      _mm_mul_ps(a5, y)), _mm_mul_ps(a8, z)), t2);
+	       __m128 r0, r1, r2;
+	       simd::interleave3(rx, ry, rz, r0, r1, r2);
+	       _mm_store_ps(dst, r0);
+	       _mm_store_ps(dst + 4, r1);
+	       _mm_store_ps(dst + 8, r2);
+	       }
+
+	    transform3_scalar(a, t, in + i, out + i, n - i);
+	    }
+
+	 template <>
+	 inline void transform2<float>(float const * a, float const * t,
+				       Vector2<float> const * in, Vector2<float> * out, size_t n)
+	    {
+	    size_t head = 0;
+	    while (head < n && ((size_t) (out + head) & 15) != 0)
+	       ++head;
+	    if (((size_t) out & 3) != 0)
+	       head = n;
+	    transform2_scalar(a, t, in, out, head);
+
+	    __m128 const a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]);
+	    __m128 const a2 = _mm_set1_ps(a[2]), a3 = _mm_set1_ps(a[3]);
+	    __m128 const t0 = _mm_set1_ps(t[0]), t1 = _mm_set1_ps(t[1]);
+	    size_t i;
+	    for (i=head; i+4<=n; i+=4)
+	       {
+	       float const * src = &in[i].x;
+	       float * dst = &out[i].x;
+	       __m128 const p01 = _mm_loadu_ps(src);     // x0 y0 x1 y1
+	       __m128 const p23 = _mm_loadu_ps(src + 4); // x2 y2 x3 y3
+	       __m128 const x = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2,0,2,0));
+	       __m128 const y = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3,1,3,1));
+	       __m128 const rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, x), _mm_mul_ps(a2, y)), t0);
+	       __m128 const ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a1, x), _mm_mul_ps(a3, y)), t1);
+	       _mm_store_ps(dst, _mm_unpacklo_ps(rx, ry));
+	       _mm_store_ps(dst + 4, _mm_unpackhi_ps(rx, ry));
+	       }
+
+	    transform2_scalar(a, t, in + i, out + i, n - i);
+	    }
+#endif // ARDA_MATH_SSE2
+
+	 // Dual quaternion skinning, one vertex at a time.  This is blend()
+	 // with the bones looked up through index, followed by
+	 // transform_point().
+	 template <typename T>
+	 inline void skin3(DualQuaternion<T> const * bones, unsigned int const * index,
+			   T const * weight, unsigned int k,
+			   Vector3<T> const * in, Vector3<T> * out, size_t n)
+	    {
+	    size_t i;
+	    unsigned int j;
+	    for (i=0; i<n; ++i, index+=k, weight+=k)
+	       {
+	       DualQuaternion<T> const & b0 = bones[index[0]];
+	       DualQuaternion<T> b(b0 * weight[0]);
+	       for (j=1; j<k; ++j)
+		  {
+		  DualQuaternion<T> const & bj = bones[index[j]];
+		  T const w = (b0.real.dot(bj.real) < T(0)) ? -weight[j] : weight[j];
+		  b.real += bj.real * w;
+		  b.dual += bj.dual * w;
+		  }
+	       out[i] = b.normalize().transform_point(in[i]);
+	       }
+	    }
+
+#if defined(ARDA_MATH_SSE2)
+	 // The blend of the k bones of one vertex.  The real and dual parts are
+	 // one register each, so this is two multiply adds per influence plus
+	 // the hemisphere test.
+	 inline void skin_blend(DualQuaternion<float> const * bones, unsigned int const * index,
+				float const * weight, unsigned int k, __m128 & r, __m128 & d)
+	    {
+	    Quaternion<float> const & q0 = bones[index[0]].real;
+	    __m128 const w0 = _mm_set1_ps(weight[0]);
+	    r = _mm_mul_ps(_mm_loadu_ps(&q0.x), w0);
+	    d = _mm_mul_ps(_mm_loadu_ps(&bones[index[0]].dual.x), w0);
+	    unsigned int j;
+	    for (j=1; j<k; ++j)
+	       {
+	       DualQuaternion<float> const & bj = bones[index[j]];
+	       __m128 const wj = _mm_set1_ps(q0.dot(bj.real) < 0.0f ? -weight[j] : weight[j]);
+	       r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&bj.real.x), wj));
+	       d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(&bj.dual.x), wj));
+	       }
+	    }
+
+	 template <>
+	 inline void skin3<float>(DualQuaternion<float> const * bones, unsigned int const * index,
+				  float const * weight, unsigned int k,
+				  Vector3<float> const * in, Vector3<float> * out, size_t n)
+	    {
+	    // Blend 4 vertices, then transpose the blends so that normalizing
+	    // them and transforming the 4 points is done one element per
+	    // register, with no shuffles and one square root and divide.
+	    size_t i;
+	    for (i=0; i+4<=n; i+=4, index+=4*k, weight+=4*k)
+	       {
+	       __m128 rx, ry, rz, rw, dx, dy, dz, dw;
+	       skin_blend(bones, index, weight, k, rx, dx);
+	       skin_blend(bones, index + k, weight + k, k, ry, dy);
+	       skin_blend(bones, index + 2*k, weight + 2*k, k, rz, dz);
+	       skin_blend(bones, index + 3*k, weight + 3*k, k, rw, dw);
+	       _MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+	       _MM_TRANSPOSE4_PS(dx, dy, dz, dw);
+
+	       __m128 const inv = _mm_div_ps(_mm_set1_ps(1.0f),
+					     _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx),
+											  _mm_mul_ps(ry, ry)),
+									       _mm_mul_ps(rz, rz)),
+								    _mm_mul_ps(rw, rw))));
+	       rx = _mm_mul_ps(rx, inv); ry = _mm_mul_ps(ry, inv);
+	       rz = _mm_mul_ps(rz, inv); rw = _mm_mul_ps(rw, inv);
+	       dx = _mm_mul_ps(dx, inv); dy = _mm_mul_ps(dy, inv);
+	       dz = _mm_mul_ps(dz, inv); dw = _mm_mul_ps(dw, inv);
+
+	       float const * src = &in[i].x;
+	       __m128 px, py, pz;
+	       simd::deinterleave3(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8),
+				   px, py, pz);
+
+	       // p + w t + cross(r, t) with t = 2 cross(r, p), plus the
+	       // translation 2 (r.w d - d.w r + cross(r, d)).
+	       __m128 tx = _mm_sub_ps(_mm_mul_ps(ry, pz), _mm_mul_ps(rz, py));
+	       __m128 ty = _mm_sub_ps(_mm_mul_ps(rz, px), _mm_mul_ps(rx, pz));
+	       __m128 tz = _mm_sub_ps(_mm_mul_ps(rx, py), _mm_mul_ps(ry, px));
+	       tx = _mm_add_ps(tx, tx); ty = _mm_add_ps(ty, ty); tz = _mm_add_ps(tz, tz);
+	       __m128 ux = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dx), _mm_mul_ps(dw, rx)),
+				      _mm_sub_ps(_mm_mul_ps(ry, dz), _mm_mul_ps(rz, dy)));
+	       __m128 uy = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dy), _mm_mul_ps(dw, ry)),
+				      _mm_sub_ps(_mm_mul_ps(rz, dx), _mm_mul_ps(rx, dz)));
+	       __m128 uz = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dz), _mm_mul_ps(dw, rz)),
+				      _mm_sub_ps(_mm_mul_ps(rx, dy), _mm_mul_ps(ry, dx)));
+	       ux = _mm_add_ps(ux, ux); uy = _mm_add_ps(uy, uy); uz = _mm_add_ps(uz, uz);
+	       __m128 const ox = _mm_add_ps(_mm_add_ps(_mm_add_ps(px, _mm_mul_ps(rw, tx)),
+						       _mm_sub_ps(_mm_mul_ps(ry, tz), _mm_mul_ps(rz, ty))), ux);
+	       __m128 const oy = _mm_add_ps(_mm_add_ps(_mm_add_ps(py, _mm_mul_ps(rw, ty)),
+						       _mm_sub_ps(_mm_mul_ps(rz, tx), _mm_mul_ps(rx, tz))), uy);
+	       __m128 const oz = _mm_add_ps(_mm_add_ps(_mm_add_ps(pz, _mm_mul_ps(rw, tz)),
+						       _mm_sub_ps(_mm_mul_ps(rx, ty), _mm_mul_ps(ry, tx))), uz);
+	       __m128 o0, o1, o2;
+	       simd::interleave3(ox, oy, oz, o0, o1, o2);
+	       float * dst = &out[i].x;
+	       _mm_storeu_ps(dst, o0);
+	       _mm_storeu_ps(dst + 4, o1);
+	       _mm_storeu_ps(dst + 8, o2);
+	       }
+
+	    // One vertex at a time for the tail.
+	    for (; i<n; ++i, index+=k, weight+=k)
+	       {
+	       __m128 r, d;
+	       skin_blend(bones, index, weight, k, r, d);
+	       __m128 const inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(simd::hsum4(_mm_mul_ps(r, r))));
+	       r = _mm_mul_ps(r, inv);
+	       d = _mm_mul_ps(d, inv);
+	       __m128 const rw = _mm_shuffle_ps(r, r, _MM_SHUFFLE(3,3,3,3));
+	       __m128 const dw = _mm_shuffle_ps(d, d, _MM_SHUFFLE(3,3,3,3));
+	       __m128 const p = simd::load3(&in[i].x);
+	       __m128 const t = simd::cross3(r, p);
+	       __m128 const t2 = _mm_add_ps(t, t);
+	       __m128 const rp = _mm_add_ps(_mm_add_ps(p, _mm_mul_ps(rw, t2)), simd::cross3(r, t2));
+	       __m128 const tr = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, d), _mm_mul_ps(dw, r)), simd::cross3(r, d));
+	       simd::store3(&out[i].x, _mm_add_ps(rp, _mm_add_ps(tr, tr)));
+	       }
+	    }
+#endif // ARDA_MATH_SSE2
+
+#if defined(ARDA_MATH_AVX)
+	 template <>
+	 inline void transform3<double>(double const * a, double const * t,
+					Vector3<double> const * in, Vector3<double> * out, size_t n)
+	    {
+	    // One vector per iteration, with the columns of A in registers.
+	    // The 4th lane is padding and is never stored.
+	    __m256d const c0 = _mm256_setr_pd(a[0], a[1], a[2], 0);
+	    __m256d const c1 = _mm256_setr_pd(a[3], a[4], a[5], 0);
+	    __m256d const c2 = _mm256_setr_pd(a[6], a[7], a[8], 0);
+	    __m256d const c3 = _mm256_setr_pd(t[0], t[1], t[2], 0);
+	    size_t i;
+	    for (i=0; i<n; ++i)
+	       {
+	       __m256d r = _mm256_mul_pd(c0, _mm256_broadcast_sd(&in[i].x));
+	       r = _mm256_add_pd(r, _mm256_mul_pd(c1, _mm256_broadcast_sd(&in[i].y)));
+	       r = _mm256_add_pd(r, _mm256_mul_pd(c2, _mm256_broadcast_sd(&in[i].z)));
+	       r = _mm256_add_pd(r, c3);
+	       _mm_storeu_pd(&out[i].x, _mm256_castpd256_pd128(r));
+	       _mm_store_sd(&out[i].z, _mm256_extractf128_pd(r, 1));
+	       }
+	    }
+#endif // ARDA_MATH_AVX
+
+	 // The 9 elements of the rotation with cosine c and sine s around v,
+	 // as get_rot_mat33(): v is normalized first, and a zero v gives the
+	 // identity.  The SSE version below does the same operations 4
+	 // rotations at a time.
+	 template <typename T>
+	 inline void rotation3(T c, T s, Vector3<T> const & v, T * e)
+	    {
+	    using std::sqrt;
+	    T const l = (T) sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
+	    T x = T(0), y = T(0), z = T(0);
+	    if (l != T(0))
+	       {
+	       x = v.x / l;
+	       y = v.y / l;
+	       z = v.z / l;
+	       }
+	    else
+	       {
+	       c = T(1);
+	       s = T(0);
+	       }
+	    T const omc = T(1) - c;
+	    T const ox = omc*x, oy = omc*y, oz = omc*z;
+	    T const xy = ox*y, xz = ox*z, yz = oy*z;
+	    T const sx = s*x, sy = s*y, sz = s*z;
+	    e[0] = c + ox*x; e[1] = xy + sz;   e[2] = xz - sy;
+	    e[3] = xy - sz;  e[4] = c + oy*y;  e[5] = yz + sx;
+	    e[6] = xz + sy;  e[7] = yz - sx;   e[8] = c + oz*z;
+	    }
+
+	 template <typename T>
+	 inline void put_rotation(Matrix33<T> & M, T const * e)
+	    { M.assign(e[0], e[1], e[2], e[3], e[4], e[5], e[6], e[7], e[8]); }
+
+	 // d may be null, for no translation.
+	 template <typename T>
+	 inline void put_rotation(Matrix44<T> & M, T const * e, Vector3<T> const * d)
+	    {
+	    M.assign(e[0], e[1], e[2], T(0),
+		     e[3], e[4], e[5], T(0),
+		     e[6], e[7], e[8], T(0),
+		     d != 0 ? d->x : T(0), d != 0 ? d->y : T(0), d != 0 ? d->z : T(0), T(1));
+	    }
+
+	 template <typename T>
+	 inline void rot_mat33_batch(Matrix33<T> * out, float const * angles,
+				     Vector3<T> const * axes, size_t n)
+	    {
+	    using std::cos;
+	    using std::sin;
+	    T e[9];
+	    size_t i;
+	    for (i=0; i<n; ++i)
+	       {
+	       rotation3((T) cos(angles[i]), (T) sin(angles[i]), axes[i], e);
+	       put_rotation(out[i], e);
+	       }
+	    }
+
+	 template <typename T>
+	 inline void rot_mat44_batch(Matrix44<T> * out, float const * angles,
+				     Vector3<T> const * axes, Vector3<T> const * d, size_t n)
+	    {
+	    using std::cos;
+	    using std::sin;
+	    T e[9];
+	    size_t i;
+	    for (i=0; i<n; ++i)
+	       {
+	       rotation3((T) cos(angles[i]), (T) sin(angles[i]), axes[i], e);
+	       put_rotation(out[i], e, d != 0 ? d + i : 0);
+	       }
+	    }
+
+#if defined(ARDA_MATH_SSE2)
+	 // rotation3() for the 4 axes starting at v, one element per register.
+	 inline void rotation3x4(__m128 c, __m128 s, Vector3<float> const * v, __m128 * e)
+	    {
+	    float const * src = &v->x;
+	    __m128 x, y, z;
+	    simd::deinterleave3(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), x, y, z);
+	    __m128 const l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+	    __m128 const nonzero = _mm_cmpneq_ps(l, _mm_setzero_ps());
+	    __m128 const one = _mm_set1_ps(1.0f);
+	    x = _mm_and_ps(nonzero, _mm_div_ps(x, l));
+	    y = _mm_and_ps(nonzero, _mm_div_ps(y, l));
+	    z = _mm_and_ps(nonzero, _mm_div_ps(z, l));
+	    c = _mm_or_ps(_mm_and_ps(nonzero, c), _mm_andnot_ps(nonzero, one));
+	    s = _mm_and_ps(nonzero, s);
+
+	    __m128 const omc = _mm_sub_ps(one, c);
+	    __m128 const ox = _mm_mul_ps(omc, x), oy = _mm_mul_ps(omc, y), oz = _mm_mul_ps(omc, z);
+	    __m128 const xy = _mm_mul_ps(ox, y), xz = _mm_mul_ps(ox, z), yz = _mm_mul_ps(oy, z);
+	    __m128 const sx = _mm_mul_ps(s, x), sy = _mm_mul_ps(s, y), sz = _mm_mul_ps(s, z);
+	    e[0] = _mm_add_ps(c, _mm_mul_ps(ox, x)); e[1] = _mm_add_ps(xy, sz); e[2] = _mm_sub_ps(xz, sy);
+	    e[3] = _mm_sub_ps(xy, sz); e[4] = _mm_add_ps(c, _mm_mul_ps(oy, y)); e[5] = _mm_add_ps(yz, sx);
+	    e[6] = _mm_add_ps(xz, sy); e[7] = _mm_sub_ps(yz, sx); e[8] = _mm_add_ps(c, _mm_mul_ps(oz, z));
+	    }
+
+	 // The sines and cosines are done a block at a time with the array
+	 // version of fast::sincos(), so that they get its widest code.
+	 static size_t const ROTATION_BLOCK = 64;
+
+	 template <>
+	 inline void rot_mat33_batch<float>(Matrix33<float> * out, float const * angles,
+					    Vector3<float> const * axes, size_t n)
+	    {
+	    float s[ROTATION_BLOCK], c[ROTATION_BLOCK];
+	    size_t i, j;
+	    for (i=0; i<n; i+=ROTATION_BLOCK)
+	       {
+	       size_t const m = n - i < ROTATION_BLOCK ? n - i : ROTATION_BLOCK;
+	       fast::sincos(angles + i, s, c, m);
+	       for (j=0; j+4<=m; j+=4)
+		  {
+		  // Transposing elements 0-3 and 4-7 gives the first 8
+		  // elements of each matrix.
+		  __m128 e[9];
+		  rotation3x4(_mm_loadu_ps(c + j), _mm_loadu_ps(s + j), axes + i + j, e);
+		  _MM_TRANSPOSE4_PS(e[0], e[1], e[2], e[3]);
+		  _MM_TRANSPOSE4_PS(e[4], e[5], e[6], e[7]);
+		  float e8[4];
+		  _mm_storeu_ps(e8, e[8]);
+		  unsigned int k;
+		  for (k=0; k<4; ++k)
+		     {
+		     float * dst = out[i + j + k].m;
+		     _mm_storeu_ps(dst, e[k]);
+		     _mm_storeu_ps(dst + 4, e[4 + k]);
+		     dst[8] = e8[k];
+		     }
+		  }
+	       for (; j<m; ++j)
+		  {
+		  float e[9];
+		  rotation3(c[j], s[j], axes[i + j], e);
+		  put_rotation(out[i + j], e);
+		  }
+	       }
+	    }
+
+	 template <>
+	 inline void rot_mat44_batch<float>(Matrix44<float> * out, float const * angles,
+					    Vector3<float> const * axes, Vector3<float> const * d, size_t n)
+	    {
+	    float s[ROTATION_BLOCK], c[ROTATION_BLOCK];
+	    __m128 const zero = _mm_setzero_ps();
+	    __m128 const w = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	    size_t i, j;
+	    for (i=0; i<n; i+=ROTATION_BLOCK)
+	       {
+	       size_t const m = n - i < ROTATION_BLOCK ? n - i : ROTATION_BLOCK;
+	       fast::sincos(angles + i, s, c, m);
+	       for (j=0; j+4<=m; j+=4)
+		  {
+		  // Transposing 3 elements and a zero gives one column of
+		  // each matrix.
+		  __m128 e[9], z0 = zero, z1 = zero, z2 = zero;
+		  rotation3x4(_mm_loadu_ps(c + j), _mm_loadu_ps(s + j), axes + i + j, e);
+		  _MM_TRANSPOSE4_PS(e[0], e[1], e[2], z0);
+		  _MM_TRANSPOSE4_PS(e[3], e[4], e[5], z1);
+		  _MM_TRANSPOSE4_PS(e[6], e[7], e[8], z2);
+		  __m128 const col[12] = { e[0], e[3], e[6], e[1], e[4], e[7], e[2], e[5], e[8], z0, z1, z2 };
+		  unsigned int k;
+		  for (k=0; k<4; ++k)
+		     {
+		     float * dst = out[i + j + k].m;
+		     _mm_storeu_ps(dst, col[3*k]);
+		     _mm_storeu_ps(dst + 4, col[3*k + 1]);
+		     _mm_storeu_ps(dst + 8, col[3*k + 2]);
+		     _mm_storeu_ps(dst + 12, d != 0 ? _mm_or_ps(simd::load3(&d[i + j + k].x), w) : w);
+		     }
+		  }
+	       for (; j<m; ++j)
+		  {
+		  float e[9];
+		  rotation3(c[j], s[j], axes[i + j], e);
+		  put_rotation(out[i + j], e, d != 0 ? d + i + j : 0);
+		  }
+	       }
+	    }
+#endif // ARDA_MATH_SSE2
+
+	 } // namespace detail
+
+      ////////////////////////////////////////
+      // 3D transforms
+      template <typename T>
+      inline void transform_points(Matrix44<T> const & M,
+				   Vector3<T> const * in, Vector3<T> * out, size_t n)
+	 {
+	 assert(in == out || in + n <= out || out + n <= in);
+	 T const a[9] = { M.m[0], M.m[1], M.m[2], M.m[4], M.m[5], M.m[6], M.m[8], M.m[9], M.m[10] };
+	 detail::transform3<T>(a, M.m + 12, in, out, n);
+	 }
+
+      template <typename T>
+      inline void transform_directions(Matrix44<T> const & M,
+				       Vector3<T> const * in, Vector3<T> * out, size_t n)
+	 {
+	 assert(in == out || in + n <= out || out + n <= in);
+	 T const a[9] = { M.m[0], M.m[1], M.m[2], M.m[4], M.m[5], M.m[6], M.m[8], M.m[9], M.m[10] };
+	 T const t[3] = { T(0), T(0), T(0) };
+	 detail::transform3<T>(a, t, in, out, n);
+	 }
+
+      template <typename T>
+      inline void transform_directions(Matrix33<T> const & M,
+				       Vector3<T> const * in, Vector3<T> * out, size_t n)
+	 {
+	 assert(in == out || in + n <= out || out + n <= in);
+	 T const t[3] = { T(0), T(0), T(0) };
+	 detail::transform3<T>(M.m, t, in, out, n);
+	 }
+
+      // The upper 3x3 of a Matrix34 is already laid out as a Matrix33.
+      template <typename T>
+      inline void transform_points(Matrix34<T> const & M,
+				   Vector3<T> const * in, Vector3<T> * out, size_t n)
+	 {
+	 assert(in == out || in + n <= out || out + n <= in);
+	 detail::transform3<T>(M.m, M.m + 9, in, out, n);
+	 }
+
+      template <typename T>
+      inline void transform_directions(Matrix34<T> const & M,
+				       Vector3<T> const * in, Vector3<T> * out, size_t n)
+	 {
+	 assert(in == out || in + n <= out || out + n <= in);
+	 T const t[3] = { T(0), T(0), T(0) };
+	 detail::transform3<T>(M.m, t, in, out, n);
+	 }
+
+      ////////////////////////////////////////
+      // 2D transforms
+      template <typename T>
+      inline void transform_points(Matrix33<T> const & M,
+				   Vector2<T> const * in, Vector2<T> * out, size_t n)
+	 {
+	 assert(in == out || in + n <= out || out + n <= in);
+	 T const a[4] = { M.m[0], M.m[1], M.m[3], M.m[4] };
+	 detail::transform2<T>(a, M.m + 6, in, out, n);
+	 }
+
+      template <typename T>
+      inline void transform_directions(Matrix33<T> const & M,
+				       Vector2<T> const * in, Vector2<T> * out, size_t n)
+	 {
+	 assert(in == out || in + n <= out || out + n <= in);
+	 T const a[4] = { M.m[0], M.m[1], M.m[3], M.m[4] };
+	 T const t[2] = { T(0), T(0) };
+	 detail::transform2<T>(a, t, in, out, n);
+	 }
+
+      ////////////////////////////////////////
+      // Rotation and rigid transform matrices
+      template <typename T>
+      inline void get_rot_mat33_batch(Matrix33<T> * out, float const * angles,
+				      Vector3<T> const * axes, size_t n)
+	 { detail::rot_mat33_batch<T>(out, angles, axes, n); }
+
+      template <typename T>
+      inline void get_rot_mat44_batch(Matrix44<T> * out, float const * angles,
+				      Vector3<T> const * axes, size_t n)
+	 { detail::rot_mat44_batch<T>(out, angles, axes, 0, n); }
+
+      template <typename T>
+      inline void get_transform_mat44_batch(Matrix44<T> * out, float const * angles,
+					    Vector3<T> const * axes, Vector3<T> const * translations, size_t n)
+	 { detail::rot_mat44_batch<T>(out, angles, axes, translations, n); }
+
+      ////////////////////////////////////////
+      // Skinning
+      template <typename T>
+      inline void skin_points(DualQuaternion<T> const * bones, unsigned int const * index,
+			      T const * weight, unsigned int k,
+			      Vector3<T> const * in, Vector3<T> * out, size_t n)
+	 {
+	 assert(k > 0);
+	 assert(in == out || in + n <= out || out + n <= in);
+	 detail::skin3<T>(bones, index, weight, k, in, out, n);
+	 }
+
+      } // namespace Math
+   } // namespace arda
+
+#endif // BATCH_H_
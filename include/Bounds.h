@@ -0,0 +1,824 @@
+#ifndef BOUNDS_H_
+#define BOUNDS_H_
+
+// Needs Vector.h, Matrix.h, Simd.h, and SoA.h, but this file is not intended
+// to be included directly.  Just include Math.h and everything will be set
+// up correctly.
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Bounding volumes.
+      //
+      // AABB<T> is an axis aligned box, from corner min to corner max
+      // inclusive.  A default constructed box is empty (min above max in
+      // every element), and merging anything into an empty box gives that
+      // thing, so bounds can be accumulated starting from AABB<T>().
+      //
+      // empty()             Some element of min is above max.
+      // center(), size(), extents()
+      //                     (min + max) / 2, max - min, and half of size().
+      // merge(p), merge(b)  Grow to include point p or box b, in place.
+      // merged(b), intersection(b)
+      //                     The smallest box containing both, and the box
+      //                     both contain, which is empty if they don't
+      //                     overlap.
+      // contains(p), contains(b)
+      //                     Point or box entirely inside (or on) the box.
+      // overlaps(b)         The boxes share at least a point.
+      // transformed(M)      Bounds of the box transformed by affine M (the
+      //                     bottom row is ignored), by Arvo's method: the
+      //                     center goes through M and the extents through
+      //                     the absolute values of its upper 3x3, instead of
+      //                     transforming all 8 corners.  An empty box stays
+      //                     empty.
+      //
+      // center(), extents(), and transformed() divide by 2, so they are
+      // only exact for float and double.
+      //
+      // bounds(points, n), bounds(soa)
+      //                     The AABB of an array of Vector3 or of a
+      //                     Vector3SoA, empty for no points.  For float
+      //                     these are min / max reductions over 8 (AVX2,
+      //                     see simd_level() in Simd.h) or 4 (SSE) floats at
+      //                     a time.  The points must not contain NaNs.
+      //
+      // Sphere<T> is a center and a radius.  The default one is empty, with
+      // a negative radius.
+      //
+      // empty(), contains(p), contains(s), overlaps(s)
+      // merge(p), merge(s)  Grow to the smallest sphere containing this one
+      //                     and point p or sphere s, in place.
+      // aabb()              The bounding box.
+      //
+      // OBB<T> is an oriented box: a center, a rotation matrix whose
+      // columns are the box's axes, and the half extents along them.  The
+      // default one is empty, with negative extents.
+      //
+      // OBB(aabb)           The same box, with the identity axes.
+      // axis(i)             Column i of axes.
+      // empty(), contains(p)
+      // overlaps(b)         Separating axis test against another OBB, on the
+      //                     15 axes that can separate them.  The rotation
+      //                     terms are padded by a few epsilon so that nearly
+      //                     parallel edges don't give a false separation; it
+      //                     errs towards overlap.
+      // aabb()              The bounding box.
+      //
+      // fit_sphere(points, n)
+      //                     Ritter's bounding sphere: the pair of extreme
+      //                     points along x, y, or z that is furthest apart
+      //                     gives a first sphere, which a second pass grows
+      //                     to take in each point still outside.  Typically
+      //                     5 to 20% larger than the minimal sphere.
+      // fit_obb(points, n)  An OBB whose axes are the eigenvectors of the
+      //                     covariance of the points, largest variance
+      //                     first, from a Jacobi eigen decomposition, with
+      //                     the bounds of the points along them.  For float
+      //                     the covariance sums and the projections onto the
+      //                     axes are done 4 (SSE) or 8 (AVX2) points at a
+      //                     time.
+      //
+      // fit_sphere() and fit_obb() return an empty volume for no points.
+
+      template <typename T>
+      class AABB
+	 {
+	 public:
+	 Vector3<T> min, max;
+
+	 AABB() : min (std::numeric_limits<T>::max()), max (std::numeric_limits<T>::lowest()) {}
+	 AABB(Vector3<T> const & lo, Vector3<T> const & hi) : min (lo), max (hi) {}
+
+	 inline bool empty() const
+	    { return !(min.x <= max.x && min.y <= max.y && min.z <= max.z); }
+
+	 inline Vector3<T> center() const { return (min + max) / T(2); }
+	 inline Vector3<T> size() const { return max - min; }
+	 inline Vector3<T> extents() const { return (max - min) / T(2); }
+
+	 inline AABB<T>& merge(Vector3<T> const & p)
+	    {
+	    unsigned int i;
+	    for (i=0; i<3; ++i)
+	       {
+	       min[i] = p[i] < min[i] ? p[i] : min[i];
+	       max[i] = p[i] > max[i] ? p[i] : max[i];
+	       }
+	    return *this;
+	    }
+
+	 inline AABB<T>& merge(AABB<T> const & b)
+	    {
+	    unsigned int i;
+	    for (i=0; i<3; ++i)
+	       {
+	       min[i] = b.min[i] < min[i] ? b.min[i] : min[i];
+	       max[i] = b.max[i] > max[i] ? b.max[i] : max[i];
+	       }
+	    return *this;
+	    }
+
+	 inline AABB<T> merged(AABB<T> const & b) const
+	    { return AABB<T>(*this).merge(b); }
+
+	 inline AABB<T> intersection(AABB<T> const & b) const
+	    {
+	    AABB<T> r;
+	    unsigned int i;
+	    for (i=0; i<3; ++i)
+	       {
+	       r.min[i] = b.min[i] > min[i] ? b.min[i] : min[i];
+	       r.max[i] = b.max[i] < max[i] ? b.max[i] : max[i];
+	       }
+	    return r;
+	    }
+
+	 inline bool contains(Vector3<T> const & p) const
+	    {
+	    return min.x <= p.x && p.x <= max.x && min.y <= p.y && p.y <= max.y
+	       && min.z <= p.z && p.z <= max.z;
+	    }
+
+	 inline bool contains(AABB<T> const & b) const
+	    {
+	    return min.x <= b.min.x && b.max.x <= max.x && min.y <= b.min.y && b.max.y <= max.y
+	       && min.z <= b.min.z && b.max.z <= max.z;
+	    }
+
+	 inline bool overlaps(AABB<T> const & b) const
+	    {
+	    return min.x <= b.max.x && b.min.x <= max.x && min.y <= b.max.y && b.min.y <= max.y
+	       && min.z <= b.max.z && b.min.z <= max.z;
+	    }
+
+	 AABB<T> transformed(Matrix44<T> const & M) const;
+	 };
+
+      typedef AABB<float> AABBf;
+      typedef AABB<double> AABBd;
+
+      //////////////////////////////////////////////////////////////////////////
+      template <typename T>
+      class Sphere
+	 {
+	 public:
+	 Vector3<T> center;
+	 T radius;
+
+	 Sphere() : center (T(0)), radius (T(-1)) {}
+	 Sphere(Vector3<T> const & c, T const r) : center (c), radius (r) {}
+
+	 inline bool empty() const { return !(radius >= T(0)); }
+
+	 inline bool contains(Vector3<T> const & p) const
+	    {
+	    Vector3<T> const d = p - center;
+	    return !empty() && d.dot(d) <= radius * radius;
+	    }
+
+	 inline bool contains(Sphere<T> const & s) const
+	    { return !empty() && !s.empty() && std::sqrt((s.center - center).dot(s.center - center)) + s.radius <= radius; }
+
+	 inline bool overlaps(Sphere<T> const & s) const
+	    {
+	    Vector3<T> const d = s.center - center;
+	    T const r = radius + s.radius;
+	    return !empty() && !s.empty() && d.dot(d) <= r * r;
+	    }
+
+	 inline Sphere<T>& merge(Vector3<T> const & p)
+	    { return merge(Sphere<T>(p, T(0))); }
+
+	 Sphere<T>& merge(Sphere<T> const & s);
+
+	 inline AABB<T> aabb() const
+	    { return empty() ? AABB<T>() : AABB<T>(center - Vector3<T>(radius), center + Vector3<T>(radius)); }
+	 };
+
+      typedef Sphere<float> Spheref;
+      typedef Sphere<double> Sphered;
+
+      //////////////////////////////////////////////////////////////////////////
+      template <typename T>
+      class OBB
+	 {
+	 public:
+	 Vector3<T> center;
+	 Matrix33<T> axes;
+	 Vector3<T> extents;
+
+	 OBB() : center (T(0)), extents (T(-1)) { axes.setidentity(); }
+	 OBB(Vector3<T> const & c, Matrix33<T> const & a, Vector3<T> const & e) : center (c), axes (a), extents (e) {}
+	 explicit OBB(AABB<T> const & b) : center (b.center()), extents (b.extents()) { axes.setidentity(); }
+
+	 inline Vector3<T> axis(unsigned int const i) const
+	    { assert(i<3); return Vector3<T>(axes[3*i], axes[3*i + 1], axes[3*i + 2]); }
+
+	 inline bool empty() const
+	    { return !(extents.x >= T(0) && extents.y >= T(0) && extents.z >= T(0)); }
+
+	 inline bool contains(Vector3<T> const & p) const
+	    {
+	    Vector3<T> const d = p - center;
+	    unsigned int i;
+	    for (i=0; i<3; ++i)
+	       if (!(std::abs(d.dot(axis(i))) <= extents[i]))
+		  return false;
+	    return true;
+	    }
+
+	 bool overlaps(OBB<T> const & b) const;
+
+	 inline AABB<T> aabb() const
+	    {
+	    if (empty())
+	       return AABB<T>();
+	    Vector3<T> e;
+	    unsigned int i;
+	    for (i=0; i<3; ++i)
+	       e[i] = std::abs(axes[i])*extents.x + std::abs(axes[3 + i])*extents.y + std::abs(axes[6 + i])*extents.z;
+	    return AABB<T>(center - e, center + e);
+	    }
+	 };
+
+      typedef OBB<float> OBBf;
+      typedef OBB<double> OBBd;
+
+      template <typename T>
+      Sphere<T> fit_sphere(Vector3<T> const * points, size_t n);
+
+      template <typename T>
+      OBB<T> fit_obb(Vector3<T> const * points, size_t n);
+
+      namespace detail
+	 {
+	 // Arvo's transform: c' = M * (c, 1), e' = |M33| * e, with the sums
+	 // in the same order in every version.
+	 template <typename T>
+	 inline void arvo_transform(Matrix44<T> const & M, Vector3<T> const & c, Vector3<T> const & e,
+				    Vector3<T> & lo, Vector3<T> & hi)
+	    {
+	    unsigned int i;
+	    for (i=0; i<3; ++i)
+	       {
+	       T const nc = M[i]*c.x + M[4 + i]*c.y + M[8 + i]*c.z + M[12 + i];
+	       T const ne = std::abs(M[i])*e.x + std::abs(M[4 + i])*e.y + std::abs(M[8 + i])*e.z;
+	       lo[i] = nc - ne;
+	       hi[i] = nc + ne;
+	       }
+	    }
+
+	 // Min and max of m floats, where float i belongs to element
+	 // i % period of lo and hi (period 1 for one array of a Vector3SoA, 3
+	 // for an array of Vector3).  lo and hi are merged into, not set.
+	 template <typename T>
+	 inline void minmax(T const * p, size_t m, unsigned int period, T * lo, T * hi)
+	    {
+	    size_t i;
+	    for (i=0; i<m; ++i)
+	       {
+	       unsigned int const k = (unsigned int) (i % period);
+	       lo[k] = p[i] < lo[k] ? p[i] : lo[k];
+	       hi[k] = p[i] > hi[k] ? p[i] : hi[k];
+	       }
+	    }
+
+	 // Sums of d, and of the products of its elements, for d = p[i] - s:
+	 // x, y, z, xx, xy, xz, yy, yz, zz, added into sums.  Subtracting s
+	 // (one of the points) keeps the float sums from cancelling when the
+	 // points are far from the origin.
+	 template <typename T>
+	 inline void moments(Vector3<T> const * p, size_t n, Vector3<T> const & s, T * sums)
+	    {
+	    size_t i;
+	    for (i=0; i<n; ++i)
+	       {
+	       T const x = p[i].x - s.x, y = p[i].y - s.y, z = p[i].z - s.z;
+	       sums[0] += x; sums[1] += y; sums[2] += z;
+	       sums[3] += x*x; sums[4] += x*y; sums[5] += x*z;
+	       sums[6] += y*y; sums[7] += y*z; sums[8] += z*z;
+	       }
+	    }
+
+	 // The range of p[i] . axis[k] for k = 0..2, merged into lo and hi.
+	 template <typename T>
+	 inline void project_minmax(Vector3<T> const * p, size_t n, Vector3<T> const * axis, T * lo, T * hi)
+	    {
+	    size_t i;
+	    unsigned int k;
+	    for (i=0; i<n; ++i)
+	       for (k=0; k<3; ++k)
+		  {
+		  T const d = axis[k].x*p[i].x + axis[k].y*p[i].y + axis[k].z*p[i].z;
+		  lo[k] = d < lo[k] ? d : lo[k];
+		  hi[k] = d > hi[k] ? d : hi[k];
+		  }
+	    }
+
+	 // Cyclic Jacobi: a is diagonalized in place by plane rotations,
+	 // which are accumulated in v, so the eigenvalues end up on the
+	 // diagonal of a and the eigenvectors in the columns of v.
+	 template <typename T>
+	 inline void jacobi_eigen(T a[3][3], T v[3][3])
+	    {
+	    unsigned int const pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+	    unsigned int i, j, k, sweep;
+	    for (i=0; i<3; ++i)
+	       for (j=0; j<3; ++j)
+		  v[i][j] = i == j ? T(1) : T(0);
+	    for (sweep=0; sweep<32; ++sweep)
+	       {
+	       T const off = a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2];
+	       T const diag = a[0][0]*a[0][0] + a[1][1]*a[1][1] + a[2][2]*a[2][2];
+	       T const eps = std::numeric_limits<T>::epsilon();
+	       if (!(off > eps * eps * diag))
+		  break;
+	       for (k=0; k<3; ++k)
+		  {
+		  unsigned int const p = pairs[k][0], q = pairs[k][1];
+		  if (a[p][q] == T(0))
+		     continue;
+		  T const theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+		  T const t = (theta >= T(0) ? T(1) : T(-1)) / (std::abs(theta) + std::sqrt(theta*theta + T(1)));
+		  T const c = T(1) / std::sqrt(t*t + T(1)), s = t * c;
+		  for (i=0; i<3; ++i)
+		     {
+		     T const ap = a[i][p], aq = a[i][q];
+		     a[i][p] = c*ap - s*aq;
+		     a[i][q] = s*ap + c*aq;
+		     T const vp = v[i][p], vq = v[i][q];
+		     v[i][p] = c*vp - s*vq;
+		     v[i][q] = s*vp + c*vq;
+		     }
+		  for (i=0; i<3; ++i)
+		     {
+		     T const ap = a[p][i], aq = a[q][i];
+		     a[p][i] = c*ap - s*aq;
+		     a[q][i] = s*ap + c*aq;
+		     }
+		  }
+	       }
+	    }
+
+#if defined(ARDA_MATH_SSE2)
+	 inline void arvo_transform(Matrix44<float> const & M, Vector3<float> const & c, Vector3<float> const & e,
+				    Vector3<float> & lo, Vector3<float> & hi)
+	    {
+	    __m128 const no_sign = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	    __m128 const m0 = _mm_loadu_ps(M.m), m1 = _mm_loadu_ps(M.m + 4);
+	    __m128 const m2 = _mm_loadu_ps(M.m + 8), m3 = _mm_loadu_ps(M.m + 12);
+	    __m128 const nc = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, _mm_set1_ps(c.x)),
+							       _mm_mul_ps(m1, _mm_set1_ps(c.y))),
+						    _mm_mul_ps(m2, _mm_set1_ps(c.z))), m3);
+	    __m128 const ne = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(m0, no_sign), _mm_set1_ps(e.x)),
+						    _mm_mul_ps(_mm_and_ps(m1, no_sign), _mm_set1_ps(e.y))),
+					 _mm_mul_ps(_mm_and_ps(m2, no_sign), _mm_set1_ps(e.z)));
+	    simd::store3(&lo.x, _mm_sub_ps(nc, ne));
+	    simd::store3(&hi.x, _mm_add_ps(nc, ne));
+	    }
+
+	 // Blocks of 12 floats (24 for AVX2) are reduced in 3 registers, so
+	 // each lane always sees the same element, and the lanes are folded
+	 // into lo and hi at the end.
+#if defined(ARDA_MATH_DISPATCH)
+	 ARDA_MATH_TARGET_AVX2
+	 inline size_t minmax_avx2(float const * p, size_t m, float * lanes_lo, float * lanes_hi)
+	    {
+	    __m256 lo0 = _mm256_loadu_ps(p), lo1 = _mm256_loadu_ps(p + 8), lo2 = _mm256_loadu_ps(p + 16);
+	    __m256 hi0 = lo0, hi1 = lo1, hi2 = lo2;
+	    size_t i;
+	    for (i=24; i+24<=m; i+=24)
+	       {
+	       __m256 const a = _mm256_loadu_ps(p + i), b = _mm256_loadu_ps(p + i + 8), c = _mm256_loadu_ps(p + i + 16);
+	       lo0 = _mm256_min_ps(lo0, a); hi0 = _mm256_max_ps(hi0, a);
+	       lo1 = _mm256_min_ps(lo1, b); hi1 = _mm256_max_ps(hi1, b);
+	       lo2 = _mm256_min_ps(lo2, c); hi2 = _mm256_max_ps(hi2, c);
+	       }
+	    _mm256_storeu_ps(lanes_lo, lo0); _mm256_storeu_ps(lanes_lo + 8, lo1); _mm256_storeu_ps(lanes_lo + 16, lo2);
+	    _mm256_storeu_ps(lanes_hi, hi0); _mm256_storeu_ps(lanes_hi + 8, hi1); _mm256_storeu_ps(lanes_hi + 16, hi2);
+	    return i;
+	    }
+#endif
+
+	 inline void minmax(float const * p, size_t m, unsigned int period, float * lo, float * hi)
+	    {
+	    float lanes_lo[24], lanes_hi[24];
+	    size_t i = 0, w = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2 && m >= 24)
+	       {
+	       i = minmax_avx2(p, m, lanes_lo, lanes_hi);
+	       w = 24;
+	       }
+	    else
+#endif
+	    if (m >= 12)
+	       {
+	       __m128 lo0 = _mm_loadu_ps(p), lo1 = _mm_loadu_ps(p + 4), lo2 = _mm_loadu_ps(p + 8);
+	       __m128 hi0 = lo0, hi1 = lo1, hi2 = lo2;
+	       for (i=12; i+12<=m; i+=12)
+		  {
+		  __m128 const a = _mm_loadu_ps(p + i), b = _mm_loadu_ps(p + i + 4), c = _mm_loadu_ps(p + i + 8);
+		  lo0 = _mm_min_ps(lo0, a); hi0 = _mm_max_ps(hi0, a);
+		  lo1 = _mm_min_ps(lo1, b); hi1 = _mm_max_ps(hi1, b);
+		  lo2 = _mm_min_ps(lo2, c); hi2 = _mm_max_ps(hi2, c);
+		  }
+	       _mm_storeu_ps(lanes_lo, lo0); _mm_storeu_ps(lanes_lo + 4, lo1); _mm_storeu_ps(lanes_lo + 8, lo2);
+	       _mm_storeu_ps(lanes_hi, hi0); _mm_storeu_ps(lanes_hi + 4, hi1); _mm_storeu_ps(lanes_hi + 8, hi2);
+	       w = 12;
+	       }
+	    size_t k;
+	    for (k=0; k<w; ++k)
+	       {
+	       unsigned int const j = (unsigned int) (k % period);
+	       lo[j] = lanes_lo[k] < lo[j] ? lanes_lo[k] : lo[j];
+	       hi[j] = lanes_hi[k] > hi[j] ? lanes_hi[k] : hi[j];
+	       }
+	    minmax<float>(p + i, m - i, period, lo, hi);
+	    }
+#endif // ARDA_MATH_SSE2
+
+#if defined(ARDA_MATH_SSE2)
+	 // For float, each sum or bound is one register, 4 or 8 points at a
+	 // time, and the lanes are combined at the end, so the last bits of
+	 // the sums depend on simd_level().  They return how many points
+	 // they did.
+	 inline size_t moments_sse(Vector3<float> const * p, size_t n, Vector3<float> const & s, float * sums)
+	    {
+	    __m128 const sx = _mm_set1_ps(s.x), sy = _mm_set1_ps(s.y), sz = _mm_set1_ps(s.z);
+	    __m128 acc[9];
+	    float lanes[4];
+	    size_t i;
+	    unsigned int k;
+	    for (k=0; k<9; ++k)
+	       acc[k] = _mm_setzero_ps();
+	    for (i=0; i+4<=n; i+=4)
+	       {
+	       __m128 x, y, z;
+	       simd::deinterleave3(_mm_loadu_ps(&p[i].x), _mm_loadu_ps(&p[i].x + 4), _mm_loadu_ps(&p[i].x + 8), x, y, z);
+	       x = _mm_sub_ps(x, sx);
+	       y = _mm_sub_ps(y, sy);
+	       z = _mm_sub_ps(z, sz);
+	       acc[0] = _mm_add_ps(acc[0], x);
+	       acc[1] = _mm_add_ps(acc[1], y);
+	       acc[2] = _mm_add_ps(acc[2], z);
+	       acc[3] = _mm_add_ps(acc[3], _mm_mul_ps(x, x));
+	       acc[4] = _mm_add_ps(acc[4], _mm_mul_ps(x, y));
+	       acc[5] = _mm_add_ps(acc[5], _mm_mul_ps(x, z));
+	       acc[6] = _mm_add_ps(acc[6], _mm_mul_ps(y, y));
+	       acc[7] = _mm_add_ps(acc[7], _mm_mul_ps(y, z));
+	       acc[8] = _mm_add_ps(acc[8], _mm_mul_ps(z, z));
+	       }
+	    for (k=0; k<9; ++k)
+	       {
+	       _mm_storeu_ps(lanes, acc[k]);
+	       sums[k] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	       }
+	    return i;
+	    }
+
+	 inline size_t project_minmax_sse(Vector3<float> const * p, size_t n, Vector3<float> const * axis, float * lo, float * hi)
+	    {
+	    __m128 ax[3], ay[3], az[3], l[3], h[3];
+	    float lanes_lo[4], lanes_hi[4];
+	    size_t i;
+	    unsigned int j, k;
+	    for (k=0; k<3; ++k)
+	       {
+	       ax[k] = _mm_set1_ps(axis[k].x);
+	       ay[k] = _mm_set1_ps(axis[k].y);
+	       az[k] = _mm_set1_ps(axis[k].z);
+	       l[k] = _mm_set1_ps(lo[k]);
+	       h[k] = _mm_set1_ps(hi[k]);
+	       }
+	    for (i=0; i+4<=n; i+=4)
+	       {
+	       __m128 x, y, z;
+	       simd::deinterleave3(_mm_loadu_ps(&p[i].x), _mm_loadu_ps(&p[i].x + 4), _mm_loadu_ps(&p[i].x + 8), x, y, z);
+	       for (k=0; k<3; ++k)
+		  {
+		  __m128 const d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[k], x), _mm_mul_ps(ay[k], y)), _mm_mul_ps(az[k], z));
+		  l[k] = _mm_min_ps(l[k], d);
+		  h[k] = _mm_max_ps(h[k], d);
+		  }
+	       }
+	    for (k=0; k<3; ++k)
+	       {
+	       _mm_storeu_ps(lanes_lo, l[k]);
+	       _mm_storeu_ps(lanes_hi, h[k]);
+	       for (j=0; j<4; ++j)
+		  {
+		  lo[k] = lanes_lo[j] < lo[k] ? lanes_lo[j] : lo[k];
+		  hi[k] = lanes_hi[j] > hi[k] ? lanes_hi[j] : hi[k];
+		  }
+	       }
+	    return i;
+	    }
+
+#if defined(ARDA_MATH_DISPATCH)
+	 ARDA_MATH_TARGET_AVX2
+	 inline size_t moments_avx2(Vector3<float> const * p, size_t n, Vector3<float> const & s, float * sums)
+	    {
+	    __m256 const sx = _mm256_set1_ps(s.x), sy = _mm256_set1_ps(s.y), sz = _mm256_set1_ps(s.z);
+	    __m256 acc[9];
+	    float lanes[8];
+	    size_t i;
+	    unsigned int k;
+	    for (k=0; k<9; ++k)
+	       acc[k] = _mm256_setzero_ps();
+	    for (i=0; i+8<=n; i+=8)
+	       {
+	       __m256 a, b, c, x, y, z;
+	       simd::load3x8(&p[i].x, a, b, c);
+	       simd::deinterleave3(a, b, c, x, y, z);
+	       x = _mm256_sub_ps(x, sx);
+	       y = _mm256_sub_ps(y, sy);
+	       z = _mm256_sub_ps(z, sz);
+	       acc[0] = _mm256_add_ps(acc[0], x);
+	       acc[1] = _mm256_add_ps(acc[1], y);
+	       acc[2] = _mm256_add_ps(acc[2], z);
+	       acc[3] = _mm256_add_ps(acc[3], _mm256_mul_ps(x, x));
+	       acc[4] = _mm256_add_ps(acc[4], _mm256_mul_ps(x, y));
+	       acc[5] = _mm256_add_ps(acc[5], _mm256_mul_ps(x, z));
+	       acc[6] = _mm256_add_ps(acc[6], _mm256_mul_ps(y, y));
+	       acc[7] = _mm256_add_ps(acc[7], _mm256_mul_ps(y, z));
+	       acc[8] = _mm256_add_ps(acc[8], _mm256_mul_ps(z, z));
+	       }
+	    for (k=0; k<9; ++k)
+	       {
+	       _mm256_storeu_ps(lanes, acc[k]);
+	       sums[k] += ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+	       }
+	    return i;
+	    }
+
+	 ARDA_MATH_TARGET_AVX2
+	 inline size_t project_minmax_avx2(Vector3<float> const * p, size_t n, Vector3<float> const * axis, float * lo, float * hi)
+	    {
+	    __m256 ax[3], ay[3], az[3], l[3], h[3];
+	    float lanes_lo[8], lanes_hi[8];
+	    size_t i;
+	    unsigned int j, k;
+	    for (k=0; k<3; ++k)
+	       {
+	       ax[k] = _mm256_set1_ps(axis[k].x);
+	       ay[k] = _mm256_set1_ps(axis[k].y);
+	       az[k] = _mm256_set1_ps(axis[k].z);
+	       l[k] = _mm256_set1_ps(lo[k]);
+	       h[k] = _mm256_set1_ps(hi[k]);
+	       }
+	    for (i=0; i+8<=n; i+=8)
+	       {
+	       __m256 a, b, c, x, y, z;
+	       simd::load3x8(&p[i].x, a, b, c);
+	       simd::deinterleave3(a, b, c, x, y, z);
+	       for (k=0; k<3; ++k)
+		  {
+		  __m256 const d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[k], x), _mm256_mul_ps(ay[k], y)),
+						 _mm256_mul_ps(az[k], z));
+		  l[k] = _mm256_min_ps(l[k], d);
+		  h[k] = _mm256_max_ps(h[k], d);
+		  }
+	       }
+	    for (k=0; k<3; ++k)
+	       {
+	       _mm256_storeu_ps(lanes_lo, l[k]);
+	       _mm256_storeu_ps(lanes_hi, h[k]);
+	       for (j=0; j<8; ++j)
+		  {
+		  lo[k] = lanes_lo[j] < lo[k] ? lanes_lo[j] : lo[k];
+		  hi[k] = lanes_hi[j] > hi[k] ? lanes_hi[j] : hi[k];
+		  }
+	       }
+	    return i;
+	    }
+#endif // ARDA_MATH_DISPATCH
+
+	 inline void moments(Vector3<float> const * p, size_t n, Vector3<float> const & s, float * sums)
+	    {
+	    size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2)
+	       i = moments_avx2(p, n, s, sums);
+#endif
+	    i += moments_sse(p + i, n - i, s, sums);
+	    moments<float>(p + i, n - i, s, sums);
+	    }
+
+	 inline void project_minmax(Vector3<float> const * p, size_t n, Vector3<float> const * axis, float * lo, float * hi)
+	    {
+	    size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2)
+	       i = project_minmax_avx2(p, n, axis, lo, hi);
+#endif
+	    i += project_minmax_sse(p + i, n - i, axis, lo, hi);
+	    project_minmax<float>(p + i, n - i, axis, lo, hi);
+	    }
+#endif // ARDA_MATH_SSE2
+	 } // namespace detail
+
+      template <typename T>
+      inline AABB<T> bounds(Vector3<T> const * points, size_t const n)
+	 {
+	 AABB<T> b;
+	 if (n != 0)
+	    detail::minmax(&points[0].x, 3 * n, 3, &b.min.x, &b.max.x);
+	 return b;
+	 }
+
+      template <typename T>
+      inline AABB<T> bounds(Vector3SoA<T> const & points)
+	 {
+	 AABB<T> b;
+	 detail::minmax(points.x(), points.size(), 1, &b.min.x, &b.max.x);
+	 detail::minmax(points.y(), points.size(), 1, &b.min.y, &b.max.y);
+	 detail::minmax(points.z(), points.size(), 1, &b.min.z, &b.max.z);
+	 return b;
+	 }
+      } // namespace Math
+   } // namespace arda
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::AABB<T> arda::Math::AABB<T>::transformed(Matrix44<T> const & M) const
+   {
+   AABB<T> r;
+   if (!empty())
+      detail::arvo_transform(M, center(), extents(), r.min, r.max);
+   return r;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::Sphere<T>& arda::Math::Sphere<T>::merge(Sphere<T> const & s)
+   {
+   if (s.empty())
+      return *this;
+   if (empty())
+      return *this = s;
+   Vector3<T> const d = s.center - center;
+   T const l = std::sqrt(d.dot(d));
+   if (l + s.radius <= radius)
+      return *this;
+   if (l + radius <= s.radius)
+      return *this = s;
+   // The new sphere touches the far sides of both.
+   T const r = (l + radius + s.radius) / 2;
+   center += d * ((r - radius) / l);
+   radius = r;
+   return *this;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+// Gottschalk's separating axis test, as in Ericson, Real-Time Collision
+// Detection, 4.4.1.  R is b's axes in a's frame, and t the offset of b's
+// center, so each test is one projection of the two boxes onto an axis.
+template <typename T>
+bool arda::Math::OBB<T>::overlaps(OBB<T> const & b) const
+   {
+   if (empty() || b.empty())
+      return false;
+   T const eps = 64 * std::numeric_limits<T>::epsilon();
+   T R[3][3], absR[3][3], t[3];
+   Vector3<T> const d = b.center - center;
+   unsigned int i, j;
+   for (i=0; i<3; ++i)
+      {
+      Vector3<T> const u = axis(i);
+      t[i] = d.dot(u);
+      for (j=0; j<3; ++j)
+	 {
+	 R[i][j] = u.dot(b.axis(j));
+	 absR[i][j] = std::abs(R[i][j]) + eps;
+	 }
+      }
+
+   // The axes of this box, then of b.
+   for (i=0; i<3; ++i)
+      if (std::abs(t[i]) > extents[i] + b.extents[0]*absR[i][0] + b.extents[1]*absR[i][1] + b.extents[2]*absR[i][2])
+	 return false;
+   for (j=0; j<3; ++j)
+      if (std::abs(t[0]*R[0][j] + t[1]*R[1][j] + t[2]*R[2][j])
+	  > extents[0]*absR[0][j] + extents[1]*absR[1][j] + extents[2]*absR[2][j] + b.extents[j])
+	 return false;
+
+   // The cross products of an axis of each.
+   for (i=0; i<3; ++i)
+      {
+      unsigned int const i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+      for (j=0; j<3; ++j)
+	 {
+	 unsigned int const j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+	 T const ra = extents[i1]*absR[i2][j] + extents[i2]*absR[i1][j];
+	 T const rb = b.extents[j1]*absR[i][j2] + b.extents[j2]*absR[i][j1];
+	 if (std::abs(t[i2]*R[i1][j] - t[i1]*R[i2][j]) > ra + rb)
+	    return false;
+	 }
+      }
+   return true;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::Sphere<T> arda::Math::fit_sphere(Vector3<T> const * points, size_t const n)
+   {
+   if (n == 0)
+      return Sphere<T>();
+
+   // The points with the smallest and largest x, y, and z.
+   size_t lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+   T lo_v[3] = { points[0].x, points[0].y, points[0].z }, hi_v[3] = { points[0].x, points[0].y, points[0].z };
+   size_t i;
+   unsigned int k;
+   for (i=1; i<n; ++i)
+      for (k=0; k<3; ++k)
+	 {
+	 T const v = points[i][k];
+	 lo[k] = v < lo_v[k] ? i : lo[k];
+	 lo_v[k] = v < lo_v[k] ? v : lo_v[k];
+	 hi[k] = v > hi_v[k] ? i : hi[k];
+	 hi_v[k] = v > hi_v[k] ? v : hi_v[k];
+	 }
+
+   unsigned int best = 0;
+   T best_d2 = T(-1);
+   for (k=0; k<3; ++k)
+      {
+      Vector3<T> const d = points[hi[k]] - points[lo[k]];
+      if (d.dot(d) > best_d2)
+	 {
+	 best_d2 = d.dot(d);
+	 best = k;
+	 }
+      }
+   Sphere<T> s((points[lo[best]] + points[hi[best]]) / T(2), std::sqrt(best_d2) / 2);
+
+   for (i=0; i<n; ++i)
+      if (!s.contains(points[i]))
+	 s.merge(points[i]);
+   return s;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::OBB<T> arda::Math::fit_obb(Vector3<T> const * points, size_t const n)
+   {
+   if (n == 0)
+      return OBB<T>();
+
+   // The covariance matrix, from sums relative to the first point.
+   Vector3<T> const s = points[0];
+   T sums[9] = { T(0), T(0), T(0), T(0), T(0), T(0), T(0), T(0), T(0) };
+   detail::moments(points, n, s, sums);
+   T const inv = T(1) / T(n);
+   T const mx = sums[0] * inv, my = sums[1] * inv, mz = sums[2] * inv;
+   T c[3][3], v[3][3];
+   c[0][0] = sums[3]*inv - mx*mx;
+   c[0][1] = c[1][0] = sums[4]*inv - mx*my;
+   c[0][2] = c[2][0] = sums[5]*inv - mx*mz;
+   c[1][1] = sums[6]*inv - my*my;
+   c[1][2] = c[2][1] = sums[7]*inv - my*mz;
+   c[2][2] = sums[8]*inv - mz*mz;
+   detail::jacobi_eigen(c, v);
+
+   // Largest eigenvalue first, and a right handed frame.
+   unsigned int order[3] = { 0, 1, 2 };
+   unsigned int i, j;
+   for (i=0; i<2; ++i)
+      for (j=i+1; j<3; ++j)
+	 if (c[order[j]][order[j]] > c[order[i]][order[i]])
+	    std::swap(order[i], order[j]);
+   Vector3<T> axis[3];
+   for (i=0; i<2; ++i)
+      axis[i] = Vector3<T>(v[0][order[i]], v[1][order[i]], v[2][order[i]]);
+   axis[0].cross(axis[1], axis[2]);
+
+   T lo[3], hi[3];
+   for (i=0; i<3; ++i)
+      {
+      lo[i] = std::numeric_limits<T>::max();
+      hi[i] = std::numeric_limits<T>::lowest();
+      }
+   detail::project_minmax(points, n, axis, lo, hi);
+
+   OBB<T> b;
+   b.center = axis[0] * ((lo[0] + hi[0]) / 2) + axis[1] * ((lo[1] + hi[1]) / 2) + axis[2] * ((lo[2] + hi[2]) / 2);
+   for (i=0; i<3; ++i)
+      {
+      b.axes.setcol(i, axis[i]);
+      b.extents[i] = (hi[i] - lo[i]) / 2;
+      }
+   return b;
+   }
+
+#endif // BOUNDS_H_
@@ -0,0 +1,270 @@
+#ifndef DUALQUATERNION_H_
+#define DUALQUATERNION_H_
+
+// Needs Vector.h, Matrix.h, and Quaternion.h, but this file is not intended to
+// be included directly.  Just include Math.h and everything will be set up
+// correctly.
+
+#include <cassert>
+#include <cstddef>
+#include <string>
+#include <sstream>
+
+namespace arda
+    {
+    namespace Math
+        {
+        ////////////////////////////////////////////////////////////////////////////////
+        /** \class arda::Math::DualQuaternion
+         *
+         * \brief Templated dual quaternion class for rigid transforms (rotation
+         * followed by translation).
+         *
+         * \tparam T Type is intended to be float and double only.
+         *
+         * \verbatim
+         * A dual quaternion is real + e dual, with e^2 = 0.  The rigid transform
+         * that rotates by the unit quaternion r and then translates by t is
+         * real = r, dual = (t, 0) r / 2.  That is 8 values instead of the 16 of
+         * a Matrix44, and, unlike matrices, a weighted sum of them is still
+         * (after normalizing) a rigid transform, which is what makes them
+         * useful for skinning.
+         *
+         * Supported operations on dual quaternions
+         *
+         * Construction
+         *     DualQuaternion dq;          * Uninitialized, like the Vector classes.
+         *     DualQuaternion dq(real, dual)
+         *     DualQuaternion dq(r, t)     * Rotation r (a unit Quaternion), then
+         *                                   translation t (a Vector3).
+         *     dq.setidentity()
+         * == != + += - -= and unary -
+         *     Element wise.  dq and -dq are the same transform.
+         * * *= / /=
+         *     Scalar multiplication/division with int, float, and double.
+         * * *=
+         *     Dual quaternion product.  As with matrices, dq1 * dq2 is the
+         *     transform dq2 followed by dq1.
+         * normalize()
+         *     Divide both parts by the length of the real part.
+         * get_translation(), transform_point(p), transform_direction(v)
+         *     These assume a unit dual quaternion.
+         *
+         * Free functions
+         *     conjugate(dq)               * Quaternion conjugate of both parts;
+         *                                   the inverse of a unit dual quaternion.
+         *     inverse(dq)                 * Same as conjugate(), but asserts that
+         *                                   dq is a unit dual quaternion.
+         *     blend(dq, weight, n)        * Dual quaternion linear blending (DLB):
+         *                                   the normalized weighted sum.
+         *     get_dual_quat(dq, M)        * From a rigid Matrix44.
+         *     get_transform_mat44(M, dq)  * To a rigid Matrix44.
+         *
+         * See skin_points() in Batch.h for blending and transforming whole
+         * vertex arrays.
+         *
+         * typedef DualQuaternion<float> DualQuaternionf;
+         * typedef DualQuaternion<double> DualQuaterniond;
+         * \endverbatim
+         */
+        template <typename T>
+        class DualQuaternion
+            {
+        public:
+            Quaternion<T> real, dual;
+
+            // Constructors
+            DualQuaternion() {}
+            DualQuaternion(Quaternion<T> const & r, Quaternion<T> const & d) : real (r), dual (d) {}
+            DualQuaternion(Quaternion<T> const & r, Vector3<T> const & t)
+                : real (r), dual (Quaternion<T>(t, T(0)) * r * 0.5) {}
+
+            // Assignment
+            inline DualQuaternion<T>& setidentity()
+                { real.setidentity(); dual.assign(T(0), T(0), T(0), T(0)); return *this; }
+
+            // Comparison
+            inline bool operator==(DualQuaternion<T> const & dq2) const
+                { return ((real == dq2.real) && (dual == dq2.dual)); }
+            inline bool operator!=(DualQuaternion<T> const & dq2) const
+                { return ! (*this == dq2); }
+
+            // Addition and subtraction
+            inline DualQuaternion<T>& operator+=(DualQuaternion<T> const & dq2)
+                { real += dq2.real; dual += dq2.dual; return *this; }
+            inline DualQuaternion<T> operator+(DualQuaternion<T> const & dq2) const
+                { return DualQuaternion<T>(*this) += dq2; }
+            inline DualQuaternion<T>& operator-=(DualQuaternion<T> const & dq2)
+                { real -= dq2.real; dual -= dq2.dual; return *this; }
+            inline DualQuaternion<T> operator-(DualQuaternion<T> const & dq2) const
+                { return DualQuaternion<T>(*this) -= dq2; }
+            inline DualQuaternion<T> operator-() const
+                { return DualQuaternion<T>(-real, -dual); }
+
+            // Scalar multiplication
+            inline DualQuaternion<T>& operator*=(int const a)
+                { real *= a; dual *= a; return *this; }
+            inline DualQuaternion<T>& operator*=(float const a)
+                { real *= a; dual *= a; return *this; }
+            inline DualQuaternion<T>& operator*=(double const a)
+                { real *= a; dual *= a; return *this; }
+            inline DualQuaternion<T> operator*(int const a) const
+                { return DualQuaternion<T>(*this) *= a;}
+            inline DualQuaternion<T> operator*(float const a) const
+                { return DualQuaternion<T>(*this) *= a;}
+            inline DualQuaternion<T> operator*(double const a) const
+                { return DualQuaternion<T>(*this) *= a;}
+
+            // Scalar division
+            inline DualQuaternion<T>& operator/=(int const a)
+                { assert(a!=0); real /= a; dual /= a; return *this; }
+            inline DualQuaternion<T>& operator/=(float const a)
+                { assert(a!=0); real /= a; dual /= a; return *this; }
+            inline DualQuaternion<T>& operator/=(double const a)
+                { assert(a!=0); real /= a; dual /= a; return *this; }
+            inline DualQuaternion<T> operator/(int const a) const
+                { return DualQuaternion<T>(*this) /= a;}
+            inline DualQuaternion<T> operator/(float const a) const
+                { return DualQuaternion<T>(*this) /= a;}
+            inline DualQuaternion<T> operator/(double const a) const
+                { return DualQuaternion<T>(*this) /= a;}
+
+            // Dual quaternion product
+            inline DualQuaternion<T>& operator*=(DualQuaternion<T> const & dq2)
+                {
+                dual = real * dq2.dual + dual * dq2.real;
+                real *= dq2.real;
+                return *this;
+                }
+            inline DualQuaternion<T> operator*(DualQuaternion<T> const & dq2) const
+                { return DualQuaternion<T>(*this) *= dq2; }
+
+            // methods
+
+            /** \brief Scale so that the real part is unit length.
+             *
+             * This is all that blending needs.  Any part of dual parallel to
+             * real (which a unit dual quaternion does not have) is left
+             * alone; the functions below ignore it.
+             */
+            inline DualQuaternion<T>& normalize()
+                {
+                typename RealType<T>::type l = real.length();
+                if (l == 0.0) return *this;
+                real /= l; dual /= l;
+                return *this;
+                }
+
+            /** \brief The translation, 2 dual conjugate(real). */
+            inline Vector3<T> get_translation(void) const
+                {
+                Quaternion<T> const t = dual * conjugate(real);
+                return Vector3<T>(2 * t.x, 2 * t.y, 2 * t.z);
+                }
+
+            /** \brief Rotate and translate the point p. */
+            inline Vector3<T> transform_point(Vector3<T> const & p) const
+                { return real.rotate(p) + get_translation(); }
+
+            /** \brief Rotate the direction v.  This ignores the translation. */
+            inline Vector3<T> transform_direction(Vector3<T> const & v) const
+                { return real.rotate(v); }
+
+            std::string to_string(void) const;
+            };
+
+        // Scalar multiplication, continued
+        template <typename T>
+        inline DualQuaternion<T> operator*(int const a, DualQuaternion<T> const & dq)
+            { return DualQuaternion<T>(dq) *= a;}
+
+        template <typename T>
+        inline DualQuaternion<T> operator*(float const a, DualQuaternion<T> const & dq)
+            { return DualQuaternion<T>(dq) *= a;}
+
+        template <typename T>
+        inline DualQuaternion<T> operator*(double const a, DualQuaternion<T> const & dq)
+            { return DualQuaternion<T>(dq) *= a;}
+
+        /////////////////////////////////////////////////////////////////////////////
+
+        template <typename T>
+        inline DualQuaternion<T> conjugate(DualQuaternion<T> const & dq)
+            { return DualQuaternion<T>(conjugate(dq.real), conjugate(dq.dual)); }
+
+        template <typename T>
+        inline DualQuaternion<T> inverse(DualQuaternion<T> const & dq)
+            {
+            assert(fabs(dq.real.dot(dq.real) - 1) < 1e-4 && fabs(dq.real.dot(dq.dual)) < 1e-4);
+            return conjugate(dq);
+            }
+
+        // Dual quaternion linear blending: sum(weight[i] dq[i]), normalized.
+        // Each dq[i] whose real part is in the opposite hemisphere from dq[0]
+        // is negated first, so that the blend takes the short way round.
+        template <typename T>
+        DualQuaternion<T> blend(DualQuaternion<T> const * dq, T const * weight, size_t n);
+
+        // The rigid transform in M, which must be rigid (see is_rigid()).
+        template <typename T>
+        void get_dual_quat(arda::Math::DualQuaternion<T> & dq, arda::Math::Matrix44<T> const & M);
+
+        // Rigid transformation matrix for the unit dual quaternion dq.
+        template <typename T>
+        void get_transform_mat44(arda::Math::Matrix44<T> & M, arda::Math::DualQuaternion<T> const & dq);
+
+        /////////////////////////////////////////////////////////////////////////////
+
+        typedef DualQuaternion<float> DualQuaternionf;
+        typedef DualQuaternion<double> DualQuaterniond;
+
+        } // namespace Math
+
+    } // namespace arda
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+std::string arda::Math::DualQuaternion<T>::to_string(void) const
+    {
+    std::stringstream ss;
+    ss << "[ " << real.to_string() << ", " << dual.to_string() << " ]";
+    return ss.str();
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::DualQuaternion<T> arda::Math::blend(arda::Math::DualQuaternion<T> const * dq, T const * weight, size_t n)
+    {
+    assert(n > 0);
+    DualQuaternion<T> b(dq[0] * weight[0]);
+    size_t i;
+    for (i=1; i<n; ++i)
+        {
+        T const w = (dq[0].real.dot(dq[i].real) < T(0)) ? -weight[i] : weight[i];
+        b.real += dq[i].real * w;
+        b.dual += dq[i].dual * w;
+        }
+    return b.normalize();
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::get_dual_quat(arda::Math::DualQuaternion<T> & dq, arda::Math::Matrix44<T> const & M)
+    {
+    assert(is_rigid(M));
+    arda::Math::Quaternion<T> r;
+    arda::Math::get_rot_quat(r, M);
+    dq = arda::Math::DualQuaternion<T>(r, arda::Math::Vector3<T>(M[12], M[13], M[14]));
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::get_transform_mat44(arda::Math::Matrix44<T> & M, arda::Math::DualQuaternion<T> const & dq)
+    {
+    arda::Math::Matrix33<T> M33;
+    arda::Math::get_rot_mat33(M33, dq.real);
+    arda::Math::Vector3<T> const d = dq.get_translation();
+    M.assign(M33[0], M33[1], M33[2], 0, M33[3], M33[4], M33[5], 0, M33[6], M33[7], M33[8], 0, d.x, d.y, d.z, 1);
+    }
+
+#endif // DUALQUATERNION_H_
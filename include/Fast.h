@@ -0,0 +1,534 @@
+#ifndef FAST_H_
+#define FAST_H_
+
+// Not intended to be included directly.  Just include Math.h and everything
+// will be set up correctly.
+
+#include "Simd.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Fast single precision trigonometry.
+      //
+      // Polynomial approximations (Cephes style minimax coefficients) that
+      // trade a couple of ulp for speed and, more importantly, for having
+      // no branches, so the same code runs on a float, 4 floats in an SSE
+      // register, or 8 in an AVX register.  Each function comes as
+      //
+      //    float f(float)                         One value.
+      //    __m128 f(__m128)                       SSE, when ARDA_MATH_SSE2.
+      //    __m256 f(__m256)                       AVX2, when ARDA_MATH_DISPATCH.
+      //                                           Only call these when
+      //                                           simd_supported() is at
+      //                                           least AVX2.
+      //    void f(float const * x, float * out, size_t n)
+      //                                           An array, using the widest
+      //                                           code simd_level() allows.
+      //                                           out may be x.
+      //
+      // with sincos() returning both results through references (arrays s
+      // and c) and atan2() taking y before x, like the standard versions.
+      // Every form gives bit identical results, except in builds that
+      // enable FMA themselves (see Simd.h).
+      //
+      // Maximum error against the correctly rounded result, measured by
+      // sweeping the inputs (see the FastTrigTest tests):
+      //
+      // sincos()  2.5 ulp for |x| < 2^12 pi/2 (about 6434).  Larger
+      //           arguments lose accuracy quickly, since the range reduction
+      //           is only exact up to there; reduce them first.  Infinity
+      //           and NaN give NaN.
+      // tan()     4.5 ulp, same domain.  This is sin / cos.
+      // asin()    2.5 ulp.  |x| > 1 gives NaN.
+      // acos()    1.5 ulp.  |x| > 1 gives NaN.
+      // atan2()   3.5 ulp.  Signed zeros are handled like the standard
+      //           atan2(), but two infinite arguments give NaN.
+      //
+      // Denormal inputs and results are handled, at whatever speed the CPU
+      // handles them.
+
+      namespace fast
+	 {
+	 namespace detail
+	    {
+	    // Adding 1.5 * 2^23 rounds a float of magnitude below 2^22 to
+	    // an integer, which ends up in the low bits of the sum.
+	    static float const ROUND = 12582912.0f;
+
+	    // pi/2 split in three.  The first two parts have 12 significant
+	    // bits, so multiplying them by a quadrant number below 2^12 is
+	    // exact.
+	    static float const TWO_DIV_PI = 0.636619772367581343f;
+	    static float const PI_DIV_2_A = 1.57080078125f;
+	    static float const PI_DIV_2_B = -4.453584551811218e-06f;
+	    static float const PI_DIV_2_C = -8.705515752716053e-10f;
+
+	    // sin and cos on [-pi/4, pi/4].
+	    static float const SIN_1 = -1.6666654611e-1f;
+	    static float const SIN_2 = 8.3321608736e-3f;
+	    static float const SIN_3 = -1.9515295891e-4f;
+	    static float const COS_1 = 4.166664568298827e-2f;
+	    static float const COS_2 = -1.388731625493765e-3f;
+	    static float const COS_3 = 2.443315711809948e-5f;
+
+	    // asin on [-0.5, 0.5], as a polynomial in x^2.
+	    static float const ASIN_0 = 1.6666752422e-1f;
+	    static float const ASIN_1 = 7.4953002686e-2f;
+	    static float const ASIN_2 = 4.5470025998e-2f;
+	    static float const ASIN_3 = 2.4181311049e-2f;
+	    static float const ASIN_4 = 4.2163199048e-2f;
+
+	    // atan on [-tan(pi/8), tan(pi/8)], as a polynomial in x^2.
+	    static float const TAN_PI_DIV_8 = 0.414213562373095049f;
+	    static float const ATAN_0 = -3.33329491539e-1f;
+	    static float const ATAN_1 = 1.99777106478e-1f;
+	    static float const ATAN_2 = -1.38776856032e-1f;
+	    static float const ATAN_3 = 8.05374449538e-2f;
+
+	    static float const PI_DIV_4 = 0.785398163397448310f;
+	    static float const PI_DIV_2 = 1.57079632679489662f;
+	    static float const PI = 3.14159265358979324f;
+
+	    // asin(a) for |a| <= 0.5, with z = a * a.
+	    inline float asin_poly(float const a, float const z)
+	       { return ((((ASIN_4*z + ASIN_3)*z + ASIN_2)*z + ASIN_1)*z + ASIN_0)*z*a + a; }
+	    } // namespace detail
+
+	 ////////////////////////////////////////////////////////////////////
+	 // Scalar versions.  These are written operation for operation like
+	 // the SIMD versions below, which is what keeps the array tails
+	 // consistent with the vector bodies.
+
+	 inline void sincos(float const x, float & s, float & c)
+	    {
+	    using namespace detail;
+	    float const t = x*TWO_DIV_PI + ROUND;
+	    float const y = t - ROUND;
+	    unsigned int q;
+	    memcpy(&q, &t, sizeof(q));
+
+	    float r = x - y*PI_DIV_2_A;
+	    r = r - y*PI_DIV_2_B;
+	    r = r - y*PI_DIV_2_C;
+	    float const z = r*r;
+	    float const ps = ((SIN_3*z + SIN_2)*z + SIN_1)*z*r + r;
+	    float const pc = ((COS_3*z + COS_2)*z + COS_1)*z*z - 0.5f*z + 1.0f;
+
+	    // Quadrant q: sin is ps, pc, -ps, -pc and cos is pc, -ps, -pc, ps.
+	    s = (q & 1) != 0 ? pc : ps;
+	    c = (q & 1) != 0 ? ps : pc;
+	    if ((q & 2) != 0)
+	       s = -s;
+	    if (((q + 1) & 2) != 0)
+	       c = -c;
+	    }
+
+	 inline float tan(float const x)
+	    {
+	    float s, c;
+	    sincos(x, s, c);
+	    return s / c;
+	    }
+
+	 inline float asin(float const x)
+	    {
+	    using namespace detail;
+	    float const a = std::fabs(x);
+	    float const z = 0.5f*(1.0f - a);
+	    float const r = a > 0.5f ? PI_DIV_2 - 2.0f*asin_poly(std::sqrt(z), z) : asin_poly(a, a*a);
+	    return std::copysign(r, x);
+	    }
+
+	 inline float acos(float const x)
+	    {
+	    using namespace detail;
+	    float const a = std::fabs(x);
+	    float const z = 0.5f*(1.0f - a);
+	    float const outer = 2.0f*asin_poly(std::sqrt(z), z);
+	    if (a > 0.5f)
+	       return x < 0.0f ? PI - outer : outer;
+	    return PI_DIV_2 - std::copysign(asin_poly(a, a*a), x);
+	    }
+
+	 inline float atan2(float const y, float const x)
+	    {
+	    using namespace detail;
+	    float const ay = std::fabs(y), ax = std::fabs(x);
+	    float const hi = ay > ax ? ay : ax;
+	    float const lo = ay < ax ? ay : ax;
+	    float t = hi != 0.0f ? lo / hi : 0.0f;
+	    float offset = 0.0f;
+	    if (t > TAN_PI_DIV_8)
+	       {
+	       t = (t - 1.0f) / (t + 1.0f);
+	       offset = PI_DIV_4;
+	       }
+	    float const z = t*t;
+	    float a = (((ATAN_3*z + ATAN_2)*z + ATAN_1)*z + ATAN_0)*z*t + t + offset;
+	    if (ay > ax)
+	       a = PI_DIV_2 - a;
+	    if (std::signbit(x))
+	       a = PI - a;
+	    return std::copysign(a, y);
+	    }
+
+#if defined(ARDA_MATH_SSE2)
+	 ////////////////////////////////////////////////////////////////////
+	 // SSE versions.
+
+	 inline void sincos(__m128 const x, __m128 & s, __m128 & c)
+	    {
+	    using namespace detail;
+	    __m128 const round = _mm_set1_ps(ROUND);
+	    __m128 const t = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(TWO_DIV_PI)), round);
+	    __m128 const y = _mm_sub_ps(t, round);
+	    __m128i const q = _mm_castps_si128(t);
+
+	    __m128 r = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_DIV_2_A)));
+	    r = _mm_sub_ps(r, _mm_mul_ps(y, _mm_set1_ps(PI_DIV_2_B)));
+	    r = _mm_sub_ps(r, _mm_mul_ps(y, _mm_set1_ps(PI_DIV_2_C)));
+	    __m128 const z = _mm_mul_ps(r, r);
+	    __m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_3), z), _mm_set1_ps(SIN_2));
+	    ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(SIN_1));
+	    ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), r), r);
+	    __m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_3), z), _mm_set1_ps(COS_2));
+	    pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(COS_1));
+	    pc = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(pc, z), z),
+				       _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+	    __m128i const one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+	    __m128 const swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+	    __m128 const sign_s = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+	    __m128 const sign_c = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+	    s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps)), sign_s);
+	    c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc)), sign_c);
+	    }
+
+	 inline __m128 tan(__m128 const x)
+	    {
+	    __m128 s, c;
+	    sincos(x, s, c);
+	    return _mm_div_ps(s, c);
+	    }
+
+	 namespace detail
+	    {
+	    inline __m128 asin_poly(__m128 const a, __m128 const z)
+	       {
+	       __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ASIN_4), z), _mm_set1_ps(ASIN_3));
+	       p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ASIN_2));
+	       p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ASIN_1));
+	       p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ASIN_0));
+	       return _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), a), a);
+	       }
+
+	    inline __m128 select(__m128 const mask, __m128 const a, __m128 const b)
+	       { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	    } // namespace detail
+
+	 inline __m128 asin(__m128 const x)
+	    {
+	    using namespace detail;
+	    __m128 const sign = _mm_set1_ps(-0.0f);
+	    __m128 const a = _mm_andnot_ps(sign, x);
+	    __m128 const z = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(_mm_set1_ps(1.0f), a));
+	    __m128 const outer = _mm_sub_ps(_mm_set1_ps(PI_DIV_2),
+					  _mm_mul_ps(_mm_set1_ps(2.0f), asin_poly(_mm_sqrt_ps(z), z)));
+	    __m128 const r = select(_mm_cmpgt_ps(a, _mm_set1_ps(0.5f)), outer, asin_poly(a, _mm_mul_ps(a, a)));
+	    return _mm_or_ps(r, _mm_and_ps(sign, x));
+	    }
+
+	 inline __m128 acos(__m128 const x)
+	    {
+	    using namespace detail;
+	    __m128 const sign = _mm_set1_ps(-0.0f);
+	    __m128 const a = _mm_andnot_ps(sign, x);
+	    __m128 const z = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(_mm_set1_ps(1.0f), a));
+	    __m128 outer = _mm_mul_ps(_mm_set1_ps(2.0f), asin_poly(_mm_sqrt_ps(z), z));
+	    outer = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(PI), outer), outer);
+	    __m128 const inner = _mm_sub_ps(_mm_set1_ps(PI_DIV_2),
+					    _mm_or_ps(asin_poly(a, _mm_mul_ps(a, a)), _mm_and_ps(sign, x)));
+	    return select(_mm_cmpgt_ps(a, _mm_set1_ps(0.5f)), outer, inner);
+	    }
+
+	 inline __m128 atan2(__m128 const y, __m128 const x)
+	    {
+	    using namespace detail;
+	    __m128 const sign = _mm_set1_ps(-0.0f);
+	    __m128 const ay = _mm_andnot_ps(sign, y), ax = _mm_andnot_ps(sign, x);
+	    __m128 const hi = _mm_max_ps(ay, ax);
+	    __m128 const lo = _mm_min_ps(ay, ax);
+	    __m128 t = _mm_and_ps(_mm_cmpneq_ps(hi, _mm_setzero_ps()), _mm_div_ps(lo, hi));
+	    __m128 const reduce = _mm_cmpgt_ps(t, _mm_set1_ps(TAN_PI_DIV_8));
+	    __m128 const one = _mm_set1_ps(1.0f);
+	    t = select(reduce, _mm_div_ps(_mm_sub_ps(t, one), _mm_add_ps(t, one)), t);
+	    __m128 const offset = _mm_and_ps(reduce, _mm_set1_ps(PI_DIV_4));
+	    __m128 const z = _mm_mul_ps(t, t);
+	    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_3), z), _mm_set1_ps(ATAN_2));
+	    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ATAN_1));
+	    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ATAN_0));
+	    __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), t), t), offset);
+	    a = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(PI_DIV_2), a), a);
+	    __m128 const negative_x = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(x), 31));
+	    a = select(negative_x, _mm_sub_ps(_mm_set1_ps(PI), a), a);
+	    return _mm_or_ps(a, _mm_and_ps(sign, y));
+	    }
+#endif // ARDA_MATH_SSE2
+
+#if defined(ARDA_MATH_DISPATCH)
+	 ////////////////////////////////////////////////////////////////////
+	 // AVX2 versions.  The same code 8 wide.
+
+	 ARDA_MATH_TARGET_AVX2
+	 inline void sincos(__m256 const x, __m256 & s, __m256 & c)
+	    {
+	    using namespace detail;
+	    __m256 const round = _mm256_set1_ps(ROUND);
+	    __m256 const t = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(TWO_DIV_PI)), round);
+	    __m256 const y = _mm256_sub_ps(t, round);
+	    __m256i const q = _mm256_castps_si256(t);
+
+	    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PI_DIV_2_A)));
+	    r = _mm256_sub_ps(r, _mm256_mul_ps(y, _mm256_set1_ps(PI_DIV_2_B)));
+	    r = _mm256_sub_ps(r, _mm256_mul_ps(y, _mm256_set1_ps(PI_DIV_2_C)));
+	    __m256 const z = _mm256_mul_ps(r, r);
+	    __m256 ps = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_3), z), _mm256_set1_ps(SIN_2));
+	    ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(SIN_1));
+	    ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, z), r), r);
+	    __m256 pc = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_3), z), _mm256_set1_ps(COS_2));
+	    pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(COS_1));
+	    pc = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(pc, z), z),
+					     _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.0f));
+
+	    __m256i const one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+	    __m256 const swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+	    __m256 const sign_s = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+	    __m256 const sign_c = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+	    s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), sign_s);
+	    c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), sign_c);
+	    }
+
+	 ARDA_MATH_TARGET_AVX2
+	 inline __m256 tan(__m256 const x)
+	    {
+	    __m256 s, c;
+	    sincos(x, s, c);
+	    return _mm256_div_ps(s, c);
+	    }
+
+	 namespace detail
+	    {
+	    ARDA_MATH_TARGET_AVX2
+	    inline __m256 asin_poly(__m256 const a, __m256 const z)
+	       {
+	       __m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ASIN_4), z), _mm256_set1_ps(ASIN_3));
+	       p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ASIN_2));
+	       p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ASIN_1));
+	       p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ASIN_0));
+	       return _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(p, z), a), a);
+	       }
+	    } // namespace detail
+
+	 ARDA_MATH_TARGET_AVX2
+	 inline __m256 asin(__m256 const x)
+	    {
+	    using namespace detail;
+	    __m256 const sign = _mm256_set1_ps(-0.0f);
+	    __m256 const a = _mm256_andnot_ps(sign, x);
+	    __m256 const z = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(_mm256_set1_ps(1.0f), a));
+	    __m256 const outer = _mm256_sub_ps(_mm256_set1_ps(PI_DIV_2),
+					     _mm256_mul_ps(_mm256_set1_ps(2.0f), asin_poly(_mm256_sqrt_ps(z), z)));
+	    __m256 const r = _mm256_blendv_ps(asin_poly(a, _mm256_mul_ps(a, a)), outer,
+					      _mm256_cmp_ps(a, _mm256_set1_ps(0.5f), _CMP_GT_OQ));
+	    return _mm256_or_ps(r, _mm256_and_ps(sign, x));
+	    }
+
+	 ARDA_MATH_TARGET_AVX2
+	 inline __m256 acos(__m256 const x)
+	    {
+	    using namespace detail;
+	    __m256 const sign = _mm256_set1_ps(-0.0f);
+	    __m256 const a = _mm256_andnot_ps(sign, x);
+	    __m256 const z = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(_mm256_set1_ps(1.0f), a));
+	    __m256 outer = _mm256_mul_ps(_mm256_set1_ps(2.0f), asin_poly(_mm256_sqrt_ps(z), z));
+	    outer = _mm256_blendv_ps(outer, _mm256_sub_ps(_mm256_set1_ps(PI), outer),
+				   _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+	    __m256 const inner = _mm256_sub_ps(_mm256_set1_ps(PI_DIV_2),
+					       _mm256_or_ps(asin_poly(a, _mm256_mul_ps(a, a)), _mm256_and_ps(sign, x)));
+	    return _mm256_blendv_ps(inner, outer, _mm256_cmp_ps(a, _mm256_set1_ps(0.5f), _CMP_GT_OQ));
+	    }
+
+	 ARDA_MATH_TARGET_AVX2
+	 inline __m256 atan2(__m256 const y, __m256 const x)
+	    {
+	    using namespace detail;
+	    __m256 const sign = _mm256_set1_ps(-0.0f);
+	    __m256 const ay = _mm256_andnot_ps(sign, y), ax = _mm256_andnot_ps(sign, x);
+	    __m256 const hi = _mm256_max_ps(ay, ax);
+	    __m256 const lo = _mm256_min_ps(ay, ax);
+	    __m256 t = _mm256_and_ps(_mm256_cmp_ps(hi, _mm256_setzero_ps(), _CMP_NEQ_UQ), _mm256_div_ps(lo, hi));
+	    __m256 const reduce = _mm256_cmp_ps(t, _mm256_set1_ps(TAN_PI_DIV_8), _CMP_GT_OQ);
+	    __m256 const one = _mm256_set1_ps(1.0f);
+	    t = _mm256_blendv_ps(t, _mm256_div_ps(_mm256_sub_ps(t, one), _mm256_add_ps(t, one)), reduce);
+	    __m256 const offset = _mm256_and_ps(reduce, _mm256_set1_ps(PI_DIV_4));
+	    __m256 const z = _mm256_mul_ps(t, t);
+	    __m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ATAN_3), z), _mm256_set1_ps(ATAN_2));
+	    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ATAN_1));
+	    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ATAN_0));
+	    __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(p, z), t), t), offset);
+	    a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(PI_DIV_2), a), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	    // blendv only looks at the sign bit, which is exactly signbit(x).
+	    a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(PI), a), x);
+	    return _mm256_or_ps(a, _mm256_and_ps(sign, y));
+	    }
+
+	 namespace detail
+	    {
+	    // Array bodies, 8 at a time.  They return how many were done;
+	    // the callers finish the rest with the SSE and scalar code.
+	    ARDA_MATH_TARGET_AVX2
+	    inline size_t sincos_avx2(float const * x, float * s, float * c, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  {
+		  __m256 vs, vc;
+		  sincos(_mm256_loadu_ps(x + i), vs, vc);
+		  _mm256_storeu_ps(s + i, vs);
+		  _mm256_storeu_ps(c + i, vc);
+		  }
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    inline size_t tan_avx2(float const * x, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  _mm256_storeu_ps(out + i, tan(_mm256_loadu_ps(x + i)));
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    inline size_t asin_avx2(float const * x, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  _mm256_storeu_ps(out + i, asin(_mm256_loadu_ps(x + i)));
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    inline size_t acos_avx2(float const * x, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  _mm256_storeu_ps(out + i, acos(_mm256_loadu_ps(x + i)));
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    inline size_t atan2_avx2(float const * y, float const * x, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  _mm256_storeu_ps(out + i, atan2(_mm256_loadu_ps(y + i), _mm256_loadu_ps(x + i)));
+	       return i;
+	       }
+	    } // namespace detail
+#endif // ARDA_MATH_DISPATCH
+
+	 ////////////////////////////////////////////////////////////////////
+	 // Arrays.  AVX-512 machines use the AVX2 code.
+
+	 inline void sincos(float const * x, float * s, float * c, size_t n)
+	    {
+	    size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2)
+	       i = detail::sincos_avx2(x, s, c, n);
+#endif
+#if defined(ARDA_MATH_SSE2)
+	    for (; i+4<=n; i+=4)
+	       {
+	       __m128 vs, vc;
+	       sincos(_mm_loadu_ps(x + i), vs, vc);
+	       _mm_storeu_ps(s + i, vs);
+	       _mm_storeu_ps(c + i, vc);
+	       }
+#endif
+	    for (; i<n; ++i)
+	       sincos(x[i], s[i], c[i]);
+	    }
+
+	 inline void tan(float const * x, float * out, size_t n)
+	    {
+	    size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2)
+	       i = detail::tan_avx2(x, out, n);
+#endif
+#if defined(ARDA_MATH_SSE2)
+	    for (; i+4<=n; i+=4)
+	       _mm_storeu_ps(out + i, tan(_mm_loadu_ps(x + i)));
+#endif
+	    for (; i<n; ++i)
+	       out[i] = tan(x[i]);
+	    }
+
+	 inline void asin(float const * x, float * out, size_t n)
+	    {
+	    size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2)
+	       i = detail::asin_avx2(x, out, n);
+#endif
+#if defined(ARDA_MATH_SSE2)
+	    for (; i+4<=n; i+=4)
+	       _mm_storeu_ps(out + i, asin(_mm_loadu_ps(x + i)));
+#endif
+	    for (; i<n; ++i)
+	       out[i] = asin(x[i]);
+	    }
+
+	 inline void acos(float const * x, float * out, size_t n)
+	    {
+	    size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2)
+	       i = detail::acos_avx2(x, out, n);
+#endif
+#if defined(ARDA_MATH_SSE2)
+	    for (; i+4<=n; i+=4)
+	       _mm_storeu_ps(out + i, acos(_mm_loadu_ps(x + i)));
+#endif
+	    for (; i<n; ++i)
+	       out[i] = acos(x[i]);
+	    }
+
+	 inline void atan2(float const * y, float const * x, float * out, size_t n)
+	    {
+	    size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	    if (simd_level() >= SimdLevel::AVX2)
+	       i = detail::atan2_avx2(y, x, out, n);
+#endif
+#if defined(ARDA_MATH_SSE2)
+	    for (; i+4<=n; i+=4)
+	       _mm_storeu_ps(out + i, atan2(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+#endif
+	    for (; i<n; ++i)
+	       out[i] = atan2(y[i], x[i]);
+	    }
+	 } // namespace fast
+      } // namespace Math
+   } // namespace arda
+
+#endif // FAST_H_
@@ -0,0 +1,444 @@
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+
+// Needs Vector.h, Matrix.h, Simd.h, SoA.h, and Bounds.h, but this file is not
+// intended to be included directly.  Just include Math.h and everything will
+// be set up correctly.
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // View frustum culling.
+      //
+      // Frustum<T> holds the six clip planes of a projection (or projection
+      // times view) matrix, extracted with the Gribb-Hartmann method: for the
+      // clip volume -w <= x, y, z <= w of get_persp_mat44() and
+      // get_ortho_mat44(), each plane is the last row of the matrix plus or
+      // minus one of the others.  A plane is (a, b, c, d) with the normal
+      // (a, b, c) pointing into the frustum and of unit length, so that
+      // a*x + b*y + c*z + d is the signed distance of a point from it.  From
+      // P * V the planes are in world space, from P alone in eye space.  The
+      // far plane of get_persp_inf_mat44() comes out as (0, 0, 0, d) with
+      // d > 0, which nothing is outside of.
+      //
+      // Frustum(M), set(M)  Extract the planes of M.
+      // planes[i]           Plane i, in the order of the Plane enum.
+      // distance(i, x, y, z)
+      //                     Signed distance of a point from plane i.
+      // contains(p)         Point inside (or on) every plane.
+      // intersects(c, r)    Sphere with center c and radius r not entirely
+      //                     outside any plane.
+      // intersects(lo, hi), intersects(box)
+      //                     Axis aligned box with corners lo and hi, or an
+      //                     AABB (see Bounds.h), not entirely outside any
+      //                     plane.
+      //
+      // The sphere and box tests are the usual conservative ones: an object
+      // near an edge of the frustum can be outside it without being outside
+      // any one plane, and then counts as visible.
+      //
+      // The batch versions test n objects given as structures of arrays
+      // (see SoA.h).  The cull_ ones write a bit mask: bit i & 7 of
+      // mask[i >> 3] is set if object i is visible; mask has (n + 7) / 8
+      // bytes and the unused bits of the last one are cleared.  The visible_
+      // ones write the indices of the visible objects in increasing order
+      // and return how many there are; indices must have room for n.
+      //
+      // cull_spheres(centers, radii, mask)
+      // visible_spheres(centers, radii, indices)
+      // cull_boxes(lo, hi, mask)
+      // visible_boxes(lo, hi, indices)
+      //
+      // For float they test 8 objects at a time with AVX2 (for AVX-512 as
+      // well), or 4 with SSE, depending on simd_level() (see Simd.h), and
+      // give the same results as the single object tests.
+
+      template <typename T>
+      class Frustum
+	 {
+	 public:
+	 enum Plane { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR };
+
+	 Vector4<T> planes[6];
+
+	 Frustum() {}
+	 explicit Frustum(Matrix44<T> const & M) { set(M); }
+
+	 Frustum<T>& set(Matrix44<T> const & M);
+
+	 inline T distance(unsigned int const i, T const x, T const y, T const z) const
+	    { assert(i<6); return planes[i].x*x + planes[i].y*y + planes[i].z*z + planes[i].w; }
+
+	 inline bool contains(Vector3<T> const & p) const
+	    { return intersects(p, T(0)); }
+
+	 inline bool intersects(Vector3<T> const & c, T const r) const
+	    {
+	    unsigned int i;
+	    for (i=0; i<6; ++i)
+	       if (!(distance(i, c.x, c.y, c.z) >= -r))
+		  return false;
+	    return true;
+	    }
+
+	 // Only the corner furthest along the normal needs testing.
+	 inline bool intersects(Vector3<T> const & lo, Vector3<T> const & hi) const
+	    {
+	    unsigned int i;
+	    for (i=0; i<6; ++i)
+	       {
+	       Vector4<T> const & q = planes[i];
+	       if (!(distance(i, q.x >= T(0) ? hi.x : lo.x, q.y >= T(0) ? hi.y : lo.y,
+			      q.z >= T(0) ? hi.z : lo.z) >= T(0)))
+		  return false;
+	       }
+	    return true;
+	    }
+
+	 inline bool intersects(AABB<T> const & box) const
+	    { return intersects(box.min, box.max); }
+
+	 void cull_spheres(Vector3SoA<T> const & centers, T const * radii, unsigned char * mask) const;
+	 size_t visible_spheres(Vector3SoA<T> const & centers, T const * radii, unsigned int * indices) const;
+	 void cull_boxes(Vector3SoA<T> const & lo, Vector3SoA<T> const & hi, unsigned char * mask) const;
+	 size_t visible_boxes(Vector3SoA<T> const & lo, Vector3SoA<T> const & hi, unsigned int * indices) const;
+	 };
+
+      typedef Frustum<float> Frustumf;
+      typedef Frustum<double> Frustumd;
+
+      namespace detail
+	 {
+	 // The batch tests go through the objects 8 at a time and hand the
+	 // visibility bits of each group to a sink, as sink(i, bits, m) for
+	 // objects i to i + m - 1.
+	 struct FrustumMaskSink
+	    {
+	    unsigned char * mask;
+	    inline void operator()(size_t const i, unsigned int const bits, size_t) const
+	       { mask[i >> 3] = (unsigned char) bits; }
+	    };
+
+	 // Every index is stored, and the count only moves past the visible
+	 // ones, so there are no branches to mispredict.
+	 struct FrustumIndexSink
+	    {
+	    unsigned int * indices;
+	    size_t count;
+	    inline void operator()(size_t const i, unsigned int const bits, size_t const m)
+	       {
+	       size_t k;
+	       for (k=0; k<m; ++k)
+		  {
+		  indices[count] = (unsigned int) (i + k);
+		  count += (bits >> k) & 1;
+		  }
+	       }
+	    };
+
+	 // Objects i to i + m - 1 one at a time, m <= 8.
+	 template <typename T>
+	 inline unsigned int frustum_spheres_at(Frustum<T> const & f, T const * const * c, T const * r,
+						size_t const i, size_t const m)
+	    {
+	    unsigned int bits = 0;
+	    size_t k;
+	    for (k=0; k<m; ++k)
+	       if (f.intersects(Vector3<T>(c[0][i+k], c[1][i+k], c[2][i+k]), r[i+k]))
+		  bits |= 1u << k;
+	    return bits;
+	    }
+
+	 template <typename T>
+	 inline unsigned int frustum_boxes_at(Frustum<T> const & f, T const * const * lo, T const * const * hi,
+					      size_t const i, size_t const m)
+	    {
+	    unsigned int bits = 0;
+	    size_t k;
+	    for (k=0; k<m; ++k)
+	       if (f.intersects(Vector3<T>(lo[0][i+k], lo[1][i+k], lo[2][i+k]),
+				Vector3<T>(hi[0][i+k], hi[1][i+k], hi[2][i+k])))
+		  bits |= 1u << k;
+	    return bits;
+	    }
+
+	 template <typename T>
+	 class FrustumKernels
+	    {
+	    public:
+	    template <typename Sink>
+	    static inline void spheres(Frustum<T> const & f, T const * const * c, T const * r, size_t n, Sink & sink)
+	       {
+	       size_t i;
+	       for (i=0; i<n; i+=8)
+		  {
+		  size_t const m = n - i < 8 ? n - i : 8;
+		  sink(i, frustum_spheres_at(f, c, r, i, m), m);
+		  }
+	       }
+
+	    template <typename Sink>
+	    static inline void boxes(Frustum<T> const & f, T const * const * lo, T const * const * hi, size_t n, Sink & sink)
+	       {
+	       size_t i;
+	       for (i=0; i<n; i+=8)
+		  {
+		  size_t const m = n - i < 8 ? n - i : 8;
+		  sink(i, frustum_boxes_at(f, lo, hi, i, m), m);
+		  }
+	       }
+	    };
+
+#if defined(ARDA_MATH_SSE2)
+	 // The distances are computed in the same order as
+	 // Frustum::distance(), so these agree exactly with the single object
+	 // tests, which do the last few objects.  The SoA arrays are 64 byte
+	 // aligned; radii may not be.
+	 template <>
+	 class FrustumKernels<float>
+	    {
+	    public:
+	    static inline __m128 distance4(Vector4<float> const & q, __m128 const x, __m128 const y, __m128 const z)
+	       {
+	       return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(q.x), x), _mm_mul_ps(_mm_set1_ps(q.y), y)),
+					    _mm_mul_ps(_mm_set1_ps(q.z), z)), _mm_set1_ps(q.w));
+	       }
+
+	    static inline unsigned int spheres4(Frustum<float> const & f, float const * const * c, float const * r, size_t i)
+	       {
+	       __m128 const x = _mm_load_ps(c[0] + i), y = _mm_load_ps(c[1] + i), z = _mm_load_ps(c[2] + i);
+	       __m128 const nr = _mm_xor_ps(_mm_loadu_ps(r + i), _mm_set1_ps(-0.0f));
+	       __m128 in = _mm_cmpge_ps(distance4(f.planes[0], x, y, z), nr);
+	       unsigned int k;
+	       for (k=1; k<6; ++k)
+		  in = _mm_and_ps(in, _mm_cmpge_ps(distance4(f.planes[k], x, y, z), nr));
+	       return (unsigned int) _mm_movemask_ps(in);
+	       }
+
+	    static inline unsigned int boxes4(Frustum<float> const & f, float const * const * lo, float const * const * hi, size_t i)
+	       {
+	       __m128 const lx = _mm_load_ps(lo[0] + i), ly = _mm_load_ps(lo[1] + i), lz = _mm_load_ps(lo[2] + i);
+	       __m128 const hx = _mm_load_ps(hi[0] + i), hy = _mm_load_ps(hi[1] + i), hz = _mm_load_ps(hi[2] + i);
+	       __m128 const zero = _mm_setzero_ps();
+	       __m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	       unsigned int k;
+	       for (k=0; k<6; ++k)
+		  {
+		  Vector4<float> const & q = f.planes[k];
+		  __m128 const d = distance4(q, q.x >= 0.0f ? hx : lx, q.y >= 0.0f ? hy : ly, q.z >= 0.0f ? hz : lz);
+		  in = _mm_and_ps(in, _mm_cmpge_ps(d, zero));
+		  }
+	       return (unsigned int) _mm_movemask_ps(in);
+	       }
+
+#if defined(ARDA_MATH_DISPATCH)
+	    // The whole groups of 8, returning how many objects they did.
+	    // The plane coefficients are broadcast once, and for boxes which
+	    // corner each plane tests is a blend mask.
+	    struct Planes8
+	       {
+	       __m256 a[6], b[6], c[6], d[6];
+
+	       ARDA_MATH_TARGET_AVX2
+	       explicit Planes8(Frustum<float> const & f)
+		  {
+		  unsigned int k;
+		  for (k=0; k<6; ++k)
+		     {
+		     a[k] = _mm256_set1_ps(f.planes[k].x);
+		     b[k] = _mm256_set1_ps(f.planes[k].y);
+		     c[k] = _mm256_set1_ps(f.planes[k].z);
+		     d[k] = _mm256_set1_ps(f.planes[k].w);
+		     }
+		  }
+
+	       ARDA_MATH_TARGET_AVX2
+	       inline __m256 distance(unsigned int const k, __m256 const x, __m256 const y, __m256 const z) const
+		  {
+		  return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[k], x), _mm256_mul_ps(b[k], y)),
+						     _mm256_mul_ps(c[k], z)), d[k]);
+		  }
+	       };
+
+	    template <typename Sink>
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t spheres_avx2(Frustum<float> const & f, float const * const * c, float const * r,
+					      size_t n, Sink & sink)
+	       {
+	       Planes8 const p(f);
+	       __m256 const sign = _mm256_set1_ps(-0.0f);
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i+8<=n; i+=8)
+		  {
+		  __m256 const x = _mm256_load_ps(c[0] + i), y = _mm256_load_ps(c[1] + i), z = _mm256_load_ps(c[2] + i);
+		  __m256 const nr = _mm256_xor_ps(_mm256_loadu_ps(r + i), sign);
+		  __m256 in = _mm256_cmp_ps(p.distance(0, x, y, z), nr, _CMP_GE_OQ);
+		  for (k=1; k<6; ++k)
+		     in = _mm256_and_ps(in, _mm256_cmp_ps(p.distance(k, x, y, z), nr, _CMP_GE_OQ));
+		  sink(i, (unsigned int) _mm256_movemask_ps(in), 8);
+		  }
+	       return i;
+	       }
+
+	    template <typename Sink>
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t boxes_avx2(Frustum<float> const & f, float const * const * lo, float const * const * hi,
+					    size_t n, Sink & sink)
+	       {
+	       Planes8 const p(f);
+	       __m256 const zero = _mm256_setzero_ps();
+	       __m256 const ones = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	       __m256 sx[6], sy[6], sz[6];
+	       size_t i;
+	       unsigned int k;
+	       for (k=0; k<6; ++k)
+		  {
+		  sx[k] = f.planes[k].x >= 0.0f ? ones : zero;
+		  sy[k] = f.planes[k].y >= 0.0f ? ones : zero;
+		  sz[k] = f.planes[k].z >= 0.0f ? ones : zero;
+		  }
+	       for (i=0; i+8<=n; i+=8)
+		  {
+		  __m256 const lx = _mm256_load_ps(lo[0] + i), ly = _mm256_load_ps(lo[1] + i), lz = _mm256_load_ps(lo[2] + i);
+		  __m256 const hx = _mm256_load_ps(hi[0] + i), hy = _mm256_load_ps(hi[1] + i), hz = _mm256_load_ps(hi[2] + i);
+		  __m256 in = ones;
+		  for (k=0; k<6; ++k)
+		     {
+		     __m256 const d = p.distance(k, _mm256_blendv_ps(lx, hx, sx[k]), _mm256_blendv_ps(ly, hy, sy[k]),
+						 _mm256_blendv_ps(lz, hz, sz[k]));
+		     in = _mm256_and_ps(in, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+		     }
+		  sink(i, (unsigned int) _mm256_movemask_ps(in), 8);
+		  }
+	       return i;
+	       }
+#endif // ARDA_MATH_DISPATCH
+
+	    template <typename Sink>
+	    static inline void spheres(Frustum<float> const & f, float const * const * c, float const * r, size_t n, Sink & sink)
+	       {
+	       size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	       if (simd_level() >= SimdLevel::AVX2)
+		  i = spheres_avx2(f, c, r, n, sink);
+#endif
+	       for (; i+8<=n; i+=8)
+		  sink(i, spheres4(f, c, r, i) | (spheres4(f, c, r, i + 4) << 4), 8);
+	       if (i < n)
+		  {
+		  size_t const m = n - i;
+		  sink(i, m < 4 ? frustum_spheres_at(f, c, r, i, m)
+		       : spheres4(f, c, r, i) | (frustum_spheres_at(f, c, r, i + 4, m - 4) << 4), m);
+		  }
+	       }
+
+	    template <typename Sink>
+	    static inline void boxes(Frustum<float> const & f, float const * const * lo, float const * const * hi, size_t n, Sink & sink)
+	       {
+	       size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	       if (simd_level() >= SimdLevel::AVX2)
+		  i = boxes_avx2(f, lo, hi, n, sink);
+#endif
+	       for (; i+8<=n; i+=8)
+		  sink(i, boxes4(f, lo, hi, i) | (boxes4(f, lo, hi, i + 4) << 4), 8);
+	       if (i < n)
+		  {
+		  size_t const m = n - i;
+		  sink(i, m < 4 ? frustum_boxes_at(f, lo, hi, i, m)
+		       : boxes4(f, lo, hi, i) | (frustum_boxes_at(f, lo, hi, i + 4, m - 4) << 4), m);
+		  }
+	       }
+	    };
+#endif // ARDA_MATH_SSE2
+	 } // namespace detail
+      } // namespace Math
+   } // namespace arda
+
+////////////////////////////////////////////////////////////////////////////////
+// Row i of M is M[i], M[4+i], M[8+i], M[12+i].  Plane 2j is row 3 plus row j
+// and plane 2j+1 is row 3 minus row j.
+template <typename T>
+arda::Math::Frustum<T>& arda::Math::Frustum<T>::set(Matrix44<T> const & M)
+   {
+   unsigned int i;
+   for (i=0; i<6; ++i)
+      {
+      unsigned int const j = i / 2;
+      Vector4<T> & q = planes[i];
+      if (i % 2 == 0)
+	 {
+	 q.x = M[3] + M[j];
+	 q.y = M[7] + M[4 + j];
+	 q.z = M[11] + M[8 + j];
+	 q.w = M[15] + M[12 + j];
+	 }
+      else
+	 {
+	 q.x = M[3] - M[j];
+	 q.y = M[7] - M[4 + j];
+	 q.z = M[11] - M[8 + j];
+	 q.w = M[15] - M[12 + j];
+	 }
+      T const l = std::sqrt(q.x*q.x + q.y*q.y + q.z*q.z);
+      if (l > T(0))
+	 {
+	 q.x /= l;
+	 q.y /= l;
+	 q.z /= l;
+	 q.w /= l;
+	 }
+      }
+   return *this;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::Frustum<T>::cull_spheres(Vector3SoA<T> const & centers, T const * radii, unsigned char * mask) const
+   {
+   T const * const c[3] = { centers.x(), centers.y(), centers.z() };
+   detail::FrustumMaskSink sink = { mask };
+   detail::FrustumKernels<T>::spheres(*this, c, radii, centers.size(), sink);
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+size_t arda::Math::Frustum<T>::visible_spheres(Vector3SoA<T> const & centers, T const * radii, unsigned int * indices) const
+   {
+   T const * const c[3] = { centers.x(), centers.y(), centers.z() };
+   detail::FrustumIndexSink sink = { indices, 0 };
+   detail::FrustumKernels<T>::spheres(*this, c, radii, centers.size(), sink);
+   return sink.count;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::Frustum<T>::cull_boxes(Vector3SoA<T> const & lo, Vector3SoA<T> const & hi, unsigned char * mask) const
+   {
+   assert(lo.size() == hi.size());
+   T const * const l[3] = { lo.x(), lo.y(), lo.z() };
+   T const * const h[3] = { hi.x(), hi.y(), hi.z() };
+   detail::FrustumMaskSink sink = { mask };
+   detail::FrustumKernels<T>::boxes(*this, l, h, lo.size(), sink);
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+size_t arda::Math::Frustum<T>::visible_boxes(Vector3SoA<T> const & lo, Vector3SoA<T> const & hi, unsigned int * indices) const
+   {
+   assert(lo.size() == hi.size());
+   T const * const l[3] = { lo.x(), lo.y(), lo.z() };
+   T const * const h[3] = { hi.x(), hi.y(), hi.z() };
+   detail::FrustumIndexSink sink = { indices, 0 };
+   detail::FrustumKernels<T>::boxes(*this, l, h, lo.size(), sink);
+   return sink.count;
+   }
+
+#endif // FRUSTUM_H_
@@ -0,0 +1,339 @@
+#ifndef HIERARCHY_H_
+#define HIERARCHY_H_
+
+// Needs Vector.h and Matrix.h, but this file is not intended to be included
+// directly.  Just include Math.h and everything will be set up correctly.
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // A transform hierarchy (scene graph) with incremental updates.
+      //
+      // TransformHierarchy<T> holds a local Matrix44 per node and computes
+      // the world matrices, world = world of parent * local.  Only nodes
+      // whose local matrix changed since the last update(), and their
+      // descendants, are recomputed.
+      //
+      // The nodes are kept in flat arrays in breadth first order: sorted by
+      // depth, so parents come before their children and each level is one
+      // contiguous range, and within a level by parent, so the children of
+      // a node are contiguous too.  update() walks down from the changed
+      // nodes a level at a time, so its cost is proportional to the number
+      // of nodes recomputed rather than to the size of the hierarchy (when
+      // a large fraction has changed, it makes one pass over the arrays
+      // instead).  Each is one 4x4 multiply (the SIMD one, for float) by
+      // the parent's world matrix from the level before.
+      //
+      // Nodes are named by the handle add() returns, which stays valid when
+      // the arrays are reordered.  Adding nodes makes the next update()
+      // reorder all of the arrays, so build the hierarchy up front.
+      //
+      // add(parent, local)  Add a node and return its handle.  parent is a
+      //                     handle from an earlier add(), or NONE for a
+      //                     root.
+      // set_local(node, m)  Change a node's local matrix.
+      // local(node), world(node), parent(node), depth(node)
+      //                     world() is as of the last update().
+      // size(), levels()    Number of nodes and of depths.
+      // update()            Recompute the world matrices that changed.
+      // update(parallel_for)
+      //                     The same, with the nodes to recompute at each
+      //                     level split up by parallel_for.  It is called as
+      //                     parallel_for(begin, end, body) and must call
+      //                     body(b, e) on subranges covering [begin, end),
+      //                     in any order and on any threads, and return when
+      //                     they are all done.  For example, with OpenMP:
+      //
+      //     h.update([](size_t begin, size_t end, auto const & body) {
+      //        #pragma omp parallel for
+      //        for (long b = begin; b < (long) end; b += 1024)
+      //           body(b, std::min<size_t>(b + 1024, end));
+      //        });
+      //
+      // worlds(), node_at(i)
+      //                     The world matrices in breadth first order, and
+      //                     the handle of the node at position i, for
+      //                     walking all of them after an update().
+
+      template <typename T>
+      class TransformHierarchy
+	 {
+	 public:
+	 typedef unsigned int Node;
+	 static constexpr Node NONE = ~0u;
+
+	 TransformHierarchy() : sorted (true) {}
+
+	 inline size_t size() const { return nodes.size(); }
+	 inline size_t levels() const
+	    {
+	    if (sorted)
+	       return begins.empty() ? 0 : begins.size() - 1;
+	    return *std::max_element(depths.begin(), depths.end()) + 1;
+	    }
+
+	 void reserve(size_t const n);
+
+	 Node add(Node const parent, Matrix44<T> const & local);
+
+	 inline void set_local(Node const node, Matrix44<T> const & m)
+	    {
+	    assert(node < slots.size());
+	    unsigned int const i = slots[node];
+	    local_matrices[i] = m;
+	    if (dirty[i] == 0)
+	       {
+	       dirty[i] = 1;
+	       changed.push_back(i);
+	       }
+	    }
+
+	 inline Matrix44<T> const & local(Node const node) const
+	    { assert(node < slots.size()); return local_matrices[slots[node]]; }
+	 inline Matrix44<T> const & world(Node const node) const
+	    { assert(node < slots.size()); return world_matrices[slots[node]]; }
+	 inline Node parent(Node const node) const
+	    {
+	    assert(node < slots.size());
+	    unsigned int const p = parents[slots[node]];
+	    return p == NONE ? NONE : nodes[p];
+	    }
+	 inline unsigned int depth(Node const node) const
+	    { assert(node < slots.size()); return depths[slots[node]]; }
+
+	 inline Matrix44<T> const * worlds() const { return world_matrices.empty() ? 0 : &world_matrices[0]; }
+	 inline Node node_at(size_t const i) const { assert(i < nodes.size()); return nodes[i]; }
+
+	 inline void update()
+	    { update([](size_t const b, size_t const e, auto const & body) { body(b, e); }); }
+
+	 template <typename ParallelFor>
+	 void update(ParallelFor parallel_for);
+
+	 private:
+	 void sort();
+
+	 // All indexed by position, except slots, which maps a handle to its
+	 // position.  parents holds positions too.  While sorted, the children
+	 // of position i are [first_child[i], first_child[i+1]) and begins[d]
+	 // is the position of the first node of depth d, with a final entry of
+	 // size().  changed lists the positions with dirty set.  level and
+	 // next_level are the nodes update() is working on.
+	 std::vector< Matrix44<T> > local_matrices, world_matrices;
+	 std::vector<unsigned int> parents, depths, first_child;
+	 std::vector<unsigned char> dirty;
+	 std::vector<Node> nodes;
+	 std::vector<unsigned int> slots;
+	 std::vector<size_t> begins;
+	 std::vector<unsigned int> changed, level, next_level;
+	 bool sorted;
+	 };
+
+      typedef TransformHierarchy<float> TransformHierarchyf;
+      typedef TransformHierarchy<double> TransformHierarchyd;
+      } // namespace Math
+   } // namespace arda
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::TransformHierarchy<T>::reserve(size_t const n)
+   {
+   local_matrices.reserve(n);
+   world_matrices.reserve(n);
+   parents.reserve(n);
+   depths.reserve(n);
+   first_child.reserve(n + 1);
+   dirty.reserve(n);
+   nodes.reserve(n);
+   slots.reserve(n);
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+typename arda::Math::TransformHierarchy<T>::Node
+arda::Math::TransformHierarchy<T>::add(Node const parent, Matrix44<T> const & local)
+   {
+   assert(parent == NONE || parent < slots.size());
+   unsigned int const i = (unsigned int) nodes.size();
+   unsigned int const p = parent == NONE ? NONE : slots[parent];
+   Node const node = (Node) slots.size();
+   local_matrices.push_back(local);
+   world_matrices.push_back(local);
+   parents.push_back(p);
+   depths.push_back(p == NONE ? 0 : depths[p] + 1);
+   dirty.push_back(1);
+   nodes.push_back(node);
+   slots.push_back(i);
+   changed.push_back(i);
+   sorted = false;
+   return node;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+// Put the nodes in breadth first order: the roots in the order they were
+// added, then each node's children in the order they were added.
+template <typename T>
+void arda::Math::TransformHierarchy<T>::sort()
+   {
+   size_t const n = nodes.size();
+   size_t i;
+
+   // The children of each node, in the current order.
+   std::vector<unsigned int> start(n + 1, 0), children(n);
+   for (i=0; i<n; ++i)
+      if (parents[i] != NONE)
+	 ++start[parents[i] + 1];
+   for (i=1; i<=n; ++i)
+      start[i] += start[i - 1];
+   std::vector<unsigned int> fill(start.begin(), start.end() - 1);
+   std::vector<unsigned int> order;
+   order.reserve(n);
+   for (i=0; i<n; ++i)
+      if (parents[i] == NONE)
+	 order.push_back((unsigned int) i);
+      else
+	 children[fill[parents[i]]++] = (unsigned int) i;
+
+   first_child.resize(n + 1);
+   for (i=0; i<n; ++i)
+      {
+      unsigned int const old = order[i];
+      first_child[i] = (unsigned int) order.size();
+      order.insert(order.end(), children.begin() + start[old], children.begin() + start[old + 1]);
+      }
+   first_child[n] = (unsigned int) n;
+
+   std::vector<unsigned int> to(n);
+   for (i=0; i<n; ++i)
+      to[order[i]] = (unsigned int) i;
+
+   std::vector< Matrix44<T> > new_locals(n), new_worlds(n);
+   std::vector<unsigned int> new_parents(n), new_depths(n);
+   std::vector<unsigned char> new_dirty(n);
+   std::vector<Node> new_nodes(n);
+   changed.clear();
+   begins.clear();
+   for (i=0; i<n; ++i)
+      {
+      unsigned int const old = order[i];
+      new_locals[i] = local_matrices[old];
+      new_worlds[i] = world_matrices[old];
+      new_parents[i] = parents[old] == NONE ? NONE : to[parents[old]];
+      new_depths[i] = depths[old];
+      new_dirty[i] = dirty[old];
+      new_nodes[i] = nodes[old];
+      slots[nodes[old]] = (unsigned int) i;
+      if (dirty[old] != 0)
+	 changed.push_back((unsigned int) i);
+      while (begins.size() <= depths[old])
+	 begins.push_back(i);
+      }
+   begins.push_back(n);
+   local_matrices.swap(new_locals);
+   world_matrices.swap(new_worlds);
+   parents.swap(new_parents);
+   depths.swap(new_depths);
+   dirty.swap(new_dirty);
+   nodes.swap(new_nodes);
+   sorted = true;
+   }
+
+////////////////////////////////////////////////////////////////////////////////
+// With few changes, level holds the sorted positions to recompute at one
+// depth: the children of the nodes recomputed at the depth before, merged
+// with the nodes changed at this depth.  Past about one node in 8 it is
+// cheaper to go through every level in order, marking the children of
+// dirty nodes dirty as it goes.
+template <typename T>
+template <typename ParallelFor>
+void arda::Math::TransformHierarchy<T>::update(ParallelFor parallel_for)
+   {
+   if (!sorted)
+      sort();
+   if (changed.empty())
+      return;
+
+   if (changed.size() > nodes.size() / 8)
+      {
+      unsigned int const first = *std::min_element(changed.begin(), changed.end());
+      auto const body = [this](size_t const b, size_t const e)
+	 {
+	 size_t i;
+	 for (i=b; i<e; ++i)
+	    {
+	    unsigned int const p = parents[i];
+	    if (p == NONE)
+	       {
+	       if (dirty[i] != 0)
+		  world_matrices[i] = local_matrices[i];
+	       }
+	    else if ((dirty[i] |= dirty[p]) != 0)
+	       world_matrices[i] = world_matrices[p] * local_matrices[i];
+	    }
+	 };
+      size_t d;
+      for (d=depths[first]; d+1<begins.size(); ++d)
+	 parallel_for(std::max(begins[d], (size_t) first), begins[d + 1], body);
+      std::fill(dirty.begin() + first, dirty.end(), 0);
+      changed.clear();
+      return;
+      }
+
+   std::sort(changed.begin(), changed.end());
+   auto const body = [this](size_t const b, size_t const e)
+      {
+      size_t k;
+      for (k=b; k<e; ++k)
+	 {
+	 unsigned int const i = level[k];
+	 unsigned int const p = parents[i];
+	 if (p == NONE)
+	    world_matrices[i] = local_matrices[i];
+	 else
+	    world_matrices[i] = world_matrices[p] * local_matrices[i];
+	 }
+      };
+
+   level.clear();
+   size_t c = 0;
+   while (c < changed.size() || !level.empty())
+      {
+      unsigned int const d = level.empty() ? depths[changed[c]] : depths[level[0]];
+      size_t const end = begins[d + 1];
+      size_t c_end = c;
+      while (c_end < changed.size() && changed[c_end] < end)
+	 ++c_end;
+      next_level.clear();
+      std::set_union(level.begin(), level.end(), changed.begin() + c, changed.begin() + c_end,
+		     std::back_inserter(next_level));
+      level.swap(next_level);
+      c = c_end;
+
+      parallel_for(0, level.size(), body);
+
+      next_level.clear();
+      size_t k;
+      for (k=0; k<level.size(); ++k)
+	 {
+	 unsigned int j;
+	 for (j=first_child[level[k]]; j<first_child[level[k] + 1]; ++j)
+	    next_level.push_back(j);
+	 }
+      level.swap(next_level);
+      }
+
+   size_t k;
+   for (k=0; k<changed.size(); ++k)
+      dirty[changed[k]] = 0;
+   changed.clear();
+   }
+
+#endif // HIERARCHY_H_
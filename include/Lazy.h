@@ -0,0 +1,535 @@
+#ifndef LAZY_H_
+#define LAZY_H_
+
+// Needs Vector.h and Matrix.h, but this file is not intended to be included
+// directly.  Just include Math.h and everything will be set up correctly.
+
+#include <cassert>
+#include <type_traits>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Lazy (expression template) arithmetic.
+      //
+      // The Vector and Matrix operators copy *this and then apply the op=, so
+      // a*v1 + b*v2 - v3 makes a temporary vector per operator, and F*S*Ft a
+      // temporary matrix per product.  The operators in arda::Math::lazy
+      // instead build a small expression object, which is evaluated in one
+      // pass when it is assigned:
+      //
+      //    using namespace arda::Math;
+      //    Vector3f v = lazy::ref(v1) * a + lazy::ref(v2) * b - v3;
+      //    lazy::assign(M, lazy::ref(F) * S * Ft);
+      //
+      // This is opt in.  Nothing changes for code that doesn't use ref(); the
+      // lazy operators are only found (by argument dependent lookup) when
+      // one of the operands is already a lazy expression.
+      //
+      // ref(x)             Wrap a Vector or square Matrix so that the
+      //                    operators below apply.  Holds a reference to x.
+      // + - unary-         Element wise, fused into one loop over the
+      //                    elements.  Either operand may be a plain Vector or
+      //                    Matrix once the other is lazy.
+      // * /                With an int, float, or double scalar, fused the
+      //                    same way.
+      // *                  Matrix * Matrix and Matrix * Vector.  A chain of
+      //                    matrix products is evaluated with the Matrix *=
+      //                    operator in a single temporary, rather than one
+      //                    per product.  A chain ending in a vector is
+      //                    evaluated right to left as matrix vector products,
+      //                    so A*B*v is two of those rather than a matrix
+      //                    product and one.
+      // assign(x, e)       Evaluate e straight into x.
+      // e.eval()           Evaluate e to a new Vector or Matrix; expressions
+      //                    also convert implicitly, so x = e works.
+      //
+      // Each element wise operation converts its result to the element type,
+      // as the op= operators do, so the results are the same as those of the
+      // plain operators.  Matrix products are done by the plain (and so
+      // SIMD) operators, but in a different association for vector chains,
+      // so the rounding of those can differ.
+      //
+      // The destination may appear in the expression, e.g.
+      // assign(M, lazy::ref(A) * M); the result is only stored once it has
+      // all been computed.
+      //
+      // Expressions hold references to their ref()'d operands, so they must
+      // be evaluated before the end of the full expression that created
+      // them.  Don't keep one in an auto variable.
+
+      namespace lazy
+	 {
+	 namespace detail
+	    {
+	    // Shape of the concrete types.  size is the number of elements;
+	    // vectors are columns.
+	    template <typename V>
+	    struct Traits
+	       {
+	       static bool const is_concrete = false;
+	       };
+
+	    template <typename T, unsigned int N>
+	    struct Traits< Vector<T, N> >
+	       {
+	       typedef T scalar_type;
+	       static bool const is_concrete = true;
+	       static bool const is_matrix = false;
+	       static unsigned int const rows = N, cols = 1, size = N;
+	       static_assert(sizeof(Vector<T, N>) == size * sizeof(T),
+			     "Vector elements must be tightly packed");
+	       };
+
+	    // Only square matrices: the lazy products are evaluated with *=.
+	    template <typename T, unsigned int N>
+	    struct Traits< Matrix<T, N, N> >
+	       {
+	       typedef T scalar_type;
+	       static bool const is_concrete = true;
+	       static bool const is_matrix = true;
+	       static unsigned int const rows = N, cols = N, size = N * N;
+	       static_assert(sizeof(Matrix<T, N, N>) == size * sizeof(T),
+			     "Matrix elements must be tightly packed");
+	       };
+
+	    // The elements of a concrete type as an array.
+	    template <typename T, unsigned int N>
+	    inline T * data(Vector<T, N> & v) { return &v[0]; }
+	    template <typename T, unsigned int N>
+	    inline T * data(Matrix<T, N, N> & m) { return m.m; }
+	    template <typename T, unsigned int N>
+	    inline T const * data(Vector<T, N> const & v) { return data(const_cast<Vector<T, N> &>(v)); }
+	    template <typename T, unsigned int N>
+	    inline T const * data(Matrix<T, N, N> const & m) { return m.m; }
+
+	    // r[i] = e[i] for i in [I, N), unrolled, since the compilers don't
+	    // reliably unroll the loop, and then keep r on the stack.
+	    template <unsigned int I, unsigned int N>
+	    struct Elements
+	       {
+	       template <typename E, typename T>
+	       static inline void get(E const & e, T * r)
+		  { r[I] = e[I]; Elements<I + 1, N>::get(e, r); }
+	       };
+
+	    template <unsigned int N>
+	    struct Elements<N, N>
+	       {
+	       template <typename E, typename T>
+	       static inline void get(E const &, T *) {}
+	       };
+
+	    // Evaluate an element wise expression.  The elements are all
+	    // computed before any are stored, which lets out be an operand, and
+	    // tells the compiler that the stores can't change the operands.
+	    template <typename E, typename V>
+	    inline void evaluate(E const & e, V & out)
+	       {
+	       typedef typename Traits<V>::scalar_type T;
+	       T r[Traits<V>::size];
+	       Elements<0, Traits<V>::size>::get(e, r);
+	       T * const p = data(out);
+	       unsigned int i;
+	       for (i=0; i<Traits<V>::size; ++i)
+		  p[i] = r[i];
+	       }
+	    } // namespace detail
+
+	 ////////////////////////////////////////
+	 // Expression nodes.  Each has result_type (the Vector or Matrix it
+	 // evaluates to) and eval_into(out).  The element wise nodes also have
+	 // operator[], and the matrix valued nodes apply(v), which does
+	 // v = node * v.
+
+	 template <typename E, typename V>
+	 class Expr
+	    {
+	    public:
+	    typedef V result_type;
+	    typedef typename detail::Traits<V>::scalar_type scalar_type;
+
+	    inline E const & self() const
+	       { return static_cast<E const &>(*this); }
+
+	    inline V eval() const
+	       { V r; self().eval_into(r); return r; }
+	    inline operator V() const
+	       { return eval(); }
+
+	    template <typename W>
+	    inline void apply(W & v) const
+	       { V const m(eval()); v = m * v; }
+	    };
+
+	 // A ref()'d Vector or Matrix.
+	 template <typename V>
+	 class Ref : public Expr<Ref<V>, V>
+	    {
+	    V const & x;
+
+	    public:
+	    explicit Ref(V const & v) : x (v) {}
+
+	    inline V const & get() const
+	       { return x; }
+	    inline typename detail::Traits<V>::scalar_type operator[](unsigned int const i) const
+	       { return detail::data(x)[i]; }
+	    inline void eval_into(V & out) const
+	       { out = x; }
+	    template <typename W>
+	    inline void apply(W & v) const
+	       { v = x * v; }
+	    };
+
+	 // An evaluated product, when it is the operand of an element wise
+	 // operation.
+	 template <typename V>
+	 class Value : public Expr<Value<V>, V>
+	    {
+	    V x;
+
+	    public:
+	    explicit Value(V const & v) : x (v) {}
+
+	    inline typename detail::Traits<V>::scalar_type operator[](unsigned int const i) const
+	       { return detail::data(x)[i]; }
+	    inline void eval_into(V & out) const
+	       { out = x; }
+	    };
+
+	 template <typename L, typename R>
+	 class Sum : public Expr<Sum<L, R>, typename L::result_type>
+	    {
+	    L const l;
+	    R const r;
+
+	    public:
+	    typedef typename L::result_type result_type;
+	    typedef typename L::scalar_type scalar_type;
+	    Sum(L const & a, R const & b) : l (a), r (b) {}
+
+	    inline scalar_type operator[](unsigned int const i) const
+	       { return scalar_type(l[i] + r[i]); }
+	    inline void eval_into(result_type & out) const
+	       { detail::evaluate(*this, out); }
+	    };
+
+	 template <typename L, typename R>
+	 class Difference : public Expr<Difference<L, R>, typename L::result_type>
+	    {
+	    L const l;
+	    R const r;
+
+	    public:
+	    typedef typename L::result_type result_type;
+	    typedef typename L::scalar_type scalar_type;
+	    Difference(L const & a, R const & b) : l (a), r (b) {}
+
+	    inline scalar_type operator[](unsigned int const i) const
+	       { return scalar_type(l[i] - r[i]); }
+	    inline void eval_into(result_type & out) const
+	       { detail::evaluate(*this, out); }
+	    };
+
+	 template <typename E>
+	 class Negation : public Expr<Negation<E>, typename E::result_type>
+	    {
+	    E const e;
+
+	    public:
+	    typedef typename E::result_type result_type;
+	    typedef typename E::scalar_type scalar_type;
+	    explicit Negation(E const & a) : e (a) {}
+
+	    inline scalar_type operator[](unsigned int const i) const
+	       { return scalar_type(-e[i]); }
+	    inline void eval_into(result_type & out) const
+	       { detail::evaluate(*this, out); }
+	    };
+
+	 // e * s, and e / s as Quotient.  s is converted to the precision the
+	 // Vector and Matrix operators use (see ScalarPrecision), so that a
+	 // float vector times 0.1 rounds 0.1 to float first, as they do.
+	 template <typename E, typename S>
+	 class Scaled : public Expr<Scaled<E, S>, typename E::result_type>
+	    {
+	    E const e;
+	    typename ScalarPrecision<typename E::scalar_type, S>::type const s;
+
+	    public:
+	    typedef typename E::result_type result_type;
+	    typedef typename E::scalar_type scalar_type;
+	    Scaled(E const & a, S const b) : e (a), s (b) {}
+
+	    inline scalar_type operator[](unsigned int const i) const
+	       { return scalar_type(e[i] * s); }
+	    inline void eval_into(result_type & out) const
+	       { detail::evaluate(*this, out); }
+	    };
+
+	 template <typename E, typename S>
+	 class Quotient : public Expr<Quotient<E, S>, typename E::result_type>
+	    {
+	    E const e;
+	    typename ScalarPrecision<typename E::scalar_type, S>::type const s;
+
+	    public:
+	    typedef typename E::result_type result_type;
+	    typedef typename E::scalar_type scalar_type;
+	    Quotient(E const & a, S const b) : e (a), s (b) { assert(b != 0); }
+
+	    inline scalar_type operator[](unsigned int const i) const
+	       { return scalar_type(e[i] / s); }
+	    inline void eval_into(result_type & out) const
+	       { detail::evaluate(*this, out); }
+	    };
+
+	 template <typename L, typename R>
+	 class MatrixProduct;
+
+	 namespace detail
+	    {
+	    // The value of a matrix valued operand, as a reference for a ref()
+	    // and evaluated into a temporary otherwise.
+	    template <typename E>
+	    class Evaluated
+	       {
+	       typename E::result_type x;
+
+	       public:
+	       explicit Evaluated(E const & e) { e.eval_into(x); }
+	       inline typename E::result_type const & get() const
+		  { return x; }
+	       };
+
+	    template <typename E>
+	    inline void chain(E const & e, typename E::result_type & x)
+	       { e.eval_into(x); }
+
+	    template <typename L, typename R>
+	    inline void chain(MatrixProduct<L, R> const & e, typename L::result_type & x)
+	       { e.chain(x); }
+
+	    template <typename V>
+	    class Evaluated< Ref<V> >
+	       {
+	       V const & x;
+
+	       public:
+	       explicit Evaluated(Ref<V> const & e) : x (e.get()) {}
+	       inline V const & get() const
+		  { return x; }
+	       };
+	    } // namespace detail
+
+	 // Matrix * Matrix.  Evaluated as x = l; x *= r in a local x, so that a
+	 // chain of them is one copy into x and a *= per product, and then
+	 // stored once.  (Running the chain in out itself is slower, since the
+	 // compiler has to assume that out overlaps the operands.)
+	 template <typename L, typename R>
+	 class MatrixProduct : public Expr<MatrixProduct<L, R>, typename L::result_type>
+	    {
+	    L const l;
+	    R const r;
+
+	    public:
+	    typedef typename L::result_type result_type;
+	    MatrixProduct(L const & a, R const & b) : l (a), r (b) {}
+
+	    inline void chain(result_type & x) const
+	       {
+	       detail::Evaluated<R> const rv(r);
+	       detail::chain(l, x);
+	       x *= rv.get();
+	       }
+	    inline void eval_into(result_type & out) const
+	       {
+	       result_type x;
+	       chain(x);
+	       out = x;
+	       }
+	    template <typename W>
+	    inline void apply(W & v) const
+	       { r.apply(v); l.apply(v); }
+	    };
+
+	 // Matrix * Vector.  Evaluated right to left: out = r, then each
+	 // matrix of l is applied to out in turn.
+	 template <typename L, typename R>
+	 class MatrixVector : public Expr<MatrixVector<L, R>, typename R::result_type>
+	    {
+	    L const l;
+	    R const r;
+
+	    public:
+	    typedef typename R::result_type result_type;
+	    MatrixVector(L const & a, R const & b) : l (a), r (b) {}
+
+	    inline void eval_into(result_type & out) const
+	       {
+	       r.eval_into(out);
+	       l.apply(out);
+	       }
+	    };
+
+	 namespace detail
+	    {
+	    // Products have no operator[], so as operands of element wise
+	    // operations they are evaluated first.
+	    template <typename E>
+	    struct Operand
+	       {
+	       typedef E type;
+	       static inline E const & get(E const & e) { return e; }
+	       };
+
+	    template <typename L, typename R>
+	    struct Operand< MatrixProduct<L, R> >
+	       {
+	       typedef Value<typename L::result_type> type;
+	       static inline type get(MatrixProduct<L, R> const & e) { return type(e.eval()); }
+	       };
+
+	    template <typename L, typename R>
+	    struct Operand< MatrixVector<L, R> >
+	       {
+	       typedef Value<typename R::result_type> type;
+	       static inline type get(MatrixVector<L, R> const & e) { return type(e.eval()); }
+	       };
+
+	    // The type of l * r.
+	    template <typename L, typename R,
+		      bool LM = Traits<typename L::result_type>::is_matrix,
+		      bool RM = Traits<typename R::result_type>::is_matrix>
+	    struct Product
+	       {
+	       static_assert(LM, "lazy::operator* needs Matrix * Matrix or Matrix * Vector");
+	       };
+
+	    template <typename L, typename R>
+	    struct Product<L, R, true, true>
+	       {
+	       static_assert(std::is_same<typename L::result_type, typename R::result_type>::value,
+			     "lazy::operator* needs matrices of the same type");
+	       typedef MatrixProduct<L, R> type;
+	       };
+
+	    template <typename L, typename R>
+	    struct Product<L, R, true, false>
+	       {
+	       static_assert(Traits<typename L::result_type>::cols == Traits<typename R::result_type>::rows,
+			     "lazy::operator* needs a vector the size of the matrix");
+	       typedef MatrixVector<L, R> type;
+	       };
+
+	    template <typename L, typename R>
+	    struct SameType
+	       {
+	       static_assert(std::is_same<typename L::result_type, typename R::result_type>::value,
+			     "lazy::operator+ and operator- need operands of the same type");
+	       static bool const value = true;
+	       };
+
+	    template <typename V, typename X = void>
+	    struct IfConcrete
+	       : std::enable_if<Traits<V>::is_concrete, X> {};
+
+	    // Product<> with a ref()'d concrete operand, for concrete V only.
+	    template <typename L, typename V, bool = Traits<V>::is_concrete>
+	    struct ProductRight {};
+	    template <typename L, typename V>
+	    struct ProductRight<L, V, true> : Product< L, Ref<V> > {};
+
+	    template <typename V, typename R, bool = Traits<V>::is_concrete>
+	    struct ProductLeft {};
+	    template <typename V, typename R>
+	    struct ProductLeft<V, R, true> : Product< Ref<V>, R > {};
+
+	    template <typename S, typename X = void>
+	    struct IfScalar
+	       : std::enable_if<std::is_same<S, int>::value || std::is_same<S, float>::value ||
+				std::is_same<S, double>::value, X> {};
+	    } // namespace detail
+
+	 ////////////////////////////////////////
+	 // Entry points
+
+	 template <typename V>
+	 inline typename detail::IfConcrete<V, Ref<V> >::type ref(V const & x)
+	    { return Ref<V>(x); }
+
+	 template <typename V, typename E, typename W>
+	 inline void assign(V & x, Expr<E, W> const & e)
+	    {
+	    static_assert(std::is_same<V, W>::value, "lazy::assign() needs an expression of the same type");
+	    e.self().eval_into(x);
+	    }
+
+	 ////////////////////////////////////////
+	 // Operators
+
+	 template <typename E, typename V>
+	 inline Negation<typename detail::Operand<E>::type> operator-(Expr<E, V> const & a)
+	    {
+	    return Negation<typename detail::Operand<E>::type>(detail::Operand<E>::get(a.self()));
+	    }
+
+#define ARDA_MATH_LAZY_ELEMENTWISE(op, Node)				\
+	 template <typename L, typename LV, typename R, typename RV>	\
+	 inline Node<typename detail::Operand<L>::type, typename detail::Operand<R>::type> \
+	 operator op(Expr<L, LV> const & a, Expr<R, RV> const & b)	\
+	    {								\
+	    static_assert(detail::SameType<L, R>::value, "");		\
+	    return Node<typename detail::Operand<L>::type, typename detail::Operand<R>::type> \
+	       (detail::Operand<L>::get(a.self()), detail::Operand<R>::get(b.self())); \
+	    }								\
+	 template <typename L, typename LV, typename V>			\
+	 inline typename detail::IfConcrete<V, Node<typename detail::Operand<L>::type, Ref<V> > >::type \
+	 operator op(Expr<L, LV> const & a, V const & b)		\
+	    { return a.self() op Ref<V>(b); }				\
+	 template <typename V, typename R, typename RV>			\
+	 inline typename detail::IfConcrete<V, Node<Ref<V>, typename detail::Operand<R>::type> >::type \
+	 operator op(V const & a, Expr<R, RV> const & b)		\
+	    { return Ref<V>(a) op b.self(); }
+
+	 ARDA_MATH_LAZY_ELEMENTWISE(+, Sum)
+	 ARDA_MATH_LAZY_ELEMENTWISE(-, Difference)
+
+#undef ARDA_MATH_LAZY_ELEMENTWISE
+
+	 template <typename E, typename V, typename S>
+	 inline typename detail::IfScalar<S, Scaled<typename detail::Operand<E>::type, S> >::type
+	 operator*(Expr<E, V> const & a, S const s)
+	    { return Scaled<typename detail::Operand<E>::type, S>(detail::Operand<E>::get(a.self()), s); }
+
+	 template <typename E, typename V, typename S>
+	 inline typename detail::IfScalar<S, Scaled<typename detail::Operand<E>::type, S> >::type
+	 operator*(S const s, Expr<E, V> const & a)
+	    { return a * s; }
+
+	 template <typename E, typename V, typename S>
+	 inline typename detail::IfScalar<S, Quotient<typename detail::Operand<E>::type, S> >::type
+	 operator/(Expr<E, V> const & a, S const s)
+	    { return Quotient<typename detail::Operand<E>::type, S>(detail::Operand<E>::get(a.self()), s); }
+
+	 template <typename L, typename LV, typename R, typename RV>
+	 inline typename detail::Product<L, R>::type operator*(Expr<L, LV> const & a, Expr<R, RV> const & b)
+	    { return typename detail::Product<L, R>::type(a.self(), b.self()); }
+
+	 template <typename L, typename LV, typename V>
+	 inline typename detail::ProductRight<L, V>::type
+	 operator*(Expr<L, LV> const & a, V const & b)
+	    { return a.self() * Ref<V>(b); }
+
+	 template <typename V, typename R, typename RV>
+	 inline typename detail::ProductLeft<V, R>::type
+	 operator*(V const & a, Expr<R, RV> const & b)
+	    { return Ref<V>(a) * b.self(); }
+	 } // namespace lazy
+      } // namespace Math
+   } // namespace arda
+
+#endif // LAZY_H_
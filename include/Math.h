@@ -3,7 +3,19 @@
 
 #include "Vector.h"
 #include "Matrix.h"
+#include "Simd.h"
+#include "Lazy.h"
+#include "Quaternion.h"
+#include "DualQuaternion.h"
 #include "Transform.h"
+#include "Hierarchy.h"
+#include "Fast.h"
+#include "Batch.h"
+#include "SoA.h"
+#include "Bounds.h"
+#include "Frustum.h"
+#include "Packet.h"
+#include "Ray.h"
 
 ///////////////////////////////////////////////////////////////////////////////////
 // Notes for improvement
@@ -36,101 +48,319 @@ namespace arda
       // * *=
       //     Defined for Vector * Matrix and Matrix * Vector, but these
       //     operators are not part of the class.  They are defined independently.
+      //     The sizes just have to match: a Vector3 times a 3x4 Matrix is a
+      //     Vector4, and a 3x4 Matrix times a Vector4 is a Vector3.
       //
 
-      // Vector2 * Matrix22
-      template <typename T> 
-      inline Vector2<T>& operator*=(Vector2<T>  & v, 
-				    Matrix22<T> const & m)
+      namespace detail
+	 {
+	 // Element I of v * m, the dot product of v and column I of m.
+	 template <unsigned int I, typename T, unsigned int R, unsigned int C, unsigned int... J>
+	 inline constexpr T vector_matrix_element(Vector<T, R> const & v, Matrix<T, R, C> const & m,
+						  std::integer_sequence<unsigned int, J...>)
+	    { return (... + (v.template get<J>() * m[I*R + J])); }
+
+	 template <typename T, unsigned int R, unsigned int C, unsigned int... I>
+	 inline constexpr Vector<T, C> vector_matrix(Vector<T, R> const & v, Matrix<T, R, C> const & m,
+						     std::integer_sequence<unsigned int, I...>)
+	    { return Vector<T, C>(vector_matrix_element<I>(v, m, Indices<R>())...); }
+
+	 // Element J of m * v, the sum of the columns of m weighted by v.
+	 template <unsigned int J, typename T, unsigned int R, unsigned int C, unsigned int... I>
+	 inline constexpr T matrix_vector_element(Matrix<T, R, C> const & m, Vector<T, C> const & v,
+						  std::integer_sequence<unsigned int, I...>)
+	    { return (... + (m[I*R + J] * v.template get<I>())); }
+
+	 template <typename T, unsigned int R, unsigned int C, unsigned int... J>
+	 inline constexpr Vector<T, R> matrix_vector(Matrix<T, R, C> const & m, Vector<T, C> const & v,
+						     std::integer_sequence<unsigned int, J...>)
+	    { return Vector<T, R>(matrix_vector_element<J>(m, v, Indices<C>())...); }
+	 } // namespace detail
+
+      // Vector * Matrix
+      // *= is for square matrices.  * of a square matrix is done with *=, so
+      // that the SIMD specializations of *= (below) apply to both.
+      template <typename T, unsigned int N> 
+      inline Vector<T, N>& operator*=(Vector<T, N> & v, 
+				      Matrix<T, N, N> const & m)
 	 {
-	 Vector2<T> vres(0);
-	 vres[0] = v[0]*m[0] + v[1]*m[1];
-	 vres[1] = v[0]*m[2] + v[1]*m[3];
-	 v = vres;
+	 v = detail::vector_matrix(v, m, detail::Indices<N>());
 	 return v;
 	 }
 
-      template <typename T> 
-      inline Vector2<T> operator*(Vector2<T>  const & v,
-				  Matrix22<T> const & m)
-	 { return Vector2<T>(v) *= m; }
+      template <typename T, unsigned int R, unsigned int C> 
+      inline Vector<T, C> operator*(Vector<T, R> const & v,
+				    Matrix<T, R, C> const & m)
+	 {
+	 if constexpr (R == C)
+	    { Vector<T, C> vres(v); return vres *= m; }
+	 else
+	    return detail::vector_matrix(v, m, detail::Indices<C>());
+	 }
 
+      // Matrix * Vector
       // Note: can't define Matrix *= Vector since the result is a Vector.
-      template <typename T> 
-      inline Vector2<T> operator*(Matrix22<T> const & m,
-				  Vector2<T>  const & v)
+      template <typename T, unsigned int R, unsigned int C> 
+      inline Vector<T, R> operator*(Matrix<T, R, C> const & m,
+				    Vector<T, C> const & v)
 	 { 
-	 Vector2<T> vres(0);
-	 vres[0] = m[0]*v[0] + m[2]*v[1];
-	 vres[1] = m[1]*v[0] + m[3]*v[1];
+	 return detail::matrix_vector(m, v, detail::Indices<R>());
+	 }
+
+#if defined(ARDA_MATH_SSE2)
+      //////////////////////////////////////////////////////////////////////////
+      // SIMD specializations of the Vector / Matrix products for float and
+      // double.
+      //
+      // Matrix * Vector is the sum of the matrix columns weighted by the
+      // vector elements, done with broadcasts.  Vector * Matrix is the dot
+      // product of the vector with each column; the per column products are
+      // transposed so that those sums are also done vertically.  Either way
+      // the terms are added in the same order as the generic versions above,
+      // so the results are the same.  The 3D float versions load and store
+      // exactly 3 elements.
+      //
+      // These rely on the vector elements being contiguous, in order.
+
+      static_assert(sizeof(Vector2<float>) == 2*sizeof(float) &&
+		    sizeof(Vector3<float>) == 3*sizeof(float) &&
+		    sizeof(Vector4<float>) == 4*sizeof(float) &&
+		    sizeof(Vector2<double>) == 2*sizeof(double) &&
+		    sizeof(Vector3<double>) == 3*sizeof(double) &&
+		    sizeof(Vector4<double>) == 4*sizeof(double),
+		    "Vector elements must be tightly packed for the SIMD code");
+
+      ////////////////////////////////////////
+      // Vector2 * Matrix22
+      template <> 
+      inline Vector2<float>& operator*=(Vector2<float> & v, 
+					Matrix22<float> const & m)
+	 {
+	 __m128 const vv = simd::load2(&v.x);
+	 __m128 const p = _mm_mul_ps(_mm_shuffle_ps(vv, vv, _MM_SHUFFLE(1,0,1,0)),
+				     _mm_loadu_ps(m.m));
+	 simd::store2(&v.x, _mm_add_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2,0,2,0)),
+				       _mm_shuffle_ps(p, p, _MM_SHUFFLE(3,1,3,1))));
+	 return v;
+	 }
+
+      template <> 
+      inline Vector2<float> operator*(Matrix22<float> const & m,
+				      Vector2<float>  const & v)
+	 { 
+	 Vector2<float> vres;
+	 __m128 const vv = simd::load2(&v.x);
+	 __m128 const p = _mm_mul_ps(_mm_loadu_ps(m.m),
+				     _mm_shuffle_ps(vv, vv, _MM_SHUFFLE(1,1,0,0)));
+	 simd::store2(&vres.x, _mm_add_ps(p, _mm_movehl_ps(p, p)));
+	 return vres;
+	 }
+
+      template <> 
+      inline Vector2<double>& operator*=(Vector2<double> & v, 
+					 Matrix22<double> const & m)
+	 {
+	 __m128d const vv = _mm_loadu_pd(&v.x);
+	 __m128d const p0 = _mm_mul_pd(vv, _mm_loadu_pd(m.m));
+	 __m128d const p1 = _mm_mul_pd(vv, _mm_loadu_pd(m.m + 2));
+	 _mm_storeu_pd(&v.x, _mm_add_pd(_mm_unpacklo_pd(p0, p1), _mm_unpackhi_pd(p0, p1)));
+	 return v;
+	 }
+
+      template <> 
+      inline Vector2<double> operator*(Matrix22<double> const & m,
+				       Vector2<double>  const & v)
+	 { 
+	 Vector2<double> vres;
+	 __m128d r = _mm_mul_pd(_mm_loadu_pd(m.m), _mm_set1_pd(v.x));
+	 r = _mm_add_pd(r, _mm_mul_pd(_mm_loadu_pd(m.m + 2), _mm_set1_pd(v.y)));
+	 _mm_storeu_pd(&vres.x, r);
 	 return vres;
 	 }
 
       ////////////////////////////////////////
       // Vector3 * Matrix33
-      template <typename T> 
-      inline Vector3<T>& operator*=(Vector3<T>  & v, 
-				    Matrix33<T> const & m)
+      template <> 
+      inline Vector3<float>& operator*=(Vector3<float> & v, 
+					Matrix33<float> const & m)
 	 {
-	 Vector3<T> vres(0);
-	 vres[0] = v[0]*m[0] + v[1]*m[1] + v[2]*m[2];
-	 vres[1] = v[0]*m[3] + v[1]*m[4] + v[2]*m[5];
-	 vres[2] = v[0]*m[6] + v[1]*m[7] + v[2]*m[8];
-	 v = vres;
+	 // Lane 3 of the columns may hold the next column's data, but the
+	 // products from lane 3 all end up in p3 which is ignored.
+	 __m128 const vv = simd::load3(&v.x);
+	 __m128 p0 = _mm_mul_ps(vv, _mm_loadu_ps(m.m));
+	 __m128 p1 = _mm_mul_ps(vv, _mm_loadu_ps(m.m + 3));
+	 __m128 p2 = _mm_mul_ps(vv, simd::load3(m.m + 6));
+	 __m128 p3 = _mm_setzero_ps();
+	 _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	 simd::store3(&v.x, _mm_add_ps(_mm_add_ps(p0, p1), p2));
 	 return v;
 	 }
 
-      template <typename T> 
-      inline Vector3<T> operator*(Vector3<T>  const & v,
-				  Matrix33<T> const & m)
-	 { return Vector3<T>(v) *= m; }
+      template <> 
+      inline Vector3<float> operator*(Matrix33<float> const & m,
+				      Vector3<float>  const & v)
+	 { 
+	 Vector3<float> vres;
+	 __m128 r = _mm_mul_ps(_mm_loadu_ps(m.m), _mm_set1_ps(v.x));
+	 r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m.m + 3), _mm_set1_ps(v.y)));
+	 r = _mm_add_ps(r, _mm_mul_ps(simd::load3(m.m + 6), _mm_set1_ps(v.z)));
+	 simd::store3(&vres.x, r);
+	 return vres;
+	 }
 
-      // Matrix * Vector
-      // Note: can't define Matrix *= Vector since the result is a Vector.
-      template <typename T> 
-      inline Vector3<T> operator*(Matrix33<T> const & m,
-				  Vector3<T>  const & v)
+      template <> 
+      inline Vector3<double>& operator*=(Vector3<double> & v, 
+					 Matrix33<double> const & m)
+	 {
+	 // Elements 0 and 1 of the result together, element 2 on its own.
+	 __m128d const v0 = _mm_set1_pd(v.x);
+	 __m128d const v1 = _mm_set1_pd(v.y);
+	 __m128d const v2 = _mm_set1_pd(v.z);
+	 __m128d const c0 = _mm_loadu_pd(m.m);
+	 __m128d const c1 = _mm_loadu_pd(m.m + 3);
+	 __m128d r = _mm_mul_pd(v0, _mm_unpacklo_pd(c0, c1));
+	 r = _mm_add_pd(r, _mm_mul_pd(v1, _mm_unpackhi_pd(c0, c1)));
+	 r = _mm_add_pd(r, _mm_mul_pd(v2, _mm_loadh_pd(_mm_load_sd(m.m + 2), m.m + 5)));
+	 v.z = v.x*m.m[6] + v.y*m.m[7] + v.z*m.m[8];
+	 _mm_storeu_pd(&v.x, r);
+	 return v;
+	 }
+
+      template <> 
+      inline Vector3<double> operator*(Matrix33<double> const & m,
+				       Vector3<double>  const & v)
 	 { 
-	 Vector3<T> vres(0);
-	 vres[0] = m[0]*v[0] + m[3]*v[1] + m[6]*v[2];
-	 vres[1] = m[1]*v[0] + m[4]*v[1] + m[7]*v[2];
-	 vres[2] = m[2]*v[0] + m[5]*v[1] + m[8]*v[2];
+	 Vector3<double> vres;
+	 __m128d const v0 = _mm_set1_pd(v.x);
+	 __m128d const v1 = _mm_set1_pd(v.y);
+	 __m128d const v2 = _mm_set1_pd(v.z);
+	 __m128d lo = _mm_mul_pd(_mm_loadu_pd(m.m), v0);
+	 __m128d hi = _mm_mul_sd(_mm_load_sd(m.m + 2), v0);
+	 lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(m.m + 3), v1));
+	 hi = _mm_add_sd(hi, _mm_mul_sd(_mm_load_sd(m.m + 5), v1));
+	 lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(m.m + 6), v2));
+	 hi = _mm_add_sd(hi, _mm_mul_sd(_mm_load_sd(m.m + 8), v2));
+	 _mm_storeu_pd(&vres.x, lo);
+	 _mm_store_sd(&vres.z, hi);
 	 return vres;
 	 }
 
       ////////////////////////////////////////
       // Vector4 * Matrix44
-      template <typename T> 
-      inline Vector4<T>& operator*=(Vector4<T>  & v, 
-				    Matrix44<T> const & m)
+      template <> 
+      inline Vector4<float>& operator*=(Vector4<float> & v, 
+					Matrix44<float> const & m)
+	 {
+	 __m128 const vv = _mm_loadu_ps(&v.x);
+	 __m128 p0 = _mm_mul_ps(vv, _mm_loadu_ps(m.m));
+	 __m128 p1 = _mm_mul_ps(vv, _mm_loadu_ps(m.m + 4));
+	 __m128 p2 = _mm_mul_ps(vv, _mm_loadu_ps(m.m + 8));
+	 __m128 p3 = _mm_mul_ps(vv, _mm_loadu_ps(m.m + 12));
+	 _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	 _mm_storeu_ps(&v.x, _mm_add_ps(_mm_add_ps(_mm_add_ps(p0, p1), p2), p3));
+	 return v;
+	 }
+
+      template <> 
+      inline Vector4<float> operator*(Matrix44<float> const & m,
+				      Vector4<float>  const & v)
+	 { 
+	 Vector4<float> vres;
+	 __m128 const vv = _mm_loadu_ps(&v.x);
+	 __m128 r = _mm_mul_ps(_mm_loadu_ps(m.m), _mm_shuffle_ps(vv, vv, 0x00));
+	 r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m.m + 4), _mm_shuffle_ps(vv, vv, 0x55)));
+	 r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m.m + 8), _mm_shuffle_ps(vv, vv, 0xAA)));
+	 r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m.m + 12), _mm_shuffle_ps(vv, vv, 0xFF)));
+	 _mm_storeu_ps(&vres.x, r);
+	 return vres;
+	 }
+
+#if defined(ARDA_MATH_AVX)
+      template <> 
+      inline Vector4<double>& operator*=(Vector4<double> & v, 
+					 Matrix44<double> const & m)
 	 {
-	 Vector4<T> vres(0);
-	 vres[0] = v[0]*m[0] + v[1]*m[1] + v[2]*m[2] + v[3]*m[3];
-	 vres[1] = v[0]*m[4] + v[1]*m[5] + v[2]*m[6] + v[3]*m[7];
-	 vres[2] = v[0]*m[8] + v[1]*m[9] + v[2]*m[10] + v[3]*m[11];
-	 vres[3] = v[0]*m[12] + v[1]*m[13] + v[2]*m[14] + v[3]*m[15];
-	 v = vres;
+	 __m256d const vv = _mm256_loadu_pd(&v.x);
+	 __m256d const p0 = _mm256_mul_pd(vv, _mm256_loadu_pd(m.m));
+	 __m256d const p1 = _mm256_mul_pd(vv, _mm256_loadu_pd(m.m + 4));
+	 __m256d const p2 = _mm256_mul_pd(vv, _mm256_loadu_pd(m.m + 8));
+	 __m256d const p3 = _mm256_mul_pd(vv, _mm256_loadu_pd(m.m + 12));
+	 __m256d const t0 = _mm256_unpacklo_pd(p0, p1);
+	 __m256d const t1 = _mm256_unpackhi_pd(p0, p1);
+	 __m256d const t2 = _mm256_unpacklo_pd(p2, p3);
+	 __m256d const t3 = _mm256_unpackhi_pd(p2, p3);
+	 __m256d r = _mm256_permute2f128_pd(t0, t2, 0x20);
+	 r = _mm256_add_pd(r, _mm256_permute2f128_pd(t1, t3, 0x20));
+	 r = _mm256_add_pd(r, _mm256_permute2f128_pd(t0, t2, 0x31));
+	 r = _mm256_add_pd(r, _mm256_permute2f128_pd(t1, t3, 0x31));
+	 _mm256_storeu_pd(&v.x, r);
 	 return v;
 	 }
 
-      template <typename T> 
-      inline Vector4<T> operator*(Vector4<T>  const & v,
-				  Matrix44<T> const & m)
-	 { return Vector4<T>(v) *= m; }
+      template <> 
+      inline Vector4<double> operator*(Matrix44<double> const & m,
+				       Vector4<double>  const & v)
+	 { 
+	 Vector4<double> vres;
+	 __m256d r = _mm256_mul_pd(_mm256_loadu_pd(m.m), _mm256_broadcast_sd(&v.x));
+	 r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m.m + 4), _mm256_broadcast_sd(&v.y)));
+	 r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m.m + 8), _mm256_broadcast_sd(&v.z)));
+	 r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m.m + 12), _mm256_broadcast_sd(&v.w)));
+	 _mm256_storeu_pd(&vres.x, r);
+	 return vres;
+	 }
+#else
+      template <> 
+      inline Vector4<double>& operator*=(Vector4<double> & v, 
+					 Matrix44<double> const & m)
+	 {
+	 // Two result elements at a time; unpacking the low and high halves of
+	 // a pair of columns gives the matching pairs of row elements.
+	 __m128d const v0 = _mm_set1_pd(v.x);
+	 __m128d const v1 = _mm_set1_pd(v.y);
+	 __m128d const v2 = _mm_set1_pd(v.z);
+	 __m128d const v3 = _mm_set1_pd(v.w);
+	 __m128d r[2];
+	 int i;
+	 for (i=0; i<2; ++i)
+	    {
+	    double const * c = m.m + 8*i;
+	    __m128d const lo0 = _mm_loadu_pd(c),     hi0 = _mm_loadu_pd(c + 2);
+	    __m128d const lo1 = _mm_loadu_pd(c + 4), hi1 = _mm_loadu_pd(c + 6);
+	    r[i] = _mm_mul_pd(v0, _mm_unpacklo_pd(lo0, lo1));
+	    r[i] = _mm_add_pd(r[i], _mm_mul_pd(v1, _mm_unpackhi_pd(lo0, lo1)));
+	    r[i] = _mm_add_pd(r[i], _mm_mul_pd(v2, _mm_unpacklo_pd(hi0, hi1)));
+	    r[i] = _mm_add_pd(r[i], _mm_mul_pd(v3, _mm_unpackhi_pd(hi0, hi1)));
+	    }
+	 _mm_storeu_pd(&v.x, r[0]);
+	 _mm_storeu_pd(&v.z, r[1]);
+	 return v;
+	 }
 
-      // Matrix * Vector
-      // Note: can't define Matrix *= Vector since the result is a Vector.
-      template <typename T> 
-      inline Vector4<T> operator*(Matrix44<T> const & m,
-				  Vector4<T>  const & v)
+      template <> 
+      inline Vector4<double> operator*(Matrix44<double> const & m,
+				       Vector4<double>  const & v)
 	 { 
-	 Vector4<T> vres(0);
-	 vres[0] = m[0]*v[0] + m[4]*v[1] + m[8]*v[2] + m[12]*v[3];
-	 vres[1] = m[1]*v[0] + m[5]*v[1] + m[9]*v[2] + m[13]*v[3];
-	 vres[2] = m[2]*v[0] + m[6]*v[1] + m[10]*v[2] + m[14]*v[3];
-	 vres[3] = m[3]*v[0] + m[7]*v[1] + m[11]*v[2] + m[15]*v[3];
+	 Vector4<double> vres;
+	 __m128d const v0 = _mm_set1_pd(v.x);
+	 __m128d const v1 = _mm_set1_pd(v.y);
+	 __m128d const v2 = _mm_set1_pd(v.z);
+	 __m128d const v3 = _mm_set1_pd(v.w);
+	 __m128d lo = _mm_mul_pd(_mm_loadu_pd(m.m), v0);
+	 __m128d hi = _mm_mul_pd(_mm_loadu_pd(m.m + 2), v0);
+	 lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(m.m + 4), v1));
+	 hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(m.m + 6), v1));
+	 lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(m.m + 8), v2));
+	 hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(m.m + 10), v2));
+	 lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(m.m + 12), v3));
+	 hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(m.m + 14), v3));
+	 _mm_storeu_pd(&vres.x, lo);
+	 _mm_storeu_pd(&vres.z, hi);
 	 return vres;
 	 }
+#endif // ARDA_MATH_AVX
+
+#endif // ARDA_MATH_SSE2
 
       //////////////////////////////////////////////////////////////////////////
 
@@ -2,6 +2,7 @@
 #define MATRIX_H_
 
 #include "Vector.h"
+#include "Simd.h"
 
 #include <cmath>
 #include <cstring>
@@ -31,7 +32,9 @@ namespace arda
       // * *= / /=
       //     Defined for scalar multiplication/division with int, float, and double.
       //     * is defined as a standalone template operator for the scalar * Matrix
-      //     form.
+      //     form.  As with Vector, float and double matrices are scaled in their
+      //     own precision and int matrices in the scalar's; see ScalarPrecision
+      //     in Vector.h.
       // * *=
       //     Also defined for Matrix * Matrix
       //
@@ -43,6 +46,26 @@ namespace arda
       //                   specific values.
       // setidentity()     Sets a matrix to the identity matrix.
       //
+      // getrow()/setrow() Same as getcol()/setcol(), for rows.
+      //
+      // All of these are defined once, on Matrix<T, R, C>, which is R rows by
+      // C columns; the element loops are unrolled at compile time.  Products
+      // are defined for any sizes that match, e.g. a 3x4 times a 4x3 gives a
+      // 3x3, and *= is for square matrices only.  Matrix22, Matrix33, and
+      // Matrix44 are aliases for the square sizes.
+      //
+      // Matrix34 is not Matrix<T, 3, 4>: it is a Matrix44 with the bottom row
+      // 0 0 0 1 implied, for affine transforms; see below.
+      // TaggedMatrix44 is a Matrix44 that knows whether it is a translation,
+      // rotation, etc., so products and inverses can take shortcuts; see
+      // below.
+      //
+      // The constructors, operators, and setidentity(), as well as det() and
+      // transpose() below, are constexpr, so constant matrices can be built
+      // at compile time.  The exceptions are the float and double Matrix44
+      // products and the float Matrix34 product when SIMD is enabled, which
+      // are hand vectorized specializations.
+      //
       //
       //
       // The following are functions, not class methods.  This is because I think
@@ -52,406 +75,399 @@ namespace arda
       //
       // det()             Calculates the determinant of a matrix.
       // transpose()       Returns the transpose of a matrix.
+      // inverse()         Returns the inverse of a matrix.
+      // try_inverse()     Inverse that reports a singular matrix instead of
+      //                   dividing by zero.
       
       //////////////////////////////////////////////////////////////////////////
-      template <typename T> 
-      class Matrix22
+      namespace detail
 	 {
+	 // The R*C elements of a Matrix<T, R, C>, with a constructor that
+	 // takes all of them (see Vector.h for Indices and Repeat).
+	 template <typename T, unsigned int N, typename = Indices<N> >
+	 struct MatrixElements;
+
+	 template <typename T, unsigned int N, unsigned int... I>
+	 struct MatrixElements<T, N, std::integer_sequence<unsigned int, I...> >
+	    {
+	    T m[N];
+
+	    MatrixElements() {}
+	    constexpr MatrixElements(typename Repeat<T, I>::type... a) : m{a...} {}
+	    };
+	 } // namespace detail
+
+      template <typename T, unsigned int R, unsigned int C> 
+      class Matrix : public detail::MatrixElements<T, R * C>
+	 {
+	 static_assert(R >= 2 && C >= 2, "Matrix needs at least 2 rows and 2 columns");
+
 	 public:
-	 T m[4];
+	 using detail::MatrixElements<T, R * C>::m;
 
 	 // Constructors
-	 Matrix22() {}
-	 explicit Matrix22(T a) { m[0] = m[1] = m[2] = m[3] = a; }
-	 Matrix22(T a0, T a1, T a2, T a3) 
-	    { 
-	    m[0] = a0; m[2] = a2;
-	    m[1] = a1; m[3] = a3; 
-	    } 
+	 Matrix() {}
+	 explicit constexpr Matrix(T a) : Matrix(a, detail::Indices<R * C>()) {}
+	 // Matrix(T a0, ..., T aRC-1), in column major order.
+	 using detail::MatrixElements<T, R * C>::MatrixElements;
 
 	 // Array indexing
 	 // Remember: column major order is used.
-	 inline T& operator[](unsigned int const i) 
-	    { assert (i<4); return m[i]; }
-	 inline T operator[](unsigned int const i) const
-	    { assert (i<4); return m[i]; }
+	 inline constexpr T& operator[](unsigned int const i) 
+	    { assert (i<R*C); return m[i]; }
+	 inline constexpr T operator[](unsigned int const i) const
+	    { assert (i<R*C); return m[i]; }
 
 	 // Assignment
-	 inline Matrix22<T>& operator=(Matrix22<T> const & m2)
-	    { 
-	    m[0] = m2[0]; m[2] = m2[2]; 
-	    m[1] = m2[1]; m[3] = m2[3]; 
-	    return *this;
-	    }
-	 inline Matrix22<T>& assign(T const a0, T const a1, 
-				    T const a2, T const a3)
-	    { 
-	    m[0] = a0; m[2] = a2;
-	    m[1] = a1; m[3] = a3; 
-	    return *this;
+	 // Takes R*C values, in column major order.
+	 template <typename... A>
+	 inline constexpr Matrix<T, R, C>& assign(A const... a)
+	    {
+	    static_assert(sizeof...(A) == R * C, "assign() takes one value per element");
+	    return *this = Matrix<T, R, C>(a...);
 	    }
 
 	 // Comparison
-	 inline bool operator==(Matrix22<T> const & m2) const
-	    {
-	    return  
-		  m[0] == m2[0] && m[2] == m2[2] &&
-		  m[1] == m2[1] && m[3] == m2[3]; 
-	    }
-	 inline bool operator!=(Matrix22<T> const & m2) const
-	    { return ! (*this == m2); } 
+	 inline constexpr bool operator==(Matrix<T, R, C> const & m2) const
+	    { return equal(m2, detail::Indices<R * C>()); }
+	 inline constexpr bool operator!=(Matrix<T, R, C> const & m2) const
+	    { return ! (*this == m2); }
 
 	 // Matrix addition
-	 inline Matrix22<T>& operator+=(Matrix22<T> const & m2)
-	    {
-	    m[0] += m2[0]; m[2] += m2[2]; 
-	    m[1] += m2[1]; m[3] += m2[3];
-	    return *this;
-	    }
-	 inline Matrix22<T> operator+(Matrix22<T> const & m2) const
-	    { return Matrix22<T>(*this) += m2; }
+	 inline constexpr Matrix<T, R, C>& operator+=(Matrix<T, R, C> const & m2)
+	    { return add(m2, detail::Indices<R * C>()); }
+	 inline constexpr Matrix<T, R, C> operator+(Matrix<T, R, C> const & m2) const
+	    { return Matrix<T, R, C>(*this) += m2; }
 
 	 // Matrix subtraction
-	 inline Matrix22<T>& operator-=(Matrix22<T> const & m2)
-	    {
-	    m[0] -= m2[0]; m[2] -= m2[2]; 
-	    m[1] -= m2[1]; m[3] -= m2[3];
-	    return *this;
-	    }
-	 inline Matrix22<T> operator-(Matrix22<T> const & m2) const
-	    { return Matrix22<T>(*this) -= m2; }
-      
+	 inline constexpr Matrix<T, R, C>& operator-=(Matrix<T, R, C> const & m2)
+	    { return subtract(m2, detail::Indices<R * C>()); }
+	 inline constexpr Matrix<T, R, C> operator-(Matrix<T, R, C> const & m2) const
+	    { return Matrix<T, R, C>(*this) -= m2; }
+
 	 // Scalar multiplication
-	 inline Matrix22<T>& operator*=(int const a)
-	    {
-	    m[0] *= a; m[2] *= a;
-	    m[1] *= a; m[3] *= a;
-	    return *this;
-	    }
-	 inline Matrix22<T>& operator*=(float const a)
-	    {
-	    m[0] *= a; m[2] *= a;
-	    m[1] *= a; m[3] *= a;
-	    return *this;
-	    }
-	 inline Matrix22<T>& operator*=(double const a)
-	    {
-	    m[0] *= a; m[2] *= a;
-	    m[1] *= a; m[3] *= a;
-	    return *this;
-	    }
+	 inline constexpr Matrix<T, R, C>& operator*=(int const a)
+	    { return multiply(a, detail::Indices<R * C>()); }
+	 inline constexpr Matrix<T, R, C>& operator*=(float const a)
+	    { return multiply(a, detail::Indices<R * C>()); }
+	 inline constexpr Matrix<T, R, C>& operator*=(double const a)
+	    { return multiply(a, detail::Indices<R * C>()); }
 
 	 // Scalar division
-	 inline Matrix22<T>& operator/=(int const a)
-	    {
-	    assert(a!=0);
-	    m[0] /= a; m[2] /= a;
-	    m[1] /= a; m[3] /= a;
-	    return *this;
-	    }
-	 inline Matrix22<T>& operator/=(float const a)
+	 inline constexpr Matrix<T, R, C>& operator/=(int const a)
+	    { assert(a!=0); return divide(a, detail::Indices<R * C>()); }
+	 inline constexpr Matrix<T, R, C>& operator/=(float const a)
+	    { assert(a!=0); return divide(a, detail::Indices<R * C>()); }
+	 inline constexpr Matrix<T, R, C>& operator/=(double const a)
+	    { assert(a!=0); return divide(a, detail::Indices<R * C>()); }
+	 inline constexpr Matrix<T, R, C> operator/(int const a) const
+	    { return Matrix<T, R, C>(*this) /= a; }
+	 inline constexpr Matrix<T, R, C> operator/(float const a) const
+	    { return Matrix<T, R, C>(*this) /= a; }
+	 inline constexpr Matrix<T, R, C> operator/(double const a) const
+	    { return Matrix<T, R, C>(*this) /= a; }
+
+	 // Matrix multiplication
+	 // *= is for square matrices.  * of square matrices is done with *=,
+	 // so that the SIMD specializations of *= (below) apply to both.
+	 inline constexpr Matrix<T, R, C>& operator*=(Matrix<T, R, C> const & m2)
 	    {
-	    assert(a!=0);
-	    m[0] /= a; m[2] /= a;
-	    m[1] /= a; m[3] /= a;
-	    return *this;
+	    static_assert(R == C, "*= needs square matrices");
+	    return *this = product(m2, detail::Indices<R * C>());
 	    }
-	 inline Matrix22<T>& operator/=(double const a)
+	 template <unsigned int K>
+	 inline constexpr Matrix<T, R, K> operator*(Matrix<T, C, K> const & m2) const
 	    {
-	    assert(a!=0);
-	    m[0] /= a; m[2] /= a;
-	    m[1] /= a; m[3] /= a;
-	    return *this;
-	    }
-	 inline Matrix22<T> operator/(int const a)
-	    { return Matrix22<T>(*this) /= a; }
-	 inline Matrix22<T> operator/(float const a)
-	    { return Matrix22<T>(*this) /= a; }
-	 inline Matrix22<T> operator/(double const a)
-	    { return Matrix22<T>(*this) /= a; }
-
-	 // Matrix multiplication
-	 // Not sure if this should be inlined at all.  Sure the compiler will
-	 // probably ignore the inline request here, but maybe it won't and maybe
-	 // that would be bad.  Needs real testing.
-	 inline Matrix22<T>& operator*=(Matrix22<T> const & m2)
-	    {
-	    const int size=2;
-	    Matrix22<T> mres(0);
-	    int i, j, k;
-	    for (i=0; i<size; ++i)
-	       for (j=0; j<size; ++j)
-		  for (k=0; k<size; ++k)
-		     mres[size*i+j] += (*this)[size*k+j] * m2[size*i+k];
-	    *this = mres;
-	    return *this;
+	    if constexpr (R == C && C == K)
+	       return Matrix<T, R, C>(*this) *= m2;
+	    else
+	       return product(m2, detail::Indices<R * K>());
 	    }
-	 inline Matrix22<T> operator*(Matrix22<T> const & m2) const
-	    { return Matrix22<T>(*this) *= m2; }
-
 
-	 inline Vector2<T> getcol(unsigned int const i) const
+	 inline constexpr Vector<T, R> getcol(unsigned int const i) const
 	    {
-	    assert(i<2);
-	    int const size=2;
-	    return Vector2<T>(m[i*size], m[i*size+1]);
+	    assert(i<C);
+	    return column(i, detail::Indices<R>());
 	    }
 
-	 inline Vector2<T> getrow(unsigned int const i) const
+	 inline constexpr Vector<T, C> getrow(unsigned int const i) const
 	    {
-	    assert(i<2);
-	    int const size=2;
-	    return Vector2<T>(m[i], m[i+size]);
+	    assert(i<R);
+	    return row(i, detail::Indices<C>());
 	    }
 	 
-	 inline Matrix22<T>& setcol(unsigned int const i, Vector2<T> const & v)
+	 inline constexpr Matrix<T, R, C>& setcol(unsigned int const i, Vector<T, R> const & v)
 	    {
-	    assert(i<2);
-	    int const size=2;
-	    m[i*size] = v[0];
-	    m[i*size+1] = v[1];
-	    return *this;
+	    assert(i<C);
+	    return set_column(i, v, detail::Indices<R>());
 	    }
 
-	 inline Matrix22<T>& setcol(unsigned int const i, T const a, T const b)
+	 // Takes R values.
+	 template <typename... A>
+	 inline constexpr Matrix<T, R, C>& setcol(unsigned int const i, A const... a)
 	    {
-	    assert(i<2);
-	    const int size=2;
-	    m[i*size] = a;
-	    m[i*size+1] = b;
-	    return *this;
+	    static_assert(sizeof...(A) == R, "setcol() takes one value per row");
+	    return setcol(i, Vector<T, R>(a...));
 	    }
 
-	 inline Matrix22<T>& setrow(unsigned int const i, Vector2<T> const & v)
+	 inline constexpr Matrix<T, R, C>& setrow(unsigned int const i, Vector<T, C> const & v)
 	    {
-	    assert(i<2);
-	    int const size=2;
-	    m[i] = v[0];
-	    m[i+size] = v[1];
-	    return *this;
+	    assert(i<R);
+	    return set_row(i, v, detail::Indices<C>());
 	    }
 
-	 inline Matrix22<T>& setrow(unsigned int const i, T const a, T const b)
+	 // Takes C values.
+	 template <typename... A>
+	 inline constexpr Matrix<T, R, C>& setrow(unsigned int const i, A const... a)
 	    {
-	    assert(i<2);
-	    int const size=2;
-	    m[i] = a;
-	    m[i+size] = b;
-	    return *this;
+	    static_assert(sizeof...(A) == C, "setrow() takes one value per column");
+	    return setrow(i, Vector<T, C>(a...));
 	    }
 
 	 std::string to_string(void) const;
 
-	 inline Matrix22<T>& setidentity()
+	 // Ones on the diagonal, zeros elsewhere.
+	 inline constexpr Matrix<T, R, C>& setidentity()
+	    { return *this = identity(detail::Indices<R * C>()); }
+
+	 private:
+	 // The unrolled element loops.  Element E is at row E % R and column
+	 // E / R.
+	 template <unsigned int... E>
+	 constexpr Matrix(T a, std::integer_sequence<unsigned int, E...>)
+	    : detail::MatrixElements<T, R * C>(((void) E, a)...) {}
+
+	 template <unsigned int... E>
+	 inline constexpr bool equal(Matrix<T, R, C> const & m2, std::integer_sequence<unsigned int, E...>) const
+	    { return ((m[E] == m2.m[E]) && ...); }
+	 template <unsigned int... E>
+	 inline constexpr Matrix<T, R, C>& add(Matrix<T, R, C> const & m2, std::integer_sequence<unsigned int, E...>)
+	    { ((m[E] += m2.m[E]), ...); return *this; }
+	 template <unsigned int... E>
+	 inline constexpr Matrix<T, R, C>& subtract(Matrix<T, R, C> const & m2, std::integer_sequence<unsigned int, E...>)
+	    { ((m[E] -= m2.m[E]), ...); return *this; }
+	 template <typename S, unsigned int... E>
+	 inline constexpr Matrix<T, R, C>& multiply(S const a, std::integer_sequence<unsigned int, E...>)
 	    {
-	    memset(m, 0, sizeof(m));
-	    m[0] = m[3] = T(1);
+	    typename ScalarPrecision<T, S>::type const b = (typename ScalarPrecision<T, S>::type) a;
+	    ((m[E] *= b), ...);
 	    return *this;
 	    }
-
+	 template <typename S, unsigned int... E>
+	 inline constexpr Matrix<T, R, C>& divide(S const a, std::integer_sequence<unsigned int, E...>)
+	    {
+	    typename ScalarPrecision<T, S>::type const b = (typename ScalarPrecision<T, S>::type) a;
+	    ((m[E] /= b), ...);
+	    return *this;
+	    }
+	 template <unsigned int... E>
+	 static inline constexpr Matrix<T, R, C> identity(std::integer_sequence<unsigned int, E...>)
+	    { return Matrix<T, R, C>((E % R == E / R ? T(1) : T(0))...); }
+
+	 // Row J of *this times column I of m2, summed in order.
+	 template <unsigned int J, unsigned int I, unsigned int K, unsigned int... L>
+	 inline constexpr T product_element(Matrix<T, C, K> const & m2, std::integer_sequence<unsigned int, L...>) const
+	    { return (... + (m[L*R + J] * m2.m[I*C + L])); }
+	 template <unsigned int K, unsigned int... E>
+	 inline constexpr Matrix<T, R, K> product(Matrix<T, C, K> const & m2, std::integer_sequence<unsigned int, E...>) const
+	    { return Matrix<T, R, K>(product_element<E % R, E / R>(m2, detail::Indices<C>())...); }
+
+	 template <unsigned int... J>
+	 inline constexpr Vector<T, R> column(unsigned int const i, std::integer_sequence<unsigned int, J...>) const
+	    { return Vector<T, R>(m[i*R + J]...); }
+	 template <unsigned int... I>
+	 inline constexpr Vector<T, C> row(unsigned int const j, std::integer_sequence<unsigned int, I...>) const
+	    { return Vector<T, C>(m[I*R + j]...); }
+	 template <unsigned int... J>
+	 inline constexpr Matrix<T, R, C>& set_column(unsigned int const i, Vector<T, R> const & v, std::integer_sequence<unsigned int, J...>)
+	    { ((m[i*R + J] = v.template get<J>()), ...); return *this; }
+	 template <unsigned int... I>
+	 inline constexpr Matrix<T, R, C>& set_row(unsigned int const j, Vector<T, C> const & v, std::integer_sequence<unsigned int, I...>)
+	    { ((m[I*R + j] = v.template get<I>()), ...); return *this; }
 	 };
 
       // Scalar multiplication continued
-      template <typename T> 
-      inline Matrix22<T> operator*(Matrix22<T> const & m, int const a)
-	 { return Matrix22<T>(m) *= a; }
+      template <typename T, unsigned int R, unsigned int C> 
+      inline constexpr Matrix<T, R, C> operator*(Matrix<T, R, C> const & m, int const a)
+	 { return Matrix<T, R, C>(m) *= a; }
 
-      template <typename T> 
-      inline Matrix22<T> operator*(int const a, Matrix22<T> const & m)
-	 { return Matrix22<T>(m) *= a; }
-
-      template <typename T> 
-      inline Matrix22<T> operator*(Matrix22<T> const & m, float const a)
-	 { return Matrix22<T>(m) *= a; }
+      template <typename T, unsigned int R, unsigned int C> 
+      inline constexpr Matrix<T, R, C> operator*(int const a, Matrix<T, R, C> const & m)
+	 { return Matrix<T, R, C>(m) *= a; }
 
-      template <typename T> 
-      inline Matrix22<T> operator*(float const a, Matrix22<T> const & m)
-	 { return Matrix22<T>(m) *= a; }
-
-      template <typename T> 
-      inline Matrix22<T> operator*(Matrix22<T> const & m, double const a)
-	 { return Matrix22<T>(m) *= a; }
+      template <typename T, unsigned int R, unsigned int C> 
+      inline constexpr Matrix<T, R, C> operator*(Matrix<T, R, C> const & m, float const a)
+	 { return Matrix<T, R, C>(m) *= a; }
 
-      template <typename T> 
-      inline Matrix22<T> operator*(double const a, Matrix22<T> const & m)
-	 { return Matrix22<T>(m) *= a; }
+      template <typename T, unsigned int R, unsigned int C> 
+      inline constexpr Matrix<T, R, C> operator*(float const a, Matrix<T, R, C> const & m)
+	 { return Matrix<T, R, C>(m) *= a; }
 
+      template <typename T, unsigned int R, unsigned int C> 
+      inline constexpr Matrix<T, R, C> operator*(Matrix<T, R, C> const & m, double const a)
+	 { return Matrix<T, R, C>(m) *= a; }
 
+      template <typename T, unsigned int R, unsigned int C> 
+      inline constexpr Matrix<T, R, C> operator*(double const a, Matrix<T, R, C> const & m)
+	 { return Matrix<T, R, C>(m) *= a; }
 
+      template <typename T> using Matrix22 = Matrix<T, 2, 2>;
+      template <typename T> using Matrix33 = Matrix<T, 3, 3>;
+      template <typename T> using Matrix44 = Matrix<T, 4, 4>;
 
       //////////////////////////////////////////////////////////////////////////
+      // A 4x4 affine matrix with the constant bottom row 0 0 0 1 left out:
+      // 3 rows by 4 columns, column major, so m[0..8] is the upper 3x3 (laid
+      // out as a Matrix33) and m[9..11] is the translation.  Every matrix
+      // built in Transform.h except the projections is of this form.  It is
+      // 12 values instead of 16, and the product is 36 multiplies instead of
+      // 64.
+      //
+      // Matrix34 * Matrix34 is the product of the 4x4 matrices.  Use
+      // transform_point() and transform_direction() (below) rather than a
+      // Matrix * Vector product, and to_matrix44() or the Matrix44
+      // constructor to convert; both conversions are exact.
       template <typename T> 
-      class Matrix33
+      class Matrix34
 	 {
 	 public:
-	 T m[9];
+	 T m[12];
 
 	 // Constructors
-	 Matrix33() {}
-	 explicit Matrix33(T a) 
-	    { 
-	    // TODO:  Is this really more efficient than memset?
-	    m[0] = m[1] = m[2] = m[3] = m[4] = m[5] = m[6] = m[7] = m[8] = a;
+	 Matrix34() {}
+	 explicit constexpr Matrix34(T a) 
+	    : m{a, a, a, a, a, a, a, a, a, a, a, a} {}
+	 constexpr Matrix34(T a0, T a1, T a2, 
+			    T a3, T a4, T a5, 
+			    T a6, T a7, T a8,
+			    T a9, T a10, T a11) 
+	    : m{a0, a1, a2, 
+		a3, a4, a5, 
+		a6, a7, a8,
+		a9, a10, a11} {}
+	 // The bottom row of m4 must be 0 0 0 1 (see is_affine()).
+	 explicit constexpr Matrix34(Matrix44<T> const & m4)
+	    : m{m4[0],  m4[1],  m4[2],
+		m4[4],  m4[5],  m4[6],
+		m4[8],  m4[9],  m4[10],
+		m4[12], m4[13], m4[14]}
+	    {
+	    assert(m4[3] == T(0) && m4[7] == T(0) && m4[11] == T(0) && m4[15] == T(1));
 	    }
-	 Matrix33(T a0, T a1, T a2, 
-		  T a3, T a4, T a5, 
-		  T a6, T a7, T a8) 
-	    { 
-	    m[0] = a0; m[3] = a3; m[6] = a6;
-	    m[1] = a1; m[4] = a4; m[7] = a7;
-	    m[2] = a2; m[5] = a5; m[8] = a8;
-	    } 
 
 	 // Array indexing
 	 // Remember: column major order is used.
-	 inline T& operator[](unsigned int const i) 
-	    { assert (i<9); return m[i]; }
-	 inline T operator[](unsigned int const i) const
-	    { assert (i<9); return m[i]; }
+	 inline constexpr T& operator[](unsigned int const i) 
+	    { assert (i<12); return m[i]; }
+	 inline constexpr T operator[](unsigned int const i) const
+	    { assert (i<12); return m[i]; }
 
 	 // Assignment
-	 inline Matrix33<T>& operator=(Matrix33<T> const & m2)
-	    { 
-	    m[0] = m2[0]; m[3] = m2[3]; m[6] = m2[6];
-	    m[1] = m2[1]; m[4] = m2[4]; m[7] = m2[7];
-	    m[2] = m2[2]; m[5] = m2[5]; m[8] = m2[8];
-	    return *this;
-	    }
-	 inline Matrix33<T>& assign(T const a0, T const a1, T const a2, 
+	 inline constexpr Matrix34<T>& assign(T const a0, T const a1, T const a2, 
 				    T const a3, T const a4, T const a5, 
-				    T const a6, T const a7, T const a8) 
+				    T const a6, T const a7, T const a8,
+				    T const a9, T const a10, T const a11)
 	    { 
-	    m[0] = a0; m[3] = a3; m[6] = a6;
-	    m[1] = a1; m[4] = a4; m[7] = a7;
-	    m[2] = a2; m[5] = a5; m[8] = a8;
+	    m[0] = a0; m[3] = a3; m[6] = a6; m[9] = a9;
+	    m[1] = a1; m[4] = a4; m[7] = a7; m[10] = a10;
+	    m[2] = a2; m[5] = a5; m[8] = a8; m[11] = a11;
 	    return *this;
 	    }
 
 	 // Comparison
-	 inline bool operator==(Matrix33<T> const & m2) const
+	 inline constexpr bool operator==(Matrix34<T> const & m2) const
 	    {
 	    return  
-		  m[0] == m2[0] && m[3] == m2[3] && m[6] == m2[6] &&
-		  m[1] == m2[1] && m[4] == m2[4] && m[7] == m2[7] &&
-		  m[2] == m2[2] && m[5] == m2[5] && m[8] == m2[8];
+		  m[0] == m2[0] && m[3] == m2[3] && m[6] == m2[6] && m[9] == m2[9] &&
+		  m[1] == m2[1] && m[4] == m2[4] && m[7] == m2[7] && m[10] == m2[10] &&
+		  m[2] == m2[2] && m[5] == m2[5] && m[8] == m2[8] && m[11] == m2[11];
 	    }
-	 inline bool operator!=(Matrix33<T> const & m2) const
-	    { return ! (*this == m2); } 
+	 inline constexpr bool operator!=(Matrix34<T> const & m2) const
+	    { return ! (*this == m2); }
 
 	 // Matrix addition
-	 inline Matrix33<T>& operator+=(Matrix33<T> const & m2)
+	 inline constexpr Matrix34<T>& operator+=(Matrix34<T> const & m2)
 	    {
-	    m[0] += m2[0]; m[3] += m2[3]; m[6] += m2[6];
-	    m[1] += m2[1]; m[4] += m2[4]; m[7] += m2[7];
-	    m[2] += m2[2]; m[5] += m2[5]; m[8] += m2[8];
+	    for (int i=0; i<12; ++i)
+	       m[i] += m2[i];
 	    return *this;
 	    }
-	 inline Matrix33<T> operator+(Matrix33<T> const & m2) const
-	    { return Matrix33<T>(*this) += m2; }
+	 inline constexpr Matrix34<T> operator+(Matrix34<T> const & m2) const
+	    { return Matrix34<T>(*this) += m2; }
 
 	 // Matrix subtraction
-	 inline Matrix33<T>& operator-=(Matrix33<T> const & m2)
+	 inline constexpr Matrix34<T>& operator-=(Matrix34<T> const & m2)
 	    {
-	    m[0] -= m2[0]; m[3] -= m2[3]; m[6] -= m2[6];
-	    m[1] -= m2[1]; m[4] -= m2[4]; m[7] -= m2[7];
-	    m[2] -= m2[2]; m[5] -= m2[5]; m[8] -= m2[8];
+	    for (int i=0; i<12; ++i)
+	       m[i] -= m2[i];
 	    return *this;
 	    }
-	 inline Matrix33<T> operator-(Matrix33<T> const & m2) const
-	    { return Matrix33<T>(*this) -= m2; }
-      
+	 inline constexpr Matrix34<T> operator-(Matrix34<T> const & m2) const
+	    { return Matrix34<T>(*this) -= m2; }
+
 	 // Scalar multiplication
-	 inline Matrix33<T>& operator*=(int const a)
-	    {
-	    m[0] *= a; m[3] *= a; m[6] *= a;
-	    m[1] *= a; m[4] *= a; m[7] *= a;
-	    m[2] *= a; m[5] *= a; m[8] *= a;
-	    return *this;
-	    }
-	 inline Matrix33<T>& operator*=(float const a)
-	    {
-	    m[0] *= a; m[3] *= a; m[6] *= a;
-	    m[1] *= a; m[4] *= a; m[7] *= a;
-	    m[2] *= a; m[5] *= a; m[8] *= a;
-	    return *this;
-	    }
-	 inline Matrix33<T>& operator*=(double const a)
-	    {
-	    m[0] *= a; m[3] *= a; m[6] *= a;
-	    m[1] *= a; m[4] *= a; m[7] *= a;
-	    m[2] *= a; m[5] *= a; m[8] *= a;
-	    return *this;
-	    }
+	 inline constexpr Matrix34<T>& operator*=(int const a)
+	    { return multiply(a); }
+	 inline constexpr Matrix34<T>& operator*=(float const a)
+	    { return multiply(a); }
+	 inline constexpr Matrix34<T>& operator*=(double const a)
+	    { return multiply(a); }
 
 	 // Scalar division
-	 inline Matrix33<T>& operator/=(int const a)
-	    {
-	    assert(a!=0);
-	    m[0] /= a; m[3] /= a; m[6] /= a;
-	    m[1] /= a; m[4] /= a; m[7] /= a;
-	    m[2] /= a; m[5] /= a; m[8] /= a;
-	    return *this;
-	    }
-	 inline Matrix33<T>& operator/=(float const a)
-	    {
-	    assert(a!=0);
-	    m[0] /= a; m[3] /= a; m[6] /= a;
-	    m[1] /= a; m[4] /= a; m[7] /= a;
-	    m[2] /= a; m[5] /= a; m[8] /= a;
-	    return *this;
-	    }
-	 inline Matrix33<T>& operator/=(double const a)
-	    {
-	    assert(a!=0);
-	    m[0] /= a; m[3] /= a; m[6] /= a;
-	    m[1] /= a; m[4] /= a; m[7] /= a;
-	    m[2] /= a; m[5] /= a; m[8] /= a;
-	    return *this;
-	    }
-	 inline Matrix33<T> operator/(int const a)
-	    { return Matrix33<T>(*this) /= a; }
-	 inline Matrix33<T> operator/(float const a)
-	    { return Matrix33<T>(*this) /= a; }
-	 inline Matrix33<T> operator/(double const a)
-	    { return Matrix33<T>(*this) /= a; }
+	 inline constexpr Matrix34<T>& operator/=(int const a)
+	    { assert(a!=0); return divide(a); }
+	 inline constexpr Matrix34<T>& operator/=(float const a)
+	    { assert(a!=0); return divide(a); }
+	 inline constexpr Matrix34<T>& operator/=(double const a)
+	    { assert(a!=0); return divide(a); }
+	 inline constexpr Matrix34<T> operator/(int const a) const
+	    { return Matrix34<T>(*this) /= a; }
+	 inline constexpr Matrix34<T> operator/(float const a) const
+	    { return Matrix34<T>(*this) /= a; }
+	 inline constexpr Matrix34<T> operator/(double const a) const
+	    { return Matrix34<T>(*this) /= a; }
 
 	 // Matrix multiplication
-	 // Not sure if this should be inlined at all.  Sure the compiler will
-	 // probably ignore the inline request here, but maybe it won't and maybe
-	 // that would be bad.  Needs real testing.
-	 inline Matrix33<T>& operator*=(Matrix33<T> const & m2)
+	 // [A a] [B b] = [AB  Ab + a], so the bottom row never enters into it.
+	 inline constexpr Matrix34<T>& operator*=(Matrix34<T> const & m2)
 	    {
-	    const int size=3;
-	    Matrix33<T> mres(0);
-	    int i, j, k;
-	    for (i=0; i<size; ++i)
-	       for (j=0; j<size; ++j)
-		  for (k=0; k<size; ++k)
-		     mres[size*i+j] += (*this)[size*k+j] * m2[size*i+k];
-	    *this = mres;
+	    // Written out, since the 3 element inner loops don't vectorize well.
+	    T const a0 = m[0], a1 = m[1], a2 = m[2];
+	    T const a3 = m[3], a4 = m[4], a5 = m[5];
+	    T const a6 = m[6], a7 = m[7], a8 = m[8];
+	    T const t0 = m[9], t1 = m[10], t2 = m[11];
+	    T const b[12] = { m2[0], m2[1], m2[2],  m2[3],  m2[4],  m2[5],
+			      m2[6], m2[7], m2[8],  m2[9],  m2[10], m2[11] };
+	    for (int i=0; i<4; ++i)
+	       {
+	       T const x = b[3*i], y = b[3*i+1], z = b[3*i+2];
+	       m[3*i]   = a0 * x + a3 * y + a6 * z;
+	       m[3*i+1] = a1 * x + a4 * y + a7 * z;
+	       m[3*i+2] = a2 * x + a5 * y + a8 * z;
+	       }
+	    m[9] += t0; m[10] += t1; m[11] += t2;
 	    return *this;
 	    }
-	 inline Matrix33<T> operator*(Matrix33<T> const & m2) const
-	    { return Matrix33<T>(*this) *= m2; }
+	 inline constexpr Matrix34<T> operator*(Matrix34<T> const & m2) const
+	    { return Matrix34<T>(*this) *= m2; }
 
-
-	 inline Vector3<T> getcol(unsigned int const i) const
+	 inline constexpr Vector3<T> getcol(unsigned int const i) const
 	    {
-	    assert(i<3);
+	    assert(i<4);
 	    const int size=3;
 	    return Vector3<T>(m[i*size], m[i*size+1], m[i*size+2]);
 	    }
 
-	 inline Vector3<T> getrow(unsigned int const i) const
+	 inline constexpr Vector4<T> getrow(unsigned int const i) const
 	    {
 	    assert(i<3);
 	    const int size=3;
-	    return Vector3<T>(m[i], m[i+size], m[i+2*size]);
+	    return Vector4<T>(m[i], m[i+size], m[i+2*size], m[i+3*size]);
 	    }
 	 
-	 inline Matrix33<T>& setcol(unsigned int const i, Vector3<T> const & v)
+	 inline constexpr Matrix34<T>& setcol(unsigned int const i, Vector3<T> const & v)
 	    {
-	    assert(i<3);
+	    assert(i<4);
 	    const int size=3;
 	    m[i*size] = v[0];
 	    m[i*size+1] = v[1];
@@ -459,10 +475,10 @@ namespace arda
 	    return *this;
 	    }
 
-	 inline Matrix33<T>& setcol(unsigned int const i, 
+	 inline constexpr Matrix34<T>& setcol(unsigned int const i, 
 				    T const a0, T const a1, T const a2)
 	    {
-	    assert(i<3);
+	    assert(i<4);
 	    const int size=3;
 	    m[i*size] = a0;
 	    m[i*size+1] = a1;
@@ -470,423 +486,1030 @@ namespace arda
 	    return *this;
 	    }
 
-	 inline Matrix33<T>& setrow(unsigned int const i, Vector3<T> const & v)
+	 // Writes the full 4x4 matrix, with bottom row 0 0 0 1.
+	 inline constexpr Matrix44<T>& to_matrix44(Matrix44<T> & M) const
 	    {
-	    assert(i<3);
-	    const int size=3;
-	    m[i] = v[0];
-	    m[i+size] = v[1];
-	    m[i+2*size] = v[2];
-	    return *this;
-	    }
-
-	 inline Matrix33<T>& setrow(unsigned int const i, 
-				    T const a0, T const a1, T const a2)
-	    {
-	    assert(i<3);
-	    const int size=3;
-	    m[i] = a0;
-	    m[i+size] = a1;
-	    m[i+2*size] = a2;
-	    return *this;
+	    return M.assign(m[0], m[1], m[2],  T(0),
+			    m[3], m[4], m[5],  T(0),
+			    m[6], m[7], m[8],  T(0),
+			    m[9], m[10], m[11], T(1));
 	    }
 
 	 std::string to_string(void) const;
 
-	 inline Matrix33<T>& setidentity()
+	 inline constexpr Matrix34<T>& setidentity()
 	    {
-	    memset(m, 0, sizeof(m));
+	    for (int i=0; i<12; ++i) m[i] = T(0);
 	    m[0] = m[4] = m[8] = T(1);
 	    return *this;
 	    }
 
+	 private:
+	 // Scaling, computed in ScalarPrecision<T, S> as for Matrix.
+	 template <typename S>
+	 inline constexpr Matrix34<T>& multiply(S const a)
+	    {
+	    typename ScalarPrecision<T, S>::type const b = (typename ScalarPrecision<T, S>::type) a;
+	    for (int i=0; i<12; ++i) m[i] *= b;
+	    return *this;
+	    }
+	 template <typename S>
+	 inline constexpr Matrix34<T>& divide(S const a)
+	    {
+	    typename ScalarPrecision<T, S>::type const b = (typename ScalarPrecision<T, S>::type) a;
+	    for (int i=0; i<12; ++i) m[i] /= b;
+	    return *this;
+	    }
 	 };
 
       // Scalar multiplication continued
       template <typename T> 
-      inline Matrix33<T> operator*(Matrix33<T> const & m, int const a)
-	 { return Matrix33<T>(m) *= a; }
+      inline constexpr Matrix34<T> operator*(Matrix34<T> const & m, int const a)
+	 { return Matrix34<T>(m) *= a; }
 
       template <typename T> 
-      inline Matrix33<T> operator*(int const a, Matrix33<T> const & m)
-	 { return Matrix33<T>(m) *= a; }
+      inline constexpr Matrix34<T> operator*(int const a, Matrix34<T> const & m)
+	 { return Matrix34<T>(m) *= a; }
 
       template <typename T> 
-      inline Matrix33<T> operator*(Matrix33<T> const & m, float const a)
-	 { return Matrix33<T>(m) *= a; }
+      inline constexpr Matrix34<T> operator*(Matrix34<T> const & m, float const a)
+	 { return Matrix34<T>(m) *= a; }
 
       template <typename T> 
-      inline Matrix33<T> operator*(float const a, Matrix33<T> const & m)
-	 { return Matrix33<T>(m) *= a; }
+      inline constexpr Matrix34<T> operator*(float const a, Matrix34<T> const & m)
+	 { return Matrix34<T>(m) *= a; }
 
       template <typename T> 
-      inline Matrix33<T> operator*(Matrix33<T> const & m, double const a)
-	 { return Matrix33<T>(m) *= a; }
+      inline constexpr Matrix34<T> operator*(Matrix34<T> const & m, double const a)
+	 { return Matrix34<T>(m) *= a; }
 
       template <typename T> 
-      inline Matrix33<T> operator*(double const a, Matrix33<T> const & m)
-	 { return Matrix33<T>(m) *= a; }
+      inline constexpr Matrix34<T> operator*(double const a, Matrix34<T> const & m)
+	 { return Matrix34<T>(m) *= a; }
 
 
 
 
       //////////////////////////////////////////////////////////////////////////
-      template <typename T> 
-      class Matrix44
-	 {
-	 public:
-	 T m[16];
+      typedef Matrix22<int> Matrix22i;
+      typedef Matrix22<float> Matrix22f;
+      typedef Matrix22<double> Matrix22d;
 
-	 // Constructors
-	 Matrix44() {}
-	 explicit Matrix44(T a) 
-	    { 
-	    // TODO:  Is this really more efficient than memset?
-	    m[0] = m[1] = m[2] = m[3] = m[4] = m[5] = m[6] = m[7] = m[8] = 
-		  m[9] = m[10] = m[11] = m[12] = m[13] = m[14] = m[15] = a;
-	    }
-	 Matrix44(T a0, T a1, T a2, T a3, 
-		  T a4, T a5, T a6, T a7, 
-		  T a8, T a9, T a10, T a11,
-		  T a12, T a13, T a14, T a15) 
-	    { 
-	    m[0] = a0; m[4] = a4;  m[8] = a8;  m[12] = a12;
-	    m[1] = a1; m[5] = a5;  m[9] = a9;  m[13] = a13;
-	    m[2] = a2; m[6] = a6; m[10] = a10; m[14] = a14;
-	    m[3] = a3; m[7] = a7; m[11] = a11; m[15] = a15;
-	    } 
+      typedef Matrix33<int> Matrix33i;
+      typedef Matrix33<float> Matrix33f;
+      typedef Matrix33<double> Matrix33d;
+      
+      typedef Matrix44<int> Matrix44i;
+      typedef Matrix44<float> Matrix44f;
+      typedef Matrix44<double> Matrix44d;
 
-	 // Array indexing
-	 // Remember: column major order is used.
-	 inline T& operator[](unsigned int const i) 
-	    { assert (i<16); return m[i]; }
-	 inline T operator[](unsigned int const i) const
-	    { assert (i<16); return m[i]; }
+      typedef Matrix34<int> Matrix34i;
+      typedef Matrix34<float> Matrix34f;
+      typedef Matrix34<double> Matrix34d;
 
-	 // Assignment
-	 inline Matrix44<T>& operator=(Matrix44<T> const & m2)
-	    { 
-	    m[0] = m2[0]; m[4] = m2[4];  m[8] = m2[8];  m[12] = m2[12];
-	    m[1] = m2[1]; m[5] = m2[5];  m[9] = m2[9];  m[13] = m2[13];
-	    m[2] = m2[2]; m[6] = m2[6]; m[10] = m2[10]; m[14] = m2[14];
-	    m[3] = m2[3]; m[7] = m2[7]; m[11] = m2[11]; m[15] = m2[15];
-	    return *this;
-	    }
-	 inline Matrix44<T>& assign(T const a0,  T const a1,  T const a2,  T const a3, 
-				    T const a4,  T const a5,  T const a6,  T const a7, 
-				    T const a8,  T const a9,  T const a10, T const a11,
-				    T const a12, T const a13, T const a14, T const a15)
-	    { 
-	    m[0] = a0; m[4] = a4;  m[8] = a8;  m[12] = a12;
-	    m[1] = a1; m[5] = a5;  m[9] = a9;  m[13] = a13;
-	    m[2] = a2; m[6] = a6; m[10] = a10; m[14] = a14;
-	    m[3] = a3; m[7] = a7; m[11] = a11; m[15] = a15;
-	    return *this;
-	    }
 
-	 // Comparison
-	 inline bool operator==(Matrix44<T> const & m2) const
-	    {
-	    // TODO: Should this use memcmp?
-	    return  
-		  m[0] == m2[0] && m[4] == m2[4] &&  m[8] == m2[8] &&  m[12] == m2[12] &&
-		  m[1] == m2[1] && m[5] == m2[5] &&  m[9] == m2[9] &&  m[13] == m2[13] &&
-		  m[2] == m2[2] && m[6] == m2[6] && m[10] == m2[10] && m[14] == m2[14] &&
-		  m[3] == m2[3] && m[7] == m2[7] && m[11] == m2[11] && m[15] == m2[15];
-	    }
-	 inline bool operator!=(Matrix44<T> const & m2) const
-	    { return ! (*this == m2); } 
+      //////////////////////////////////////////////////////////////////////////
+      // SIMD specializations of Matrix44 multiplication.
+      //
+      // Column i of the product is the sum over k of column k of *this scaled
+      // by element k of column i of m2, so each result column is built with
+      // broadcast-multiply-add on whole columns.  The sum is accumulated in
+      // the same order as the generic loop (k = 0..3) using separate multiplies
+      // and adds, which gives the same results as the generic template (up to
+      // the sign of an exactly zero element).  All result columns are computed
+      // before any are stored so that m *= m works.
+
+#if defined(ARDA_MATH_AVX)
+      template <>
+      inline Matrix44<float>& Matrix44<float>::operator*=(Matrix44<float> const & m2)
+	 {
+	 // Two result columns per 256 bit register.  Each column of *this is
+	 // duplicated into both halves, and the in-lane shuffles broadcast
+	 // element k of each of the two m2 columns into its half.
+	 __m256 const a0 = _mm256_broadcast_ps((__m128 const *) (m));
+	 __m256 const a1 = _mm256_broadcast_ps((__m128 const *) (m + 4));
+	 __m256 const a2 = _mm256_broadcast_ps((__m128 const *) (m + 8));
+	 __m256 const a3 = _mm256_broadcast_ps((__m128 const *) (m + 12));
+	 __m256 const b01 = _mm256_loadu_ps(m2.m);
+	 __m256 const b23 = _mm256_loadu_ps(m2.m + 8);
+
+	 __m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+	 r01 = _mm256_add_ps(r01, _mm256_mul_ps(a1, _mm256_shuffle_ps(b01, b01, 0x55)));
+	 r01 = _mm256_add_ps(r01, _mm256_mul_ps(a2, _mm256_shuffle_ps(b01, b01, 0xAA)));
+	 r01 = _mm256_add_ps(r01, _mm256_mul_ps(a3, _mm256_shuffle_ps(b01, b01, 0xFF)));
+
+	 __m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+	 r23 = _mm256_add_ps(r23, _mm256_mul_ps(a1, _mm256_shuffle_ps(b23, b23, 0x55)));
+	 r23 = _mm256_add_ps(r23, _mm256_mul_ps(a2, _mm256_shuffle_ps(b23, b23, 0xAA)));
+	 r23 = _mm256_add_ps(r23, _mm256_mul_ps(a3, _mm256_shuffle_ps(b23, b23, 0xFF)));
+
+	 _mm256_storeu_ps(m, r01);
+	 _mm256_storeu_ps(m + 8, r23);
+	 return *this;
+	 }
 
-	 // Matrix addition
-	 inline Matrix44<T>& operator+=(Matrix44<T> const & m2)
+      template <>
+      inline Matrix44<double>& Matrix44<double>::operator*=(Matrix44<double> const & m2)
+	 {
+	 __m256d const a0 = _mm256_loadu_pd(m);
+	 __m256d const a1 = _mm256_loadu_pd(m + 4);
+	 __m256d const a2 = _mm256_loadu_pd(m + 8);
+	 __m256d const a3 = _mm256_loadu_pd(m + 12);
+	 __m256d r[4];
+	 int i;
+	 for (i=0; i<4; ++i)
 	    {
-	    m[0] += m2[0]; m[4] += m2[4];  m[8] += m2[8];  m[12] += m2[12];
-	    m[1] += m2[1]; m[5] += m2[5];  m[9] += m2[9];  m[13] += m2[13];
-	    m[2] += m2[2]; m[6] += m2[6]; m[10] += m2[10]; m[14] += m2[14];
-	    m[3] += m2[3]; m[7] += m2[7]; m[11] += m2[11]; m[15] += m2[15];
-	    return *this;
+	    double const * b = m2.m + 4*i;
+	    r[i] = _mm256_mul_pd(a0, _mm256_broadcast_sd(b));
+	    r[i] = _mm256_add_pd(r[i], _mm256_mul_pd(a1, _mm256_broadcast_sd(b + 1)));
+	    r[i] = _mm256_add_pd(r[i], _mm256_mul_pd(a2, _mm256_broadcast_sd(b + 2)));
+	    r[i] = _mm256_add_pd(r[i], _mm256_mul_pd(a3, _mm256_broadcast_sd(b + 3)));
 	    }
-	 inline Matrix44<T> operator+(Matrix44<T> const & m2) const
-	    { return Matrix44<T>(*this) += m2; }
+	 for (i=0; i<4; ++i)
+	    _mm256_storeu_pd(m + 4*i, r[i]);
+	 return *this;
+	 }
 
-	 // Matrix subtraction
-	 inline Matrix44<T>& operator-=(Matrix44<T> const & m2)
-	    {
-	    m[0] -= m2[0]; m[4] -= m2[4];  m[8] -= m2[8];  m[12] -= m2[12];
-	    m[1] -= m2[1]; m[5] -= m2[5];  m[9] -= m2[9];  m[13] -= m2[13];
-	    m[2] -= m2[2]; m[6] -= m2[6]; m[10] -= m2[10]; m[14] -= m2[14];
-	    m[3] -= m2[3]; m[7] -= m2[7]; m[11] -= m2[11]; m[15] -= m2[15];
-	    return *this;
-	    }
-	 inline Matrix44<T> operator-(Matrix44<T> const & m2) const
-	    { return Matrix44<T>(*this) -= m2; }
-      
-	 // Scalar multiplication
-	 inline Matrix44<T>& operator*=(int const a)
-	    {
-	    m[0] *= a; m[4] *= a;  m[8] *= a; m[12] *= a;
-	    m[1] *= a; m[5] *= a;  m[9] *= a; m[13] *= a;
-	    m[2] *= a; m[6] *= a; m[10] *= a; m[14] *= a;
-	    m[3] *= a; m[7] *= a; m[11] *= a; m[15] *= a;
-	    return *this;
-	    }
-	 inline Matrix44<T>& operator*=(float const a)
-	    {
-	    m[0] *= a; m[4] *= a;  m[8] *= a; m[12] *= a;
-	    m[1] *= a; m[5] *= a;  m[9] *= a; m[13] *= a;
-	    m[2] *= a; m[6] *= a; m[10] *= a; m[14] *= a;
-	    m[3] *= a; m[7] *= a; m[11] *= a; m[15] *= a;
-	    return *this;
-	    }
-	 inline Matrix44<T>& operator*=(double const a)
+#elif defined(ARDA_MATH_SSE2)
+      template <>
+      inline Matrix44<float>& Matrix44<float>::operator*=(Matrix44<float> const & m2)
+	 {
+	 __m128 const a0 = _mm_loadu_ps(m);
+	 __m128 const a1 = _mm_loadu_ps(m + 4);
+	 __m128 const a2 = _mm_loadu_ps(m + 8);
+	 __m128 const a3 = _mm_loadu_ps(m + 12);
+	 __m128 r[4];
+	 int i;
+	 for (i=0; i<4; ++i)
 	    {
-	    m[0] *= a; m[4] *= a;  m[8] *= a; m[12] *= a;
-	    m[1] *= a; m[5] *= a;  m[9] *= a; m[13] *= a;
-	    m[2] *= a; m[6] *= a; m[10] *= a; m[14] *= a;
-	    m[3] *= a; m[7] *= a; m[11] *= a; m[15] *= a;
-	    return *this;
+	    __m128 const b = _mm_loadu_ps(m2.m + 4*i);
+	    r[i] = _mm_mul_ps(a0, _mm_shuffle_ps(b, b, 0x00));
+	    r[i] = _mm_add_ps(r[i], _mm_mul_ps(a1, _mm_shuffle_ps(b, b, 0x55)));
+	    r[i] = _mm_add_ps(r[i], _mm_mul_ps(a2, _mm_shuffle_ps(b, b, 0xAA)));
+	    r[i] = _mm_add_ps(r[i], _mm_mul_ps(a3, _mm_shuffle_ps(b, b, 0xFF)));
 	    }
+	 for (i=0; i<4; ++i)
+	    _mm_storeu_ps(m + 4*i, r[i]);
+	 return *this;
+	 }
 
-	 // Scalar division
-	 inline Matrix44<T>& operator/=(int const a)
-	    {
-	    assert(a!=0);
-	    m[0] /= a; m[4] /= a;  m[8] /= a; m[12] /= a;
-	    m[1] /= a; m[5] /= a;  m[9] /= a; m[13] /= a;
-	    m[2] /= a; m[6] /= a; m[10] /= a; m[14] /= a;
-	    m[3] /= a; m[7] /= a; m[11] /= a; m[15] /= a;
-	    return *this;
-	    }
-	 inline Matrix44<T>& operator/=(float const a)
+      template <>
+      inline Matrix44<double>& Matrix44<double>::operator*=(Matrix44<double> const & m2)
+	 {
+	 // Each column is split into a low (rows 0-1) and high (rows 2-3) half.
+	 __m128d const a0l = _mm_loadu_pd(m),      a0h = _mm_loadu_pd(m + 2);
+	 __m128d const a1l = _mm_loadu_pd(m + 4),  a1h = _mm_loadu_pd(m + 6);
+	 __m128d const a2l = _mm_loadu_pd(m + 8),  a2h = _mm_loadu_pd(m + 10);
+	 __m128d const a3l = _mm_loadu_pd(m + 12), a3h = _mm_loadu_pd(m + 14);
+	 __m128d rl[4], rh[4];
+	 int i;
+	 for (i=0; i<4; ++i)
 	    {
-	    assert(a!=0);
-	    m[0] /= a; m[4] /= a;  m[8] /= a; m[12] /= a;
-	    m[1] /= a; m[5] /= a;  m[9] /= a; m[13] /= a;
-	    m[2] /= a; m[6] /= a; m[10] /= a; m[14] /= a;
-	    m[3] /= a; m[7] /= a; m[11] /= a; m[15] /= a;
-	    return *this;
+	    double const * b = m2.m + 4*i;
+	    __m128d const b0 = _mm_set1_pd(b[0]);
+	    __m128d const b1 = _mm_set1_pd(b[1]);
+	    __m128d const b2 = _mm_set1_pd(b[2]);
+	    __m128d const b3 = _mm_set1_pd(b[3]);
+	    rl[i] = _mm_mul_pd(a0l, b0);
+	    rh[i] = _mm_mul_pd(a0h, b0);
+	    rl[i] = _mm_add_pd(rl[i], _mm_mul_pd(a1l, b1));
+	    rh[i] = _mm_add_pd(rh[i], _mm_mul_pd(a1h, b1));
+	    rl[i] = _mm_add_pd(rl[i], _mm_mul_pd(a2l, b2));
+	    rh[i] = _mm_add_pd(rh[i], _mm_mul_pd(a2h, b2));
+	    rl[i] = _mm_add_pd(rl[i], _mm_mul_pd(a3l, b3));
+	    rh[i] = _mm_add_pd(rh[i], _mm_mul_pd(a3h, b3));
 	    }
-	 inline Matrix44<T>& operator/=(double const a)
+	 for (i=0; i<4; ++i)
 	    {
-	    assert(a!=0);
-	    m[0] /= a; m[4] /= a;  m[8] /= a; m[12] /= a;
-	    m[1] /= a; m[5] /= a;  m[9] /= a; m[13] /= a;
-	    m[2] /= a; m[6] /= a; m[10] /= a; m[14] /= a;
-	    m[3] /= a; m[7] /= a; m[11] /= a; m[15] /= a;
-	    return *this;
+	    _mm_storeu_pd(m + 4*i, rl[i]);
+	    _mm_storeu_pd(m + 4*i + 2, rh[i]);
 	    }
-	 inline Matrix44<T> operator/(int const a)
-	    { return Matrix44<T>(*this) /= a; }
-	 inline Matrix44<T> operator/(float const a)
-	    { return Matrix44<T>(*this) /= a; }
-	 inline Matrix44<T> operator/(double const a)
-	    { return Matrix44<T>(*this) /= a; }
+	 return *this;
+	 }
+#endif
 
-	 // Matrix multiplication
-	 // Not sure if this should be inlined at all.  Sure the compiler will
-	 // probably ignore the inline request here, but maybe it won't and maybe
-	 // that would be bad.  Needs real testing.
-	 inline Matrix44<T>& operator*=(Matrix44<T> const & m2)
-	    {
-	    const int size=4;
-	    Matrix44<T> mres(0);
-	    int i, j, k;
-	    for (i=0; i<size; ++i)
-	       for (j=0; j<size; ++j)
-		  for (k=0; k<size; ++k)
-		     mres[size*i+j] += (*this)[size*k+j] * m2[size*i+k];
-	    *this = mres;
-	    return *this;
-	    }
-	 inline Matrix44<T> operator*(Matrix44<T> const & m2) const
-	    { return Matrix44<T>(*this) *= m2; }
 
+      //////////////////////////////////////////////////////////////////////////
+      // Matrix functions
+      // TODO: The determinant functions suffer from some bad round off error.
+      // Is it significant?  I don't know.  None of the other game engines
+      // I've checked bother to do anything to calculate det more accurately.
+      // So maybe it just doesn't matter enough for game purposes.
+      //
+      // inverse() and try_inverse() use the adjugate (transposed cofactor
+      // matrix) divided by the determinant, and share the cofactors or 2x2
+      // sub-determinants with det(), so the determinant falls out of the
+      // inverse for free.  They are not meaningful for int matrices.
+      //
+      // The 4x4 inverse is straight line code with no branches, so
+      // inverse(Matrix44x4f) and inverse(Matrix44x8f) (see Packet.h) invert
+      // 4 or 8 matrices at once.  Lanes holding singular matrices come out as
+      // inf or NaN; check det() per lane if that can happen.
+      //
+      // inverse()         Returns the inverse.  The matrix must not be singular.
+      // try_inverse()     Sets mres to the inverse and returns true, or returns
+      //                   false and leaves mres alone if |det(m)| <= epsilon.
 
-	 inline Vector4<T> getcol(unsigned int const i) const
+      namespace detail
+	 {
+	 // The cofactors of a 3x3 matrix, computed in R.  Reading the column
+	 // major m as a row major array gives the transpose of the matrix, and
+	 // since inverse(transpose(M)) == transpose(inverse(M)) the row major
+	 // adjugate formulas below give the column major result directly.
+	 // c[0], c[1], and c[2] are the cofactors of m[0], m[3], and m[6],
+	 // which are all det() needs.
+	 template <typename T, typename R>
+	 struct Cofactors33
 	    {
-	    assert(i<4);
-	    const int size=4;
-	    return Vector4<T>(m[i*size], m[i*size+1], m[i*size+2], m[i*size+3]);
-	    }
-
-	 inline Vector4<T> getrow(unsigned int const i) const
+	    R c[9];
+
+	    explicit constexpr Cofactors33(Matrix33<T> const & m)
+	       : c{(R) m[4] * m[8] - (R) m[5] * m[7],
+		   (R) m[2] * m[7] - (R) m[1] * m[8],
+		   (R) m[1] * m[5] - (R) m[2] * m[4],
+		   (R) m[5] * m[6] - (R) m[3] * m[8],
+		   (R) m[0] * m[8] - (R) m[2] * m[6],
+		   (R) m[2] * m[3] - (R) m[0] * m[5],
+		   (R) m[3] * m[7] - (R) m[4] * m[6],
+		   (R) m[1] * m[6] - (R) m[0] * m[7],
+		   (R) m[0] * m[4] - (R) m[1] * m[3]} {}
+
+	    inline constexpr R det(Matrix33<T> const & m) const
+	       { return m[0] * c[0] + m[3] * c[1] + m[6] * c[2]; }
+	    };
+
+	 // The 2x2 sub-determinants of a 4x4 matrix: s from the first two
+	 // columns and c from the last two.  Every cofactor, and so both det()
+	 // and inverse(), is a sum of products of these with single elements.
+	 template <typename T>
+	 struct SubDet44
 	    {
-	    assert(i<4);
-	    const int size=4;
-	    return Vector4<T>(m[i], m[i+size], m[i+2*size], m[i+3*size]);
-	    }
-	 
-	 inline Matrix44<T>& setcol(unsigned int const i, Vector4<T> const & v)
+	    T s[6], c[6];
+
+	    explicit constexpr SubDet44(Matrix44<T> const & m)
+	       : s{m[0] * m[5] - m[4] * m[1],
+		   m[0] * m[6] - m[4] * m[2],
+		   m[0] * m[7] - m[4] * m[3],
+		   m[1] * m[6] - m[5] * m[2],
+		   m[1] * m[7] - m[5] * m[3],
+		   m[2] * m[7] - m[6] * m[3]},
+		 c{m[8]  * m[13] - m[12] * m[9],
+		   m[8]  * m[14] - m[12] * m[10],
+		   m[8]  * m[15] - m[12] * m[11],
+		   m[9]  * m[14] - m[13] * m[10],
+		   m[9]  * m[15] - m[13] * m[11],
+		   m[10] * m[15] - m[14] * m[11]} {}
+
+	    inline constexpr T det() const
+	       { return s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0]; }
+	    };
+
+	 // Sets mres to the adjugate of m and returns the determinant, which
+	 // the caller checks before dividing by it.
+	 template <typename T>
+	 inline T adjugate44(Matrix44<T> const & m, Matrix44<T> & mres)
 	    {
-	    assert(i<4);
-	    const int size=4;
-	    m[i*size] = v[0];
-	    m[i*size+1] = v[1];
-	    m[i*size+2] = v[2];
-	    m[i*size+3] = v[3];
-	    return *this;
+	    // As with Cofactors33 the row major formulas work on column major
+	    // data.
+	    SubDet44<T> const sd(m);
+	    T const * const s = sd.s;
+	    T const * const c = sd.c;
+	    T const a[16] = { m[0], m[1], m[2],  m[3],  m[4],  m[5],  m[6],  m[7],
+			      m[8], m[9], m[10], m[11], m[12], m[13], m[14], m[15] };
+
+	    mres[0]  =  a[5]  * c[5] - a[6]  * c[4] + a[7]  * c[3];
+	    mres[1]  = -a[1]  * c[5] + a[2]  * c[4] - a[3]  * c[3];
+	    mres[2]  =  a[13] * s[5] - a[14] * s[4] + a[15] * s[3];
+	    mres[3]  = -a[9]  * s[5] + a[10] * s[4] - a[11] * s[3];
+
+	    mres[4]  = -a[4]  * c[5] + a[6]  * c[2] - a[7]  * c[1];
+	    mres[5]  =  a[0]  * c[5] - a[2]  * c[2] + a[3]  * c[1];
+	    mres[6]  = -a[12] * s[5] + a[14] * s[2] - a[15] * s[1];
+	    mres[7]  =  a[8]  * s[5] - a[10] * s[2] + a[11] * s[1];
+
+	    mres[8]  =  a[4]  * c[4] - a[5]  * c[2] + a[7]  * c[0];
+	    mres[9]  = -a[0]  * c[4] + a[1]  * c[2] - a[3]  * c[0];
+	    mres[10] =  a[12] * s[4] - a[13] * s[2] + a[15] * s[0];
+	    mres[11] = -a[8]  * s[4] + a[9]  * s[2] - a[11] * s[0];
+
+	    mres[12] = -a[4]  * c[3] + a[5]  * c[1] - a[6]  * c[0];
+	    mres[13] =  a[0]  * c[3] - a[1]  * c[1] + a[2]  * c[0];
+	    mres[14] = -a[12] * s[3] + a[13] * s[1] - a[14] * s[0];
+	    mres[15] =  a[8]  * s[3] - a[9]  * s[1] + a[10] * s[0];
+	    return sd.det();
 	    }
 
-	 inline Matrix44<T>& setcol(unsigned int const i, 
-				    T const a0, T const a1, T const a2, T const a3)
+	 // m * (1 / d), element by element.
+	 template <typename T>
+	 inline void scale44(Matrix44<T> & m, T const d)
 	    {
-	    assert(i<4);
-	    const int size=4;
-	    m[i*size] = a0;
-	    m[i*size+1] = a1;
-	    m[i*size+2] = a2;
-	    m[i*size+3] = a3;
-	    return *this;
+	    T const r = T(1) / d;
+	    unsigned int i;
+	    for (i=0; i<16; ++i)
+	       m[i] = m[i] * r;
 	    }
 
-	 inline Matrix44<T>& setrow(unsigned int const i, Vector4<T> const & v)
-	    {
-	    assert(i<4);
-	    const int size=4;
-	    m[i] = v[0];
-	    m[i+size] = v[1];
-	    m[i+2*size] = v[2];
-	    m[i+3*size] = v[3];
-	    return *this;
-	    }
+	 } // namespace detail
 
-	 inline Matrix44<T>& setrow(unsigned int const i, 
-				    T const a0, T const a1, T const a2, T const a3)
-	    {
-	    assert(i<4);
-	    const int size=4;
-	    m[i] = a0;
-	    m[i+size] = a1;
-	    m[i+2*size] = a2;
-	    m[i+3*size] = a3;
-	    return *this;
-	    }
+      namespace detail
+	 {
+	 // Element E of the C x R transpose is element (E % C) * R + E / C of m.
+	 template <typename T, unsigned int R, unsigned int C, unsigned int... E>
+	 inline constexpr Matrix<T, C, R> transpose(Matrix<T, R, C> const & m, std::integer_sequence<unsigned int, E...>)
+	    { return Matrix<T, C, R>(m[(E % C) * R + E / C]...); }
+	 } // namespace detail
+
+      template <typename T, unsigned int R, unsigned int C> 
+      inline constexpr Matrix<T, C, R> transpose(Matrix<T, R, C> const & m)
+	 {
+	 return detail::transpose(m, detail::Indices<R * C>());
+	 }
 
-	 std::string to_string(void) const;
+      template <typename T> 
+      inline constexpr double det(Matrix22<T> const & m)
+	 { 
+	 return (double) (m[0] * m[3]) - (double) (m[1] * m[2]); 
+	 }
 
-	 inline Matrix44<T>& setidentity()
-	    {
-	    memset(m, 0, sizeof(m));
-	    m[0] = m[5] = m[10] = m[15] = T(1);
-	    return *this;
-	    }
+      template <typename T> 
+      inline bool try_inverse(Matrix22<T> const & m, Matrix22<T> & mres, double epsilon = 0.0)
+	 {
+	 double const d = det(m);
+	 if (!(fabs(d) > epsilon))
+	    return false;
+	 mres.assign((T) (m[3] / d), (T) (-m[1] / d),
+		     (T) (-m[2] / d), (T) (m[0] / d));
+	 return true;
+	 }
 
-	 };
+      template <typename T> 
+      inline Matrix22<T> inverse(Matrix22<T> const & m)
+	 {
+	 Matrix22<T> mres;
+	 bool const ok = try_inverse(m, mres);
+	 assert(ok);
+	 (void) ok;
+	 return mres;
+	 }
 
-      // Scalar multiplication continued
       template <typename T> 
-      inline Matrix44<T> operator*(Matrix44<T> const & m, int const a)
-	 { return Matrix44<T>(m) *= a; }
+      inline constexpr double det(Matrix33<T> const & m)
+	 {
+	 return detail::Cofactors33<T, double>(m).det(m);
+	 }
 
       template <typename T> 
-      inline Matrix44<T> operator*(int const a, Matrix44<T> const & m)
-	 { return Matrix44<T>(m) *= a; }
+      inline bool try_inverse(Matrix33<T> const & m, Matrix33<T> & mres, double epsilon = 0.0)
+	 {
+	 detail::Cofactors33<T, double> const cf(m);
+	 double const d = cf.det(m);
+	 if (!(fabs(d) > epsilon))
+	    return false;
+	 double const r = 1.0 / d;
+	 int i;
+	 for (i=0; i<9; ++i)
+	    mres[i] = (T) (cf.c[i] * r);
+	 return true;
+	 }
 
       template <typename T> 
-      inline Matrix44<T> operator*(Matrix44<T> const & m, float const a)
-	 { return Matrix44<T>(m) *= a; }
+      inline Matrix33<T> inverse(Matrix33<T> const & m)
+	 {
+	 Matrix33<T> mres;
+	 bool const ok = try_inverse(m, mres);
+	 assert(ok);
+	 (void) ok;
+	 return mres;
+	 }
 
       template <typename T> 
-      inline Matrix44<T> operator*(float const a, Matrix44<T> const & m)
-	 { return Matrix44<T>(m) *= a; }
+      inline constexpr double det(Matrix44<T> const & m)
+	 { 
+	 return detail::SubDet44<T>(m).det();
+	 }
 
       template <typename T> 
-      inline Matrix44<T> operator*(Matrix44<T> const & m, double const a)
-	 { return Matrix44<T>(m) *= a; }
+      inline bool try_inverse(Matrix44<T> const & m, Matrix44<T> & mres, double epsilon = 0.0)
+	 {
+	 Matrix44<T> tmp;
+	 T const d = detail::adjugate44(m, tmp);
+	 if (!(fabs(d) > epsilon))
+	    return false;
+	 detail::scale44(tmp, d);
+	 mres = tmp;
+	 return true;
+	 }
 
       template <typename T> 
-      inline Matrix44<T> operator*(double const a, Matrix44<T> const & m)
-	 { return Matrix44<T>(m) *= a; }
+      inline Matrix44<T> inverse(Matrix44<T> const & m)
+	 {
+	 Matrix44<T> mres;
+	 T const d = detail::adjugate44(m, mres);
+	 assert(d != T(0));
+	 detail::scale44(mres, d);
+	 return mres;
+	 }
 
+      ////////////////////////////////////////
+      // Inverses of structured 4x4 matrices.  These are much cheaper than
+      // inverse() but only correct for the kind of matrix they are named for,
+      // which is checked by assert() in debug builds.
+      //
+      // inverse_rigid()   For a rotation followed by a translation, as built by
+      //                   get_rot_mat44() and get_transform_mat44().  The
+      //                   inverse is the transposed rotation and the rotated,
+      //                   negated translation.  (Any orthonormal upper 3x3,
+      //                   including reflections, works.)
+      // inverse_affine()  For any affine matrix (bottom row 0 0 0 1), e.g. with
+      //                   non-uniform scale or shear.  Inverts the upper 3x3
+      //                   and uses that to transform the translation.
+      //
+      // is_rigid()        True if m is affine with an orthonormal upper 3x3, to
+      //                   within tolerance.
+      // is_affine()       True if the bottom row of m is exactly 0 0 0 1.
 
+      template <typename T>
+      inline bool is_affine(Matrix44<T> const & m)
+	 {
+	 return m[3] == T(0) && m[7] == T(0) && m[11] == T(0) && m[15] == T(1);
+	 }
 
+      template <typename T>
+      inline bool is_rigid(Matrix44<T> const & m, double tolerance = 1e-4)
+	 {
+	 if (!is_affine(m))
+	    return false;
+	 int i, j;
+	 for (i=0; i<3; ++i)
+	    for (j=i; j<3; ++j)
+	       {
+	       double const d = (double) m[4*i] * m[4*j] + (double) m[4*i+1] * m[4*j+1]
+				+ (double) m[4*i+2] * m[4*j+2];
+	       if (fabs(d - (i == j ? 1.0 : 0.0)) > tolerance)
+		  return false;
+	       }
+	 return true;
+	 }
 
-      //////////////////////////////////////////////////////////////////////////
-      typedef Matrix22<int> Matrix22i;
-      typedef Matrix22<float> Matrix22f;
-      typedef Matrix22<double> Matrix22d;
+      template <typename T>
+      inline Matrix44<T> inverse_rigid(Matrix44<T> const & m)
+	 {
+	 assert(is_rigid(m));
+	 T const tx = m[12], ty = m[13], tz = m[14];
+	 return Matrix44<T>(m[0], m[4], m[8],  T(0),
+			    m[1], m[5], m[9],  T(0),
+			    m[2], m[6], m[10], T(0),
+			    -(m[0] * tx + m[1] * ty + m[2]  * tz),
+			    -(m[4] * tx + m[5] * ty + m[6]  * tz),
+			    -(m[8] * tx + m[9] * ty + m[10] * tz),
+			    T(1));
+	 }
 
-      typedef Matrix33<int> Matrix33i;
-      typedef Matrix33<float> Matrix33f;
-      typedef Matrix33<double> Matrix33d;
-      
-      typedef Matrix44<int> Matrix44i;
-      typedef Matrix44<float> Matrix44f;
-      typedef Matrix44<double> Matrix44d;
+      template <typename T>
+      inline Matrix44<T> inverse_affine(Matrix44<T> const & m)
+	 {
+	 assert(is_affine(m));
+	 // The rows of the inverse of the 3x3 with columns a, b, c are
+	 // b x c, c x a, and a x b divided by the determinant a . (b x c).
+	 T const a0 = m[0], a1 = m[1], a2 = m[2];
+	 T const b0 = m[4], b1 = m[5], b2 = m[6];
+	 T const c0 = m[8], c1 = m[9], c2 = m[10];
+	 T const tx = m[12], ty = m[13], tz = m[14];
+
+	 T const bc0 = b1 * c2 - b2 * c1, bc1 = b2 * c0 - b0 * c2, bc2 = b0 * c1 - b1 * c0;
+	 T const ca0 = c1 * a2 - c2 * a1, ca1 = c2 * a0 - c0 * a2, ca2 = c0 * a1 - c1 * a0;
+	 T const ab0 = a1 * b2 - a2 * b1, ab1 = a2 * b0 - a0 * b2, ab2 = a0 * b1 - a1 * b0;
+	 T const d = a0 * bc0 + a1 * bc1 + a2 * bc2;
+	 assert(d != T(0));
+	 T const r = T(1) / d;
+
+	 Matrix44<T> mres(bc0 * r, ca0 * r, ab0 * r, T(0),
+			  bc1 * r, ca1 * r, ab1 * r, T(0),
+			  bc2 * r, ca2 * r, ab2 * r, T(0),
+			  T(0),    T(0),    T(0),    T(1));
+	 mres[12] = -(mres[0] * tx + mres[4] * ty + mres[8]  * tz);
+	 mres[13] = -(mres[1] * tx + mres[5] * ty + mres[9]  * tz);
+	 mres[14] = -(mres[2] * tx + mres[6] * ty + mres[10] * tz);
+	 return mres;
+	 }
+
+#if defined(ARDA_MATH_SSE2)
+      // The same, on whole columns.
+      template <>
+      inline Matrix44<float> inverse_rigid<float>(Matrix44<float> const & m)
+	 {
+	 assert(is_rigid(m));
+	 __m128 c0 = _mm_loadu_ps(m.m);
+	 __m128 c1 = _mm_loadu_ps(m.m + 4);
+	 __m128 c2 = _mm_loadu_ps(m.m + 8);
+	 __m128 c3 = _mm_loadu_ps(m.m + 12);
+	 __m128 const tx = _mm_shuffle_ps(c3, c3, _MM_SHUFFLE(0,0,0,0));
+	 __m128 const ty = _mm_shuffle_ps(c3, c3, _MM_SHUFFLE(1,1,1,1));
+	 __m128 const tz = _mm_shuffle_ps(c3, c3, _MM_SHUFFLE(2,2,2,2));
+	 // After the transpose the first three columns are the transposed
+	 // rotation, with garbage (the old translation) in the last row.
+	 _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	 __m128 const xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	 __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, tx), _mm_mul_ps(c1, ty)), _mm_mul_ps(c2, tz));
+	 t = _mm_or_ps(_mm_andnot_ps(xyz, _mm_set1_ps(1.0f)),
+		       _mm_and_ps(xyz, _mm_xor_ps(t, _mm_set1_ps(-0.0f))));
+	 Matrix44<float> mres;
+	 _mm_storeu_ps(mres.m,      _mm_and_ps(c0, xyz));
+	 _mm_storeu_ps(mres.m + 4,  _mm_and_ps(c1, xyz));
+	 _mm_storeu_ps(mres.m + 8,  _mm_and_ps(c2, xyz));
+	 _mm_storeu_ps(mres.m + 12, t);
+	 return mres;
+	 }
 
+      template <>
+      inline Matrix44<float> inverse_affine<float>(Matrix44<float> const & m)
+	 {
+	 assert(is_affine(m));
+	 __m128 const a = _mm_loadu_ps(m.m);
+	 __m128 const b = _mm_loadu_ps(m.m + 4);
+	 __m128 const c = _mm_loadu_ps(m.m + 8);
+	 __m128 const t = _mm_loadu_ps(m.m + 12);
+	 // (y z x) and (z x y) of each column; the w lanes are 0 and stay 0.
+	 __m128 const a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,0,2,1));
+	 __m128 const a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,1,0,2));
+	 __m128 const b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,0,2,1));
+	 __m128 const b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,1,0,2));
+	 __m128 const c_yzx = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,0,2,1));
+	 __m128 const c_zxy = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,1,0,2));
+	 __m128 r0 = _mm_sub_ps(_mm_mul_ps(b_yzx, c_zxy), _mm_mul_ps(b_zxy, c_yzx));
+	 __m128 r1 = _mm_sub_ps(_mm_mul_ps(c_yzx, a_zxy), _mm_mul_ps(c_zxy, a_yzx));
+	 __m128 r2 = _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+
+	 // det = a . (b x c), summed into every lane
+	 __m128 d = _mm_mul_ps(a, r0);
+	 d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2,3,0,1)));
+	 d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1,0,3,2)));
+	 assert(_mm_cvtss_f32(d) != 0.0f);
+	 __m128 const r = _mm_div_ps(_mm_set1_ps(1.0f), d);
+	 r0 = _mm_mul_ps(r0, r);
+	 r1 = _mm_mul_ps(r1, r);
+	 r2 = _mm_mul_ps(r2, r);
+
+	 // r0, r1, r2 are the rows of the inverse; transpose them to columns.
+	 __m128 r3 = _mm_setzero_ps();
+	 _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	 __m128 tt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0,0,0,0))),
+					   _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1,1,1,1)))),
+				_mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2,2,2,2))));
+	 tt = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), tt);
+	 Matrix44<float> mres;
+	 _mm_storeu_ps(mres.m,      r0);
+	 _mm_storeu_ps(mres.m + 4,  r1);
+	 _mm_storeu_ps(mres.m + 8,  r2);
+	 _mm_storeu_ps(mres.m + 12, tt);
+	 return mres;
+	 }
+#endif // ARDA_MATH_SSE2
 
-      //////////////////////////////////////////////////////////////////////////
-      // Matrix functions
-      // TODO: The determinant functions suffer from some bad round off error.
-      // Is it significant?  I don't know.  None of the other game engines
-      // I've checked bother to do anything to calculate det more accurately.
-      // So maybe it just doesn't matter enough for game purposes.
+      ////////////////////////////////////////
+      // Matrix34 functions.  det() and the inverse are those of the 4x4
+      // matrix, which only depend on the upper 3x3.
+      //
+      // transform_point()      M * (p, 1), i.e. A p + t.
+      // transform_direction()  M * (v, 0), i.e. A v.
 
       template <typename T> 
-      inline double det(Matrix22<T> const & m)
-	 { 
-	 return (double) (m[0] * m[3]) - (double) (m[1] * m[2]); 
+      inline constexpr double det(Matrix34<T> const & m)
+	 {
+	 Matrix33<T> const a(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8]);
+	 return detail::Cofactors33<T, double>(a).det(a);
 	 }
 
       template <typename T> 
-      inline Matrix22<T> transpose(Matrix22<T> const & m)
+      inline bool try_inverse(Matrix34<T> const & m, Matrix34<T> & mres, double epsilon = 0.0)
 	 {
-	 const int size=2;
-	 Matrix22<T> mres(0);
-	 int i, j;
-	 for (i=0; i<size; ++i)
-	    for (j=0; j<size; j++)
-	       mres[size*i+j] = m[size*j+i];
+	 Matrix33<T> const a(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8]);
+	 detail::Cofactors33<T, double> const cf(a);
+	 double const d = cf.det(a);
+	 if (!(fabs(d) > epsilon))
+	    return false;
+	 double const r = 1.0 / d;
+	 double const tx = m[9], ty = m[10], tz = m[11];
+	 int i;
+	 for (i=0; i<3; ++i)
+	    mres[9+i] = (T) (-(cf.c[i] * tx + cf.c[3+i] * ty + cf.c[6+i] * tz) * r);
+	 for (i=0; i<9; ++i)
+	    mres[i] = (T) (cf.c[i] * r);
+	 return true;
+	 }
+
+      template <typename T> 
+      inline Matrix34<T> inverse(Matrix34<T> const & m)
+	 {
+	 Matrix34<T> mres;
+	 bool const ok = try_inverse(m, mres);
+	 assert(ok);
+	 (void) ok;
 	 return mres;
 	 }
 
       template <typename T> 
-      inline double det(Matrix33<T> const & m)
+      inline constexpr Vector3<T> transform_point(Matrix34<T> const & m, Vector3<T> const & p)
 	 {
-	 return   m[0] * ( (double) m[4] * m[8] - (double) m[5] * m[7])  
-	       -  m[3] * ( (double) m[1] * m[8] - (double) m[2] * m[7]) 
-	       +  m[6] * ( (double) m[1] * m[5] - (double) m[2] * m[4]);
+	 return Vector3<T>(m[0] * p.x + m[3] * p.y + m[6] * p.z + m[9],
+			   m[1] * p.x + m[4] * p.y + m[7] * p.z + m[10],
+			   m[2] * p.x + m[5] * p.y + m[8] * p.z + m[11]);
 	 }
+
       template <typename T> 
-      inline Matrix33<T> transpose(Matrix33<T> const & m)
+      inline constexpr Vector3<T> transform_direction(Matrix34<T> const & m, Vector3<T> const & v)
 	 {
-	 const int size=3;
-	 Matrix33<T> mres(0);
-	 int i, j;
-	 for (i=0; i<size; ++i)
-	    for (j=0; j<size; j++)
-	       mres[size*i+j] = m[size*j+i];
+	 return Vector3<T>(m[0] * v.x + m[3] * v.y + m[6] * v.z,
+			   m[1] * v.x + m[4] * v.y + m[7] * v.z,
+			   m[2] * v.x + m[5] * v.y + m[8] * v.z);
+	 }
+
+#if defined(ARDA_MATH_SSE2)
+      // As the Matrix44 product: column i of the result is the columns of
+      // *this weighted by the elements of column i of m2, plus the
+      // translation of *this for the last column.
+      //
+      // The 3 element columns straddle 16 byte boundaries, so the matrix is
+      // loaded and stored as 3 whole registers and the columns are shuffled
+      // out and back in.  Loading or storing the columns directly, overlapped,
+      // is slower: a 16 byte load that spans two earlier stores (e.g. of
+      // the copy made by operator*) can't be forwarded from them.
+      template <>
+      inline Matrix34<float>& Matrix34<float>::operator*=(Matrix34<float> const & m2)
+	 {
+	 __m128 const x0 = _mm_loadu_ps(m);       // a0 a1 a2 a3
+	 __m128 const x1 = _mm_loadu_ps(m + 4);   // a4 a5 a6 a7
+	 __m128 const x2 = _mm_loadu_ps(m + 8);   // a8 t0 t1 t2
+	 __m128 const t = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(1,0,3,3));   // a3 a3 a4 a5
+	 __m128 const c0 = x0;
+	 __m128 const c1 = _mm_shuffle_ps(t, t, _MM_SHUFFLE(3,3,2,1));
+	 __m128 const c2 = _mm_shuffle_ps(x1, x2, _MM_SHUFFLE(0,0,3,2));
+	 __m128 const c3 = _mm_shuffle_ps(x2, x2, _MM_SHUFFLE(3,3,2,1));
+	 float const * const b = m2.m;
+	 __m128 r[4];
+	 int i;
+	 for (i=0; i<4; ++i)
+	    {
+	    r[i] = _mm_mul_ps(c0, _mm_set1_ps(b[3*i]));
+	    r[i] = _mm_add_ps(r[i], _mm_mul_ps(c1, _mm_set1_ps(b[3*i+1])));
+	    r[i] = _mm_add_ps(r[i], _mm_mul_ps(c2, _mm_set1_ps(b[3*i+2])));
+	    }
+	 r[3] = _mm_add_ps(r[3], c3);
+
+	 __m128 const t01 = _mm_shuffle_ps(r[0], r[1], _MM_SHUFFLE(0,0,2,2));    // r0z r0z r1x r1x
+	 __m128 const t23 = _mm_shuffle_ps(r[2], r[3], _MM_SHUFFLE(0,0,2,2));    // r2z r2z r3x r3x
+	 _mm_storeu_ps(m,     _mm_shuffle_ps(r[0], t01, _MM_SHUFFLE(2,0,1,0)));
+	 _mm_storeu_ps(m + 4, _mm_shuffle_ps(r[1], r[2], _MM_SHUFFLE(1,0,2,1)));
+	 _mm_storeu_ps(m + 8, _mm_shuffle_ps(t23, r[3], _MM_SHUFFLE(2,1,2,0)));
+	 return *this;
+	 }
+#endif // ARDA_MATH_SSE2
+
+      ////////////////////////////////////////
+      // Matrices tagged with their kind
+      //
+      // TaggedMatrix44 is a Matrix44 plus a MatrixKind saying how much
+      // structure it has.  Products, det(), and inverse() of tagged matrices
+      // use the tags to skip work: the product of two translations is an
+      // add, identity is a copy, the inverse of a rigid matrix is a
+      // transpose, and (in the generic templates) affine products skip the
+      // bottom row.  The tag of a product is worked out from the tags of its
+      // factors.
+      //
+      // The inverses are several times faster than the dense inverse.  The
+      // dense SIMD product is already cheap, so the product shortcuts only
+      // pay when the copy of the result is avoided, i.e. with multiply()
+      // rather than operator*(), and with AVX the dense product is faster
+      // still.  Without SIMD, the shortcuts halve the cost of a product.
+      //
+      // The kinds, from most to least structured:
+      //
+      // IDENTITY
+      // TRANSLATION  Identity upper 3x3.
+      // SCALE        Diagonal upper 3x3, no translation.
+      // ROTATION     Orthonormal upper 3x3, no translation.
+      // RIGID        Orthonormal upper 3x3 and a translation.
+      // AFFINE       Bottom row 0 0 0 1.
+      // PROJECTIVE   Anything.
+      //
+      // The Transform.h builders have overloads that take a TaggedMatrix44
+      // and set the tag.  A TaggedMatrix44 constructed from a plain Matrix44
+      // without a kind is classified by classify(), which only picks the
+      // kinds that hold exactly, so a rotation computed in floating point
+      // (orthonormal only to within rounding) is AFFINE unless a builder
+      // tagged it.  If you change mat directly, set kind to match;
+      // PROJECTIVE is always safe.
+      //
+      // Products of ROTATION and RIGID matrices stay tagged as such, though
+      // rounding makes them drift away from orthonormal.  inverse() checks
+      // them against is_rigid()'s tolerance and falls back to
+      // inverse_affine() (and an AFFINE result) for one that has drifted
+      // past it.
+
+      enum class MatrixKind { IDENTITY, TRANSLATION, SCALE, ROTATION, RIGID, AFFINE, PROJECTIVE };
+
+      // The kind of a * b.
+      inline MatrixKind kind_product(MatrixKind const a, MatrixKind const b)
+	 {
+	 if (a == MatrixKind::IDENTITY)
+	    return b;
+	 if (b == MatrixKind::IDENTITY || a == b)
+	    return a;
+	 if (a == MatrixKind::PROJECTIVE || b == MatrixKind::PROJECTIVE)
+	    return MatrixKind::PROJECTIVE;
+	 bool const ra = a == MatrixKind::TRANSLATION || a == MatrixKind::ROTATION || a == MatrixKind::RIGID;
+	 bool const rb = b == MatrixKind::TRANSLATION || b == MatrixKind::ROTATION || b == MatrixKind::RIGID;
+	 return ra && rb ? MatrixKind::RIGID : MatrixKind::AFFINE;
+	 }
+
+      template <typename T>
+      inline MatrixKind classify(Matrix44<T> const & m)
+	 {
+	 if (!is_affine(m))
+	    return MatrixKind::PROJECTIVE;
+	 bool const no_translation = m[12] == T(0) && m[13] == T(0) && m[14] == T(0);
+	 bool const diagonal = m[1] == T(0) && m[2] == T(0) && m[4] == T(0) &&
+			       m[6] == T(0) && m[8] == T(0) && m[9] == T(0);
+	 if (diagonal && m[0] == T(1) && m[5] == T(1) && m[10] == T(1))
+	    return no_translation ? MatrixKind::IDENTITY : MatrixKind::TRANSLATION;
+	 if (diagonal && no_translation)
+	    return MatrixKind::SCALE;
+	 if (is_rigid(m, 0.0))
+	    return no_translation ? MatrixKind::ROTATION : MatrixKind::RIGID;
+	 return MatrixKind::AFFINE;
+	 }
+
+      namespace detail
+	 {
+	 // Whether the upper 3x3 of m is orthonormal to within is_rigid()'s
+	 // default tolerance.  This is the test inverse() makes of every
+	 // ROTATION and RIGID matrix, so it is done in T and without branches,
+	 // which is several times cheaper than is_rigid().
+	 template <typename T>
+	 inline bool orthonormal33(Matrix44<T> const & m)
+	    {
+	    T const e = std::abs(m[0] * m[0] + m[1] * m[1] + m[2]  * m[2]  - T(1))
+		      + std::abs(m[4] * m[4] + m[5] * m[5] + m[6]  * m[6]  - T(1))
+		      + std::abs(m[8] * m[8] + m[9] * m[9] + m[10] * m[10] - T(1))
+		      + std::abs(m[0] * m[4] + m[1] * m[5] + m[2]  * m[6])
+		      + std::abs(m[0] * m[8] + m[1] * m[9] + m[2]  * m[10])
+		      + std::abs(m[4] * m[8] + m[5] * m[9] + m[6]  * m[10]);
+	    return e <= T(1e-4);
+	    }
+
+	 // Products of affine matrices (bottom row 0 0 0 1) with shortcuts for
+	 // the kinds that need them.  The bottom rows of a and b are taken to
+	 // be 0 0 0 1, and so is that of mres.  mres must not be a or b.
+	 //
+	 // affine_product()        a * b
+	 // translation_product()   a * b for a translation a
+	 // product_translation()   a * b for a translation b
+	 // product_scale()         a * b for a scale b
+
+	 template <typename T>
+	 inline void affine_product(Matrix44<T> const & a, Matrix44<T> const & b, Matrix44<T> & mres)
+	    {
+	    int i;
+	    for (i=0; i<4; ++i)
+	       {
+	       T const x = b[4*i], y = b[4*i+1], z = b[4*i+2];
+	       mres[4*i]   = a[0] * x + a[4] * y + a[8]  * z;
+	       mres[4*i+1] = a[1] * x + a[5] * y + a[9]  * z;
+	       mres[4*i+2] = a[2] * x + a[6] * y + a[10] * z;
+	       mres[4*i+3] = T(0);
+	       }
+	    mres[12] += a[12]; mres[13] += a[13]; mres[14] += a[14];
+	    mres[15] = T(1);
+	    }
+
+	 template <typename T>
+	 inline void translation_product(Matrix44<T> const & a, Matrix44<T> const & b, Matrix44<T> & mres)
+	    {
+	    mres.assign(b[0],  b[1],  b[2],  T(0),
+			b[4],  b[5],  b[6],  T(0),
+			b[8],  b[9],  b[10], T(0),
+			b[12] + a[12], b[13] + a[13], b[14] + a[14], T(1));
+	    }
+
+	 template <typename T>
+	 inline void product_translation(Matrix44<T> const & a, Matrix44<T> const & b, Matrix44<T> & mres)
+	    {
+	    T const x = b[12], y = b[13], z = b[14];
+	    mres.assign(a[0],  a[1],  a[2],  T(0),
+			a[4],  a[5],  a[6],  T(0),
+			a[8],  a[9],  a[10], T(0),
+			a[0] * x + a[4] * y + a[8]  * z + a[12],
+			a[1] * x + a[5] * y + a[9]  * z + a[13],
+			a[2] * x + a[6] * y + a[10] * z + a[14], T(1));
+	    }
+
+	 template <typename T>
+	 inline void product_scale(Matrix44<T> const & a, Matrix44<T> const & b, Matrix44<T> & mres)
+	    {
+	    T const x = b[0], y = b[5], z = b[10];
+	    mres.assign(a[0] * x, a[1] * x, a[2]  * x, T(0),
+			a[4] * y, a[5] * y, a[6]  * y, T(0),
+			a[8] * z, a[9] * z, a[10] * z, T(0),
+			a[12], a[13], a[14], T(1));
+	    }
+
+#if defined(ARDA_MATH_SSE2)
+	 // The columns of an affine matrix have 0 (or for the last, 1) in lane
+	 // 3, so these come out with the right bottom row without being told.
+	 //
+	 // The result is written whole, with the widest stores the compiler
+	 // will use to copy it (32 bytes with AVX).  Patching single elements
+	 // of a copy, or storing 16 bytes at a time under AVX, is much slower,
+	 // since the wide loads of the next copy of the result can't be
+	 // forwarded from narrower stores.
+	 inline void store_columns(float * p, __m128 c0, __m128 c1, __m128 c2, __m128 c3)
+	    {
+#if defined(ARDA_MATH_AVX)
+	    _mm256_storeu_ps(p,     _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c1, 1));
+	    _mm256_storeu_ps(p + 8, _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c3, 1));
+#else
+	    _mm_storeu_ps(p,      c0);
+	    _mm_storeu_ps(p + 4,  c1);
+	    _mm_storeu_ps(p + 8,  c2);
+	    _mm_storeu_ps(p + 12, c3);
+#endif
+	    }
+
+	 // Skipping the bottom row saves a quarter of the multiplies, but
+	 // the SIMD dense products need no fewer loads, shuffles, and stores,
+	 // and measure as fast or faster, so they are used instead.
+	 template <>
+	 inline void affine_product<float>(Matrix44<float> const & a, Matrix44<float> const & b,
+					   Matrix44<float> & mres)
+	    { mres = a * b; }
+
+	 template <>
+	 inline void affine_product<double>(Matrix44<double> const & a, Matrix44<double> const & b,
+					    Matrix44<double> & mres)
+	    { mres = a * b; }
+
+	 template <>
+	 inline void translation_product<float>(Matrix44<float> const & a, Matrix44<float> const & b,
+						Matrix44<float> & mres)
+	    {
+	    __m128 const t = _mm_sub_ps(_mm_loadu_ps(a.m + 12), _mm_set_ps(1, 0, 0, 0));
+	    store_columns(mres.m, _mm_loadu_ps(b.m), _mm_loadu_ps(b.m + 4), _mm_loadu_ps(b.m + 8),
+			  _mm_add_ps(_mm_loadu_ps(b.m + 12), t));
+	    }
+
+	 template <>
+	 inline void product_translation<float>(Matrix44<float> const & a, Matrix44<float> const & b,
+						Matrix44<float> & mres)
+	    {
+	    __m128 const a0 = _mm_loadu_ps(a.m);
+	    __m128 const a1 = _mm_loadu_ps(a.m + 4);
+	    __m128 const a2 = _mm_loadu_ps(a.m + 8);
+	    __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[12]));
+	    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[13])));
+	    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[14])));
+	    store_columns(mres.m, a0, a1, a2, _mm_add_ps(r, _mm_loadu_ps(a.m + 12)));
+	    }
+
+	 template <>
+	 inline void product_scale<float>(Matrix44<float> const & a, Matrix44<float> const & b,
+					  Matrix44<float> & mres)
+	    {
+	    store_columns(mres.m,
+			  _mm_mul_ps(_mm_loadu_ps(a.m),     _mm_set1_ps(b[0])),
+			  _mm_mul_ps(_mm_loadu_ps(a.m + 4), _mm_set1_ps(b[5])),
+			  _mm_mul_ps(_mm_loadu_ps(a.m + 8), _mm_set1_ps(b[10])),
+			  _mm_loadu_ps(a.m + 12));
+	    }
+#endif // ARDA_MATH_SSE2
+	 } // namespace detail
+
+      template <typename T>
+      class TaggedMatrix44
+	 {
+	 public:
+	 Matrix44<T> mat;
+	 MatrixKind kind;
+
+	 // Constructors
+	 TaggedMatrix44() : kind (MatrixKind::PROJECTIVE) {}
+	 explicit TaggedMatrix44(Matrix44<T> const & m) : mat (m), kind (classify(m)) {}
+	 TaggedMatrix44(Matrix44<T> const & m, MatrixKind const k) : mat (m), kind (k) {}
+
+	 // Element access is read only, since writing could invalidate kind.
+	 inline T operator[](unsigned int const i) const
+	    { return mat[i]; }
+
+	 // Comparison
+	 inline bool operator==(TaggedMatrix44<T> const & m2) const
+	    { return mat == m2.mat; }
+	 inline bool operator!=(TaggedMatrix44<T> const & m2) const
+	    { return ! (*this == m2); }
+
+	 // Matrix multiplication; see also multiply() below.
+	 inline TaggedMatrix44<T> operator*(TaggedMatrix44<T> const & m2) const;
+	 inline TaggedMatrix44<T>& operator*=(TaggedMatrix44<T> const & m2)
+	    { return *this = *this * m2; }
+
+	 inline TaggedMatrix44<T>& setidentity()
+	    { mat.setidentity(); kind = MatrixKind::IDENTITY; return *this; }
+	 };
+
+      // mres = a * b, which is operator*() without the copy of the result.
+      // mres must not be a or b.
+      template <typename T>
+      inline void multiply(TaggedMatrix44<T> const & a, TaggedMatrix44<T> const & b, TaggedMatrix44<T> & mres)
+	 {
+	 assert(&mres != &a && &mres != &b);
+	 bool const affine = a.kind != MatrixKind::PROJECTIVE && b.kind != MatrixKind::PROJECTIVE;
+	 if (b.kind == MatrixKind::IDENTITY)
+	    mres.mat = a.mat;
+	 else if (a.kind == MatrixKind::IDENTITY)
+	    mres.mat = b.mat;
+	 else if (!affine)
+	    mres.mat = a.mat * b.mat;
+	 else if (a.kind == MatrixKind::TRANSLATION)
+	    detail::translation_product(a.mat, b.mat, mres.mat);
+	 else if (b.kind == MatrixKind::TRANSLATION)
+	    detail::product_translation(a.mat, b.mat, mres.mat);
+	 else if (b.kind == MatrixKind::SCALE)
+	    detail::product_scale(a.mat, b.mat, mres.mat);
+	 else
+	    detail::affine_product(a.mat, b.mat, mres.mat);
+	 mres.kind = kind_product(a.kind, b.kind);
+	 }
+
+      template <typename T>
+      inline TaggedMatrix44<T> TaggedMatrix44<T>::operator*(TaggedMatrix44<T> const & m2) const
+	 {
+	 TaggedMatrix44<T> mres;
+	 multiply(*this, m2, mres);
 	 return mres;
 	 }
 
-      template <typename T> 
-      inline double det(Matrix44<T> const & m)
-	 { 
-	 return  m[0]  * (  m[5]  * (m[10] * m[15] - m[11] * m[14])
-		          - m[9]  * (m[6]  * m[15] - m[7]  * m[14])
-		          + m[13] * (m[6]  * m[11] - m[7]  * m[10]))
-	       - m[4]  * (  m[1]  * (m[10] * m[15] - m[11] * m[14])
-		          - m[9]  * (m[2]  * m[15] - m[3]  * m[14])
-		          + m[13] * (m[2]  * m[11] - m[3]  * m[10]))
-	       + m[8]  * (  m[1]  * (m[6]  * m[15] - m[7]  * m[14])
-		          - m[5]  * (m[2]  * m[15] - m[3]  * m[14])
-		          + m[13] * (m[2]  * m[7]  - m[3]  * m[6]))
-	       + m[12] * (  m[1]  * (m[6]  * m[11] - m[7]  * m[10])
-		          - m[5]  * (m[2]  * m[11] - m[3]  * m[10])
-		          + m[9]  * (m[2]  * m[7]  - m[3]  * m[6]));
+      template <typename T>
+      inline double det(TaggedMatrix44<T> const & m)
+	 {
+	 switch (m.kind)
+	    {
+	    case MatrixKind::IDENTITY:
+	    case MatrixKind::TRANSLATION:
+	       return 1.0;
+	    case MatrixKind::SCALE:
+	       return (double) m[0] * m[5] * m[10];
+	    case MatrixKind::PROJECTIVE:
+	       return det(m.mat);
+	    default:
+	       {
+	       // Rotations can be reflections, so these need the 3x3
+	       // determinant too.
+	       Matrix33<T> const a(m[0], m[1], m[2], m[4], m[5], m[6], m[8], m[9], m[10]);
+	       return detail::Cofactors33<T, double>(a).det(a);
+	       }
+	    }
 	 }
-      template <typename T> 
-      inline Matrix44<T> transpose(Matrix44<T> const & m)
+
+      template <typename T>
+      inline TaggedMatrix44<T> inverse(TaggedMatrix44<T> const & m)
 	 {
-	 const int size=4;
-	 Matrix44<T> mres(0);
-	 int i, j;
-	 for (i=0; i<size; ++i)
-	    for (j=0; j<size; j++)
-	       mres[size*i+j] = m[size*j+i];
+	 TaggedMatrix44<T> mres(m);
+	 switch (m.kind)
+	    {
+	    case MatrixKind::IDENTITY:
+	       break;
+	    case MatrixKind::TRANSLATION:
+	       mres.mat[12] = -m[12]; mres.mat[13] = -m[13]; mres.mat[14] = -m[14];
+	       break;
+	    case MatrixKind::SCALE:
+	       assert(m[0] != T(0) && m[5] != T(0) && m[10] != T(0));
+	       mres.mat[0] = T(1) / m[0]; mres.mat[5] = T(1) / m[5]; mres.mat[10] = T(1) / m[10];
+	       break;
+	    case MatrixKind::ROTATION:
+	    case MatrixKind::RIGID:
+	       if (detail::orthonormal33(m.mat))
+		  mres.mat = inverse_rigid(m.mat);
+	       else
+		  {
+		  mres.mat = inverse_affine(m.mat);
+		  mres.kind = MatrixKind::AFFINE;
+		  }
+	       break;
+	    case MatrixKind::AFFINE:
+	       mres.mat = inverse_affine(m.mat);
+	       break;
+	    case MatrixKind::PROJECTIVE:
+	       mres.mat = inverse(m.mat);
+	       break;
+	    }
 	 return mres;
 	 }
 
+      template <typename T>
+      inline Vector4<T> operator*(TaggedMatrix44<T> const & m, Vector4<T> const & v)
+	 { return m.mat * v; }
+
+      typedef TaggedMatrix44<float> TaggedMatrix44f;
+      typedef TaggedMatrix44<double> TaggedMatrix44d;
+
       } // namespace Math
    } // namespace arda
 
@@ -894,37 +1517,32 @@ namespace arda
 ////////////////////////////////////////////////////////////////////////////////
 // Matrix methods
 
-template <typename T> 
-std::string arda::Math::Matrix22<T>::to_string(void) const
+template <typename T, unsigned int R, unsigned int C> 
+std::string arda::Math::Matrix<T, R, C>::to_string(void) const
    {
    std::stringstream ss;
-   ss << "[ "
-	 "[ " << m[0] << ", " << m[1] << " ], "
-	 "[ " << m[2] << ", " << m[3] << " ] ]";
+   ss << "[ ";
+   unsigned int i, j;
+   for (i=0; i<C; ++i)
+      {
+      ss << (i ? ", [ " : "[ ") << m[i*R];
+      for (j=1; j<R; ++j)
+	 ss << ", " << m[i*R + j];
+      ss << " ]";
+      }
+   ss << " ]";
    return ss.str();
    }
 
 template <typename T> 
-std::string arda::Math::Matrix33<T>::to_string(void) const
+std::string arda::Math::Matrix34<T>::to_string(void) const
    {
    std::stringstream ss;
    ss << "[ "
 	 "[ " << m[0] << ", " << m[1] << ", " << m[2] << " ], "
 	 "[ " << m[3] << ", " << m[4] << ", " << m[5] << " ], "
-	 "[ " << m[6] << ", " << m[7] << ", " << m[8] << " ], ""]";
-   return ss.str();
-   }
-
-
-template <typename T> 
-std::string arda::Math::Matrix44<T>::to_string(void) const
-   {
-   std::stringstream ss;
-   ss << "[ "
-	 "[ " << m[0] << ", " << m[1] << ", " << m[2] << ", " << m[3] << " ], "
-	 "[ " << m[4] << ", " << m[5] << ", " << m[6] << ", " << m[7] << " ], "
-	 "[ " << m[8] << ", " << m[9] << ", " << m[10] << ", " << m[11] << " ], "
-	 "[ " << m[12] << ", " << m[13] << ", " << m[14] << ", " << m[15] << " ], ""]";
+	 "[ " << m[6] << ", " << m[7] << ", " << m[8] << " ], "
+	 "[ " << m[9] << ", " << m[10] << ", " << m[11] << " ] ]";
    return ss.str();
    }
 
@@ -0,0 +1,396 @@
+#ifndef PACKET_H_
+#define PACKET_H_
+
+// Needs Vector.h and Matrix.h, but this file is not intended to be included
+// directly.  Just include Math.h and everything will be set up correctly.
+
+#include "Simd.h"
+
+#include <cassert>
+#include <iostream>
+#include <type_traits>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Packet types.
+      //
+      // A packet is a SIMD register of floats that acts like a single scalar,
+      // so that the Vector and Matrix templates can be instantiated with it.
+      // A Vector3<Packet8f> is 8 Vector3f's in "array of structures of arrays"
+      // layout, and all of the usual Vector and Matrix code runs on all 8 lanes
+      // at once.  That lets one templated algorithm run either on a single
+      // Vector3f or 8 wide.
+      //
+      // Packet4f    4 floats (SSE).  Available when ARDA_MATH_SSE2 is defined.
+      // Packet8f    8 floats (AVX).  Available when ARDA_MATH_AVX is defined.
+      //
+      // Packets convert implicitly from float (broadcast to all lanes), so
+      // int, float, and double constants and scalars work as they do with
+      // float.  Arithmetic operators and sqrt(), abs(), min(), and max() work
+      // lane by lane.
+      //
+      // == and != compare all lanes and return a bool, so that the Vector and
+      // Matrix comparison operators still mean "every element is equal".  Use
+      // cmpeq(), cmplt(), etc. for per lane masks, and select(), any(), and
+      // all() to consume them.
+      //
+      // The following differ from the scalar Vector and Matrix versions:
+      //
+      // length()    Returns a packet rather than a double.
+      // normalize() Leaves zero length lanes alone, per lane.
+      // det()       Returns a packet rather than a double, and is computed in
+      //             float.
+      //
+      // load() and store() need 16 (Packet4f) or 32 (Packet8f) byte aligned
+      // pointers, which the element arrays of the SoA containers are at
+      // multiples of 8 vectors.  loadu() and storeu() take any pointer.
+      // Packets themselves need the same alignment, which the compiler takes
+      // care of on the stack and, since we build as C++17, in new and
+      // std::allocator as well.
+      //
+      // Any size of Vector and Matrix works.  Typedefs are provided for
+      // Vector2/3/4 and Matrix22/33/44 of each packet type, e.g. Vector3x4f and Matrix44x8f.
+
+      template <typename T>
+      struct IsPacket
+	 {
+	 static bool const value = false;
+	 };
+
+#if defined(ARDA_MATH_SSE2)
+      //////////////////////////////////////////////////////////////////////////
+      class Packet4f
+	 {
+	 public:
+	 static unsigned int const size = 4;
+	 __m128 v;
+
+	 // Constructors
+	 Packet4f() = default;
+	 Packet4f(float a) : v(_mm_set1_ps(a)) {}
+	 Packet4f(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+	 explicit Packet4f(__m128 a) : v(a) {}
+
+	 static inline Packet4f load(float const * p)
+	    { assert(((size_t) p & 15) == 0); return Packet4f(_mm_load_ps(p)); }
+	 static inline Packet4f loadu(float const * p)
+	    { return Packet4f(_mm_loadu_ps(p)); }
+	 inline void store(float * p) const
+	    { assert(((size_t) p & 15) == 0); _mm_store_ps(p, v); }
+	 inline void storeu(float * p) const
+	    { _mm_storeu_ps(p, v); }
+
+	 // Read lane i
+	 inline float operator[](unsigned int const i) const
+	    { assert(i<size); float a[size]; _mm_storeu_ps(a, v); return a[i]; }
+
+	 inline Packet4f& operator+=(Packet4f const & a)
+	    { v = _mm_add_ps(v, a.v); return *this; }
+	 inline Packet4f& operator-=(Packet4f const & a)
+	    { v = _mm_sub_ps(v, a.v); return *this; }
+	 inline Packet4f& operator*=(Packet4f const & a)
+	    { v = _mm_mul_ps(v, a.v); return *this; }
+	 inline Packet4f& operator/=(Packet4f const & a)
+	    { v = _mm_div_ps(v, a.v); return *this; }
+	 };
+
+      template <>
+      struct IsPacket<Packet4f>
+	 {
+	 static bool const value = true;
+	 };
+
+      inline Packet4f operator+(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_add_ps(a.v, b.v)); }
+      inline Packet4f operator-(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_sub_ps(a.v, b.v)); }
+      inline Packet4f operator*(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_mul_ps(a.v, b.v)); }
+      inline Packet4f operator/(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_div_ps(a.v, b.v)); }
+      inline Packet4f operator-(Packet4f const & a)
+	 { return Packet4f(_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))); }
+
+      // Lane masks
+      inline Packet4f cmpeq(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_cmpeq_ps(a.v, b.v)); }
+      inline Packet4f cmpneq(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_cmpneq_ps(a.v, b.v)); }
+      inline Packet4f cmplt(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_cmplt_ps(a.v, b.v)); }
+      inline Packet4f cmple(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_cmple_ps(a.v, b.v)); }
+      inline Packet4f cmpgt(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_cmpgt_ps(a.v, b.v)); }
+      inline Packet4f cmpge(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_cmpge_ps(a.v, b.v)); }
+
+      // a where mask is set, otherwise b
+      inline Packet4f select(Packet4f const & mask, Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))); }
+      inline bool any(Packet4f const & mask)
+	 { return _mm_movemask_ps(mask.v) != 0; }
+      inline bool all(Packet4f const & mask)
+	 { return _mm_movemask_ps(mask.v) == 0xF; }
+
+      inline bool operator==(Packet4f const & a, Packet4f const & b)
+	 { return all(cmpeq(a, b)); }
+      inline bool operator!=(Packet4f const & a, Packet4f const & b)
+	 { return ! (a == b); }
+
+      inline Packet4f sqrt(Packet4f const & a)
+	 { return Packet4f(_mm_sqrt_ps(a.v)); }
+      inline Packet4f abs(Packet4f const & a)
+	 { return Packet4f(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+      inline Packet4f min(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_min_ps(a.v, b.v)); }
+      inline Packet4f max(Packet4f const & a, Packet4f const & b)
+	 { return Packet4f(_mm_max_ps(a.v, b.v)); }
+
+      inline std::ostream& operator<<(std::ostream & os, Packet4f const & a)
+	 { return os << "(" << a[0] << " " << a[1] << " " << a[2] << " " << a[3] << ")"; }
+
+      template <>
+      struct RealType<Packet4f>
+	 {
+	 typedef Packet4f type;
+	 };
+#endif // ARDA_MATH_SSE2
+
+#if defined(ARDA_MATH_AVX)
+      //////////////////////////////////////////////////////////////////////////
+      class Packet8f
+	 {
+	 public:
+	 static unsigned int const size = 8;
+	 __m256 v;
+
+	 // Constructors
+	 Packet8f() = default;
+	 Packet8f(float a) : v(_mm256_set1_ps(a)) {}
+	 Packet8f(float a, float b, float c, float d, float e, float f, float g, float h)
+	    : v(_mm256_setr_ps(a, b, c, d, e, f, g, h)) {}
+	 explicit Packet8f(__m256 a) : v(a) {}
+
+	 static inline Packet8f load(float const * p)
+	    { assert(((size_t) p & 31) == 0); return Packet8f(_mm256_load_ps(p)); }
+	 static inline Packet8f loadu(float const * p)
+	    { return Packet8f(_mm256_loadu_ps(p)); }
+	 inline void store(float * p) const
+	    { assert(((size_t) p & 31) == 0); _mm256_store_ps(p, v); }
+	 inline void storeu(float * p) const
+	    { _mm256_storeu_ps(p, v); }
+
+	 // Read lane i
+	 inline float operator[](unsigned int const i) const
+	    { assert(i<size); float a[size]; _mm256_storeu_ps(a, v); return a[i]; }
+
+	 inline Packet8f& operator+=(Packet8f const & a)
+	    { v = _mm256_add_ps(v, a.v); return *this; }
+	 inline Packet8f& operator-=(Packet8f const & a)
+	    { v = _mm256_sub_ps(v, a.v); return *this; }
+	 inline Packet8f& operator*=(Packet8f const & a)
+	    { v = _mm256_mul_ps(v, a.v); return *this; }
+	 inline Packet8f& operator/=(Packet8f const & a)
+	    { v = _mm256_div_ps(v, a.v); return *this; }
+	 };
+
+      template <>
+      struct IsPacket<Packet8f>
+	 {
+	 static bool const value = true;
+	 };
+
+      inline Packet8f operator+(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_add_ps(a.v, b.v)); }
+      inline Packet8f operator-(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_sub_ps(a.v, b.v)); }
+      inline Packet8f operator*(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_mul_ps(a.v, b.v)); }
+      inline Packet8f operator/(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_div_ps(a.v, b.v)); }
+      inline Packet8f operator-(Packet8f const & a)
+	 { return Packet8f(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))); }
+
+      // Lane masks
+      inline Packet8f cmpeq(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)); }
+      inline Packet8f cmpneq(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ)); }
+      inline Packet8f cmplt(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OS)); }
+      inline Packet8f cmple(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OS)); }
+      inline Packet8f cmpgt(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OS)); }
+      inline Packet8f cmpge(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OS)); }
+
+      // a where mask is set, otherwise b
+      inline Packet8f select(Packet8f const & mask, Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_blendv_ps(b.v, a.v, mask.v)); }
+      inline bool any(Packet8f const & mask)
+	 { return _mm256_movemask_ps(mask.v) != 0; }
+      inline bool all(Packet8f const & mask)
+	 { return _mm256_movemask_ps(mask.v) == 0xFF; }
+
+      inline bool operator==(Packet8f const & a, Packet8f const & b)
+	 { return all(cmpeq(a, b)); }
+      inline bool operator!=(Packet8f const & a, Packet8f const & b)
+	 { return ! (a == b); }
+
+      inline Packet8f sqrt(Packet8f const & a)
+	 { return Packet8f(_mm256_sqrt_ps(a.v)); }
+      inline Packet8f abs(Packet8f const & a)
+	 { return Packet8f(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)); }
+      inline Packet8f min(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_min_ps(a.v, b.v)); }
+      inline Packet8f max(Packet8f const & a, Packet8f const & b)
+	 { return Packet8f(_mm256_max_ps(a.v, b.v)); }
+
+      inline std::ostream& operator<<(std::ostream & os, Packet8f const & a)
+	 {
+	 os << "(" << a[0];
+	 unsigned int i;
+	 for (i=1; i<Packet8f::size; ++i)
+	    os << " " << a[i];
+	 return os << ")";
+	 }
+
+      template <>
+      struct RealType<Packet8f>
+	 {
+	 typedef Packet8f type;
+	 };
+#endif // ARDA_MATH_AVX
+
+      //////////////////////////////////////////////////////////////////////////
+      // Vector and Matrix scaling by a packet.
+      //
+      // The class operators take int, float, and double scalars, which a
+      // packet does not convert to, so these cover scaling each lane by its
+      // own value (e.g. v * v.dot(v2) with packet vectors).
+
+      // PacketOnly<P, R>::type is R, but only exists when P is a packet type.
+      template <typename P, typename R>
+      struct PacketOnly : std::enable_if<IsPacket<P>::value, R>
+	 {
+	 };
+
+      template <typename P, unsigned int N>
+      inline typename PacketOnly<P, Vector<P, N>&>::type operator*=(Vector<P, N> & v, P const & a)
+	 { unsigned int i; for (i=0; i<N; ++i) v[i] *= a; return v; }
+      template <typename P, unsigned int N>
+      inline typename PacketOnly<P, Vector<P, N>&>::type operator/=(Vector<P, N> & v, P const & a)
+	 { unsigned int i; for (i=0; i<N; ++i) v[i] /= a; return v; }
+
+      template <typename P, unsigned int R, unsigned int C>
+      inline typename PacketOnly<P, Matrix<P, R, C>&>::type operator*=(Matrix<P, R, C> & m, P const & a)
+	 { unsigned int i; for (i=0; i<R*C; ++i) m.m[i] *= a; return m; }
+      template <typename P, unsigned int R, unsigned int C>
+      inline typename PacketOnly<P, Matrix<P, R, C>&>::type operator/=(Matrix<P, R, C> & m, P const & a)
+	 { unsigned int i; for (i=0; i<R*C; ++i) m.m[i] /= a; return m; }
+
+      // The non-assigning forms.
+      template <typename P, unsigned int N>
+      inline typename PacketOnly<P, Vector<P, N>>::type operator*(Vector<P, N> const & v, P const & a)
+	 { Vector<P, N> vres(v); return vres *= a; }
+      template <typename P, unsigned int N>
+      inline typename PacketOnly<P, Vector<P, N>>::type operator*(P const & a, Vector<P, N> const & v)
+	 { Vector<P, N> vres(v); return vres *= a; }
+      template <typename P, unsigned int N>
+      inline typename PacketOnly<P, Vector<P, N>>::type operator/(Vector<P, N> const & v, P const & a)
+	 { Vector<P, N> vres(v); return vres /= a; }
+
+      template <typename P, unsigned int R, unsigned int C>
+      inline typename PacketOnly<P, Matrix<P, R, C>>::type operator*(Matrix<P, R, C> const & m, P const & a)
+	 { Matrix<P, R, C> mres(m); return mres *= a; }
+      template <typename P, unsigned int R, unsigned int C>
+      inline typename PacketOnly<P, Matrix<P, R, C>>::type operator*(P const & a, Matrix<P, R, C> const & m)
+	 { Matrix<P, R, C> mres(m); return mres *= a; }
+      template <typename P, unsigned int R, unsigned int C>
+      inline typename PacketOnly<P, Matrix<P, R, C>>::type operator/(Matrix<P, R, C> const & m, P const & a)
+	 { Matrix<P, R, C> mres(m); return mres /= a; }
+
+      //////////////////////////////////////////////////////////////////////////
+      // Packet versions of normalize() and det().
+
+      namespace detail
+	 {
+	 template <typename P, typename V>
+	 inline V& normalize_lanes(V & v, unsigned int const n)
+	    {
+	    P const l = v.length();
+	    P const nonzero = cmpneq(l, P(0.0f));
+	    unsigned int i;
+	    for (i=0; i<n; ++i)
+	       v[i] = select(nonzero, v[i] / l, v[i]);
+	    return v;
+	    }
+
+	 template <typename P>
+	 inline P det_lanes(Matrix22<P> const & m)
+	    { return m[0] * m[3] - m[1] * m[2]; }
+
+	 template <typename P>
+	 inline P det_lanes(Matrix33<P> const & m)
+	    { return Cofactors33<P, P>(m).det(m); }
+
+	 template <typename P>
+	 inline P det_lanes(Matrix44<P> const & m)
+	    { return SubDet44<P>(m).det(); }
+	 } // namespace detail
+
+#if defined(ARDA_MATH_SSE2)
+      template <>
+      inline Vector2<Packet4f>& Vector2<Packet4f>::normalize()
+	 { return detail::normalize_lanes<Packet4f>(*this, 2); }
+      template <>
+      inline Vector3<Packet4f>& Vector3<Packet4f>::normalize()
+	 { return detail::normalize_lanes<Packet4f>(*this, 3); }
+      template <>
+      inline Vector4<Packet4f>& Vector4<Packet4f>::normalize()
+	 { return detail::normalize_lanes<Packet4f>(*this, 4); }
+
+      inline Packet4f det(Matrix22<Packet4f> const & m) { return detail::det_lanes(m); }
+      inline Packet4f det(Matrix33<Packet4f> const & m) { return detail::det_lanes(m); }
+      inline Packet4f det(Matrix44<Packet4f> const & m) { return detail::det_lanes(m); }
+
+      typedef Vector2<Packet4f> Vector2x4f;
+      typedef Vector3<Packet4f> Vector3x4f;
+      typedef Vector4<Packet4f> Vector4x4f;
+      typedef Matrix22<Packet4f> Matrix22x4f;
+      typedef Matrix33<Packet4f> Matrix33x4f;
+      typedef Matrix44<Packet4f> Matrix44x4f;
+#endif // ARDA_MATH_SSE2
+
+#if defined(ARDA_MATH_AVX)
+      template <>
+      inline Vector2<Packet8f>& Vector2<Packet8f>::normalize()
+	 { return detail::normalize_lanes<Packet8f>(*this, 2); }
+      template <>
+      inline Vector3<Packet8f>& Vector3<Packet8f>::normalize()
+	 { return detail::normalize_lanes<Packet8f>(*this, 3); }
+      template <>
+      inline Vector4<Packet8f>& Vector4<Packet8f>::normalize()
+	 { return detail::normalize_lanes<Packet8f>(*this, 4); }
+
+      inline Packet8f det(Matrix22<Packet8f> const & m) { return detail::det_lanes(m); }
+      inline Packet8f det(Matrix33<Packet8f> const & m) { return detail::det_lanes(m); }
+      inline Packet8f det(Matrix44<Packet8f> const & m) { return detail::det_lanes(m); }
+
+      typedef Vector2<Packet8f> Vector2x8f;
+      typedef Vector3<Packet8f> Vector3x8f;
+      typedef Vector4<Packet8f> Vector4x8f;
+      typedef Matrix22<Packet8f> Matrix22x8f;
+      typedef Matrix33<Packet8f> Matrix33x8f;
+      typedef Matrix44<Packet8f> Matrix44x8f;
+#endif // ARDA_MATH_AVX
+
+      } // namespace Math
+   } // namespace arda
+
+#endif // PACKET_H_
@@ -0,0 +1,516 @@
+#ifndef QUATERNION_H_
+#define QUATERNION_H_
+
+// Needs Vector.h and Matrix.h, but this file is not intended to be included
+// directly.  Just include Math.h and everything will be set up correctly.
+
+#include "Simd.h"
+
+#include <cassert>
+#include <cmath>
+#include <string>
+#include <sstream>
+
+namespace arda
+    {
+    namespace Math
+        {
+        ////////////////////////////////////////////////////////////////////////////////
+        /** \class arda::Math::Quaternion
+         *
+         * \brief Templated quaternion class for representing 3D rotations.
+         *
+         * \tparam T Type is intended to be float and double only.
+         *
+         * \verbatim
+         * The vector part is (x, y, z) and the scalar part is w, stored in that
+         * order so that a Quaternion<float> is one 16 byte SSE register.  The
+         * rotation by angle a about the unit axis v is
+         * (v.x sin(a/2), v.y sin(a/2), v.z sin(a/2), cos(a/2)).
+         *
+         * A rotation is 4 values instead of the 9 of a Matrix33, and composing
+         * two of them is 16 multiplies and 12 adds instead of 27 and 18.  Use
+         * them to store, compose, and interpolate rotations, and convert to a
+         * matrix when many points are to be transformed by the same rotation.
+         *
+         * Supported operations on quaternions
+         *
+         * Construction
+         *     Quaternion q;          * Uninitialized, like the Vector classes.
+         *     Quaternion q(x, y, z, w)
+         *     Quaternion q(v, w)     * From a Vector3 and a scalar part.
+         *     q.setidentity()        * (0, 0, 0, 1), the identity rotation.
+         * []
+         *     q[0], q[1], q[2], and q[3] are q.x, q.y, q.z, and q.w.
+         * == != + += - -= and unary -
+         *     Element wise.  Note that q and -q are the same rotation.
+         * * *= / /=
+         *     Scalar multiplication/division with int, float, and double.
+         * * *=
+         *     Quaternion product.  As with matrices, q1 * q2 is the rotation
+         *     q2 followed by q1.
+         * dot(), length(), normalize()
+         *     As for Vector4.
+         * rotate(v)
+         *     Rotate a Vector3 by a unit quaternion.
+         *
+         * Free functions
+         *     conjugate(q)           * (-x, -y, -z, w); the inverse of a unit quaternion.
+         *     inverse(q)             * conjugate(q) / q.dot(q)
+         *     nlerp(q1, q2, t)       * Normalized linear interpolation.
+         *     slerp(q1, q2, t)       * Spherical linear interpolation.
+         *     get_rot_quat(q, angle, v)  * Rotation by angle about v.
+         *     get_rot_quat(q, M)     * From the rotation in a Matrix33 or Matrix44.
+         *     get_rot_mat33(M, q), get_rot_mat44(M, q)
+         *                            * To a rotation matrix.
+         *
+         * nlerp() and slerp() both take the shorter of the two arcs between
+         * q1 and q2.  nlerp() does not move at a constant angular rate, but is
+         * much cheaper and is close to slerp() for the small steps typical of
+         * animation.  The conversions to matrices and rotate() assume unit
+         * quaternions.
+         *
+         * typedef Quaternion<float> Quaternionf;
+         * typedef Quaternion<double> Quaterniond;
+         * \endverbatim
+         */
+        template <typename T>
+        class Quaternion
+            {
+        public:
+            T x, y, z, w;
+
+            // Constructors
+            Quaternion() {}
+            Quaternion(T a, T b, T c, T d) : x (a), y(b), z(c), w(d) {}
+            Quaternion(Vector3<T> v, T s) : x (v.x), y (v.y), z (v.z), w (s) {}
+
+            // Array indexing
+            inline T& operator[](unsigned int const i)
+                { assert (i<4); if (i==0) return x; if (i==1) return y; if (i==2) return z; return w; }
+            inline T operator[](unsigned int const i) const
+                { assert (i<4); if (i==0) return x; if (i==1) return y; if (i==2) return z; return w; }
+
+            // Assignment
+            inline Quaternion<T>& assign(T const a, T const b, T const c, T const d)
+                { x = a; y = b; z = c; w = d; return *this; }
+            inline Quaternion<T>& setidentity()
+                { x = T(0); y = T(0); z = T(0); w = T(1); return *this; }
+
+            // Comparison
+            inline bool operator==(Quaternion<T> const & q2) const
+                { return ((x == q2.x) && (y == q2.y) && (z == q2.z) && (w == q2.w)); }
+            inline bool operator!=(Quaternion<T> const & q2) const
+                { return ! (*this == q2); }
+
+            // Addition and subtraction
+            inline Quaternion<T>& operator+=(Quaternion<T> const & q2)
+                { x += q2.x; y += q2.y; z += q2.z; w += q2.w; return *this; }
+            inline Quaternion<T> operator+(Quaternion<T> const & q2) const
+                { return Quaternion<T>(*this) += q2; }
+            inline Quaternion<T>& operator-=(Quaternion<T> const & q2)
+                { x -= q2.x; y -= q2.y; z -= q2.z; w -= q2.w; return *this; }
+            inline Quaternion<T> operator-(Quaternion<T> const & q2) const
+                { return Quaternion<T>(*this) -= q2; }
+            inline Quaternion<T> operator-() const
+                { return Quaternion<T>(-x, -y, -z, -w); }
+
+            // Scalar multiplication
+            inline Quaternion<T>& operator*=(int const a)
+                { x *= a; y *= a; z *= a; w *= a; return *this; }
+            inline Quaternion<T>& operator*=(float const a)
+                { x *= a; y *= a; z *= a; w *= a; return *this; }
+            inline Quaternion<T>& operator*=(double const a)
+                { x *= a; y *= a; z *= a; w *= a; return *this; }
+            inline Quaternion<T> operator*(int const a) const
+                { return Quaternion<T>(*this) *= a;}
+            inline Quaternion<T> operator*(float const a) const
+                { return Quaternion<T>(*this) *= a;}
+            inline Quaternion<T> operator*(double const a) const
+                { return Quaternion<T>(*this) *= a;}
+
+            // Scalar division
+            inline Quaternion<T>& operator/=(int const a)
+                { assert(a!=0); x /= a; y /= a; z /= a; w /= a; return *this; }
+            inline Quaternion<T>& operator/=(float const a)
+                { assert(a!=0); x /= a; y /= a; z /= a; w /= a; return *this; }
+            inline Quaternion<T>& operator/=(double const a)
+                { assert(a!=0); x /= a; y /= a; z /= a; w /= a; return *this; }
+            inline Quaternion<T> operator/(int const a) const
+                { return Quaternion<T>(*this) /= a;}
+            inline Quaternion<T> operator/(float const a) const
+                { return Quaternion<T>(*this) /= a;}
+            inline Quaternion<T> operator/(double const a) const
+                { return Quaternion<T>(*this) /= a;}
+
+            // Quaternion product
+            /** \brief Quaternion product, *this = *this * q2.
+             *
+             * The terms of each element are summed in the order of the w, x,
+             * y, and z elements of *this, which is also the order the SSE
+             * version uses, so both give the same results.
+             */
+            inline Quaternion<T>& operator*=(Quaternion<T> const & q2)
+                {
+                T const a = x, b = y, c = z, d = w;
+                x = d*q2.x + a*q2.w + b*q2.z - c*q2.y;
+                y = d*q2.y - a*q2.z + b*q2.w + c*q2.x;
+                z = d*q2.z + a*q2.y - b*q2.x + c*q2.w;
+                w = d*q2.w - a*q2.x - b*q2.y - c*q2.z;
+                return *this;
+                }
+            inline Quaternion<T> operator*(Quaternion<T> const & q2) const
+                { return Quaternion<T>(*this) *= q2; }
+
+            // methods
+
+            /** \brief Dot product of the quaternions as 4 element vectors. */
+            inline T dot(Quaternion<T> const & q2) const
+                { return x*q2.x + y*q2.y + z*q2.z + w*q2.w; }
+
+            /** \copydoc arda::Math::Vector2::length */
+            inline typename RealType<T>::type length(void) const
+                { return sqrt((dot(*this))); }
+
+            /** \copydoc arda::Math::Vector2::normalize */
+            inline Quaternion<T>& normalize()
+                { typename RealType<T>::type l = length(); if (l == 0.0) return *this; x /= l; y /= l; z /= l; w /= l; return *this; }
+
+            /** \brief Rotate v by this quaternion, which must be unit length.
+             *
+             * This is q v q* expanded as v + w t + cross(q.xyz, t) with
+             * t = 2 cross(q.xyz, v), which is 15 multiplies and 15 adds rather
+             * than the 28 and 24 of two full quaternion products.
+             */
+            inline Vector3<T> rotate(Vector3<T> const & v) const
+                {
+                T const tx = 2 * (y*v.z - z*v.y);
+                T const ty = 2 * (z*v.x - x*v.z);
+                T const tz = 2 * (x*v.y - y*v.x);
+                return Vector3<T>(v.x + w*tx + (y*tz - z*ty),
+                                  v.y + w*ty + (z*tx - x*tz),
+                                  v.z + w*tz + (x*ty - y*tx));
+                }
+
+            std::string to_string(void) const;
+            };
+
+        // Scalar multiplication, continued
+        template <typename T>
+        inline Quaternion<T> operator*(int const a, Quaternion<T> const & q)
+            { return Quaternion<T>(q) *= a;}
+
+        template <typename T>
+        inline Quaternion<T> operator*(float const a, Quaternion<T> const & q)
+            { return Quaternion<T>(q) *= a;}
+
+        template <typename T>
+        inline Quaternion<T> operator*(double const a, Quaternion<T> const & q)
+            { return Quaternion<T>(q) *= a;}
+
+        /////////////////////////////////////////////////////////////////////////////
+
+        template <typename T>
+        inline Quaternion<T> conjugate(Quaternion<T> const & q)
+            { return Quaternion<T>(-q.x, -q.y, -q.z, q.w); }
+
+        template <typename T>
+        inline Quaternion<T> inverse(Quaternion<T> const & q)
+            {
+            T const n = q.dot(q);
+            assert(n != T(0));
+            return Quaternion<T>(-q.x / n, -q.y / n, -q.z / n, q.w / n);
+            }
+
+        // Normalized linear interpolation from q1 (t = 0) to q2 (t = 1).
+        template <typename T>
+        inline Quaternion<T> nlerp(Quaternion<T> const & q1, Quaternion<T> const & q2, T t)
+            {
+            Quaternion<T> const q2s = (q1.dot(q2) < T(0)) ? -q2 : q2;
+            return (q1 + (q2s - q1) * t).normalize();
+            }
+
+        // Spherical linear interpolation from q1 (t = 0) to q2 (t = 1).  Falls
+        // back to nlerp() when the quaternions are so close that sin(angle)
+        // would lose all precision.
+        template <typename T>
+        Quaternion<T> slerp(Quaternion<T> const & q1, Quaternion<T> const & q2, T t);
+
+        // Rotation by angle around vector v, as get_rot_mat33().
+        template <typename T>
+        void get_rot_quat(arda::Math::Quaternion<T> & q, float angle, arda::Math::Vector3<T> v);
+
+        // The rotation in a pure rotation matrix.
+        template <typename T>
+        void get_rot_quat(arda::Math::Quaternion<T> & q, arda::Math::Matrix33<T> const & M);
+
+        template <typename T>
+        void get_rot_quat(arda::Math::Quaternion<T> & q, arda::Math::Matrix44<T> const & M);
+
+        // Rotation matrix for the unit quaternion q.
+        template <typename T>
+        void get_rot_mat33(arda::Math::Matrix33<T> & M, arda::Math::Quaternion<T> const & q);
+
+        template <typename T>
+        void get_rot_mat44(arda::Math::Matrix44<T> & M, arda::Math::Quaternion<T> const & q);
+
+        namespace detail
+            {
+            // Shepperd's method: take the square root of whichever of 4w^2,
+            // 4x^2, 4y^2, and 4z^2 is largest, so that the divisions that give
+            // the other three elements are well conditioned.  r(i, j) is row
+            // i, column j of the rotation.
+            template <typename T, typename R>
+            void quat_from_rot(arda::Math::Quaternion<T> & q, R const & r)
+                {
+                T const trace = r(0,0) + r(1,1) + r(2,2);
+                if (trace > 0)
+                    {
+                    T const s = T(2 * sqrt(trace + 1));
+                    q.assign((r(2,1) - r(1,2)) / s, (r(0,2) - r(2,0)) / s, (r(1,0) - r(0,1)) / s, s / 4);
+                    }
+                else if (r(0,0) > r(1,1) && r(0,0) > r(2,2))
+                    {
+                    T const s = T(2 * sqrt(1 + r(0,0) - r(1,1) - r(2,2)));
+                    q.assign(s / 4, (r(0,1) + r(1,0)) / s, (r(0,2) + r(2,0)) / s, (r(2,1) - r(1,2)) / s);
+                    }
+                else if (r(1,1) > r(2,2))
+                    {
+                    T const s = T(2 * sqrt(1 + r(1,1) - r(0,0) - r(2,2)));
+                    q.assign((r(0,1) + r(1,0)) / s, s / 4, (r(1,2) + r(2,1)) / s, (r(0,2) - r(2,0)) / s);
+                    }
+                else
+                    {
+                    T const s = T(2 * sqrt(1 + r(2,2) - r(0,0) - r(1,1)));
+                    q.assign((r(0,2) + r(2,0)) / s, (r(1,2) + r(2,1)) / s, s / 4, (r(1,0) - r(0,1)) / s);
+                    }
+                }
+
+            // Element access for the column major matrices.
+            template <typename T, unsigned int N>
+            struct RotElements
+                {
+                T const * m;
+                explicit RotElements(T const * mm) : m (mm) {}
+                inline T operator()(unsigned int const i, unsigned int const j) const
+                    { return m[N*j + i]; }
+                };
+            } // namespace detail
+
+#if defined(ARDA_MATH_SSE2)
+        /////////////////////////////////////////////////////////////////////////////
+        // SSE specializations for float.  A Quaternion<float> is exactly one
+        // register.  The product and rotate() add the terms in the same order
+        // as the generic versions, so the results are the same (unless the
+        // compiler contracts the generic versions into fused multiply adds).
+        // nlerp() normalizes in float rather than double, and slerp() blends
+        // the end points in float, so they can differ in the last bit.
+
+        static_assert(sizeof(Quaternion<float>) == 4*sizeof(float),
+                      "Quaternion elements must be tightly packed for the SIMD code");
+
+        namespace simd
+            {
+            // Flip the sign of the lanes (listed low to high) set to 1.
+            inline __m128 flip_signs(__m128 v, int a, int b, int c, int d)
+                {
+                return _mm_xor_ps(v, _mm_setr_ps(a ? -0.0f : 0.0f, b ? -0.0f : 0.0f,
+                                                 c ? -0.0f : 0.0f, d ? -0.0f : 0.0f));
+                }
+
+            // Quaternion product of two registers.
+            inline __m128 quat_mul(__m128 a, __m128 b)
+                {
+                __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3,3,3,3)), b);
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0,0,0,0)),
+                                             flip_signs(_mm_shuffle_ps(b, b, _MM_SHUFFLE(0,1,2,3)), 0, 1, 0, 1)));
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1,1,1,1)),
+                                             flip_signs(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1,0,3,2)), 0, 0, 1, 1)));
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2,2,2,2)),
+                                             flip_signs(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2,3,0,1)), 1, 0, 0, 1)));
+                return r;
+                }
+
+            // Sum of all 4 lanes, in every lane, added as ((x + y) + z) + w.
+            inline __m128 hsum4(__m128 v)
+                {
+                __m128 s = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1)));
+                s = _mm_add_ss(s, _mm_movehl_ps(v, v));
+                s = _mm_add_ss(s, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3)));
+                return _mm_shuffle_ps(s, s, _MM_SHUFFLE(0,0,0,0));
+                }
+
+            // cross(a, b) in the first 3 lanes.
+            inline __m128 cross3(__m128 a, __m128 b)
+                {
+                __m128 const a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,0,2,1));
+                __m128 const a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,1,0,2));
+                __m128 const b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,0,2,1));
+                __m128 const b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,1,0,2));
+                return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+                }
+            } // namespace simd
+
+        template <>
+        inline Quaternion<float>& Quaternion<float>::operator*=(Quaternion<float> const & q2)
+            {
+            _mm_storeu_ps(&x, simd::quat_mul(_mm_loadu_ps(&x), _mm_loadu_ps(&q2.x)));
+            return *this;
+            }
+
+        template <>
+        inline Vector3<float> Quaternion<float>::rotate(Vector3<float> const & v) const
+            {
+            __m128 const q = _mm_loadu_ps(&x);
+            __m128 const vv = simd::load3(&v.x);
+            __m128 const t = simd::cross3(q, vv);
+            __m128 const t2 = _mm_add_ps(t, t);
+            __m128 const r = _mm_add_ps(_mm_add_ps(vv, _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(3,3,3,3)), t2)),
+                                        simd::cross3(q, t2));
+            Vector3<float> vres;
+            simd::store3(&vres.x, r);
+            return vres;
+            }
+
+        template <>
+        inline Quaternion<float> nlerp(Quaternion<float> const & q1, Quaternion<float> const & q2, float t)
+            {
+            __m128 const a = _mm_loadu_ps(&q1.x);
+            __m128 b = _mm_loadu_ps(&q2.x);
+            __m128 const sign = _mm_and_ps(simd::hsum4(_mm_mul_ps(a, b)), _mm_set1_ps(-0.0f));
+            b = _mm_xor_ps(b, sign);
+            __m128 const r = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+            __m128 const l = _mm_sqrt_ps(simd::hsum4(_mm_mul_ps(r, r)));
+            Quaternion<float> qres;
+            _mm_storeu_ps(&qres.x, _mm_div_ps(r, l));
+            return qres;
+            }
+
+        // The angle and the weights are scalar, as in the generic version;
+        // the sign flip, the dot product, and the blend are done in one
+        // register each.
+        template <>
+        inline Quaternion<float> slerp(Quaternion<float> const & q1, Quaternion<float> const & q2, float t)
+            {
+            __m128 const a = _mm_loadu_ps(&q1.x);
+            __m128 b = _mm_loadu_ps(&q2.x);
+            __m128 const dot = simd::hsum4(_mm_mul_ps(a, b));
+            b = _mm_xor_ps(b, _mm_and_ps(dot, _mm_set1_ps(-0.0f)));
+            Quaternion<float> qres;
+            double const d = fabs((double) _mm_cvtss_f32(dot));
+            if (d > 0.9995)
+                {
+                _mm_storeu_ps(&qres.x, b);
+                return nlerp(q1, qres, t);
+                }
+
+            double const angle = acos(d);
+            double const s = sin(angle);
+            __m128 const w1 = _mm_set1_ps((float) (sin((1 - t) * angle) / s));
+            __m128 const w2 = _mm_set1_ps((float) (sin(t * angle) / s));
+            _mm_storeu_ps(&qres.x, _mm_add_ps(_mm_mul_ps(a, w1), _mm_mul_ps(b, w2)));
+            return qres;
+            }
+#endif // ARDA_MATH_SSE2
+
+        /////////////////////////////////////////////////////////////////////////////
+
+        typedef Quaternion<float> Quaternionf;
+        typedef Quaternion<double> Quaterniond;
+
+        } // namespace Math
+
+    } // namespace arda
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+std::string arda::Math::Quaternion<T>::to_string(void) const
+    {
+    std::stringstream ss;
+    ss << "[ " << x << ", " << y << ", " << z << ", " << w << " ]";
+    return ss.str();
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::Quaternion<T> arda::Math::slerp(arda::Math::Quaternion<T> const & q1, arda::Math::Quaternion<T> const & q2, T t)
+    {
+    typedef typename RealType<T>::type R;
+    R d = q1.dot(q2);
+    Quaternion<T> q2s(q2);
+    if (d < 0)
+        {
+        d = -d;
+        q2s = -q2;
+        }
+
+    // Past this sin(angle) is below about 0.03 and nlerp() is within a
+    // few ulps of the true arc anyway.
+    if (d > R(0.9995))
+        return nlerp(q1, q2s, t);
+
+    R const angle = acos(d);
+    R const s = sin(angle);
+    R const s1 = sin((1 - t) * angle) / s;
+    R const s2 = sin(t * angle) / s;
+    return Quaternion<T>(T(s1*q1.x + s2*q2s.x), T(s1*q1.y + s2*q2s.y),
+                         T(s1*q1.z + s2*q2s.z), T(s1*q1.w + s2*q2s.w));
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::get_rot_quat(arda::Math::Quaternion<T> & q, float angle, arda::Math::Vector3<T> v)
+    {
+    // Only an exactly zero axis can't be normalized.
+    if (0.0 == v.length()) {
+        q.setidentity();
+        return;
+        }
+
+    v.normalize();
+
+    float s = sin(0.5f * angle);
+    q.assign(s * v.x, s * v.y, s * v.z, cos(0.5f * angle));
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::get_rot_quat(arda::Math::Quaternion<T> & q, arda::Math::Matrix33<T> const & M)
+    {
+    arda::Math::detail::quat_from_rot(q, arda::Math::detail::RotElements<T, 3>(M.m));
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::get_rot_quat(arda::Math::Quaternion<T> & q, arda::Math::Matrix44<T> const & M)
+    {
+    arda::Math::detail::quat_from_rot(q, arda::Math::detail::RotElements<T, 4>(M.m));
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::get_rot_mat33(arda::Math::Matrix33<T> & M, arda::Math::Quaternion<T> const & q)
+    {
+    T const x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+    T const xx = q.x * x2, yy = q.y * y2, zz = q.z * z2;
+    T const xy = q.x * y2, xz = q.x * z2, yz = q.y * z2;
+    T const wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+
+    // Remember: the "rows" as written here are actually the columns of the matrix.
+    M.assign(
+        1 - (yy + zz)   ,   xy + wz         ,   xz - wy         ,
+        xy - wz         ,   1 - (xx + zz)   ,   yz + wx         ,
+        xz + wy         ,   yz - wx         ,   1 - (xx + yy)
+        );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::get_rot_mat44(arda::Math::Matrix44<T> & M, arda::Math::Quaternion<T> const & q)
+    {
+    arda::Math::Matrix33<T> M33;
+    arda::Math::get_rot_mat33(M33, q);
+    M.assign(M33[0], M33[1], M33[2], 0, M33[3], M33[4], M33[5], 0, M33[6], M33[7], M33[8], 0, 0, 0, 0, 1);
+    }
+
+#endif // QUATERNION_H_
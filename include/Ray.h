@@ -0,0 +1,218 @@
+#ifndef RAY_H_
+#define RAY_H_
+
+// Needs Vector.h, Packet.h, and Bounds.h, but this file is not intended to be
+// included directly.  Just include Math.h and everything will be set up
+// correctly.
+
+#include "Simd.h"
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Rays, and ray / box slab tests.
+      //
+      // Ray<T> is origin + t * direction for tmin <= t <= tmax, with
+      // 1 / direction kept alongside so that the box tests only multiply.
+      // Set the direction with the constructor or set_direction() to keep
+      // the two in step.  It need not be unit length; t is in units of it.
+      // tmax defaults to the largest finite value, and must be finite.
+      //
+      // T is float or double, or a packet type (see Packet.h), in which case
+      // the ray is 4 or 8 rays, one per lane.  For example, rays i to i + 7
+      // of two Vector3SoA<float>:
+      //
+      //     Ray<Packet8f> r(Vector3x8f(Packet8f::load(o.x() + i), Packet8f::load(o.y() + i),
+      //                                Packet8f::load(o.z() + i)),
+      //                     Vector3x8f(Packet8f::load(d.x() + i), ...));
+      //
+      // In the same way, an AABB<Packet4f> or AABB<Packet8f> is 4 or 8 boxes,
+      // such as the children of a wide BVH node.  Give unused lanes an empty
+      // box (min above max).
+      //
+      // at(t)               The point at distance t.
+      // intersects(ray, box)
+      // intersects(ray, box, t)
+      //                     Slab test: whether [tmin, tmax] of the ray meets
+      //                     the box, and in t where it enters (tmin if it
+      //                     starts inside).  A Ray<T> and an AABB<T> of
+      //                     float or double give a bool.  The others give a
+      //                     bit mask, bit i for lane i, and t per lane (only
+      //                     meaningful for the lanes that hit):
+      //                        a ray packet and an AABB<float>,
+      //                        a Ray<float> and a box packet (a ray against
+      //                        4 or 8 boxes at once),
+      //                        a ray packet and a box packet, lane by lane.
+      //
+      // The tests have no branches, and get the edge cases right.  On each
+      // axis the ray enters through the min plane and leaves through the max
+      // one, or the other way round, according to the sign of the direction.
+      // A zero direction element (of either sign) has an infinite inverse,
+      // so the slab limits are infinite, or NaN (0 * infinity) when the
+      // origin is on the plane, and the operands of the min and max are in
+      // the order that drops the NaN.  So a ray running along a face hits,
+      // a ray parallel to a slab and outside it misses, and an empty box
+      // (including AABB<T>()) is never hit.  Boxes are closed.
+
+      template <typename T>
+      class Ray
+	 {
+	 public:
+	 typedef typename std::conditional<IsPacket<T>::value, float, T>::type Scalar;
+
+	 Vector3<T> origin, direction, inv_direction;
+	 T tmin, tmax;
+
+	 Ray() {}
+	 Ray(Vector3<T> const & o, Vector3<T> const & d, T const t0 = T(0), T const t1 = T(std::numeric_limits<Scalar>::max()))
+	    : origin (o), tmin (t0), tmax (t1)
+	    { set_direction(d); }
+
+	 inline Ray<T>& set_direction(Vector3<T> const & d)
+	    {
+	    direction = d;
+	    inv_direction = Vector3<T>(T(1) / d.x, T(1) / d.y, T(1) / d.z);
+	    return *this;
+	    }
+
+	 inline Vector3<T> at(T const t) const { return origin + direction * t; }
+	 };
+
+      typedef Ray<float> Rayf;
+      typedef Ray<double> Rayd;
+
+      namespace detail
+	 {
+	 // a > b ? a : b and a < b ? a : b, which are maxps and minps for
+	 // packets.  A NaN a gives b.
+	 template <typename T>
+	 inline T ray_max(T const a, T const b) { return a > b ? a : b; }
+	 template <typename T>
+	 inline T ray_min(T const a, T const b) { return a < b ? a : b; }
+
+	 // a where x has its sign bit set, otherwise b.
+	 template <typename T>
+	 inline T sign_select(T const x, T const a, T const b) { return std::signbit(x) ? a : b; }
+
+#if defined(ARDA_MATH_SSE2)
+	 inline Packet4f ray_max(Packet4f const & a, Packet4f const & b) { return max(a, b); }
+	 inline Packet4f ray_min(Packet4f const & a, Packet4f const & b) { return min(a, b); }
+	 inline Packet4f sign_select(Packet4f const & x, Packet4f const & a, Packet4f const & b)
+	    { return select(Packet4f(_mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(x.v), 31))), a, b); }
+	 inline unsigned int lanes(Packet4f const & mask)
+	    { return (unsigned int) _mm_movemask_ps(mask.v); }
+#endif
+
+#if defined(ARDA_MATH_AVX)
+	 inline Packet8f ray_max(Packet8f const & a, Packet8f const & b) { return max(a, b); }
+	 inline Packet8f ray_min(Packet8f const & a, Packet8f const & b) { return min(a, b); }
+	 inline Packet8f sign_select(Packet8f const & x, Packet8f const & a, Packet8f const & b)
+	    { return Packet8f(_mm256_blendv_ps(b.v, a.v, x.v)); }
+	 inline unsigned int lanes(Packet8f const & mask)
+	    { return (unsigned int) _mm256_movemask_ps(mask.v); }
+#endif
+
+	 // The slab test proper, given the planes through which the ray enters
+	 // and leaves on each axis.  t0 and t1 start as the ray's range and end
+	 // as its range inside the box, empty (t0 > t1) for a miss.
+	 template <typename T>
+	 inline void slab(Vector3<T> const & o, Vector3<T> const & inv, Vector3<T> const & enter,
+			  Vector3<T> const & leave, T & t0, T & t1)
+	    {
+	    unsigned int i;
+	    for (i=0; i<3; ++i)
+	       {
+	       t0 = ray_max((enter[i] - o[i]) * inv[i], t0);
+	       t1 = ray_min((leave[i] - o[i]) * inv[i], t1);
+	       }
+	    }
+	 } // namespace detail
+
+      //////////////////////////////////////////////////////////////////////////
+      // One ray, one box.
+      template <typename T>
+      inline typename std::enable_if<!IsPacket<T>::value, bool>::type
+      intersects(Ray<T> const & r, AABB<T> const & b, T & t)
+	 {
+	 Vector3<T> const enter(detail::sign_select(r.inv_direction.x, b.max.x, b.min.x),
+				detail::sign_select(r.inv_direction.y, b.max.y, b.min.y),
+				detail::sign_select(r.inv_direction.z, b.max.z, b.min.z));
+	 Vector3<T> const leave(detail::sign_select(r.inv_direction.x, b.min.x, b.max.x),
+				detail::sign_select(r.inv_direction.y, b.min.y, b.max.y),
+				detail::sign_select(r.inv_direction.z, b.min.z, b.max.z));
+	 T t1 = r.tmax;
+	 t = r.tmin;
+	 detail::slab(r.origin, r.inv_direction, enter, leave, t, t1);
+	 return t <= t1;
+	 }
+
+      template <typename T>
+      inline typename std::enable_if<!IsPacket<T>::value, bool>::type
+      intersects(Ray<T> const & r, AABB<T> const & b)
+	 { T t; return intersects(r, b, t); }
+
+#if defined(ARDA_MATH_SSE2)
+      // A ray packet against a box packet, lane by lane.
+      template <typename P>
+      inline typename PacketOnly<P, unsigned int>::type intersects(Ray<P> const & r, AABB<P> const & b, P & t)
+	 {
+	 Vector3<P> const enter(detail::sign_select(r.inv_direction.x, b.max.x, b.min.x),
+				detail::sign_select(r.inv_direction.y, b.max.y, b.min.y),
+				detail::sign_select(r.inv_direction.z, b.max.z, b.min.z));
+	 Vector3<P> const leave(detail::sign_select(r.inv_direction.x, b.min.x, b.max.x),
+				detail::sign_select(r.inv_direction.y, b.min.y, b.max.y),
+				detail::sign_select(r.inv_direction.z, b.min.z, b.max.z));
+	 P t1 = r.tmax;
+	 t = r.tmin;
+	 detail::slab(r.origin, r.inv_direction, enter, leave, t, t1);
+	 return detail::lanes(cmple(t, t1));
+	 }
+
+      template <typename P>
+      inline typename PacketOnly<P, unsigned int>::type intersects(Ray<P> const & r, AABB<P> const & b)
+	 { P t; return intersects(r, b, t); }
+
+      // A ray packet against one box.
+      template <typename P>
+      inline typename PacketOnly<P, unsigned int>::type intersects(Ray<P> const & r, AABB<float> const & b, P & t)
+	 {
+	 return intersects(r, AABB<P>(Vector3<P>(b.min.x, b.min.y, b.min.z), Vector3<P>(b.max.x, b.max.y, b.max.z)), t);
+	 }
+
+      template <typename P>
+      inline typename PacketOnly<P, unsigned int>::type intersects(Ray<P> const & r, AABB<float> const & b)
+	 { P t; return intersects(r, b, t); }
+
+      // One ray against a box packet.  The planes are picked by the ray's
+      // direction, the same for every lane, so there is nothing to blend.
+      template <typename P>
+      inline typename PacketOnly<P, unsigned int>::type intersects(Ray<float> const & r, AABB<P> const & b, P & t)
+	 {
+	 Vector3<P> const o(r.origin.x, r.origin.y, r.origin.z);
+	 Vector3<P> const inv(r.inv_direction.x, r.inv_direction.y, r.inv_direction.z);
+	 Vector3<P> const enter(std::signbit(r.inv_direction.x) ? b.max.x : b.min.x,
+				std::signbit(r.inv_direction.y) ? b.max.y : b.min.y,
+				std::signbit(r.inv_direction.z) ? b.max.z : b.min.z);
+	 Vector3<P> const leave(std::signbit(r.inv_direction.x) ? b.min.x : b.max.x,
+				std::signbit(r.inv_direction.y) ? b.min.y : b.max.y,
+				std::signbit(r.inv_direction.z) ? b.min.z : b.max.z);
+	 P t1 = r.tmax;
+	 t = r.tmin;
+	 detail::slab(o, inv, enter, leave, t, t1);
+	 return detail::lanes(cmple(t, t1));
+	 }
+
+      template <typename P>
+      inline typename PacketOnly<P, unsigned int>::type intersects(Ray<float> const & r, AABB<P> const & b)
+	 { P t; return intersects(r, b, t); }
+#endif // ARDA_MATH_SSE2
+      } // namespace Math
+   } // namespace arda
+
+#endif // RAY_H_
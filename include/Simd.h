@@ -0,0 +1,313 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+////////////////////////////////////////////////////////////////////////////////
+// Instruction set selection for the hand vectorized code paths.
+//
+// The SIMD specializations are chosen at compile time from the compiler's own
+// target macros, so building with -msse4.2, -mavx2, -march=native, etc. turns
+// on the matching code.  x86-64 always has SSE2, so that is the baseline.
+// Anything else (or a build with ARDA_MATH_NO_SIMD defined) falls back to the
+// generic templates.
+//
+// ARDA_MATH_SSE2    SSE and SSE2 (float and double 128 bit registers)
+// ARDA_MATH_SSE41   SSE4.1 (blends, dot products, rounding)
+// ARDA_MATH_AVX     AVX (256 bit float and double registers)
+// ARDA_MATH_AVX2    AVX2 (256 bit integer operations)
+// ARDA_MATH_FMA     Fused multiply add.  Note that the specializations that
+//                   promise results identical to the generic templates do not
+//                   use it, since fusing changes the rounding.
+//
+// The batch kernels (Batch.h transforms and the SoA.h bulk operations) are
+// also compiled for AVX2 and AVX-512 regardless of the build flags, and the
+// widest one the CPU supports is chosen at run time; see simd_level() below.
+// ARDA_MATH_DISPATCH is defined when that is available (GCC and Clang on
+// x86).  Define ARDA_MATH_NO_DISPATCH to only use what the build flags
+// allow.
+
+#if !defined(ARDA_MATH_NO_SIMD)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARDA_MATH_SSE2 1
+#endif
+
+#if defined(ARDA_MATH_SSE2) && (defined(__SSE4_1__) || defined(__AVX__))
+#define ARDA_MATH_SSE41 1
+#endif
+
+#if defined(ARDA_MATH_SSE2) && defined(__AVX__)
+#define ARDA_MATH_AVX 1
+#endif
+
+#if defined(ARDA_MATH_AVX) && defined(__AVX2__)
+#define ARDA_MATH_AVX2 1
+#endif
+
+#if defined(ARDA_MATH_AVX) && defined(__FMA__)
+#define ARDA_MATH_FMA 1
+#endif
+
+#if defined(ARDA_MATH_SSE2) && !defined(ARDA_MATH_NO_DISPATCH) && \
+    (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ARDA_MATH_DISPATCH 1
+// AVX-512F has its own fused multiply add, which GCC would otherwise fuse
+// the separate multiplies and adds into, so contraction is turned off to
+// keep the results the same as the SSE code.
+#define ARDA_MATH_TARGET_AVX2 __attribute__((target("avx2"), optimize("fp-contract=off")))
+#define ARDA_MATH_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+
+#endif // ARDA_MATH_NO_SIMD
+
+#if defined(ARDA_MATH_SSE2)
+#include <immintrin.h>
+
+namespace arda 
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Small helpers shared by the SIMD specializations.  These are not part
+      // of the public interface.
+      namespace simd
+	 {
+	 // Load / store 2 or 3 floats without touching memory past the end.
+	 // Unused lanes are loaded as zero.
+	 inline __m128 load2(float const * p)
+	    { return _mm_loadl_pi(_mm_setzero_ps(), (__m64 const *) p); }
+	 inline void store2(float * p, __m128 v)
+	    { _mm_storel_pi((__m64 *) p, v); }
+	 inline __m128 load3(float const * p)
+	    { return _mm_movelh_ps(load2(p), _mm_load_ss(p + 2)); }
+	 inline void store3(float * p, __m128 v)
+	    { store2(p, v); _mm_store_ss(p + 2, _mm_movehl_ps(v, v)); }
+
+	 // Convert 4 packed 3 element vectors (x0 y0 z0 x1, y1 z1 x2 y2,
+	 // z2 x3 y3 z3) to one register per element (x0 x1 x2 x3, etc.), and
+	 // back again.
+	 inline void deinterleave3(__m128 a, __m128 b, __m128 c,
+				   __m128 & x, __m128 & y, __m128 & z)
+	    {
+	    __m128 const t0 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,1,3,2)); // x2 y2 x3 y3
+	    __m128 const t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1,0,2,1)); // y0 z0 y1 z1
+	    x = _mm_shuffle_ps(a, t0, _MM_SHUFFLE(2,0,3,0));
+	    y = _mm_shuffle_ps(t1, t0, _MM_SHUFFLE(3,1,2,0));
+	    z = _mm_shuffle_ps(t1, c, _MM_SHUFFLE(3,0,3,1));
+	    }
+	 inline void interleave3(__m128 x, __m128 y, __m128 z,
+				 __m128 & a, __m128 & b, __m128 & c)
+	    {
+	    __m128 const xy_lo = _mm_unpacklo_ps(x, y);                        // x0 y0 x1 y1
+	    __m128 const xy_hi = _mm_unpackhi_ps(x, y);                        // x2 y2 x3 y3
+	    __m128 const t0 = _mm_shuffle_ps(z, xy_lo, _MM_SHUFFLE(3,2,1,0)); // z0 z1 x1 y1
+	    __m128 const t1 = _mm_shuffle_ps(z, xy_hi, _MM_SHUFFLE(3,2,3,2)); // z2 z3 x3 y3
+	    a = _mm_shuffle_ps(xy_lo, t0, _MM_SHUFFLE(2,0,1,0));
+	    b = _mm_shuffle_ps(t0, xy_hi, _MM_SHUFFLE(1,0,1,3));
+	    c = _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(1,3,2,0));
+	    }
+
+	 // Approximate 1 / sqrt(d): rsqrtps (relative error up to 1.5 * 2^-12)
+	 // refined with one Newton-Raphson step, y (1.5 - 0.5 d y y).  The
+	 // result is within 2^-21 relative of the exact value for normal d > 0.
+	 // Other d give garbage (d = 0 gives NaN), so callers check for zero.
+	 inline __m128 rsqrt_nr(__m128 d)
+	    {
+	    __m128 const y = _mm_rsqrt_ps(d);
+	    __m128 const hdyy = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), d), y), y);
+	    return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), hdyy));
+	    }
+
+#if defined(ARDA_MATH_DISPATCH)
+	 // The same, 8 wide.  This is used for AVX-512 as well, since
+	 // vrsqrt14ps gives different approximations than rsqrtps.
+	 ARDA_MATH_TARGET_AVX2
+	 inline __m256 rsqrt_nr(__m256 d)
+	    {
+	    __m256 const y = _mm256_rsqrt_ps(d);
+	    __m256 const hdyy = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), d), y), y);
+	    return _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), hdyy));
+	    }
+
+	 // The same, for 8 vectors.  The shuffles work within 128 bit lanes,
+	 // so with vectors 0-3 in the low lanes and 4-7 in the high lanes the
+	 // code is the same as above.  load3x8() and store3x8() arrange the
+	 // 24 floats that way.
+	 ARDA_MATH_TARGET_AVX2
+	 inline void load3x8(float const * p, __m256 & a, __m256 & b, __m256 & c)
+	    {
+	    a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
+	    b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+	    c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+	    }
+	 ARDA_MATH_TARGET_AVX2
+	 inline void store3x8(float * p, __m256 a, __m256 b, __m256 c)
+	    {
+	    _mm_storeu_ps(p, _mm256_castps256_ps128(a));
+	    _mm_storeu_ps(p + 4, _mm256_castps256_ps128(b));
+	    _mm_storeu_ps(p + 8, _mm256_castps256_ps128(c));
+	    _mm_storeu_ps(p + 12, _mm256_extractf128_ps(a, 1));
+	    _mm_storeu_ps(p + 16, _mm256_extractf128_ps(b, 1));
+	    _mm_storeu_ps(p + 20, _mm256_extractf128_ps(c, 1));
+	    }
+	 ARDA_MATH_TARGET_AVX2
+	 inline void deinterleave3(__m256 a, __m256 b, __m256 c,
+				   __m256 & x, __m256 & y, __m256 & z)
+	    {
+	    __m256 const t0 = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2,1,3,2));
+	    __m256 const t1 = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1,0,2,1));
+	    x = _mm256_shuffle_ps(a, t0, _MM_SHUFFLE(2,0,3,0));
+	    y = _mm256_shuffle_ps(t1, t0, _MM_SHUFFLE(3,1,2,0));
+	    z = _mm256_shuffle_ps(t1, c, _MM_SHUFFLE(3,0,3,1));
+	    }
+	 ARDA_MATH_TARGET_AVX2
+	 inline void interleave3(__m256 x, __m256 y, __m256 z,
+				 __m256 & a, __m256 & b, __m256 & c)
+	    {
+	    __m256 const xy_lo = _mm256_unpacklo_ps(x, y);
+	    __m256 const xy_hi = _mm256_unpackhi_ps(x, y);
+	    __m256 const t0 = _mm256_shuffle_ps(z, xy_lo, _MM_SHUFFLE(3,2,1,0));
+	    __m256 const t1 = _mm256_shuffle_ps(z, xy_hi, _MM_SHUFFLE(3,2,3,2));
+	    a = _mm256_shuffle_ps(xy_lo, t0, _MM_SHUFFLE(2,0,1,0));
+	    b = _mm256_shuffle_ps(t0, xy_hi, _MM_SHUFFLE(1,0,1,3));
+	    c = _mm256_shuffle_ps(t1, t1, _MM_SHUFFLE(1,3,2,0));
+	    }
+
+	 // The same, for 16 vectors in 48 consecutive floats.  Each output is
+	 // two two-register permutes: the first gathers what it can from a
+	 // pair of inputs, the second fills in the rest from the third.
+	 ARDA_MATH_TARGET_AVX512
+	 inline void deinterleave3(__m512 a, __m512 b, __m512 c,
+				   __m512 & x, __m512 & y, __m512 & z)
+	    {
+	    x = _mm512_permutex2var_ps(a, _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 0, 0, 0, 0, 0), b);
+	    y = _mm512_permutex2var_ps(a, _mm512_setr_epi32(1, 4, 7, 10, 13, 16, 19, 22, 25, 28, 31, 0, 0, 0, 0, 0), b);
+	    z = _mm512_permutex2var_ps(a, _mm512_setr_epi32(2, 5, 8, 11, 14, 17, 20, 23, 26, 29, 0, 0, 0, 0, 0, 0), b);
+	    x = _mm512_permutex2var_ps(x, _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 17, 20, 23, 26, 29), c);
+	    y = _mm512_permutex2var_ps(y, _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 18, 21, 24, 27, 30), c);
+	    z = _mm512_permutex2var_ps(z, _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 16, 19, 22, 25, 28, 31), c);
+	    }
+	 ARDA_MATH_TARGET_AVX512
+	 inline void interleave3(__m512 x, __m512 y, __m512 z,
+				 __m512 & a, __m512 & b, __m512 & c)
+	    {
+	    a = _mm512_permutex2var_ps(x, _mm512_setr_epi32(0, 16, 0, 1, 17, 0, 2, 18, 0, 3, 19, 0, 4, 20, 0, 5), y);
+	    b = _mm512_permutex2var_ps(x, _mm512_setr_epi32(21, 0, 6, 22, 0, 7, 23, 0, 8, 24, 0, 9, 25, 0, 10, 26), y);
+	    c = _mm512_permutex2var_ps(x, _mm512_setr_epi32(0, 11, 27, 0, 12, 28, 0, 13, 29, 0, 14, 30, 0, 15, 31, 0), y);
+	    a = _mm512_permutex2var_ps(a, _mm512_setr_epi32(0, 1, 16, 3, 4, 17, 6, 7, 18, 9, 10, 19, 12, 13, 20, 15), z);
+	    b = _mm512_permutex2var_ps(b, _mm512_setr_epi32(0, 21, 2, 3, 22, 5, 6, 23, 8, 9, 24, 11, 12, 25, 14, 15), z);
+	    c = _mm512_permutex2var_ps(c, _mm512_setr_epi32(26, 1, 2, 27, 4, 5, 28, 7, 8, 29, 10, 11, 30, 13, 14, 31), z);
+	    }
+#endif // ARDA_MATH_DISPATCH
+	 } // namespace simd
+      } // namespace Math
+   } // namespace arda
+#endif
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+namespace arda 
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Run time selection of the batch kernels.
+      //
+      // The level is picked once, the first time it is needed, as the widest
+      // one both the build and the CPU support.  The environment variable
+      // ARDA_MATH_SIMD can lower it, which is meant for testing and
+      // benchmarking: "scalar", "sse2", "avx2", or "avx512".  Requests above
+      // what is supported, or below the build's baseline, are clamped, and
+      // anything else is ignored.
+      //
+      // simd_supported()   The widest level this build can run on this CPU.
+      // simd_level()       The level in use.
+      // set_simd_level()   Change the level in use, clamped the same way as
+      //                    ARDA_MATH_SIMD; returns the level actually set.
+      //                    Not meant to be called while other threads are
+      //                    running batch operations.
+      // simd_level_name()  "scalar", "sse2", etc., for logging.
+      //
+      // All levels give bit identical results, since none of the kernels use
+      // fused multiply add and the other operations are exactly rounded.  The
+      // exception is a build that enables FMA itself (ARDA_MATH_FMA, e.g.
+      // -march=native), where the compiler may fuse the baseline code.
+
+      enum class SimdLevel { SCALAR, SSE2, AVX2, AVX512 };
+
+      inline char const * simd_level_name(SimdLevel const level)
+	 {
+	 switch (level)
+	    {
+	    case SimdLevel::SSE2:   return "sse2";
+	    case SimdLevel::AVX2:   return "avx2";
+	    case SimdLevel::AVX512: return "avx512";
+	    default:                return "scalar";
+	    }
+	 }
+
+      inline SimdLevel simd_supported()
+	 {
+#if defined(ARDA_MATH_DISPATCH)
+	 __builtin_cpu_init();
+	 if (__builtin_cpu_supports("avx512f"))
+	    return SimdLevel::AVX512;
+	 if (__builtin_cpu_supports("avx2"))
+	    return SimdLevel::AVX2;
+	 return SimdLevel::SSE2;
+#elif defined(ARDA_MATH_SSE2)
+	 return SimdLevel::SSE2;
+#else
+	 return SimdLevel::SCALAR;
+#endif
+	 }
+
+      namespace detail
+	 {
+	 inline SimdLevel clamp_simd_level(SimdLevel const level)
+	    {
+	    SimdLevel const top = simd_supported();
+#if defined(ARDA_MATH_SSE2)
+	    SimdLevel const bottom = SimdLevel::SSE2;
+#else
+	    SimdLevel const bottom = SimdLevel::SCALAR;
+#endif
+	    return level > top ? top : level < bottom ? bottom : level;
+	    }
+
+	 inline SimdLevel initial_simd_level()
+	    {
+	    char const * const env = getenv("ARDA_MATH_SIMD");
+	    if (env != 0)
+	       {
+	       int i;
+	       for (i=(int) SimdLevel::SCALAR; i<=(int) SimdLevel::AVX512; ++i)
+		  if (strcmp(env, simd_level_name((SimdLevel) i)) == 0)
+		     return clamp_simd_level((SimdLevel) i);
+	       }
+	    return simd_supported();
+	    }
+
+	 inline std::atomic<SimdLevel> & simd_level_storage()
+	    {
+	    static std::atomic<SimdLevel> level(initial_simd_level());
+	    return level;
+	    }
+	 } // namespace detail
+
+      inline SimdLevel simd_level()
+	 {
+	 return detail::simd_level_storage().load(std::memory_order_relaxed);
+	 }
+
+      inline SimdLevel set_simd_level(SimdLevel const level)
+	 {
+	 SimdLevel const l = detail::clamp_simd_level(level);
+	 detail::simd_level_storage().store(l, std::memory_order_relaxed);
+	 return l;
+	 }
+      } // namespace Math
+   } // namespace arda
+
+#endif // SIMD_H_
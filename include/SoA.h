@@ -0,0 +1,1057 @@
+#ifndef SOA_H_
+#define SOA_H_
+
+// Needs Vector.h, but this file is not intended to be included directly.
+// Just include Math.h and everything will be set up correctly.
+
+#include "Simd.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace arda
+   {
+   namespace Math
+      {
+      //////////////////////////////////////////////////////////////////////////
+      // Structure of arrays containers for Vector2, Vector3 and Vector4.
+      //
+      // Vector2SoA<T>, Vector3SoA<T> and Vector4SoA<T> hold many vectors as one
+      // array per element (all the x's, then all the y's, ...) instead of an
+      // array of VectorN<T>.  That lets the bulk operations below work on 4
+      // vectors per instruction without any shuffling.  Each element array is
+      // 64 byte aligned.
+      //
+      // Supported operations
+      //
+      // size(), resize()  Number of vectors.  resize() keeps existing values;
+      //                   new vectors are zero.
+      // x(), y(), z(), w()
+      //                   The element arrays, for direct access.
+      // get(), set()      Read or write vector i as a VectorN<T>.
+      // assign()          Set from an array of VectorN<T>.
+      // copy_to()         Copy out to an array of VectorN<T>.
+      // + += - -=         Element wise on two containers of the same size.
+      // * *= / /=         Scaling every vector by a scalar.
+      //
+      // The bulk methods mirror the VectorN methods, applied to every vector:
+      //
+      // dot(v2, out)      out[i] = v[i].dot(v2[i])
+      // length(out)       out[i] = v[i].length()  (out is T, not double)
+      // normalize()       v[i].normalize() for all i.  Zero vectors are left
+      //                   alone, as with VectorN::normalize().
+      // fast_length(out), fast_normalize()
+      //                   The same with VectorN::fast_length() and
+      //                   fast_normalize(), with the same error bound.
+      // proj(v2, vres)    vres[i] = v[i].proj(v2[i])
+      // cross(v2, vres)   vres[i] = v[i].cross(v2[i])  (Vector3SoA only)
+      //
+      // Converting between the array of vectors and the structure of arrays
+      // layouts is necessarily a copy, but it is done with SIMD transposes.
+
+      namespace detail
+	 {
+	 // Aligned allocation.  The pointer to free is stored just before the
+	 // aligned block.
+	 inline void * aligned_malloc(size_t bytes, size_t alignment)
+	    {
+	    void * raw = malloc(bytes + alignment + sizeof(void *));
+	    if (raw == 0)
+	       throw std::bad_alloc();
+	    size_t p = ((size_t) raw + sizeof(void *) + alignment - 1) & ~(alignment - 1);
+	    ((void **) p)[-1] = raw;
+	    return (void *) p;
+	    }
+
+	 inline void aligned_free(void * p)
+	    {
+	    if (p != 0)
+	       free(((void **) p)[-1]);
+	    }
+
+	 ///////////////////////////////////////////////////////////////////////
+	 // Bulk kernels on N element arrays of n entries each.  The generic
+	 // versions are plain loops; the float versions do 4 vectors at a time.
+	 template <typename T, unsigned int N>
+	 class SoAKernels
+	    {
+	    public:
+	    static inline T dot_at(T const * const * a, T const * const * b, size_t i)
+	       {
+	       T d = a[0][i] * b[0][i];
+	       unsigned int k;
+	       for (k=1; k<N; ++k)
+		  d += a[k][i] * b[k][i];
+	       return d;
+	       }
+
+	    static inline void add(T const * a, T const * b, T * out, size_t n)
+	       { size_t i; for (i=0; i<n; ++i) out[i] = a[i] + b[i]; }
+	    static inline void sub(T const * a, T const * b, T * out, size_t n)
+	       { size_t i; for (i=0; i<n; ++i) out[i] = a[i] - b[i]; }
+	    static inline void scale(T const * a, T const s, T * out, size_t n)
+	       { size_t i; for (i=0; i<n; ++i) out[i] = a[i] * s; }
+	    static inline void divide(T const * a, T const s, T * out, size_t n)
+	       { size_t i; for (i=0; i<n; ++i) out[i] = a[i] / s; }
+
+	    static inline void dot(T const * const * a, T const * const * b, T * out, size_t n)
+	       { size_t i; for (i=0; i<n; ++i) out[i] = dot_at(a, b, i); }
+
+	    static inline void length(T const * const * a, T * out, size_t n)
+	       { size_t i; for (i=0; i<n; ++i) out[i] = (T) sqrt(dot_at(a, a, i)); }
+
+	    static inline void normalize(T * const * a, size_t n)
+	       {
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i<n; ++i)
+		  {
+		  T l = (T) sqrt(dot_at(a, a, i));
+		  if (l == T(0))
+		     continue;
+		  for (k=0; k<N; ++k)
+		     a[k][i] /= l;
+		  }
+	       }
+
+	    static inline void fast_length(T const * const * a, T * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i<n; ++i)
+		  {
+		  T const d = dot_at(a, a, i);
+		  out[i] = d > T(0) ? d * fast_rsqrt(d) : T(0);
+		  }
+	       }
+
+	    static inline void fast_normalize(T * const * a, size_t n)
+	       {
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i<n; ++i)
+		  {
+		  T const d = dot_at(a, a, i);
+		  if (!(d > T(0)))
+		     continue;
+		  T const r = fast_rsqrt(d);
+		  for (k=0; k<N; ++k)
+		     a[k][i] *= r;
+		  }
+	       }
+
+	    static inline void proj(T const * const * a, T const * const * b, T * const * out, size_t n)
+	       {
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i<n; ++i)
+		  {
+		  T s = dot_at(a, b, i) / dot_at(b, b, i);
+		  for (k=0; k<N; ++k)
+		     out[k][i] = b[k][i] * s;
+		  }
+	       }
+
+	    static inline void cross(T const * const * a, T const * const * b, T * const * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i<n; ++i)
+		  {
+		  T const ax = a[0][i], ay = a[1][i], az = a[2][i];
+		  T const bx = b[0][i], by = b[1][i], bz = b[2][i];
+		  out[0][i] =  ay*bz - by*az;
+		  out[1][i] = -ax*bz + bx*az;
+		  out[2][i] =  ax*by - bx*ay;
+		  }
+	       }
+	    };
+
+#if defined(ARDA_MATH_SSE2)
+	 // The element arrays are 64 byte aligned, so aligned loads and stores
+	 // are used for them; only the caller's out arrays may be unaligned.
+	 // dot(), length(), normalize(), and proj() also do 8 or 16 vectors at
+	 // a time with AVX2 or AVX-512 when simd_level() (see Simd.h) says so,
+	 // and fast_length() and fast_normalize() 8 at a time.
+	 // The generic loops handle the tails, and since they use the same
+	 // operations (sqrt and divide are exactly rounded) results do not
+	 // depend on a vector's position in the array.
+	 template <unsigned int N>
+	 class SoAKernels<float, N>
+	    {
+	    public:
+	    static inline float dot_at(float const * const * a, float const * const * b, size_t i)
+	       {
+	       float d = a[0][i] * b[0][i];
+	       unsigned int k;
+	       for (k=1; k<N; ++k)
+		  d += a[k][i] * b[k][i];
+	       return d;
+	       }
+
+	    static inline __m128 dot4(float const * const * a, float const * const * b, size_t i)
+	       {
+	       __m128 d = _mm_mul_ps(_mm_load_ps(a[0] + i), _mm_load_ps(b[0] + i));
+	       unsigned int k;
+	       for (k=1; k<N; ++k)
+		  d = _mm_add_ps(d, _mm_mul_ps(_mm_load_ps(a[k] + i), _mm_load_ps(b[k] + i)));
+	       return d;
+	       }
+
+#if defined(ARDA_MATH_DISPATCH)
+	    // The run time dispatched versions of dot(), length(), normalize(),
+	    // and proj(), 8 and 16 vectors at a time.  They return how many
+	    // vectors they did and leave the rest to the SSE loops.
+	    ARDA_MATH_TARGET_AVX2
+	    static inline __m256 dot8(float const * const * a, float const * const * b, size_t i)
+	       {
+	       __m256 d = _mm256_mul_ps(_mm256_load_ps(a[0] + i), _mm256_load_ps(b[0] + i));
+	       unsigned int k;
+	       for (k=1; k<N; ++k)
+		  d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_load_ps(a[k] + i), _mm256_load_ps(b[k] + i)));
+	       return d;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t dot_avx2(float const * const * a, float const * const * b, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  _mm256_storeu_ps(out + i, dot8(a, b, i));
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t length_avx2(float const * const * a, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  _mm256_storeu_ps(out + i, _mm256_sqrt_ps(dot8(a, a, i)));
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t normalize_avx2(float * const * a, size_t n)
+	       {
+	       __m256 const zero = _mm256_setzero_ps();
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i+8<=n; i+=8)
+		  {
+		  __m256 const l = _mm256_sqrt_ps(dot8(a, a, i));
+		  __m256 const nonzero = _mm256_cmp_ps(l, zero, _CMP_NEQ_UQ);
+		  for (k=0; k<N; ++k)
+		     {
+		     __m256 const e = _mm256_load_ps(a[k] + i);
+		     _mm256_store_ps(a[k] + i, _mm256_blendv_ps(e, _mm256_div_ps(e, l), nonzero));
+		     }
+		  }
+	       return i;
+	       }
+
+	    // These are used for AVX-512 too; see simd::rsqrt_nr().
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t fast_length_avx2(float const * const * a, float * out, size_t n)
+	       {
+	       __m256 const zero = _mm256_setzero_ps();
+	       size_t i;
+	       for (i=0; i+8<=n; i+=8)
+		  {
+		  __m256 const d = dot8(a, a, i);
+		  __m256 const l = _mm256_mul_ps(d, simd::rsqrt_nr(d));
+		  _mm256_storeu_ps(out + i, _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ), l));
+		  }
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t fast_normalize_avx2(float * const * a, size_t n)
+	       {
+	       __m256 const zero = _mm256_setzero_ps();
+	       __m256 const one = _mm256_set1_ps(1.0f);
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i+8<=n; i+=8)
+		  {
+		  __m256 const d = dot8(a, a, i);
+		  __m256 const r = _mm256_blendv_ps(one, simd::rsqrt_nr(d), _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+		  for (k=0; k<N; ++k)
+		     _mm256_store_ps(a[k] + i, _mm256_mul_ps(_mm256_load_ps(a[k] + i), r));
+		  }
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX2
+	    static inline size_t proj_avx2(float const * const * a, float const * const * b, float * const * out, size_t n)
+	       {
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i+8<=n; i+=8)
+		  {
+		  __m256 const s = _mm256_div_ps(dot8(a, b, i), dot8(b, b, i));
+		  for (k=0; k<N; ++k)
+		     _mm256_store_ps(out[k] + i, _mm256_mul_ps(_mm256_load_ps(b[k] + i), s));
+		  }
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX512
+	    static inline __m512 dot16(float const * const * a, float const * const * b, size_t i)
+	       {
+	       __m512 d = _mm512_mul_ps(_mm512_load_ps(a[0] + i), _mm512_load_ps(b[0] + i));
+	       unsigned int k;
+	       for (k=1; k<N; ++k)
+		  d = _mm512_add_ps(d, _mm512_mul_ps(_mm512_load_ps(a[k] + i), _mm512_load_ps(b[k] + i)));
+	       return d;
+	       }
+
+	    // _mm512_sqrt_ps() passes an undefined register through GCC's
+	    // masked builtin, which -Wmaybe-uninitialized flags.  With every
+	    // lane selected, the masked form is the same instruction.
+	    ARDA_MATH_TARGET_AVX512
+	    static inline __m512 sqrt16(__m512 const x)
+	       { return _mm512_mask_sqrt_ps(x, (__mmask16) 0xFFFF, x); }
+
+	    ARDA_MATH_TARGET_AVX512
+	    static inline size_t dot_avx512(float const * const * a, float const * const * b, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+16<=n; i+=16)
+		  _mm512_storeu_ps(out + i, dot16(a, b, i));
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX512
+	    static inline size_t length_avx512(float const * const * a, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+16<=n; i+=16)
+		  _mm512_storeu_ps(out + i, sqrt16(dot16(a, a, i)));
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX512
+	    static inline size_t normalize_avx512(float * const * a, size_t n)
+	       {
+	       __m512 const zero = _mm512_setzero_ps();
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i+16<=n; i+=16)
+		  {
+		  __m512 const l = sqrt16(dot16(a, a, i));
+		  __mmask16 const nonzero = _mm512_cmp_ps_mask(l, zero, _CMP_NEQ_UQ);
+		  for (k=0; k<N; ++k)
+		     {
+		     __m512 const e = _mm512_load_ps(a[k] + i);
+		     _mm512_store_ps(a[k] + i, _mm512_mask_div_ps(e, nonzero, e, l));
+		     }
+		  }
+	       return i;
+	       }
+
+	    ARDA_MATH_TARGET_AVX512
+	    static inline size_t proj_avx512(float const * const * a, float const * const * b, float * const * out, size_t n)
+	       {
+	       size_t i;
+	       unsigned int k;
+	       for (i=0; i+16<=n; i+=16)
+		  {
+		  __m512 const s = _mm512_div_ps(dot16(a, b, i), dot16(b, b, i));
+		  for (k=0; k<N; ++k)
+		     _mm512_store_ps(out[k] + i, _mm512_mul_ps(_mm512_load_ps(b[k] + i), s));
+		  }
+	       return i;
+	       }
+#endif // ARDA_MATH_DISPATCH
+
+	    static inline void add(float const * a, float const * b, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+4<=n; i+=4)
+		  _mm_store_ps(out + i, _mm_add_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+	       for (; i<n; ++i)
+		  out[i] = a[i] + b[i];
+	       }
+
+	    static inline void sub(float const * a, float const * b, float * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+4<=n; i+=4)
+		  _mm_store_ps(out + i, _mm_sub_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+	       for (; i<n; ++i)
+		  out[i] = a[i] - b[i];
+	       }
+
+	    static inline void scale(float const * a, float const s, float * out, size_t n)
+	       {
+	       __m128 const ss = _mm_set1_ps(s);
+	       size_t i;
+	       for (i=0; i+4<=n; i+=4)
+		  _mm_store_ps(out + i, _mm_mul_ps(_mm_load_ps(a + i), ss));
+	       for (; i<n; ++i)
+		  out[i] = a[i] * s;
+	       }
+
+	    static inline void divide(float const * a, float const s, float * out, size_t n)
+	       {
+	       __m128 const ss = _mm_set1_ps(s);
+	       size_t i;
+	       for (i=0; i+4<=n; i+=4)
+		  _mm_store_ps(out + i, _mm_div_ps(_mm_load_ps(a + i), ss));
+	       for (; i<n; ++i)
+		  out[i] = a[i] / s;
+	       }
+
+	    static inline void dot(float const * const * a, float const * const * b, float * out, size_t n)
+	       {
+	       size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	       SimdLevel const level = simd_level();
+	       if (level == SimdLevel::AVX512)
+		  i = dot_avx512(a, b, out, n);
+	       else if (level == SimdLevel::AVX2)
+		  i = dot_avx2(a, b, out, n);
+#endif
+	       for (; i+4<=n; i+=4)
+		  _mm_storeu_ps(out + i, dot4(a, b, i));
+	       for (; i<n; ++i)
+		  out[i] = dot_at(a, b, i);
+	       }
+
+	    static inline void length(float const * const * a, float * out, size_t n)
+	       {
+	       size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	       SimdLevel const level = simd_level();
+	       if (level == SimdLevel::AVX512)
+		  i = length_avx512(a, out, n);
+	       else if (level == SimdLevel::AVX2)
+		  i = length_avx2(a, out, n);
+#endif
+	       for (; i+4<=n; i+=4)
+		  _mm_storeu_ps(out + i, _mm_sqrt_ps(dot4(a, a, i)));
+	       for (; i<n; ++i)
+		  out[i] = sqrtf(dot_at(a, a, i));
+	       }
+
+	    static inline void normalize(float * const * a, size_t n)
+	       {
+	       __m128 const zero = _mm_setzero_ps();
+	       size_t i = 0;
+	       unsigned int k;
+#if defined(ARDA_MATH_DISPATCH)
+	       SimdLevel const level = simd_level();
+	       if (level == SimdLevel::AVX512)
+		  i = normalize_avx512(a, n);
+	       else if (level == SimdLevel::AVX2)
+		  i = normalize_avx2(a, n);
+#endif
+	       for (; i+4<=n; i+=4)
+		  {
+		  __m128 const l = _mm_sqrt_ps(dot4(a, a, i));
+		  __m128 const nonzero = _mm_cmpneq_ps(l, zero);
+		  for (k=0; k<N; ++k)
+		     {
+		     __m128 const e = _mm_load_ps(a[k] + i);
+		     __m128 const q = _mm_div_ps(e, l);
+		     _mm_store_ps(a[k] + i, _mm_or_ps(_mm_and_ps(nonzero, q), _mm_andnot_ps(nonzero, e)));
+		     }
+		  }
+	       for (; i<n; ++i)
+		  {
+		  float l = sqrtf(dot_at(a, a, i));
+		  if (l == 0.0f)
+		     continue;
+		  for (k=0; k<N; ++k)
+		     a[k][i] /= l;
+		  }
+	       }
+
+	    // The tails use fast_rsqrt(), which is the same computation on one
+	    // lane, so the results don't depend on position here either.
+	    static inline void fast_length(float const * const * a, float * out, size_t n)
+	       {
+	       size_t i = 0;
+#if defined(ARDA_MATH_DISPATCH)
+	       if (simd_level() >= SimdLevel::AVX2)
+		  i = fast_length_avx2(a, out, n);
+#endif
+	       __m128 const zero = _mm_setzero_ps();
+	       for (; i+4<=n; i+=4)
+		  {
+		  __m128 const d = dot4(a, a, i);
+		  __m128 const l = _mm_mul_ps(d, simd::rsqrt_nr(d));
+		  _mm_storeu_ps(out + i, _mm_and_ps(_mm_cmpgt_ps(d, zero), l));
+		  }
+	       for (; i<n; ++i)
+		  {
+		  float const d = dot_at(a, a, i);
+		  out[i] = d > 0.0f ? d * fast_rsqrt(d) : 0.0f;
+		  }
+	       }
+
+	    static inline void fast_normalize(float * const * a, size_t n)
+	       {
+	       size_t i = 0;
+	       unsigned int k;
+#if defined(ARDA_MATH_DISPATCH)
+	       if (simd_level() >= SimdLevel::AVX2)
+		  i = fast_normalize_avx2(a, n);
+#endif
+	       __m128 const zero = _mm_setzero_ps();
+	       __m128 const one = _mm_set1_ps(1.0f);
+	       for (; i+4<=n; i+=4)
+		  {
+		  __m128 const d = dot4(a, a, i);
+		  __m128 const positive = _mm_cmpgt_ps(d, zero);
+		  __m128 const r = _mm_or_ps(_mm_and_ps(positive, simd::rsqrt_nr(d)), _mm_andnot_ps(positive, one));
+		  for (k=0; k<N; ++k)
+		     _mm_store_ps(a[k] + i, _mm_mul_ps(_mm_load_ps(a[k] + i), r));
+		  }
+	       for (; i<n; ++i)
+		  {
+		  float const d = dot_at(a, a, i);
+		  if (!(d > 0.0f))
+		     continue;
+		  float const r = fast_rsqrt(d);
+		  for (k=0; k<N; ++k)
+		     a[k][i] *= r;
+		  }
+	       }
+
+	    static inline void proj(float const * const * a, float const * const * b, float * const * out, size_t n)
+	       {
+	       size_t i = 0;
+	       unsigned int k;
+#if defined(ARDA_MATH_DISPATCH)
+	       SimdLevel const level = simd_level();
+	       if (level == SimdLevel::AVX512)
+		  i = proj_avx512(a, b, out, n);
+	       else if (level == SimdLevel::AVX2)
+		  i = proj_avx2(a, b, out, n);
+#endif
+	       for (; i+4<=n; i+=4)
+		  {
+		  __m128 const s = _mm_div_ps(dot4(a, b, i), dot4(b, b, i));
+		  for (k=0; k<N; ++k)
+		     _mm_store_ps(out[k] + i, _mm_mul_ps(_mm_load_ps(b[k] + i), s));
+		  }
+	       for (; i<n; ++i)
+		  {
+		  float s = dot_at(a, b, i) / dot_at(b, b, i);
+		  for (k=0; k<N; ++k)
+		     out[k][i] = b[k][i] * s;
+		  }
+	       }
+
+	    static inline void cross(float const * const * a, float const * const * b, float * const * out, size_t n)
+	       {
+	       size_t i;
+	       for (i=0; i+4<=n; i+=4)
+		  {
+		  __m128 const ax = _mm_load_ps(a[0] + i);
+		  __m128 const ay = _mm_load_ps(a[1] + i);
+		  __m128 const az = _mm_load_ps(a[2] + i);
+		  __m128 const bx = _mm_load_ps(b[0] + i);
+		  __m128 const by = _mm_load_ps(b[1] + i);
+		  __m128 const bz = _mm_load_ps(b[2] + i);
+		  _mm_store_ps(out[0] + i, _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(by, az)));
+		  _mm_store_ps(out[1] + i, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), ax), bz),
+						      _mm_mul_ps(bx, az)));
+		  _mm_store_ps(out[2] + i, _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(bx, ay)));
+		  }
+	       for (; i<n; ++i)
+		  {
+		  float const ax = a[0][i], ay = a[1][i], az = a[2][i];
+		  float const bx = b[0][i], by = b[1][i], bz = b[2][i];
+		  out[0][i] =  ay*bz - by*az;
+		  out[1][i] = -ax*bz + bx*az;
+		  out[2][i] =  ax*by - bx*ay;
+		  }
+	       }
+	    };
+#endif // ARDA_MATH_SSE2
+
+	 ///////////////////////////////////////////////////////////////////////
+	 // The storage and bulk operations shared by Vector2SoA, Vector3SoA, and
+	 // Vector4SoA.  V is the derived container, so that operators return the
+	 // right type, and N is the number of elements per vector.
+	 template <typename V, typename T, unsigned int N>
+	 class SoABase
+	    {
+	    public:
+	    SoABase() : n(0), cap(0), data(0) { set_streams(); }
+	    explicit SoABase(size_t size) : n(0), cap(0), data(0) { set_streams(); resize(size); }
+	    SoABase(SoABase const & v2) : n(0), cap(0), data(0) { set_streams(); *this = v2; }
+	    ~SoABase() { aligned_free(data); }
+
+	    inline SoABase& operator=(SoABase const & v2)
+	       {
+	       if (this == &v2)
+		  return *this;
+	       n = 0;
+	       resize(v2.n);
+	       unsigned int k;
+	       for (k=0; k<N; ++k)
+		  if (n > 0)
+		     memcpy(s[k], v2.s[k], n*sizeof(T));
+	       return *this;
+	       }
+
+	    inline size_t size() const { return n; }
+
+	    inline void resize(size_t size)
+	       {
+	       if (size > cap)
+		  {
+		  // Round up so that every element array stays 64 byte aligned.
+		  size_t const round = 64 / sizeof(T);
+		  size_t const newcap = (size + round - 1) / round * round;
+		  T * newdata = (T *) aligned_malloc(N*newcap*sizeof(T), 64);
+		  unsigned int k;
+		  for (k=0; k<N; ++k)
+		     if (n > 0)
+			memcpy(newdata + k*newcap, s[k], n*sizeof(T));
+		  aligned_free(data);
+		  data = newdata;
+		  cap = newcap;
+		  set_streams();
+		  }
+	       unsigned int k;
+	       for (k=0; k<N && size>n; ++k)
+		  memset(s[k] + n, 0, (size-n)*sizeof(T));
+	       n = size;
+	       }
+
+	    // Element array k (0 = x, 1 = y, ...)
+	    inline T * stream(unsigned int const k)
+	       { assert(k<N); return s[k]; }
+	    inline T const * stream(unsigned int const k) const
+	       { assert(k<N); return s[k]; }
+
+	    // Element wise addition and subtraction
+	    inline V& operator+=(V const & v2)
+	       {
+	       assert(n == v2.size());
+	       unsigned int k;
+	       for (k=0; k<N; ++k)
+		  SoAKernels<T, N>::add(s[k], v2.s[k], s[k], n);
+	       return derived();
+	       }
+	    inline V operator+(V const & v2) const
+	       { V vres(derived()); return vres += v2; }
+
+	    inline V& operator-=(V const & v2)
+	       {
+	       assert(n == v2.size());
+	       unsigned int k;
+	       for (k=0; k<N; ++k)
+		  SoAKernels<T, N>::sub(s[k], v2.s[k], s[k], n);
+	       return derived();
+	       }
+	    inline V operator-(V const & v2) const
+	       { V vres(derived()); return vres -= v2; }
+
+	    // Scalar multiplication and division
+	    inline V& operator*=(T const a)
+	       {
+	       unsigned int k;
+	       for (k=0; k<N; ++k)
+		  SoAKernels<T, N>::scale(s[k], a, s[k], n);
+	       return derived();
+	       }
+	    inline V operator*(T const a) const
+	       { V vres(derived()); return vres *= a; }
+
+	    inline V& operator/=(T const a)
+	       {
+	       assert(a!=0);
+	       unsigned int k;
+	       for (k=0; k<N; ++k)
+		  SoAKernels<T, N>::divide(s[k], a, s[k], n);
+	       return derived();
+	       }
+	    inline V operator/(T const a) const
+	       { V vres(derived()); return vres /= a; }
+
+	    /** \brief out[i] is the dot product of vector i with vector i of v2.
+	     */
+	    inline void dot(V const & v2, T * out) const
+	       { assert(n == v2.size()); SoAKernels<T, N>::dot(s, v2.s, out, n); }
+
+	    /** \brief out[i] is the length of vector i.  Not meaningful for int vectors.
+	     */
+	    inline void length(T * out) const
+	       { SoAKernels<T, N>::length(s, out, n); }
+
+	    /** \brief Normalizes every vector.  Not meaningful for int vectors.
+	     */
+	    inline V& normalize()
+	       { SoAKernels<T, N>::normalize(s, n); return derived(); }
+
+	    /** \brief out[i] is the fast_length() of vector i.  Not meaningful for int vectors.
+	     */
+	    inline void fast_length(T * out) const
+	       { SoAKernels<T, N>::fast_length(s, out, n); }
+
+	    /** \brief fast_normalize() every vector.  Not meaningful for int vectors.
+	     */
+	    inline V& fast_normalize()
+	       { SoAKernels<T, N>::fast_normalize(s, n); return derived(); }
+
+	    /** \brief Vector i of vres is the projection of vector i onto vector i of v2.
+	     * Not meaningful for int vectors.
+	     */
+	    inline V& proj(V const & v2, V & vres) const
+	       {
+	       assert(n == v2.size());
+	       vres.resize(n);
+	       SoAKernels<T, N>::proj(s, v2.s, vres.s, n);
+	       return vres;
+	       }
+
+	    protected:
+	    size_t n, cap;
+	    T * data;
+	    T * s[N];
+
+	    inline void set_streams()
+	       {
+	       unsigned int k;
+	       for (k=0; k<N; ++k)
+		  s[k] = data + k*cap;
+	       }
+
+	    inline V& derived() { return static_cast<V&>(*this); }
+	    inline V const & derived() const { return static_cast<V const &>(*this); }
+	    };
+
+	 } // namespace detail
+
+      //////////////////////////////////////////////////////////////////////////
+      template <typename T>
+      class Vector2SoA : public detail::SoABase<Vector2SoA<T>, T, 2>
+	 {
+	 typedef detail::SoABase<Vector2SoA<T>, T, 2> Base;
+	 public:
+	 Vector2SoA() {}
+	 explicit Vector2SoA(size_t size) : Base(size) {}
+
+	 inline T * x() { return this->s[0]; }
+	 inline T * y() { return this->s[1]; }
+	 inline T const * x() const { return this->s[0]; }
+	 inline T const * y() const { return this->s[1]; }
+
+	 inline Vector2<T> get(size_t const i) const
+	    { assert(i<this->n); return Vector2<T>(x()[i], y()[i]); }
+	 inline Vector2SoA<T>& set(size_t const i, Vector2<T> const & v)
+	    { assert(i<this->n); x()[i] = v.x; y()[i] = v.y; return *this; }
+
+	 /** \brief Resize to n and copy in the array of vectors v.
+	  */
+	 Vector2SoA<T>& assign(Vector2<T> const * v, size_t const n);
+
+	 /** \brief Copy all of the vectors out to the array v.
+	  */
+	 void copy_to(Vector2<T> * v) const;
+	 };
+
+      //////////////////////////////////////////////////////////////////////////
+      template <typename T>
+      class Vector3SoA : public detail::SoABase<Vector3SoA<T>, T, 3>
+	 {
+	 typedef detail::SoABase<Vector3SoA<T>, T, 3> Base;
+	 public:
+	 Vector3SoA() {}
+	 explicit Vector3SoA(size_t size) : Base(size) {}
+
+	 inline T * x() { return this->s[0]; }
+	 inline T * y() { return this->s[1]; }
+	 inline T * z() { return this->s[2]; }
+	 inline T const * x() const { return this->s[0]; }
+	 inline T const * y() const { return this->s[1]; }
+	 inline T const * z() const { return this->s[2]; }
+
+	 inline Vector3<T> get(size_t const i) const
+	    { assert(i<this->n); return Vector3<T>(x()[i], y()[i], z()[i]); }
+	 inline Vector3SoA<T>& set(size_t const i, Vector3<T> const & v)
+	    { assert(i<this->n); x()[i] = v.x; y()[i] = v.y; z()[i] = v.z; return *this; }
+
+	 /** \copydoc arda::Math::Vector2SoA::assign */
+	 Vector3SoA<T>& assign(Vector3<T> const * v, size_t const n);
+
+	 /** \copydoc arda::Math::Vector2SoA::copy_to */
+	 void copy_to(Vector3<T> * v) const;
+
+	 /** \brief Vector i of vres is the cross product of vector i with vector i of v2.
+	  */
+	 inline Vector3SoA<T>& cross(Vector3SoA<T> const & v2, Vector3SoA<T> & vres) const
+	    {
+	    assert(this->n == v2.size());
+	    vres.resize(this->n);
+	    detail::SoAKernels<T, 3>::cross(this->s, v2.s, vres.s, this->n);
+	    return vres;
+	    }
+	 };
+
+      //////////////////////////////////////////////////////////////////////////
+      template <typename T>
+      class Vector4SoA : public detail::SoABase<Vector4SoA<T>, T, 4>
+	 {
+	 typedef detail::SoABase<Vector4SoA<T>, T, 4> Base;
+	 public:
+	 Vector4SoA() {}
+	 explicit Vector4SoA(size_t size) : Base(size) {}
+
+	 inline T * x() { return this->s[0]; }
+	 inline T * y() { return this->s[1]; }
+	 inline T * z() { return this->s[2]; }
+	 inline T * w() { return this->s[3]; }
+	 inline T const * x() const { return this->s[0]; }
+	 inline T const * y() const { return this->s[1]; }
+	 inline T const * z() const { return this->s[2]; }
+	 inline T const * w() const { return this->s[3]; }
+
+	 inline Vector4<T> get(size_t const i) const
+	    { assert(i<this->n); return Vector4<T>(x()[i], y()[i], z()[i], w()[i]); }
+	 inline Vector4SoA<T>& set(size_t const i, Vector4<T> const & v)
+	    { assert(i<this->n); x()[i] = v.x; y()[i] = v.y; z()[i] = v.z; w()[i] = v.w; return *this; }
+
+	 /** \copydoc arda::Math::Vector2SoA::assign */
+	 Vector4SoA<T>& assign(Vector4<T> const * v, size_t const n);
+
+	 /** \copydoc arda::Math::Vector2SoA::copy_to */
+	 void copy_to(Vector4<T> * v) const;
+	 };
+
+      //////////////////////////////////////////////////////////////////////////
+      typedef Vector2SoA<int> Vector2SoAi;
+      typedef Vector2SoA<float> Vector2SoAf;
+      typedef Vector2SoA<double> Vector2SoAd;
+
+      typedef Vector3SoA<int> Vector3SoAi;
+      typedef Vector3SoA<float> Vector3SoAf;
+      typedef Vector3SoA<double> Vector3SoAd;
+
+      typedef Vector4SoA<int> Vector4SoAi;
+      typedef Vector4SoA<float> Vector4SoAf;
+      typedef Vector4SoA<double> Vector4SoAd;
+
+      } // namespace Math
+   } // namespace arda
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Layout conversions
+
+template <typename T>
+arda::Math::Vector2SoA<T>& arda::Math::Vector2SoA<T>::assign(arda::Math::Vector2<T> const * v, size_t const n)
+   {
+   this->resize(n);
+   size_t i;
+   for (i=0; i<n; ++i)
+      {
+      x()[i] = v[i].x;
+      y()[i] = v[i].y;
+      }
+   return *this;
+   }
+
+template <typename T>
+void arda::Math::Vector2SoA<T>::copy_to(arda::Math::Vector2<T> * v) const
+   {
+   size_t i;
+   for (i=0; i<this->n; ++i)
+      v[i].assign(x()[i], y()[i]);
+   }
+
+template <typename T>
+arda::Math::Vector3SoA<T>& arda::Math::Vector3SoA<T>::assign(arda::Math::Vector3<T> const * v, size_t const n)
+   {
+   this->resize(n);
+   size_t i;
+   for (i=0; i<n; ++i)
+      {
+      x()[i] = v[i].x;
+      y()[i] = v[i].y;
+      z()[i] = v[i].z;
+      }
+   return *this;
+   }
+
+template <typename T>
+void arda::Math::Vector3SoA<T>::copy_to(arda::Math::Vector3<T> * v) const
+   {
+   size_t i;
+   for (i=0; i<this->n; ++i)
+      v[i].assign(x()[i], y()[i], z()[i]);
+   }
+
+template <typename T>
+arda::Math::Vector4SoA<T>& arda::Math::Vector4SoA<T>::assign(arda::Math::Vector4<T> const * v, size_t const n)
+   {
+   this->resize(n);
+   size_t i;
+   for (i=0; i<n; ++i)
+      {
+      x()[i] = v[i].x;
+      y()[i] = v[i].y;
+      z()[i] = v[i].z;
+      w()[i] = v[i].w;
+      }
+   return *this;
+   }
+
+template <typename T>
+void arda::Math::Vector4SoA<T>::copy_to(arda::Math::Vector4<T> * v) const
+   {
+   size_t i;
+   for (i=0; i<this->n; ++i)
+      v[i].assign(x()[i], y()[i], z()[i], w()[i]);
+   }
+
+#if defined(ARDA_MATH_SSE2)
+////////////////////////////////////////////////////////////////////////////////
+// float layout conversions, 4 vectors at a time.
+
+namespace arda
+   {
+   namespace Math
+      {
+      template <>
+      inline Vector2SoA<float>& Vector2SoA<float>::assign(Vector2<float> const * v, size_t const n)
+	 {
+	 resize(n);
+	 float * px = x(); float * py = y();
+	 size_t i;
+	 for (i=0; i+4<=n; i+=4)
+	    {
+	    __m128 const a = _mm_loadu_ps(&v[i].x);     // x0 y0 x1 y1
+	    __m128 const b = _mm_loadu_ps(&v[i+2].x);   // x2 y2 x3 y3
+	    _mm_store_ps(px + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+	    _mm_store_ps(py + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+	    }
+	 for (; i<n; ++i)
+	    {
+	    px[i] = v[i].x;
+	    py[i] = v[i].y;
+	    }
+	 return *this;
+	 }
+
+      template <>
+      inline void Vector2SoA<float>::copy_to(Vector2<float> * v) const
+	 {
+	 float const * px = x(); float const * py = y();
+	 size_t i;
+	 for (i=0; i+4<=n; i+=4)
+	    {
+	    __m128 const vx = _mm_load_ps(px + i);
+	    __m128 const vy = _mm_load_ps(py + i);
+	    _mm_storeu_ps(&v[i].x, _mm_unpacklo_ps(vx, vy));
+	    _mm_storeu_ps(&v[i+2].x, _mm_unpackhi_ps(vx, vy));
+	    }
+	 for (; i<n; ++i)
+	    v[i].assign(px[i], py[i]);
+	 }
+
+      template <>
+      inline Vector3SoA<float>& Vector3SoA<float>::assign(Vector3<float> const * v, size_t const n)
+	 {
+	 resize(n);
+	 float * px = x(); float * py = y(); float * pz = z();
+	 size_t i;
+	 for (i=0; i+4<=n; i+=4)
+	    {
+	    float const * src = &v[i].x;
+	    __m128 vx, vy, vz;
+	    simd::deinterleave3(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8),
+				vx, vy, vz);
+	    _mm_store_ps(px + i, vx);
+	    _mm_store_ps(py + i, vy);
+	    _mm_store_ps(pz + i, vz);
+	    }
+	 for (; i<n; ++i)
+	    {
+	    px[i] = v[i].x;
+	    py[i] = v[i].y;
+	    pz[i] = v[i].z;
+	    }
+	 return *this;
+	 }
+
+      template <>
+      inline void Vector3SoA<float>::copy_to(Vector3<float> * v) const
+	 {
+	 float const * px = x(); float const * py = y(); float const * pz = z();
+	 size_t i;
+	 for (i=0; i+4<=n; i+=4)
+	    {
+	    float * dst = &v[i].x;
+	    __m128 a, b, c;
+	    simd::interleave3(_mm_load_ps(px + i), _mm_load_ps(py + i), _mm_load_ps(pz + i),
+			      a, b, c);
+	    _mm_storeu_ps(dst, a);
+	    _mm_storeu_ps(dst + 4, b);
+	    _mm_storeu_ps(dst + 8, c);
+	    }
+	 for (; i<n; ++i)
+	    v[i].assign(px[i], py[i], pz[i]);
+	 }
+
+      template <>
+      inline Vector4SoA<float>& Vector4SoA<float>::assign(Vector4<float> const * v, size_t const n)
+	 {
+	 resize(n);
+	 float * px = x(); float * py = y(); float * pz = z(); float * pw = w();
+	 size_t i;
+	 for (i=0; i+4<=n; i+=4)
+	    {
+	    __m128 r0 = _mm_loadu_ps(&v[i].x);
+	    __m128 r1 = _mm_loadu_ps(&v[i+1].x);
+	    __m128 r2 = _mm_loadu_ps(&v[i+2].x);
+	    __m128 r3 = _mm_loadu_ps(&v[i+3].x);
+	    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	    _mm_store_ps(px + i, r0);
+	    _mm_store_ps(py + i, r1);
+	    _mm_store_ps(pz + i, r2);
+	    _mm_store_ps(pw + i, r3);
+	    }
+	 for (; i<n; ++i)
+	    {
+	    px[i] = v[i].x;
+	    py[i] = v[i].y;
+	    pz[i] = v[i].z;
+	    pw[i] = v[i].w;
+	    }
+	 return *this;
+	 }
+
+      template <>
+      inline void Vector4SoA<float>::copy_to(Vector4<float> * v) const
+	 {
+	 float const * px = x(); float const * py = y(); float const * pz = z(); float const * pw = w();
+	 size_t i;
+	 for (i=0; i+4<=n; i+=4)
+	    {
+	    __m128 r0 = _mm_load_ps(px + i);
+	    __m128 r1 = _mm_load_ps(py + i);
+	    __m128 r2 = _mm_load_ps(pz + i);
+	    __m128 r3 = _mm_load_ps(pw + i);
+	    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	    _mm_storeu_ps(&v[i].x, r0);
+	    _mm_storeu_ps(&v[i+1].x, r1);
+	    _mm_storeu_ps(&v[i+2].x, r2);
+	    _mm_storeu_ps(&v[i+3].x, r3);
+	    }
+	 for (; i<n; ++i)
+	    v[i].assign(px[i], py[i], pz[i], pw[i]);
+	 }
+
+      } // namespace Math
+   } // namespace arda
+#endif // ARDA_MATH_SSE2
+
+#endif // SOA_H_
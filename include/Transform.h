@@ -1,8 +1,11 @@
 #ifndef TRANSFORM_H_
 #define TRANSFORM_H_
 
-// Needs Vector.h and Matrix.h, but this file is not intended to be included
-// directly.  Just include Math.h and everything will be set up correctly.
+// Needs Vector.h, Matrix.h, and Quaternion.h, but this file is not intended
+// to be included directly.  Just include Math.h and everything will be set up
+// correctly.
+
+#include "Simd.h"
 
 #include <iostream>
 
@@ -48,7 +51,7 @@ namespace arda
 
         // Rotate by angle around v with center of rotation p.
         template <typename T>
-        void get_rot_about_point_mat44(arda::Math::Matrix33<T> & M, float angle, arda::Math::Vector3<T> v, arda::Math::Vector3<T> p);
+        void get_rot_about_point_mat44(arda::Math::Matrix44<T> & M, float angle, arda::Math::Vector3<T> v, arda::Math::Vector3<T> p);
 
         ////////////////////////////////////////      
         // Projection matrices
@@ -62,6 +65,194 @@ namespace arda
         template <typename T>
         void get_persp_inf_mat44(arda::Math::Matrix44<T> & M, T near, T far, T left, T right, T bottom, T top);
 
+        ////////////////////////////////////////
+        // The same, returned by value from constexpr functions, so that fixed
+        // matrices can be built at compile time:
+        //
+        //     constexpr Matrix44f P = get_ortho_mat44(0.1f, 100.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+        //
+        // T can't be deduced for the uniform scale and the shear, so write
+        // get_scale_mat44<float>(2) and get_shear_mat44<float>(0, 1, 0.5f).
+        // The versions above are implemented with these.
+
+        template <typename T>
+        inline constexpr arda::Math::Matrix44<T> get_trans_mat44(arda::Math::Vector3<T> const & d)
+            {
+            return arda::Math::Matrix44<T>(T(1), T(0), T(0), T(0),
+                                           T(0), T(1), T(0), T(0),
+                                           T(0), T(0), T(1), T(0),
+                                           d.x,  d.y,  d.z,  T(1));
+            }
+
+        template <typename T>
+        inline constexpr arda::Math::Matrix44<T> get_scale_mat44(float const s)
+            {
+            return arda::Math::Matrix44<T>(T(s), T(0), T(0), T(0),
+                                           T(0), T(s), T(0), T(0),
+                                           T(0), T(0), T(s), T(0),
+                                           T(0), T(0), T(0), T(1));
+            }
+
+        template <typename T>
+        inline constexpr arda::Math::Matrix44<T> get_scale_mat44(arda::Math::Vector3<T> const & s)
+            {
+            return arda::Math::Matrix44<T>(s.x,  T(0), T(0), T(0),
+                                           T(0), s.y,  T(0), T(0),
+                                           T(0), T(0), s.z,  T(0),
+                                           T(0), T(0), T(0), T(1));
+            }
+
+        template <typename T>
+        inline constexpr arda::Math::Matrix44<T> get_shear_mat44(int const i, int const j, float const s)
+            {
+            assert(i<3 && i>=0);
+            assert(j<3 && j>=0);
+            arda::Math::Matrix44<T> M(T(0));
+            M.setidentity();
+            M[4*j + i] = s;
+            return M;
+            }
+
+        template <typename T>
+        inline constexpr arda::Math::Matrix44<T> get_ortho_mat44(T near, T far, T left, T right, T bottom, T top)
+            {
+            return arda::Math::Matrix44<T>(
+                2 / (right - left),                T(0),                              T(0),                          T(0),
+                T(0),                              2 / (top - bottom),                T(0),                          T(0),
+                T(0),                              T(0),                              - 2 / (far - near),            T(0),
+                - (right + left) / (right - left), - (top + bottom) / (top - bottom), - (far + near) / (far - near), T(1) );
+            }
+
+        ////////////////////////////////////////
+        // The same, for TaggedMatrix44 (see Matrix.h).  These set the kind, so
+        // that products and inverses of the results take the fast paths.
+
+        template <typename T>
+        inline void get_trans_mat44(arda::Math::TaggedMatrix44<T> & M, arda::Math::Vector3<T> d)
+            { get_trans_mat44(M.mat, d); M.kind = arda::Math::MatrixKind::TRANSLATION; }
+
+        template <typename T>
+        inline void get_rot_mat44(arda::Math::TaggedMatrix44<T> & M, float angle, arda::Math::Vector3<T> v)
+            { get_rot_mat44(M.mat, angle, v); M.kind = arda::Math::MatrixKind::ROTATION; }
+
+        template <typename T>
+        inline void get_scale_mat44(arda::Math::TaggedMatrix44<T> & M, float s)
+            { get_scale_mat44(M.mat, s); M.kind = arda::Math::MatrixKind::SCALE; }
+
+        template <typename T>
+        inline void get_scale_mat44(arda::Math::TaggedMatrix44<T> & M, arda::Math::Vector3<T> s)
+            { get_scale_mat44(M.mat, s); M.kind = arda::Math::MatrixKind::SCALE; }
+
+        template <typename T>
+        inline void get_scale_mat44(arda::Math::TaggedMatrix44<T> & M, arda::Math::Vector3<T> s,
+            arda::Math::Vector3<T> x, arda::Math::Vector3<T> y, arda::Math::Vector3<T> z)
+            { get_scale_mat44(M.mat, s, x, y, z); M.kind = arda::Math::MatrixKind::AFFINE; }
+
+        template <typename T>
+        inline void get_shear_mat44(arda::Math::TaggedMatrix44<T> & M, int i, int j, float s)
+            { get_shear_mat44(M.mat, i, j, s); M.kind = arda::Math::MatrixKind::AFFINE; }
+
+        template <typename T>
+        inline void get_transform_mat44(arda::Math::TaggedMatrix44<T> & M, float angle, arda::Math::Vector3<T> v,
+            arda::Math::Vector3<T> d)
+            { get_transform_mat44(M.mat, angle, v, d); M.kind = arda::Math::MatrixKind::RIGID; }
+
+        template <typename T>
+        inline void get_rot_about_point_mat44(arda::Math::TaggedMatrix44<T> & M, float angle, arda::Math::Vector3<T> v,
+            arda::Math::Vector3<T> p)
+            { get_rot_about_point_mat44(M.mat, angle, v, p); M.kind = arda::Math::MatrixKind::RIGID; }
+
+        template <typename T>
+        inline void get_ortho_mat44(arda::Math::TaggedMatrix44<T> & M, T near, T far, T left, T right, T bottom, T top)
+            { get_ortho_mat44(M.mat, near, far, left, right, bottom, top); M.kind = arda::Math::MatrixKind::AFFINE; }
+
+        template <typename T>
+        inline void get_persp_mat44(arda::Math::TaggedMatrix44<T> & M, T near, T far, T left, T right, T bottom, T top)
+            { get_persp_mat44(M.mat, near, far, left, right, bottom, top); M.kind = arda::Math::MatrixKind::PROJECTIVE; }
+
+        template <typename T>
+        inline void get_persp_inf_mat44(arda::Math::TaggedMatrix44<T> & M, T near, T far, T left, T right, T bottom, T top)
+            { get_persp_inf_mat44(M.mat, near, far, left, right, bottom, top); M.kind = arda::Math::MatrixKind::PROJECTIVE; }
+
+        ////////////////////////////////////////
+        // Translation, rotation, and scale
+
+        /** \class arda::Math::Transform
+         *
+         * \brief A transform stored as its translation, rotation, and scale.
+         *
+         * \verbatim
+         * The transform is M = T R S, i.e. scale, then rotate, then translate,
+         * which is what a scene node usually holds.  A Transform<float> is 40
+         * bytes rather than the 64 of a Matrix44f, and compose() is about 40
+         * multiplies rather than the 64 of a Matrix44 product.
+         *
+         * Scale is per axis.  A product of two T R S transforms with non
+         * uniform scale can have shear, which this can't represent, so
+         * compose() and inverse() are only exact when the scale of the left
+         * hand (for inverse(), the only) transform is uniform.  This is the
+         * usual compromise for scene graphs; use matrices where shear matters.
+         *
+         * to_matrix44(M)           Write M = T R S into a Matrix44 or a
+         *                          TaggedMatrix44.
+         * transform_point(p)       t + r (s * p), with * per element.
+         * transform_direction(v)   r (s * v); no translation.
+         * compose(a, b)            a after b, as a * b for matrices.
+         * inverse(x)
+         * lerp(a, b, t)            Linear interpolation of the translations and
+         *                          scales, nlerp() of the rotations.
+         * \endverbatim
+         */
+        template <typename T>
+        class Transform
+            {
+        public:
+            arda::Math::Vector3<T> translation;
+            arda::Math::Quaternion<T> rotation;
+            arda::Math::Vector3<T> scale;
+
+            // Constructors
+            Transform() {}
+            Transform(arda::Math::Vector3<T> const & t, arda::Math::Quaternion<T> const & r,
+                arda::Math::Vector3<T> const & s)
+                : translation (t), rotation (r), scale (s) {}
+            Transform(arda::Math::Vector3<T> const & t, arda::Math::Quaternion<T> const & r, T s = T(1))
+                : translation (t), rotation (r), scale (s) {}
+
+            inline Transform<T>& setidentity()
+                { translation.assign(0, 0, 0); rotation.setidentity(); scale.assign(1, 1, 1); return *this; }
+
+            inline arda::Math::Vector3<T> transform_direction(arda::Math::Vector3<T> const & v) const
+                { return rotation.rotate(arda::Math::Vector3<T>(scale.x * v.x, scale.y * v.y, scale.z * v.z)); }
+
+            inline arda::Math::Vector3<T> transform_point(arda::Math::Vector3<T> const & p) const
+                { return transform_direction(p) + translation; }
+
+            void to_matrix44(arda::Math::Matrix44<T> & M) const;
+
+            // Tagged RIGID if the scale is 1, AFFINE otherwise.
+            inline void to_matrix44(arda::Math::TaggedMatrix44<T> & M) const
+                {
+                to_matrix44(M.mat);
+                M.kind = (scale.x == T(1) && scale.y == T(1) && scale.z == T(1))
+                    ? arda::Math::MatrixKind::RIGID : arda::Math::MatrixKind::AFFINE;
+                }
+            };
+
+        template <typename T>
+        arda::Math::Transform<T> compose(arda::Math::Transform<T> const & a, arda::Math::Transform<T> const & b);
+
+        template <typename T>
+        arda::Math::Transform<T> inverse(arda::Math::Transform<T> const & x);
+
+        template <typename T>
+        arda::Math::Transform<T> lerp(arda::Math::Transform<T> const & a, arda::Math::Transform<T> const & b, T t);
+
+        typedef Transform<float> Transformf;
+        typedef Transform<double> Transformd;
+
+        static_assert(sizeof(Transform<float>) == 40, "Transform<float> should be 10 packed floats");
+
         } // namespace Math
    
     } // namespace arda
@@ -71,8 +262,7 @@ namespace arda
 template <typename T>
 void arda::Math::get_trans_mat44(arda::Math::Matrix44<T> & M, arda::Math::Vector3<T> d)
     {
-    M.setidentity();
-    M.setcol(3, d.x, d.y, d.z, 1);
+    M = arda::Math::get_trans_mat44(d);
     }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -116,19 +306,14 @@ void arda::Math::get_rot_mat44(arda::Math::Matrix44<T> & M, float angle, arda::M
 template <typename T>
 void arda::Math::get_scale_mat44(arda::Math::Matrix44<T> & M, float s)
     {
-    M.setidentity();
-    M *= s;
-    M[15] = 1;
+    M = arda::Math::get_scale_mat44<T>(s);
     }
 
 ////////////////////////////////////////////////////////////////////////////////
 template <typename T>
 void arda::Math::get_scale_mat44(arda::Math::Matrix44<T> & M, arda::Math::Vector3<T> s)
     {
-    M.setidentity();
-    M[0] = s.x;
-    M[5] = s.y;
-    M[10] = s.z;
+    M = arda::Math::get_scale_mat44(s);
     }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -150,17 +335,14 @@ void arda::Math::get_scale_mat44(arda::Math::Matrix44<T> & M, arda::Math::Vector
     Ft = arda::Math::transpose(F);
     arda::Math::get_scale_mat44(S, s);
 
-    M = F * S * Ft;
+    arda::Math::lazy::assign(M, arda::Math::lazy::ref(F) * S * Ft);
     }
 
 ////////////////////////////////////////////////////////////////////////////////
 template <typename T>
 void arda::Math::get_shear_mat44(arda::Math::Matrix44<T> & M, int i, int j, float s)
     {
-    assert(i<3 && i>=0);
-    assert(j<3 && j>=0);
-    M.setidentity();
-    M[4*j + i] = s;
+    M = arda::Math::get_shear_mat44<T>(i, j, s);
     }
 
 
@@ -186,9 +368,9 @@ void arda::Math::get_rot_about_point_mat44(arda::Math::Matrix44<T> & M,
     float angle, arda::Math::Vector3<T> v,
     arda::Math::Vector3<T> p)
     {
-    arda::Math::Matrix33f M33(0);
+    arda::Math::Matrix33<T> M33(0);
     get_rot_mat33(M33, angle, v);
-    arda::Math::Vector3f p1 = M33 * p;
+    arda::Math::Vector3<T> p1 = M33 * p;
 
     M[0] = M33[0];
     M[1] = M33[1];
@@ -215,12 +397,7 @@ void arda::Math::get_rot_about_point_mat44(arda::Math::Matrix44<T> & M,
 template <typename T>
 void arda::Math::get_ortho_mat44(arda::Math::Matrix44<T> & M, T near, T far, T left, T right, T bottom, T top)
     {
-    M.assign(
-        2 / (right - left),                T(0),                              T(0),                          T(0),
-        T(0),                              2 / (top - bottom),                T(0),                          T(0),
-        T(0),                              T(0),                              - 2 / (far - near),            T(0),
-        - (right + left) / (right - left), - (top + bottom) / (top - bottom), - (far + near) / (far - near), T(1) );
-    
+    M = arda::Math::get_ortho_mat44(near, far, left, right, bottom, top);
     }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -249,5 +426,107 @@ void arda::Math::get_persp_inf_mat44(arda::Math::Matrix44<T> & M, T near, T far,
     
     }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void arda::Math::Transform<T>::to_matrix44(arda::Math::Matrix44<T> & M) const
+    {
+    arda::Math::Matrix33<T> R;
+    arda::Math::get_rot_mat33(R, rotation);
+
+    // Remember: the "rows" as written here are actually the columns of the matrix.
+    M.assign(
+        R[0] * scale.x,   R[1] * scale.x,   R[2] * scale.x,   T(0),
+        R[3] * scale.y,   R[4] * scale.y,   R[5] * scale.y,   T(0),
+        R[6] * scale.z,   R[7] * scale.z,   R[8] * scale.z,   T(0),
+        translation.x,    translation.y,    translation.z,    T(1)
+        );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::Transform<T> arda::Math::compose(arda::Math::Transform<T> const & a, arda::Math::Transform<T> const & b)
+    {
+    // a (b p) = ta + ra (sa * (tb + rb (sb * p))), and when sa is uniform
+    // sa * rb (...) == rb (sa * ...), which gives the T R S form below.
+    return arda::Math::Transform<T>(a.transform_point(b.translation),
+        a.rotation * b.rotation,
+        arda::Math::Vector3<T>(a.scale.x * b.scale.x, a.scale.y * b.scale.y, a.scale.z * b.scale.z));
+    }
+
+#if defined(ARDA_MATH_SSE2)
+////////////////////////////////////////////////////////////////////////////////
+// The 10 floats of a Transform<float> are loaded as three overlapping
+// registers, (t, r.x), r, and (r.w, s), and stored the same way, with r last
+// so that it overwrites the unused lanes of the other two.  That needs no
+// shuffles to split or merge the parts, which matters since this is limited
+// by the shuffles.
+template <>
+inline arda::Math::Transform<float> arda::Math::compose<float>(arda::Math::Transform<float> const & a,
+    arda::Math::Transform<float> const & b)
+    {
+    float const * const pa = &a.translation.x;
+    float const * const pb = &b.translation.x;
+    __m128 const ta = _mm_loadu_ps(pa), ra = _mm_loadu_ps(pa + 3), ha = _mm_loadu_ps(pa + 6);
+    __m128 const tb = _mm_loadu_ps(pb), rb = _mm_loadu_ps(pb + 3), hb = _mm_loadu_ps(pb + 6);
+    __m128 const sa = _mm_shuffle_ps(ha, ha, _MM_SHUFFLE(3,3,2,1));
+    __m128 const aw = _mm_set1_ps(pa[6]);
+
+    // a.transform_point(b.translation).  The cross products are done as
+    // cross(u, v) = (u v.yzx - u.yzx v).yzx, and u = cross(ra, p) is kept
+    // in that rotated order, which saves 3 shuffles over simd::cross3().
+    __m128 const p = _mm_mul_ps(sa, tb);
+    __m128 const ra_yzx = _mm_shuffle_ps(ra, ra, _MM_SHUFFLE(3,0,2,1));
+    __m128 const u = _mm_sub_ps(_mm_mul_ps(ra, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3,0,2,1))),
+                                _mm_mul_ps(ra_yzx, p));
+    __m128 const u2 = _mm_add_ps(u, u);
+    __m128 const c2 = _mm_shuffle_ps(u2, u2, _MM_SHUFFLE(3,0,2,1));
+    __m128 const v = _mm_sub_ps(_mm_mul_ps(ra, _mm_shuffle_ps(u2, u2, _MM_SHUFFLE(3,1,0,2))),
+                                _mm_mul_ps(ra_yzx, c2));
+    __m128 const t = _mm_add_ps(_mm_add_ps(_mm_add_ps(p, _mm_mul_ps(aw, c2)),
+                                           _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,0,2,1))), ta);
+
+    // a.rotation * b.rotation, as simd::quat_mul() but with the elements of
+    // a broadcast from memory.
+    __m128 r = _mm_mul_ps(aw, rb);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(pa[3]),
+                                 arda::Math::simd::flip_signs(_mm_shuffle_ps(rb, rb, _MM_SHUFFLE(0,1,2,3)), 0, 1, 0, 1)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(pa[4]),
+                                 arda::Math::simd::flip_signs(_mm_shuffle_ps(rb, rb, _MM_SHUFFLE(1,0,3,2)), 0, 0, 1, 1)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(pa[5]),
+                                 arda::Math::simd::flip_signs(_mm_shuffle_ps(rb, rb, _MM_SHUFFLE(2,3,0,1)), 1, 0, 0, 1)));
+    __m128 const h = _mm_mul_ps(ha, hb);
+
+    arda::Math::Transform<float> x;
+    float * const px = &x.translation.x;
+    _mm_storeu_ps(px, t);
+    _mm_storeu_ps(px + 6, h);
+    _mm_storeu_ps(px + 3, r);
+    return x;
+    }
+#endif // ARDA_MATH_SSE2
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::Transform<T> arda::Math::inverse(arda::Math::Transform<T> const & x)
+    {
+    assert(x.scale.x != 0 && x.scale.y != 0 && x.scale.z != 0);
+
+    // x^-1 p = (1/s) * r^-1 (p - t).  With uniform s this is T R S with the
+    // translation -(1/s) * r^-1 t.
+    arda::Math::Quaternion<T> const ri = arda::Math::conjugate(x.rotation);
+    arda::Math::Vector3<T> const si(1 / x.scale.x, 1 / x.scale.y, 1 / x.scale.z);
+    arda::Math::Vector3<T> const t = ri.rotate(x.translation);
+    return arda::Math::Transform<T>(arda::Math::Vector3<T>(-si.x * t.x, -si.y * t.y, -si.z * t.z), ri, si);
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+arda::Math::Transform<T> arda::Math::lerp(arda::Math::Transform<T> const & a, arda::Math::Transform<T> const & b, T t)
+    {
+    return arda::Math::Transform<T>(a.translation + (b.translation - a.translation) * t,
+        arda::Math::nlerp(a.rotation, b.rotation, t),
+        a.scale + (b.scale - a.scale) * t);
+    }
+
 
 #endif
@@ -1,23 +1,28 @@
 #ifndef VECTOR_H_
 #define VECTOR_H_
 
+#include "Simd.h"
+
 #include <cassert>
 #include <cmath>
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
+#include <utility>
 
 
-namespace arda 
+namespace arda
     {
     namespace Math
         {
         ////////////////////////////////////////////////////////////////////////////////
-        /** \class arda::Math::Vector2
+        /** \class arda::Math::Vector
          *
-         * \brief Templated classes for 2, 3, and 4 dimensional vectors.
+         * \brief Templated class for N dimensional vectors.
          *
          * \tparam T Type is intended to be int, float, and double only. (i.e. if you roll your own base type, it had better act like a numeric scalar.)
+         * \tparam N The number of elements, at least 2.
          *
          * \verbatim
          * Supported operations on vectors
@@ -26,21 +31,34 @@ namespace arda
          *     Vector v;             * Default zero vector.
          *     Vector v2(v);         * Construct from other vector.
          *     T a, b;
-         *     Vector v(a, b)        * Construct from values.
+         *     Vector v(a, b)        * Construct from values, one per element.
+         *     Vector v(a)           * Every element set to a.
+         *     Vector v(u)           * From a shorter vector u, with the rest
+         *                             of the elements zero.
          * []
          *     If you have a Vector named v you can access it's member elements as
          *     v[0], v[1], v[2], and v[3]. in addtion to v.x, v.y, v.z, and v.w
+         *     (which exist for N = 2, 3, and 4).  v.get<I>() is element I,
+         *     with I checked at compile time.
          * == != + += - -=
          *     Defined for operations on two vectors of the same type.
          *     TODO Is there a better way to do this?  With integer types this is fine,
-         *     but with floating point types this == and != are really worthless.  Is it possible to 
+         *     but with floating point types this == and != are really worthless.  Is it possible to
          *     create variant methods in a template class that vary by the type?  Or do I just have
          *     to suck it up and create type specific external functions for comparing vectors?
          * * *= / /=
          *     Defined for scalar multiplication/division with int, float, and double.
          *     * is defined as a standalone template operator for the scalar * Vector form.
          *
-         * Note that the following typedefs are defined for convenience:
+         * length() and normalize() are exact (to double precision).  fast_length()
+         * and fast_normalize() are computed in T instead, and for float use an
+         * approximate reciprocal square root; see detail::fast_rsqrt().
+         *
+         * Everything except length(), normalize(), fast_length(), fast_normalize(),
+         * get_angle(), get_anglen(), and to_string() is constexpr.
+         *
+         * Vector2, Vector3, and Vector4 are aliases for Vector<T, 2>, etc., and
+         * the following typedefs are defined for convenience:
          *
          * typedef Vector2<int> Vector2i;
          * typedef Vector2<float> Vector2f;
@@ -62,120 +80,312 @@ namespace arda
          *
          * Is there a better way to do this?  Am I worrying about nothing?
          *
+         * As it turns out, mostly: promoting every element of a float vector to
+         * double and back costs more than it buys, and keeps the compiler from
+         * vectorizing loops over float vectors.  So the arithmetic is now done
+         * in the type ScalarPrecision<T, S> (below) picks, which is T itself for
+         * float and double: the scalar is rounded to T once and the elements
+         * are scaled in T.  Int vectors still compute in the wider type, so a
+         * Vector3i times 0.5 is exact before it is truncated.  normalize() works
+         * the same way, with the length computed in T.
          *
          *
-         * I suppose I could make this into a single Vector template on two parameters
-         * template <typename T, unsigned int N> class Vector
-         *    {
-         *    T v[N];
          *
-         *    etc...
-         *
-         * This might buy perfect generality, but it would come at the expense of
-         * loops in all of the code, so I don't think it would really be worth it.
+         * This used to be three classes, Vector2, Vector3, and Vector4, on the
+         * theory that a single template on N would mean loops in all of the
+         * code.  It doesn't: every element wise operation is a parameter pack
+         * expansion over the indexes 0..N-1, so it is written once and comes
+         * out as straight line code, the same as the hand written versions.
+         * Sums (dot() etc.) are left folds, so they add in the same order as
+         * x*a.x + y*a.y + z*a.z.
          *
          * \endverbatim
          */
 
         /////////////////////////////////////////////////////////////////////////////
-        template <typename T> 
-        class Vector2
+        /** \brief The type that length() returns for a Vector<T>.
+         *
+         * This is double for int, float, and double.  Packet types (see Packet.h)
+         * specialize it so that length() returns one length per lane.
+         */
+        template <typename T>
+        struct RealType
             {
-        public:
-            T x, y;
-	 
-            // Constructors
-            Vector2() {}
-            explicit Vector2(T a) : x (a), y(a) {}
-            Vector2(T a, T b) : x (a), y(b) {}
+            typedef double type;
+            };
 
-            // Array indexing
-            inline T& operator[](unsigned int const i)
-                { assert (i<2); if (i==0) return x; return y; }
-            inline T operator[](unsigned int const i) const
-                { assert (i<2); if (i==0) return x; return y; }
+        /** \brief The type that scalar multiplication and division of a Vector<T>
+         * or Matrix<T> by an S are computed in.
+         *
+         * T for floating point T, so float stays float.  Otherwise the type of
+         * T * S, so int vectors scaled by a float or double are computed in that
+         * type.  Specialize it to change the policy for a type.
+         */
+        template <typename T, typename S>
+        struct ScalarPrecision
+            {
+            typedef typename std::conditional<std::is_floating_point<T>::value, T,
+                                              decltype(std::declval<T>() * std::declval<S>())>::type type;
+            };
 
-            // Assignment
-            inline Vector2<T>& operator=(Vector2<T> const & v2)
-                { x = v2.x; y = v2.y; return *this; }
+        namespace detail
+            {
+            // Compile time element indexes, for the unrolled element loops.
+            template <unsigned int N>
+            using Indices = std::make_integer_sequence<unsigned int, N>;
 
-            /** \brief Directly assign values to the vector.
+            template <unsigned int I>
+            using Index = std::integral_constant<unsigned int, I>;
+
+            // T, once per index, so that Repeat<T, I>::type... is N T's.
+            template <typename T, unsigned int>
+            struct Repeat
+                {
+                typedef T type;
+                };
+
+            /** \brief Approximate 1 / sqrt(d), for fast_length() and fast_normalize().
              *
-             * Takes 2, 3, or 4 arguments of template type T according to the size of the Vector.
+             * For float with SSE this is rsqrtss refined with one Newton-Raphson
+             * step, with a relative error of at most 2^-21 (about 4.8e-7, or 4
+             * ulps) for normal d > 0.  The approximation is the CPU's, so the
+             * last bits may differ between CPU vendors.  Otherwise it is
+             * 1 / sqrt(d) computed in T.  d must be greater than zero.
              */
+            template <typename T>
+            inline T fast_rsqrt(T const d)
+                { return T(1) / (T) sqrt(d); }
 
-            inline Vector2<T>& assign(T const a, T const b)
-                { x = a; y = b; return *this; }
+#if defined(ARDA_MATH_SSE2)
+            inline float fast_rsqrt(float const d)
+                { return _mm_cvtss_f32(simd::rsqrt_nr(_mm_set1_ps(d))); }
+#endif
+
+            /** \brief The elements of a Vector<T, N>.
+             *
+             * The named members x, y, z, and w for N = 2, 3, and 4, and an array
+             * otherwise.  The constructor takes one value per element, and
+             * element(Index<I>()) is element I.
+             */
+            template <typename T, unsigned int N, typename = Indices<N> >
+            struct VectorElements;
+
+            template <typename T, unsigned int N, unsigned int... I>
+            struct VectorElements<T, N, std::integer_sequence<unsigned int, I...> >
+                {
+                T v[N];
+
+                VectorElements() {}
+                constexpr VectorElements(typename Repeat<T, I>::type... a) : v {a...} {}
+
+                inline constexpr T& operator[](unsigned int const i)
+                    { assert (i<N); return v[i]; }
+                inline constexpr T operator[](unsigned int const i) const
+                    { assert (i<N); return v[i]; }
+
+                template <unsigned int J>
+                inline constexpr T& element(Index<J>) { return v[J]; }
+                template <unsigned int J>
+                inline constexpr T element(Index<J>) const { return v[J]; }
+                };
+
+            template <typename T>
+            struct VectorElements<T, 2, std::integer_sequence<unsigned int, 0, 1> >
+                {
+                T x, y;
+
+                VectorElements() {}
+                constexpr VectorElements(T a, T b) : x (a), y (b) {}
+
+                inline constexpr T& operator[](unsigned int const i)
+                    { assert (i<2); if (i==0) return x; return y; }
+                inline constexpr T operator[](unsigned int const i) const
+                    { assert (i<2); if (i==0) return x; return y; }
+
+                inline constexpr T& element(Index<0>) { return x; }
+                inline constexpr T& element(Index<1>) { return y; }
+                inline constexpr T element(Index<0>) const { return x; }
+                inline constexpr T element(Index<1>) const { return y; }
+                };
+
+            template <typename T>
+            struct VectorElements<T, 3, std::integer_sequence<unsigned int, 0, 1, 2> >
+                {
+                T x, y, z;
+
+                VectorElements() {}
+                constexpr VectorElements(T a, T b, T c) : x (a), y (b), z (c) {}
+
+                inline constexpr T& operator[](unsigned int const i)
+                    { assert (i<3); if (i==0) return x; if (i==1) return y; return z; }
+                inline constexpr T operator[](unsigned int const i) const
+                    { assert (i<3); if (i==0) return x; if (i==1) return y; return z; }
+
+                inline constexpr T& element(Index<0>) { return x; }
+                inline constexpr T& element(Index<1>) { return y; }
+                inline constexpr T& element(Index<2>) { return z; }
+                inline constexpr T element(Index<0>) const { return x; }
+                inline constexpr T element(Index<1>) const { return y; }
+                inline constexpr T element(Index<2>) const { return z; }
+                };
+
+            template <typename T>
+            struct VectorElements<T, 4, std::integer_sequence<unsigned int, 0, 1, 2, 3> >
+                {
+                T x, y, z, w;
+
+                VectorElements() {}
+                constexpr VectorElements(T a, T b, T c, T d) : x (a), y (b), z (c), w (d) {}
+
+                inline constexpr T& operator[](unsigned int const i)
+                    { assert (i<4); if (i==0) return x; if (i==1) return y; if (i==2) return z; return w; }
+                inline constexpr T operator[](unsigned int const i) const
+                    { assert (i<4); if (i==0) return x; if (i==1) return y; if (i==2) return z; return w; }
+
+                inline constexpr T& element(Index<0>) { return x; }
+                inline constexpr T& element(Index<1>) { return y; }
+                inline constexpr T& element(Index<2>) { return z; }
+                inline constexpr T& element(Index<3>) { return w; }
+                inline constexpr T element(Index<0>) const { return x; }
+                inline constexpr T element(Index<1>) const { return y; }
+                inline constexpr T element(Index<2>) const { return z; }
+                inline constexpr T element(Index<3>) const { return w; }
+                };
+            } // namespace detail
+
+        /////////////////////////////////////////////////////////////////////////////
+        template <typename T, unsigned int N>
+        class Vector : public detail::VectorElements<T, N>
+            {
+            static_assert(N >= 2, "Vector needs at least 2 elements");
+
+        public:
+            // Constructors
+            Vector() {}
+            explicit constexpr Vector(T a) : Vector(a, detail::Indices<N>()) {}
+            // Vector(T a0, ..., T aN-1)
+            using detail::VectorElements<T, N>::VectorElements;
+            template <unsigned int M, typename = typename std::enable_if<(M < N)>::type>
+            constexpr Vector(Vector<T, M> const & v) : Vector(v, detail::Indices<N>()) {}
+
+            // Array indexing is inherited; get<I>() is element I, checked at
+            // compile time.
+            template <unsigned int I>
+            inline constexpr T& get()
+                { static_assert(I < N, "Vector index out of range"); return this->element(detail::Index<I>()); }
+            template <unsigned int I>
+            inline constexpr T get() const
+                { static_assert(I < N, "Vector index out of range"); return this->element(detail::Index<I>()); }
+
+            // Assignment (from a Vector of the same size is the implicit one)
+            template <unsigned int M, typename = typename std::enable_if<(M < N)>::type>
+            inline constexpr Vector<T, N>& operator=(Vector<T, M> const & v2)
+                { return *this = Vector<T, N>(v2); }
+
+            /** \brief Directly assign values to the vector.
+             *
+             * Takes N arguments, which are converted to T.
+             */
+            template <typename... A>
+            inline constexpr Vector<T, N>& assign(A const... a)
+                {
+                static_assert(sizeof...(A) == N, "assign() takes one value per element");
+                return *this = Vector<T, N>(a...);
+                }
 
             // Comparison
-            inline bool operator==(Vector2<T> const & v2) const
-                { return ((x == v2.x) && (y == v2.y)); }
-            inline bool operator!=(Vector2<T> const & v2) const
+            inline constexpr bool operator==(Vector<T, N> const & v2) const
+                { return equal(v2, detail::Indices<N>()); }
+            inline constexpr bool operator!=(Vector<T, N> const & v2) const
                 { return ! (*this == v2); }
 
             // Vector addition
-            inline Vector2<T>& operator+=(Vector2<T> const & v2)
-                { x += v2.x; y += v2.y; return *this; }
-            inline Vector2<T> operator+(Vector2<T> const & v2) const
-                { return Vector2<T>(*this) += v2; }
+            inline constexpr Vector<T, N>& operator+=(Vector<T, N> const & v2)
+                { return add(v2, detail::Indices<N>()); }
+            inline constexpr Vector<T, N> operator+(Vector<T, N> const & v2) const
+                { return Vector<T, N>(*this) += v2; }
 
             // Vector subtraction
-            inline Vector2<T>& operator-=(Vector2<T> const & v2)
-                { x -= v2.x; y -= v2.y; return *this; }
-            inline Vector2<T> operator-(Vector2<T> const & v2) const
-                { return Vector2<T>(*this) -= v2; }
+            inline constexpr Vector<T, N>& operator-=(Vector<T, N> const & v2)
+                { return subtract(v2, detail::Indices<N>()); }
+            inline constexpr Vector<T, N> operator-(Vector<T, N> const & v2) const
+                { return Vector<T, N>(*this) -= v2; }
 
             // Scalar multiplication
-            inline Vector2<T>& operator*=(int const a)
-                { x *= a; y *= a; return *this; }
-            inline Vector2<T>& operator*=(float const a)
-                { x *= a; y *= a; return *this; }
-            inline Vector2<T>& operator*=(double const a)
-                { x *= a; y *= a; return *this; }
-
-            inline Vector2<T> operator*(int const a) const
-                { return Vector2<T>(*this) *= a;}
-            inline Vector2<T> operator*(float const a) const
-                { return Vector2<T>(*this) *= a;}
-            inline Vector2<T> operator*(double const a) const
-                { return Vector2<T>(*this) *= a;}
+            inline constexpr Vector<T, N>& operator*=(int const a)
+                { return multiply(a, detail::Indices<N>()); }
+            inline constexpr Vector<T, N>& operator*=(float const a)
+                { return multiply(a, detail::Indices<N>()); }
+            inline constexpr Vector<T, N>& operator*=(double const a)
+                { return multiply(a, detail::Indices<N>()); }
+
+            inline constexpr Vector<T, N> operator*(int const a) const
+                { return Vector<T, N>(*this) *= a;}
+            inline constexpr Vector<T, N> operator*(float const a) const
+                { return Vector<T, N>(*this) *= a;}
+            inline constexpr Vector<T, N> operator*(double const a) const
+                { return Vector<T, N>(*this) *= a;}
 
             // Scalar division
-            inline Vector2<T>& operator/=(int const a)
-                { assert(a!=0); x /= a; y /= a; return *this; }
-            inline Vector2<T>& operator/=(float const a)
-                { assert(a!=0); x /= a; y /= a; return *this; }
-            inline Vector2<T>& operator/=(double const a)
-                { assert(a!=0); x /= a; y /= a; return *this; }
+            inline constexpr Vector<T, N>& operator/=(int const a)
+                { assert(a!=0); return divide(a, detail::Indices<N>()); }
+            inline constexpr Vector<T, N>& operator/=(float const a)
+                { assert(a!=0); return divide(a, detail::Indices<N>()); }
+            inline constexpr Vector<T, N>& operator/=(double const a)
+                { assert(a!=0); return divide(a, detail::Indices<N>()); }
 
-            inline Vector2<T> operator/(int const a) const
-                { return Vector2<T>(*this) /= a;}
-            inline Vector2<T> operator/(float const a) const
-                { return Vector2<T>(*this) /= a;}
-            inline Vector2<T> operator/(double const a) const
-                { return Vector2<T>(*this) /= a;}
+            inline constexpr Vector<T, N> operator/(int const a) const
+                { return Vector<T, N>(*this) /= a;}
+            inline constexpr Vector<T, N> operator/(float const a) const
+                { return Vector<T, N>(*this) /= a;}
+            inline constexpr Vector<T, N> operator/(double const a) const
+                { return Vector<T, N>(*this) /= a;}
 
 
             // methods
 
             /** \brief The dot product of the vector with v2.
              */
-            inline T dot(Vector2<T> const & v2) const
-                { return x*v2.x + y*v2.y; }
+            inline constexpr T dot(Vector<T, N> const & v2) const
+                { return dot(v2, detail::Indices<N>()); }
+
+            /** \brief Cross product of the vector with another Vector. Result returned in vres.  3D vectors only.
+             *
+             * The version that takes two arguments stores the result in the second
+             * argument.  This may be faster since no temporary object is created
+             * during the operation.
+             */
+            inline constexpr Vector<T, N>& cross(Vector<T, N> const & v2, Vector<T, N>& vres) const
+                {
+                static_assert(N == 3, "cross() is only defined for 3D vectors");
+                vres.x =  this->y*v2.z - v2.y*this->z;
+                vres.y = -this->x*v2.z + v2.x*this->z;
+                vres.z =  this->x*v2.y - v2.x*this->y;
+                return vres;
+                }
+            /** \brief Cross product of the vector with another Vector.  3D vectors only.
+             * \copydetails arda::Math::Vector::cross */
+            inline constexpr Vector<T, N> cross(Vector<T, N> const & v2) const
+                {
+                static_assert(N == 3, "cross() is only defined for 3D vectors");
+                return Vector<T, N>( this->y*v2.z - v2.y*this->z,
+                                    -this->x*v2.z + v2.x*this->z,
+                                     this->x*v2.y - v2.x*this->y);
+                }
 
 
             /** \brief Returns the angle (in radians) between the vector and v2. Not meaningful for int vectors.
              */
-            inline double get_angle(Vector2<T> const & v2)
-                { 
-                double tmp = dot(v2); 
+            inline double get_angle(Vector<T, N> const & v2)
+                {
+                double tmp = dot(v2);
                 return acos(sqrt(tmp*tmp/(dot(*this)*v2.dot(v2))));
                 }
 
 
             /** \brief Like get_angle(), but the vectors must already be normalized. Not meaningful for int vectors.
              */
-            inline double get_anglen(Vector2<T> const & v2)
+            inline double get_anglen(Vector<T, N> const & v2)
                 { return acos((double) dot(v2)); }
 
 
@@ -184,339 +394,122 @@ namespace arda
             std::string to_string(void) const;
 
 
-            /** \brief Get the length of a vector. Returns a double for all vector types.
+            /** \brief Get the length of a vector. Returns a double for all of the built in types
+             * (see arda::Math::RealType).
              */
-            inline double length(void) const
+            inline typename RealType<T>::type length(void) const
                 { return sqrt((dot(*this))); }
 
 
             /** \brief Normalizes the vector. Not meaningful for int vectors.
              */
-            inline Vector2<T>& normalize()
-                { 
-                double l = length(); 
-                if (l == 0.0) return *this; 
-                x /= l; y /= l; 
-                return *this; }
-
-            /** \brief Calculates the projection of the vector onto v2.  Not meaningful for int vectors.
-             */
-            inline Vector2<T> proj(Vector2<T> const & v2)
-                { Vector2<T> vres; vres = v2 * (dot(v2)/v2.dot(v2)); return vres; }
-            /** \copybrief arda::Math::Vector2::proj
-             * Returns result in vres
-             */
-           inline Vector2<T>& proj(Vector2<T> const & v2, Vector2<T>& vres)
-                { vres = v2 * dot(v2)/v2.dot(v2); return vres; }
-            };
-
-        // Scalar multiplication, continued
-        template <typename T> 
-        inline Vector2<T> operator*(int const a, Vector2<T> const & v)
-            { return Vector2<T>(v) *= a;}
-
-        template <typename T> 
-        inline Vector2<T> operator*(float const a, Vector2<T> const & v)
-            { return Vector2<T>(v) *= a;}
-
-        template <typename T> 
-        inline Vector2<T> operator*(double const a, Vector2<T> const & v)
-            { return Vector2<T>(v) *= a;}
-
-
-        /////////////////////////////////////////////////////////////////////////////
-        /** \class arda::Math::Vector3
-         *  \copydoc arda::Math::Vector2
-         */
-        template <typename T> 
-        class Vector3
-            {
-        public:
-            T x, y, z;
-
-            // Constructors
-            Vector3() {}
-            explicit Vector3(T a) : x (a), y(a), z(a) {}
-            Vector3(T a, T b, T c) : x (a), y(b), z(c) {}
-            Vector3(Vector2<T> v) : x (v.x), y (v.y), z (0) {}
-
-            // Array indexing
-            inline T& operator[](unsigned int const i)
-                { assert (i<3); if (i==0) return x; if (i==1) return y; return z; }
-            inline T operator[](unsigned int const i) const
-                { assert (i<3); if (i==0) return x; if (i==1) return y; return z; }
-
-            // Assignment
-            inline Vector3<T>& operator=(Vector2<T> const & v2)
-                { x = v2.x; y = v2.y; z = T(0); return *this; }
-            inline Vector3<T>& operator=(Vector3<T> const & v2)
-                { x = v2.x; y = v2.y; z = v2.z; return *this; }
-
-            /** \copydoc arda::Math::Vector2::assign */
-            inline Vector3<T>& assign(T const a, T const b, T const c)
-                { x = a; y = b; z = c; return *this; }
-
-            // Comparison
-            inline bool operator==(Vector3<T> const & v2) const
-                { return ((x == v2.x) && (y == v2.y) && (z == v2.z)); }
-            inline bool operator!=(Vector3<T> const & v2) const
-                { return ! (*this == v2); }
-
-            // Vector addition
-            inline Vector3<T>& operator+=(Vector3<T> const & v2)
-                { x += v2.x; y += v2.y; z += v2.z; return *this; }
-            inline Vector3<T> operator+(Vector3<T> const & v2) const
-                { return Vector3<T>(*this) += v2; }
-
-            // Vector subtraction
-            inline Vector3<T>& operator-=(Vector3<T> const & v2)
-                { x -= v2.x; y -= v2.y; z -= v2.z; return *this; }
-            inline Vector3<T> operator-(Vector3<T> const & v2) const
-                { return Vector3<T>(*this) -= v2; }
-
-            // Scalar multiplication
-            inline Vector3<T>& operator*=(int const a)
-                { x *= a; y *= a; z *= a; return *this; }
-            inline Vector3<T>& operator*=(float const a)
-                { x *= a; y *= a; z *= a; return *this; }
-            inline Vector3<T>& operator*=(double const a)
-                { x *= a; y *= a; z *= a; return *this; }
-
-            inline Vector3<T> operator*(int const a) const
-                { return Vector3<T>(*this) *= a;}
-            inline Vector3<T> operator*(float const a) const
-                { return Vector3<T>(*this) *= a;}
-            inline Vector3<T> operator*(double const a) const
-                { return Vector3<T>(*this) *= a;}
-
-            // Scalar division
-            inline Vector3<T>& operator/=(int const a)
-                { assert(a!=0); x /= a; y /= a; z /= a; return *this; }
-            inline Vector3<T>& operator/=(float const a)
-                { assert(a!=0); x /= a; y /= a; z /= a; return *this; }
-            inline Vector3<T>& operator/=(double const a)
-                { assert(a!=0); x /= a; y /= a; z /= a; return *this; }
-
-            inline Vector3<T> operator/(int const a) const
-                { return Vector3<T>(*this) /= a;}
-            inline Vector3<T> operator/(float const a) const
-                { return Vector3<T>(*this) /= a;}
-            inline Vector3<T> operator/(double const a) const
-                { return Vector3<T>(*this) /= a;}
-
-
-            // methods
+            inline Vector<T, N>& normalize()
+                {
+                using std::sqrt;
+                typedef typename ScalarPrecision<T, typename RealType<T>::type>::type R;
+                R const l = (R) sqrt((R) dot(*this));
+                if (l == R(0)) return *this;
+                return divide(l, detail::Indices<N>());
+                }
 
-            /** \brief Cross product of the vector with another Vector. Result returned in vres.
-             *
-             * The version that takes two arguments stores the result in the second
-             * argument.  This may be faster since no temporary object is created
-             * during the operation.
+            /** \brief Approximate length, computed in T.  For float the reciprocal square
+             * root is within 2^-21 (see detail::fast_rsqrt()), on top of the rounding
+             * of the dot product.  Not meaningful for int vectors.
              */
-            inline Vector3<T>& cross(Vector3<T> const & v2, Vector3<T>& vres)
-                { 
-                vres.x =  y*v2.z - v2.y*z;
-                vres.y = -x*v2.z + v2.x*z;
-                vres.z =  x*v2.y - v2.x*y;
-                return vres;
-                }
-            /** \brief Cross product of the vector with another Vector.
-             * \copydetails arda::Math::Vector3::cross */
-            inline Vector3<T> cross(Vector3<T> const & v2)
-                { 
-                Vector3<T> vres;
-                vres.x =  y*v2.z - v2.y*z;
-                vres.y = -x*v2.z + v2.x*z;
-                vres.z =  x*v2.y - v2.x*y;
-                return vres;
+            inline T fast_length(void) const
+                {
+                T const d = dot(*this);
+                return d > T(0) ? d * detail::fast_rsqrt(d) : T(0);
                 }
 
-            /** \copydoc arda::Math::Vector2::dot */
-            inline T dot(Vector3<T> const & v2) const
-                { return x*v2.x + y*v2.y + z*v2.z; }
 
-            /** \copydoc arda::Math::Vector2::get_angle */
-            inline double get_angle(Vector3<T> const & v2)
-                { 
-                double tmp = dot(v2); 
-                return acos(sqrt(tmp*tmp/(dot(*this)*v2.dot(v2))));
+            /** \brief Approximately normalizes the vector, computed in T.  For float the
+             * length of the result is within 2^-21 of 1 (see detail::fast_rsqrt()).
+             * Zero vectors are left alone, as with normalize().  Not meaningful for
+             * int vectors.
+             */
+            inline Vector<T, N>& fast_normalize()
+                {
+                T const d = dot(*this);
+                if (!(d > T(0))) return *this;
+                return multiply(detail::fast_rsqrt(d), detail::Indices<N>());
                 }
 
-            /** \copydoc arda::Math::Vector2::get_anglen */
-            inline double get_anglen(Vector3<T> const & v2)
-                { return acos((double) dot(v2)); }
-
-            /** \copydoc arda::Math::Vector2::to_string */
-            std::string to_string(void) const;
-
-            /** \copydoc arda::Math::Vector2::length */
-            inline double length(void) const
-                { return sqrt((dot(*this))); }
-
-            /** \copydoc arda::Math::Vector2::normalize */
-            inline Vector3<T>& normalize()
-                { double l = length(); if (l == 0.0) return *this; x /= l; y /= l; z /= l; return *this; }
-
-            /** \copydoc arda::Math::Vector2::proj */
-            inline Vector3<T> proj(Vector3<T> const & v2)
-                { Vector3<T> vres; vres = v2 * dot(v2)/v2.dot(v2); return vres; }
-            /** \copybrief arda::Math::Vector2::proj
+            /** \brief Calculates the projection of the vector onto v2.  Not meaningful for int vectors.
+             */
+            inline constexpr Vector<T, N> proj(Vector<T, N> const & v2) const
+                { return v2 * (dot(v2)/v2.dot(v2)); }
+            /** \copybrief arda::Math::Vector::proj
              * Returns result in vres
              */
-            inline Vector3<T>& proj(Vector3<T> const & v2, Vector3<T>& vres)
-                { vres = v2 * dot(v2)/v2.dot(v2); return vres; }
+            inline constexpr Vector<T, N>& proj(Vector<T, N> const & v2, Vector<T, N>& vres) const
+                { vres = v2 * (dot(v2)/v2.dot(v2)); return vres; }
+
+        private:
+            // The unrolled element loops.
+            template <unsigned int... I>
+            constexpr Vector(T a, std::integer_sequence<unsigned int, I...>)
+                : detail::VectorElements<T, N>(((void) I, a)...) {}
+
+            template <unsigned int I, unsigned int M>
+            static inline constexpr T padded(Vector<T, M> const & v)
+                {
+                if constexpr (I < M)
+                    return v.template get<I>();
+                else
+                    return T(0);
+                }
+            template <unsigned int M, unsigned int... I>
+            constexpr Vector(Vector<T, M> const & v, std::integer_sequence<unsigned int, I...>)
+                : detail::VectorElements<T, N>(padded<I>(v)...) {}
+
+            template <unsigned int... I>
+            inline constexpr bool equal(Vector<T, N> const & v2, std::integer_sequence<unsigned int, I...>) const
+                { return ((get<I>() == v2.template get<I>()) && ...); }
+            template <unsigned int... I>
+            inline constexpr Vector<T, N>& add(Vector<T, N> const & v2, std::integer_sequence<unsigned int, I...>)
+                { ((get<I>() += v2.template get<I>()), ...); return *this; }
+            template <unsigned int... I>
+            inline constexpr Vector<T, N>& subtract(Vector<T, N> const & v2, std::integer_sequence<unsigned int, I...>)
+                { ((get<I>() -= v2.template get<I>()), ...); return *this; }
+            template <typename S, unsigned int... I>
+            inline constexpr Vector<T, N>& multiply(S const a, std::integer_sequence<unsigned int, I...>)
+                {
+                typename ScalarPrecision<T, S>::type const b = (typename ScalarPrecision<T, S>::type) a;
+                ((get<I>() *= b), ...);
+                return *this;
+                }
+            template <typename S, unsigned int... I>
+            inline constexpr Vector<T, N>& divide(S const a, std::integer_sequence<unsigned int, I...>)
+                {
+                typename ScalarPrecision<T, S>::type const b = (typename ScalarPrecision<T, S>::type) a;
+                ((get<I>() /= b), ...);
+                return *this;
+                }
+            template <unsigned int... I>
+            inline constexpr T dot(Vector<T, N> const & v2, std::integer_sequence<unsigned int, I...>) const
+                { return (... + (get<I>() * v2.template get<I>())); }
             };
 
         // Scalar multiplication, continued
-        template <typename T> 
-        inline Vector3<T> operator*(int const a, Vector3<T> const & v)
-            { return Vector3<T>(v) *= a;}
-      
-        template <typename T> 
-        inline Vector3<T> operator*(float const a, Vector3<T> const & v)
-            { return Vector3<T>(v) *= a;}
-
-        template <typename T> 
-        inline Vector3<T> operator*(double const a, Vector3<T> const & v)
-            { return Vector3<T>(v) *= a;}
-
-        /////////////////////////////////////////////////////////////////////////////
-        /** \class arda::Math::Vector4
-         *  \copydoc arda::Math::Vector2
-         */
-        template <typename T> 
-        class Vector4
-            {
-        public:
-            T x, y, z, w;
-
-            // Constructors
-            Vector4() {}
-            explicit Vector4(T a) : x (a), y(a), z(a), w(a) {}
-            Vector4(T a, T b, T c, T d) : x (a), y(b), z(c), w(d) {}
-            Vector4(Vector2<T> v) : x (v.x), y (v.y), z (0), w (0) {}
-            Vector4(Vector3<T> v) : x (v.x), y (v.y), z (v.z), w (0) {}
-
-            // Array indexing
-            inline T& operator[](unsigned int const i)
-                { assert (i<4); if (i==0) return x; if (i==1) return y; if (i==2) return z; return w; }
-            inline T operator[](unsigned int const i) const
-                { assert (i<4); if (i==0) return x; if (i==1) return y; if (i==2) return z; return w; }
-
-            // Assignment
-            inline Vector4<T>& operator=(Vector2<T> const & v2)
-                { x = v2.x; y = v2.y; z = T(0); w = T(0); return *this; }
-            inline Vector4<T>& operator=(Vector3<T> const & v2)
-                { x = v2.x; y = v2.y; z = v2.z; w = T(0); return *this; }
-            inline Vector4<T>& operator=(Vector4<T> const & v2)
-                { x = v2.x; y = v2.y; z = v2.z; w = v2.w; return *this; }
-
-            /** \copydoc arda::Math::Vector2::assign */
-            inline Vector4<T>& assign(T const a, T const b, T const c, T const d)
-                { x = a; y = b; z = c; w = d; return *this; }
-
-            // Comparison
-            inline bool operator==(Vector4<T> const & v2) const
-                { return ((x == v2.x) && (y == v2.y) && (z == v2.z) && (w == v2.w)); }
-            inline bool operator!=(Vector4<T> const & v2) const
-                { return ! (*this == v2); }
-
-            // Vector addition
-            inline Vector4<T>& operator+=(Vector4<T> const & v2)
-                { x += v2.x; y += v2.y; z += v2.z; w += v2.w; return *this; }
-            inline Vector4<T> operator+(Vector4<T> const & v2) const
-                { return Vector4<T>(*this) += v2; }
-
-            // Vector subtraction
-            inline Vector4<T>& operator-=(Vector4<T> const & v2)
-                { x -= v2.x; y -= v2.y; z -= v2.z; w -= v2.w; return *this; }
-            inline Vector4<T> operator-(Vector4<T> const & v2) const
-                { return Vector4<T>(*this) -= v2; }
+        template <typename T, unsigned int N>
+        inline constexpr Vector<T, N> operator*(int const a, Vector<T, N> const & v)
+            { return Vector<T, N>(v) *= a;}
 
-            // Scalar multiplication
-            inline Vector4<T>& operator*=(int const a)
-                { x *= a; y *= a; z *= a; w *= a; return *this; }
-            inline Vector4<T>& operator*=(float const a)
-                { x *= a; y *= a; z *= a; w *= a; return *this; }
-            inline Vector4<T>& operator*=(double const a)
-                { x *= a; y *= a; z *= a; w *= a; return *this; }
-
-            inline Vector4<T> operator*(int const a) const
-                { return Vector4<T>(*this) *= a;}
-            inline Vector4<T> operator*(float const a) const
-                { return Vector4<T>(*this) *= a;}
-            inline Vector4<T> operator*(double const a) const
-                { return Vector4<T>(*this) *= a;}
-
-            // Scalar division
-            inline Vector4<T>& operator/=(int const a)
-                { assert(a!=0); x /= a; y /= a; z /= a; w /= a; return *this; }
-            inline Vector4<T>& operator/=(float const a)
-                { assert(a!=0); x /= a; y /= a; z /= a; w /= a; return *this; }
-            inline Vector4<T>& operator/=(double const a)
-                { assert(a!=0); x /= a; y /= a; z /= a; w /= a; return *this; }
-
-            inline Vector4<T> operator/(int const a) const
-                { return Vector4<T>(*this) /= a;}
-            inline Vector4<T> operator/(float const a) const
-                { return Vector4<T>(*this) /= a;}
-            inline Vector4<T> operator/(double const a) const
-                { return Vector4<T>(*this) /= a;}
-
-
-            // methods
-
-            /** \copydoc arda::Math::Vector2::dot */
-            inline T dot(Vector4<T> const & v2) const
-                { return x*v2.x + y*v2.y + z*v2.z + w*v2.w; }
-
-            /** \copydoc arda::Math::Vector2::get_angle */
-            inline double get_angle(Vector4<T> const & v2)
-                { 
-                double tmp = dot(v2); 
-                return acos(sqrt(tmp*tmp/(dot(*this)*v2.dot(v2))));
-                }
-
-            /** \copydoc arda::Math::Vector2::get_anglen */
-            inline double get_anglen(Vector4<T> const & v2)
-                { return acos((double) dot(v2)); }
-
-            /** \copydoc arda::Math::Vector2::to_string */
-            std::string to_string(void) const;
-
-            /** \copydoc arda::Math::Vector2::length */
-            inline double length(void) const
-                { return sqrt((dot(*this))); }
-
-            /** \copydoc arda::Math::Vector2::normalize */
-            inline Vector4<T>& normalize()
-                { double l = length(); if (l == 0.0) return *this; x /= l; y /= l; z /= l; w /= l; return *this; }
+        template <typename T, unsigned int N>
+        inline constexpr Vector<T, N> operator*(float const a, Vector<T, N> const & v)
+            { return Vector<T, N>(v) *= a;}
 
-            /** \copydoc arda::Math::Vector2::proj */
-            inline Vector4<T> proj(Vector4<T> const & v2)
-                { Vector4<T> vres; vres = v2 * dot(v2)/v2.dot(v2); return vres; }
-            /** \copybrief arda::Math::Vector2::proj
-             * Returns result in vres
-             */
-            inline Vector4<T>& proj(Vector4<T> const & v2, Vector4<T>& vres)
-                { vres = v2 * dot(v2)/v2.dot(v2); return vres; }
-            };
-
-        // Scalar multiplication, continued
-        template <typename T> 
-        inline Vector4<T> operator*(int const a, Vector4<T> const & v)
-            { return Vector4<T>(v) *= a;}
-      
-        template <typename T> 
-        inline Vector4<T> operator*(float const a, Vector4<T> const & v)
-            { return Vector4<T>(v) *= a;}
-      
-        template <typename T> 
-        inline Vector4<T> operator*(double const a, Vector4<T> const & v)
-            { return Vector4<T>(v) *= a;}
+        template <typename T, unsigned int N>
+        inline constexpr Vector<T, N> operator*(double const a, Vector<T, N> const & v)
+            { return Vector<T, N>(v) *= a;}
 
         /////////////////////////////////////////////////////////////////////////////
 
+        template <typename T> using Vector2 = Vector<T, 2>;
+        template <typename T> using Vector3 = Vector<T, 3>;
+        template <typename T> using Vector4 = Vector<T, 4>;
+
         typedef Vector2<int> Vector2i;
         typedef Vector2<float> Vector2f;
         typedef Vector2<double> Vector2d;
@@ -534,29 +527,15 @@ namespace arda
     } // namespace arda
 
 ////////////////////////////////////////////////////////////////////////////////
-template <typename T> 
-std::string arda::Math::Vector2<T>::to_string(void) const
-    {
-    std::stringstream ss;
-    ss << "[ " << x << ", " << y << " ]";
-    return ss.str();
-    }
-
-////////////////////////////////////////////////////////////////////////////////
-template <typename T> 
-std::string arda::Math::Vector3<T>::to_string(void) const
-    {
-    std::stringstream ss;
-    ss << "[ " << x << ", " << y << ", " << z << " ]";
-    return ss.str();
-    }
-
-////////////////////////////////////////////////////////////////////////////////
-template <typename T> 
-std::string arda::Math::Vector4<T>::to_string(void) const
+template <typename T, unsigned int N>
+std::string arda::Math::Vector<T, N>::to_string(void) const
     {
     std::stringstream ss;
-    ss << "[ " << x << ", " << y << ", " << z << ", " << w << " ]";
+    ss << "[ " << (*this)[0];
+    unsigned int i;
+    for (i=1; i<N; ++i)
+        ss << ", " << (*this)[i];
+    ss << " ]";
     return ss.str();
     }
 
@@ -2,6 +2,8 @@
 #include <iomanip>
 #include <limits>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -14,6 +16,7 @@ using namespace arda::Math;
 // Vector2 floating point
 
 typedef ::testing::Types<int, float, double> MyTypes;
+typedef ::testing::Types<float, double> RealTypes;
 
 template <typename T>
 class VectorTest : public ::testing::Test {
@@ -137,6 +140,2037 @@ TYPED_TEST( VectorTest, Indexing ) {
 
     }
 
+TYPED_TEST( VectorTest, LargerSizes ) {
+    Vector<TypeParam, 6> a( 1, 2, 3, 4, 5, 6 );
+    Vector<TypeParam, 6> b( (TypeParam) 2 );
+    EXPECT_EQ( (TypeParam) 42, a.dot(b) );
+    EXPECT_EQ( (TypeParam) 4, a.template get<3>() );
+    EXPECT_EQ( (TypeParam) 6, a[5] );
+    a += b;
+    EXPECT_TRUE(( a == Vector<TypeParam, 6>( 3, 4, 5, 6, 7, 8 ) ));
+    a = a * 2;
+    EXPECT_TRUE(( a == Vector<TypeParam, 6>( 6, 8, 10, 12, 14, 16 ) ));
+
+    // Smaller vectors widen with zeros.
+    Vector<TypeParam, 6> c = Vector3<TypeParam>( 1, 2, 3 );
+    EXPECT_TRUE(( c == Vector<TypeParam, 6>( 1, 2, 3, 0, 0, 0 ) ));
+    }
+
+TEST( ScalarPrecisionTest, FloatStaysFloatIntWidens ) {
+    static_assert( std::is_same<ScalarPrecision<float, double>::type, float>::value, "float" );
+    static_assert( std::is_same<ScalarPrecision<double, float>::type, double>::value, "double" );
+    static_assert( std::is_same<ScalarPrecision<int, double>::type, double>::value, "int" );
+    static_assert( std::is_same<ScalarPrecision<int, int>::type, int>::value, "int by int" );
+
+    // Float vectors and matrices are scaled by the scalar rounded to float.
+    Vector3f const v( 1.0f / 3, 2.0f / 7, -5.0f / 11 );
+    EXPECT_TRUE( v * 0.1 == v * 0.1f );
+    EXPECT_TRUE( v / 0.3 == v / 0.3f );
+    Vector3f n( v );
+    n.normalize();
+    EXPECT_NEAR( 1.0, n.length(), 1e-7 );
+    Matrix33f const m( 1.0f / 3, 2, 3,  4, 5.0f / 7, 6,  7, 8, 9.0f / 11 );
+    EXPECT_TRUE( m * 0.1 == m * 0.1f );
+    EXPECT_TRUE( m / 0.3 == m / 0.3f );
+    Matrix34f const a( 1.0f / 3, 2, 3,  4, 5.0f / 7, 6,  7, 8, 9.0f / 11,  0.1f, 0.2f, 0.3f );
+    EXPECT_TRUE( a * 0.1 == a * 0.1f );
+
+    // Int vectors are scaled in the scalar's type, then truncated.
+    EXPECT_TRUE( Vector3i( 3, 5, -7 ) * 0.5 == Vector3i( 1, 2, -3 ) );
+    EXPECT_TRUE( Vector3i( 3, 5, -7 ) / 2.5f == Vector3i( 1, 2, -2 ) );
+    EXPECT_TRUE( Matrix22i( 3, 5, -7, 9 ) * 0.5 == Matrix22i( 1, 2, -3, 4 ) );
+    }
+
+template <typename T>
+class FastVectorTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( FastVectorTest, RealTypes );
+
+TYPED_TEST( FastVectorTest, LengthAndNormalize ) {
+    // The documented bound for float; double is computed exactly in double.
+    double const bound = sizeof(TypeParam) == sizeof(float) ? ldexp(1.0, -21) : 1e-15;
+    int i;
+    for (i = 0; i < 10000; ++i) {
+        Vector4<TypeParam> v( (TypeParam) (sin(i * 0.37) * (1 + i % 97)), (TypeParam) (cos(i * 1.1) * (i % 13)),
+                              (TypeParam) (i % 7 - 3), (TypeParam) (1e-3 * i) );
+        double const l = v.length();
+        ASSERT_NEAR( l, v.fast_length(), 2 * bound * l ) << i;
+        Vector4<TypeParam> n( v );
+        n.fast_normalize();
+        ASSERT_NEAR( 1.0, n.length(), 2 * bound ) << i;
+        }
+
+    Vector3<TypeParam> zero( 0 );
+    EXPECT_EQ( (TypeParam) 0, zero.fast_length() );
+    EXPECT_TRUE( zero.fast_normalize() == Vector3<TypeParam>( 0 ) );
+
+    // The SoA versions give the same results as the Vector versions, at
+    // every dispatch level.
+    size_t const n = 16 + 8 + 4 + 3;
+    Vector3SoA<TypeParam> a(n);
+    size_t j;
+    for (j = 0; j < n; ++j)
+        a.set(j, Vector3<TypeParam>( (TypeParam) (0.25 * j - 3), (TypeParam) (1.5 - 0.125 * j), (TypeParam) (0.5 * j) ));
+    a.set(9, Vector3<TypeParam>( 0 ));
+    SimdLevel const saved = simd_level();
+    int level;
+    for (level = (int) SimdLevel::SCALAR; level <= (int) simd_supported(); ++level) {
+        set_simd_level((SimdLevel) level);
+        std::vector<TypeParam> len(n);
+        a.fast_length(&len[0]);
+        Vector3SoA<TypeParam> norm( a );
+        norm.fast_normalize();
+        for (j = 0; j < n; ++j) {
+            Vector3<TypeParam> v = a.get(j);
+#if defined(ARDA_MATH_FMA)
+            EXPECT_NEAR( v.fast_length(), len[j], 1e-6 * len[j] ) << j;
+            EXPECT_NEAR( 0, (v.fast_normalize() - norm.get(j)).length(), 1e-6 ) << j;
+#else
+            EXPECT_EQ( v.fast_length(), len[j] ) << simd_level_name(simd_level()) << " " << j;
+            EXPECT_TRUE( v.fast_normalize() == norm.get(j) ) << simd_level_name(simd_level()) << " " << j;
+#endif
+            }
+        }
+    set_simd_level(saved);
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Matrix multiplication
+
+template <typename T>
+class MatrixTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( MatrixTest, MyTypes );
+
+TYPED_TEST( MatrixTest, Multiply44MatchesReferenceLoop ) {
+    Matrix44<TypeParam> a, b, ref;
+    int i, j, k;
+    for (i = 0; i < 16; ++i) {
+        a[i] = (TypeParam) (1.5 * i - 7.25);
+        b[i] = (TypeParam) (3.75 - 0.5 * i);
+        }
+
+    // Column major: ref = a * b
+    for (i = 0; i < 4; ++i)
+        for (j = 0; j < 4; ++j) {
+            TypeParam sum = a[j] * b[4*i];
+            for (k = 1; k < 4; ++k)
+                sum += a[4*k+j] * b[4*i+k];
+            ref[4*i+j] = sum;
+            }
+
+    Matrix44<TypeParam> c = a * b;
+    for (i = 0; i < 16; ++i)
+        EXPECT_EQ( ref[i], c[i] ) << "element " << i << " of a * b is wrong";
+
+    // Self multiplication must not read elements it has already overwritten.
+    Matrix44<TypeParam> sq = a * a;
+    a *= a;
+    for (i = 0; i < 16; ++i)
+        EXPECT_EQ( sq[i], a[i] ) << "element " << i << " of a *= a is wrong";
+    }
+
+TYPED_TEST( MatrixTest, MatrixVectorProducts ) {
+    // Values are chosen so that every product and sum is exact.
+    Matrix22<TypeParam> m22;
+    Matrix33<TypeParam> m33;
+    Matrix44<TypeParam> m44;
+    int i;
+    for (i = 0; i < 4; ++i)
+        m22[i] = (TypeParam) (0.5 * i - 1);
+    for (i = 0; i < 9; ++i)
+        m33[i] = (TypeParam) (0.5 * i - 2);
+    for (i = 0; i < 16; ++i)
+        m44[i] = (TypeParam) (0.5 * i - 3);
+
+    Vector2<TypeParam> v2( (TypeParam) 1.5, (TypeParam) -2 );
+    Vector3<TypeParam> v3( (TypeParam) 1.5, (TypeParam) -2, (TypeParam) 3 );
+    Vector4<TypeParam> v4( (TypeParam) 1.5, (TypeParam) -2, (TypeParam) 3, (TypeParam) -0.5 );
+
+    Vector2<TypeParam> r2 = m22 * v2;
+    EXPECT_EQ( m22[0]*v2.x + m22[2]*v2.y, r2.x );
+    EXPECT_EQ( m22[1]*v2.x + m22[3]*v2.y, r2.y );
+    r2 = v2 * m22;
+    EXPECT_EQ( v2.x*m22[0] + v2.y*m22[1], r2.x );
+    EXPECT_EQ( v2.x*m22[2] + v2.y*m22[3], r2.y );
+
+    Vector3<TypeParam> r3 = m33 * v3;
+    for (i = 0; i < 3; ++i)
+        EXPECT_EQ( m33[i]*v3.x + m33[i+3]*v3.y + m33[i+6]*v3.z, r3[i] ) << "element " << i << " of M * v";
+    r3 = v3 * m33;
+    for (i = 0; i < 3; ++i)
+        EXPECT_EQ( v3.x*m33[3*i] + v3.y*m33[3*i+1] + v3.z*m33[3*i+2], r3[i] ) << "element " << i << " of v * M";
+
+    Vector4<TypeParam> r4 = m44 * v4;
+    for (i = 0; i < 4; ++i)
+        EXPECT_EQ( m44[i]*v4.x + m44[i+4]*v4.y + m44[i+8]*v4.z + m44[i+12]*v4.w, r4[i] ) << "element " << i << " of M * v";
+    r4 = v4 * m44;
+    for (i = 0; i < 4; ++i)
+        EXPECT_EQ( v4.x*m44[4*i] + v4.y*m44[4*i+1] + v4.z*m44[4*i+2] + v4.w*m44[4*i+3], r4[i] ) << "element " << i << " of v * M";
+
+    // v *= M must not see its own partial results.
+    Vector4<TypeParam> v4_copy( v4 );
+    v4_copy *= m44;
+    EXPECT_TRUE( v4_copy == r4 );
+    }
+
+TYPED_TEST( MatrixTest, NonSquareSizes ) {
+    // 3 rows by 4 columns and 4 rows by 3 columns; column major.
+    Matrix<TypeParam, 3, 4> a;
+    Matrix<TypeParam, 4, 3> b;
+    int i, j, k;
+    for (i = 0; i < 12; ++i) {
+        a[i] = (TypeParam) (0.5 * i - 2);
+        b[i] = (TypeParam) (1.5 - 0.25 * i);
+        }
+
+    Matrix<TypeParam, 3, 3> ab = a * b;
+    for (i = 0; i < 3; ++i)
+        for (j = 0; j < 3; ++j) {
+            TypeParam sum = a[j] * b[4*i];
+            for (k = 1; k < 4; ++k)
+                sum += a[3*k+j] * b[4*i+k];
+            EXPECT_EQ( sum, ab[3*i+j] ) << "element " << 3*i+j << " of a * b is wrong";
+            }
+    Matrix<TypeParam, 4, 4> ba = b * a;
+    for (i = 0; i < 4; ++i)
+        for (j = 0; j < 4; ++j) {
+            TypeParam sum = b[j] * a[3*i];
+            for (k = 1; k < 3; ++k)
+                sum += b[4*k+j] * a[3*i+k];
+            EXPECT_EQ( sum, ba[4*i+j] ) << "element " << 4*i+j << " of b * a is wrong";
+            }
+
+    Matrix<TypeParam, 4, 3> at = transpose(a);
+    for (i = 0; i < 3; ++i)
+        for (j = 0; j < 4; ++j)
+            EXPECT_EQ( a[3*j+i], at[4*i+j] );
+    EXPECT_TRUE( transpose(at) == a );
+
+    Vector3<TypeParam> v3( (TypeParam) 1.5, (TypeParam) -2, (TypeParam) 3 );
+    Vector4<TypeParam> v4( (TypeParam) 1.5, (TypeParam) -2, (TypeParam) 3, (TypeParam) -0.5 );
+    Vector3<TypeParam> r3 = a * v4;
+    for (i = 0; i < 3; ++i)
+        EXPECT_EQ( a[i]*v4.x + a[i+3]*v4.y + a[i+6]*v4.z + a[i+9]*v4.w, r3[i] ) << "element " << i << " of M * v";
+    Vector4<TypeParam> r4 = v3 * a;
+    for (i = 0; i < 4; ++i)
+        EXPECT_EQ( v3.x*a[3*i] + v3.y*a[3*i+1] + v3.z*a[3*i+2], r4[i] ) << "element " << i << " of v * M";
+    EXPECT_TRUE( r4 == at * v3 );
+
+    EXPECT_TRUE( a.getcol(2) == Vector3<TypeParam>( a[6], a[7], a[8] ) );
+    EXPECT_TRUE( a.getrow(1) == Vector4<TypeParam>( a[1], a[4], a[7], a[10] ) );
+    a.setrow(0, v4);
+    a.setcol(3, (TypeParam) 7, (TypeParam) 8, (TypeParam) 9);
+    EXPECT_TRUE( a.getrow(0) == Vector4<TypeParam>( v4.x, v4.y, v4.z, (TypeParam) 7 ) );
+    EXPECT_TRUE( a.getcol(3) == Vector3<TypeParam>( (TypeParam) 7, (TypeParam) 8, (TypeParam) 9 ) );
+
+    Matrix<TypeParam, 3, 4> id;
+    id.setidentity();
+    EXPECT_TRUE( id * Vector4<TypeParam>( 1, 2, 3, 4 ) == Vector3<TypeParam>( 1, 2, 3 ) );
+    }
+
+TYPED_TEST( MatrixTest, Inverse ) {
+    // Products of unit triangular integer matrices have determinant 1 and
+    // integer inverses, so every type (even int) gets an exact result.
+    Matrix22<TypeParam> l22( 1, 2, 0, 1 ), u22( 1, 0, -3, 1 ), i22;
+    Matrix33<TypeParam> l33( 1, 2, -1,  0, 1, 3,  0, 0, 1 ), u33( 1, 0, 0,  2, 1, 0,  -2, 1, 1 ), i33;
+    Matrix44<TypeParam> l44( 1, 2, -1, 0,  0, 1, 3, 1,  0, 0, 1, -2,  0, 0, 0, 1 );
+    Matrix44<TypeParam> u44( 1, 0, 0, 0,  2, 1, 0, 0,  0, 1, 1, 0,  -1, 2, 3, 1 );
+    Matrix44<TypeParam> i44;
+    i22.setidentity();
+    i33.setidentity();
+    i44.setidentity();
+
+    Matrix22<TypeParam> m22 = l22 * u22;
+    Matrix33<TypeParam> m33 = l33 * u33;
+    Matrix44<TypeParam> m44 = l44 * u44;
+    EXPECT_TRUE( inverse(m22) * m22 == i22 );
+    EXPECT_TRUE( inverse(m33) * m33 == i33 );
+    EXPECT_TRUE( inverse(m44) * m44 == i44 );
+    EXPECT_TRUE( m44 * inverse(m44) == i44 );
+    EXPECT_EQ( 1.0, det(m33) );
+    EXPECT_EQ( 1.0, det(m44) );
+
+    // In place
+    Matrix44<TypeParam> inv44 = inverse(m44);
+    EXPECT_TRUE( try_inverse(m44, m44) );
+    EXPECT_TRUE( m44 == inv44 );
+
+    // A singular matrix is reported and mres is left alone.
+    Matrix22<TypeParam> s22( 1, 2, 2, 4 );
+    Matrix33<TypeParam> s33( 1, 2, 3,  4, 5, 6,  7, 8, 9 );
+    Matrix44<TypeParam> s44( l44 );
+    s44.setcol(2, s44.getcol(0) * 2 - s44.getcol(1));
+    Matrix44<TypeParam> untouched( i44 );
+    EXPECT_FALSE( try_inverse(s22, i22) );
+    EXPECT_FALSE( try_inverse(s33, i33) );
+    EXPECT_FALSE( try_inverse(s44, untouched) );
+    EXPECT_TRUE( untouched == i44 );
+    EXPECT_FALSE( try_inverse(m44, untouched, 2.0) );
+
+    if (std::numeric_limits<TypeParam>::is_integer)
+        return;
+
+    // A general matrix
+    Matrix44<TypeParam> g( (TypeParam) 0.5, (TypeParam) 1.25, (TypeParam) -2, (TypeParam) 0.1,
+                           (TypeParam) 3, (TypeParam) 0.75, (TypeParam) 0.2, (TypeParam) -1,
+                           (TypeParam) -0.3, (TypeParam) 2, (TypeParam) 1.5, (TypeParam) 0.6,
+                           (TypeParam) 4, (TypeParam) -2.5, (TypeParam) 0.9, (TypeParam) 1 );
+    Matrix44<TypeParam> p = inverse(g) * g;
+    int i;
+    for (i = 0; i < 16; ++i)
+        EXPECT_NEAR( i44[i], p[i], 1e-5 ) << "element " << i;
+    Matrix33<TypeParam> g33( g[0], g[1], g[2],  g[4], g[5], g[6],  g[8], g[9], g[10] );
+    Matrix33<TypeParam> p33 = g33 * inverse(g33);
+    for (i = 0; i < 9; ++i)
+        EXPECT_NEAR( i33[i], p33[i], 1e-5 ) << "element " << i;
+    }
+
+TYPED_TEST( MatrixTest, RigidAndAffineInverse ) {
+    // A 90 degree rotation about z followed by a translation, and an affine
+    // matrix with a unimodular upper 3x3, so the inverses are exact for
+    // every type.
+    Matrix44<TypeParam> rigid( 0, 1, 0, 0,  -1, 0, 0, 0,  0, 0, 1, 0,  3, -2, 5, 1 );
+    Matrix44<TypeParam> affine( 1, 2, -1, 0,  0, 1, 3, 0,  2, 5, 2, 0,  -4, 1, 7, 1 );
+    ASSERT_EQ( 1.0, det(affine) );
+
+    EXPECT_TRUE( is_rigid(rigid) );
+    EXPECT_TRUE( is_affine(affine) );
+    EXPECT_FALSE( is_rigid(affine) );
+    EXPECT_TRUE( inverse_rigid(rigid) == inverse(rigid) );
+    EXPECT_TRUE( inverse_affine(rigid) == inverse(rigid) );
+    EXPECT_TRUE( inverse_affine(affine) == inverse(affine) );
+
+    Matrix44<TypeParam> proj( affine );
+    proj[11] = -1;
+    EXPECT_FALSE( is_affine(proj) );
+    EXPECT_FALSE( is_rigid(proj) );
+
+    if (std::numeric_limits<TypeParam>::is_integer)
+        return;
+
+    // The matrices built by Transform.h
+    Matrix44<TypeParam> m, s, ms;
+    get_transform_mat44(m, 0.7f, Vector3<TypeParam>( 1, -2, 0.5 ), Vector3<TypeParam>( 4, 5, -6 ));
+    get_scale_mat44(s, Vector3<TypeParam>( 2, 0.5, 3 ));
+    ms = m * s;
+    EXPECT_TRUE( is_rigid(m) );
+    EXPECT_FALSE( is_rigid(ms) );
+    Matrix44<TypeParam> const ri = inverse_rigid(m), ai = inverse_affine(ms);
+    Matrix44<TypeParam> const gi = inverse(m), gsi = inverse(ms);
+    int i;
+    for (i = 0; i < 16; ++i) {
+        EXPECT_NEAR( gi[i], ri[i], 1e-5 ) << "element " << i;
+        EXPECT_NEAR( gsi[i], ai[i], 1e-5 ) << "element " << i;
+        }
+    }
+
+TYPED_TEST( MatrixTest, Matrix34 ) {
+    // Affine matrices with unimodular upper 3x3s, so everything is exact for
+    // every type.
+    Matrix44<TypeParam> const a44( 1, 2, -1, 0,  0, 1, 3, 0,  2, 5, 2, 0,  -4, 1, 7, 1 );
+    Matrix44<TypeParam> const b44( 0, 1, 0, 0,  -1, 0, 0, 0,  0, 0, 1, 0,  3, -2, 5, 1 );
+    Matrix34<TypeParam> const a( a44 ), b( b44 );
+    EXPECT_TRUE( a == Matrix34<TypeParam>( 1, 2, -1,  0, 1, 3,  2, 5, 2,  -4, 1, 7 ) );
+    EXPECT_TRUE( (a * 2) / 2 == a && (a * 2.0f) / 2.0 == a );
+    EXPECT_EQ( "[ [ 1, 2, -1 ], [ 0, 1, 3 ], [ 2, 5, 2 ], [ -4, 1, 7 ] ]", a.to_string() );
+
+    Matrix44<TypeParam> m44;
+    a.to_matrix44(m44);
+    EXPECT_TRUE( m44 == a44 );
+
+    // Composition matches the 4x4 product, including in place.
+    EXPECT_TRUE( a * b == Matrix34<TypeParam>( a44 * b44 ) );
+    EXPECT_TRUE( b * a == Matrix34<TypeParam>( b44 * a44 ) );
+    Matrix34<TypeParam> c( a );
+    c *= c;
+    EXPECT_TRUE( c == Matrix34<TypeParam>( a44 * a44 ) );
+    Matrix34<TypeParam> id;
+    id.setidentity();
+    EXPECT_TRUE( id * a == a );
+    EXPECT_TRUE( a * id == a );
+
+    EXPECT_EQ( det(a44), det(a) );
+    EXPECT_TRUE( inverse(a) == Matrix34<TypeParam>( inverse(a44) ) );
+    EXPECT_TRUE( inverse(a) * a == id );
+    Matrix34<TypeParam> s( 0 ), sres( id );
+    EXPECT_FALSE( try_inverse(s, sres) );
+    EXPECT_TRUE( sres == id );
+
+    // Point and direction transforms, single and batched.
+    Vector3<TypeParam> const p[5] = { Vector3<TypeParam>( 1, 2, 3 ), Vector3<TypeParam>( -1, 0, 4 ),
+                                      Vector3<TypeParam>( 2, -3, 1 ), Vector3<TypeParam>( 0, 5, -2 ),
+                                      Vector3<TypeParam>( 7, 1, 1 ) };
+    Vector3<TypeParam> pts[5], dirs[5];
+    transform_points(a, p, pts, 5);
+    transform_directions(a, p, dirs, 5);
+    int i;
+    for (i = 0; i < 5; ++i) {
+        Vector4<TypeParam> const mp = a44 * Vector4<TypeParam>( p[i].x, p[i].y, p[i].z, 1 );
+        Vector4<TypeParam> const md = a44 * Vector4<TypeParam>( p[i].x, p[i].y, p[i].z, 0 );
+        EXPECT_TRUE( transform_point(a, p[i]) == Vector3<TypeParam>( mp.x, mp.y, mp.z ) );
+        EXPECT_TRUE( transform_direction(a, p[i]) == Vector3<TypeParam>( md.x, md.y, md.z ) );
+        EXPECT_TRUE( pts[i] == transform_point(a, p[i]) );
+        EXPECT_TRUE( dirs[i] == transform_direction(a, p[i]) );
+        }
+    }
+
+TYPED_TEST( MatrixTest, TaggedMatrix44 ) {
+    // One matrix of each kind, all with small integer elements and
+    // unimodular upper 3x3s, so the products and inverses are exact for
+    // every type.
+    Matrix44<TypeParam> i44;
+    i44.setidentity();
+    Matrix44<TypeParam> const t44( 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  3, -2, 5, 1 );
+    Matrix44<TypeParam> const s44( 1, 0, 0, 0,  0, -1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 );
+    Matrix44<TypeParam> const r44( 0, 1, 0, 0,  -1, 0, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 );
+    Matrix44<TypeParam> const g44( 0, 0, 1, 0,  1, 0, 0, 0,  0, 1, 0, 0,  -1, 4, 2, 1 );
+    Matrix44<TypeParam> const a44( 1, 2, -1, 0,  0, 1, 3, 0,  2, 5, 2, 0,  -4, 1, 7, 1 );
+    Matrix44<TypeParam> const p44( 1, 2, -1, 0,  0, 1, 3, 0,  2, 5, 2, -1,  -4, 1, 7, 1 );
+    Matrix44<TypeParam> const m44[7] = { i44, t44, s44, r44, g44, a44, p44 };
+    MatrixKind const kinds[7] = { MatrixKind::IDENTITY, MatrixKind::TRANSLATION, MatrixKind::SCALE,
+                                  MatrixKind::ROTATION, MatrixKind::RIGID, MatrixKind::AFFINE,
+                                  MatrixKind::PROJECTIVE };
+    int i, j;
+    for (i = 0; i < 7; ++i) {
+        TaggedMatrix44<TypeParam> const a( m44[i] );
+        EXPECT_EQ( kinds[i], a.kind ) << "kind " << i;
+        EXPECT_EQ( det(m44[i]), det(a) ) << "kind " << i;
+        EXPECT_TRUE( inverse(a).mat == inverse(m44[i]) ) << "kind " << i;
+        EXPECT_EQ( kinds[i], inverse(a).kind ) << "kind " << i;
+        for (j = 0; j < 7; ++j) {
+            TaggedMatrix44<TypeParam> const b( m44[j], kinds[j] );
+            TaggedMatrix44<TypeParam> const ab = a * b;
+            EXPECT_TRUE( ab.mat == m44[i] * m44[j] ) << "kinds " << i << " " << j;
+            EXPECT_EQ( kind_product(kinds[i], kinds[j]), ab.kind ) << "kinds " << i << " " << j;
+            TaggedMatrix44<TypeParam> m;
+            multiply(a, b, m);
+            EXPECT_TRUE( m.mat == ab.mat && m.kind == ab.kind ) << "kinds " << i << " " << j;
+            // The tag of the product is never more specific than the product.
+            EXPECT_GE( (int) ab.kind, (int) classify(ab.mat) ) << "kinds " << i << " " << j;
+            TaggedMatrix44<TypeParam> c( a );
+            c *= c;
+            EXPECT_TRUE( c.mat == m44[i] * m44[i] ) << "kind " << i;
+            }
+        }
+    EXPECT_EQ( MatrixKind::TRANSLATION, kind_product(MatrixKind::TRANSLATION, MatrixKind::TRANSLATION) );
+    EXPECT_EQ( MatrixKind::RIGID, kind_product(MatrixKind::TRANSLATION, MatrixKind::ROTATION) );
+    EXPECT_EQ( MatrixKind::AFFINE, kind_product(MatrixKind::SCALE, MatrixKind::RIGID) );
+    EXPECT_EQ( MatrixKind::PROJECTIVE, kind_product(MatrixKind::PROJECTIVE, MatrixKind::IDENTITY) );
+
+    if (std::numeric_limits<TypeParam>::is_integer)
+        return;
+
+    // The Transform.h builders set the tag.
+    TaggedMatrix44<TypeParam> t, r, s, m;
+    get_trans_mat44(t, Vector3<TypeParam>( 1, 2, 3 ));
+    get_rot_mat44(r, 0.7f, Vector3<TypeParam>( 0, 0, 1 ));
+    get_scale_mat44(s, Vector3<TypeParam>( 2, 0.5, 3 ));
+    get_transform_mat44(m, 0.7f, Vector3<TypeParam>( 0, 0, 1 ), Vector3<TypeParam>( 1, 2, 3 ));
+    EXPECT_EQ( MatrixKind::TRANSLATION, t.kind );
+    EXPECT_EQ( MatrixKind::ROTATION, r.kind );
+    EXPECT_EQ( MatrixKind::SCALE, s.kind );
+    EXPECT_EQ( MatrixKind::RIGID, m.kind );
+    TaggedMatrix44<TypeParam> about;
+    Matrix44<TypeParam> about44;
+    get_rot_about_point_mat44(about, 0.7f, Vector3<TypeParam>( 0, 0, 1 ), Vector3<TypeParam>( 1, 2, 3 ));
+    get_rot_about_point_mat44(about44, 0.7f, Vector3<TypeParam>( 0, 0, 1 ), Vector3<TypeParam>( 1, 2, 3 ));
+    EXPECT_EQ( MatrixKind::RIGID, about.kind );
+    EXPECT_TRUE( about.mat == about44 );
+    TaggedMatrix44<TypeParam> const tr = t * r, trs = tr * s;
+    EXPECT_EQ( MatrixKind::RIGID, tr.kind );
+    EXPECT_EQ( MatrixKind::AFFINE, trs.kind );
+    Matrix44<TypeParam> const trs44 = t.mat * r.mat * s.mat;
+    Matrix44<TypeParam> const inv44 = inverse(trs44);
+    for (i = 0; i < 16; ++i) {
+        EXPECT_NEAR( m[i], tr[i], 1e-5 ) << "element " << i;
+        EXPECT_NEAR( trs44[i], trs[i], 1e-5 ) << "element " << i;
+        EXPECT_NEAR( inv44[i], inverse(trs)[i], 1e-5 ) << "element " << i;
+        }
+
+    // Only exact kinds are inferred: a rotation with a slight scale is
+    // affine, and a matrix tagged rigid that isn't any more (say, after
+    // drifting through many products) is inverted as affine.
+    Matrix44<TypeParam> near;
+    get_scale_mat44(near, Vector3<TypeParam>( (TypeParam) 1.00001 ));
+    near = m.mat * near;
+    EXPECT_EQ( MatrixKind::AFFINE, classify(near) );
+    EXPECT_EQ( MatrixKind::AFFINE, classify(r.mat * r.mat) );
+    get_scale_mat44(near, Vector3<TypeParam>( (TypeParam) 1.01 ));
+    near = m.mat * near;
+    TaggedMatrix44<TypeParam> const drifted( near, MatrixKind::RIGID );
+    EXPECT_TRUE( inverse(drifted).mat == inverse_affine(near) );
+    EXPECT_EQ( MatrixKind::AFFINE, inverse(drifted).kind );
+    EXPECT_TRUE( inverse(m).mat == inverse_rigid(m.mat) );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Lazy (expression template) arithmetic
+
+template <typename T>
+class LazyTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( LazyTest, MyTypes );
+
+TYPED_TEST( LazyTest, MatchesPlainOperators ) {
+    using namespace arda::Math;
+    Vector3<TypeParam> const v1( 1, -2, 3 ), v2( 4, 0, -1 ), v3( 2, 5, 7 );
+
+    // Element wise expressions, with scalars of each type.
+    Vector3<TypeParam> v = lazy::ref(v1) * 3 + lazy::ref(v2) * 2.0f - v3;
+    EXPECT_TRUE( v == v1 * 3 + v2 * 2.0f - v3 );
+    v = -(2 * lazy::ref(v1)) + v2 / 2.0;
+    EXPECT_TRUE( v == v2 / 2.0 - v1 * 2 );
+    lazy::assign(v, v3 - lazy::ref(v) * 2);
+    EXPECT_TRUE( v == v3 - (v2 / 2.0 - v1 * 2) * 2 );
+
+    // Matrix chains, including with the destination as an operand.
+    Matrix44<TypeParam> const a( 1, 2, -1, 0,  0, 1, 3, 0,  2, 5, 2, 0,  -4, 1, 7, 1 );
+    Matrix44<TypeParam> const b( 0, 1, 0, 0,  -1, 0, 0, 0,  0, 0, 1, 0,  3, -2, 5, 1 );
+    Matrix44<TypeParam> const c( 2, 0, 0, 1,  0, 1, 0, 0,  1, 0, 1, 0,  0, 3, 0, 1 );
+    Matrix44<TypeParam> m;
+    lazy::assign(m, lazy::ref(a) * b * c);
+    EXPECT_TRUE( m == a * b * c );
+    m = lazy::ref(a) * (lazy::ref(b) * c);
+    EXPECT_TRUE( m == a * (b * c) );
+    Matrix44<TypeParam> n( b );
+    lazy::assign(n, lazy::ref(a) * n);
+    EXPECT_TRUE( n == a * b );
+    n = b;
+    lazy::assign(n, lazy::ref(n) * a * n);
+    EXPECT_TRUE( n == b * a * b );
+    m = lazy::ref(a) * b + c * 2 - lazy::ref(a);
+    EXPECT_TRUE( m == a * b + c * 2 - a );
+
+    // Matrix * vector chains are evaluated right to left.  With these
+    // elements everything is exact, so the association doesn't matter.
+    Vector4<TypeParam> const p( 1, 2, 3, 1 );
+    Vector4<TypeParam> q = lazy::ref(a) * b * c * p;
+    EXPECT_TRUE( q == a * b * c * p );
+    q = lazy::ref(a) * p + (lazy::ref(b) * 2) * p;
+    EXPECT_TRUE( q == a * p + (b * 2) * p );
+    Matrix33<TypeParam> const r( 0, 1, 0,  -1, 0, 0,  0, 0, 1 );
+    Vector3<TypeParam> const w = lazy::ref(r) * r * v1;
+    EXPECT_TRUE( w == r * (r * v1) );
+    }
+
+TYPED_TEST( LazyTest, InexactScalars ) {
+    using namespace arda::Math;
+
+    // 0.1 is not exact in float, so the scalar has to be rounded the way
+    // the plain operators round it for the results to match.
+    int i;
+    for (i = 0; i < 1000; ++i) {
+        Vector3<TypeParam> const v( (TypeParam) (0.37 * i - 150), (TypeParam) (i + 0.25), (TypeParam) (-0.013 * i) );
+        Vector3<TypeParam> r = lazy::ref(v) * 0.1;
+        ASSERT_TRUE( r == v * 0.1 ) << "element " << i;
+        r = lazy::ref(v) / 0.1;
+        ASSERT_TRUE( r == v / 0.1 ) << "element " << i;
+        r = lazy::ref(v) * 0.1f + v * 0.3;
+        ASSERT_TRUE( r == v * 0.1f + v * 0.3 ) << "element " << i;
+        }
+
+    Matrix33<TypeParam> m;
+    for (i = 0; i < 9; ++i)
+        m[i] = (TypeParam) (1.7 * i - 3);
+    Matrix33<TypeParam> const p = lazy::ref(m) * 0.1 - m / 0.3;
+    EXPECT_TRUE( p == m * 0.1 - m / 0.3 );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Batch operations
+
+template <typename T>
+class BatchTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( BatchTest, MyTypes );
+
+TYPED_TEST( BatchTest, TransformPointsAndDirections ) {
+    Matrix44<TypeParam> m44;
+    Matrix33<TypeParam> m33;
+    size_t i;
+    for (i = 0; i < 16; ++i)
+        m44[i] = (TypeParam) (0.5 * i - 3);
+    for (i = 0; i < 9; ++i)
+        m33[i] = (TypeParam) (0.5 * i - 2);
+
+    // Run every length up to a few SIMD blocks, at every starting offset
+    // within a 16 byte line, so the unaligned heads and tails are covered.
+    std::vector< Vector3<TypeParam> > in3(24), out3(24);
+    std::vector< Vector2<TypeParam> > in2(24), out2(24);
+    for (i = 0; i < in3.size(); ++i) {
+        in3[i].assign( (TypeParam) i, (TypeParam) (1.5 - i), (TypeParam) (0.5 * i) );
+        in2[i].assign( (TypeParam) i, (TypeParam) (1.5 - i) );
+        }
+
+    size_t offset, n;
+    for (offset = 0; offset < 4; ++offset)
+        for (n = 0; n + offset <= in3.size(); ++n) {
+            transform_points(m44, &in3[0], &out3[offset], n);
+            for (i = 0; i < n; ++i) {
+                Vector4<TypeParam> p = m44 * Vector4<TypeParam>( in3[i].x, in3[i].y, in3[i].z, 1 );
+                ASSERT_TRUE( out3[offset+i] == Vector3<TypeParam>( p.x, p.y, p.z ) ) << "point " << i << " of " << n;
+                }
+
+            transform_directions(m44, &in3[0], &out3[offset], n);
+            for (i = 0; i < n; ++i) {
+                Vector4<TypeParam> d = m44 * Vector4<TypeParam>( in3[i] );
+                ASSERT_TRUE( out3[offset+i] == Vector3<TypeParam>( d.x, d.y, d.z ) ) << "direction " << i << " of " << n;
+                }
+
+            transform_directions(m33, &in3[0], &out3[offset], n);
+            for (i = 0; i < n; ++i)
+                ASSERT_TRUE( out3[offset+i] == m33 * in3[i] ) << "3x3 direction " << i << " of " << n;
+
+            transform_points(m33, &in2[0], &out2[offset], n);
+            for (i = 0; i < n; ++i) {
+                Vector3<TypeParam> p = m33 * Vector3<TypeParam>( in2[i].x, in2[i].y, 1 );
+                ASSERT_TRUE( out2[offset+i] == Vector2<TypeParam>( p.x, p.y ) ) << "2D point " << i << " of " << n;
+                }
+
+            transform_directions(m33, &in2[0], &out2[offset], n);
+            for (i = 0; i < n; ++i) {
+                Vector3<TypeParam> d = m33 * Vector3<TypeParam>( in2[i] );
+                ASSERT_TRUE( out2[offset+i] == Vector2<TypeParam>( d.x, d.y ) ) << "2D direction " << i << " of " << n;
+                }
+            }
+
+    // In place
+    std::vector< Vector3<TypeParam> > inplace( in3 );
+    transform_points(m44, &inplace[1], &inplace[1], inplace.size() - 1);
+    transform_points(m44, &in3[1], &out3[1], in3.size() - 1);
+    for (i = 1; i < in3.size(); ++i)
+        EXPECT_TRUE( inplace[i] == out3[i] ) << "in place point " << i;
+    }
+
+template <typename T>
+class BatchRotationTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( BatchRotationTest, RealTypes );
+
+TYPED_TEST( BatchRotationTest, MatchesSingleMatrices ) {
+    // Past one block of the float version, with a tail, and a zero axis.
+    size_t const n = 64 + 8 + 3;
+    std::vector<float> angles(n);
+    std::vector< Vector3<TypeParam> > axes(n), d(n);
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        angles[i] = 0.37f * i - 11;
+        axes[i].assign( (TypeParam) (0.5 * i - 7), (TypeParam) 1.25, (TypeParam) (3 - 0.25 * i) );
+        d[i].assign( (TypeParam) i, (TypeParam) -2, (TypeParam) (0.5 * i) );
+        }
+    axes[5].assign( 0, 0, 0 );
+
+    std::vector< Matrix33<TypeParam> > r33(n);
+    std::vector< Matrix44<TypeParam> > r44(n), t44(n);
+    get_rot_mat33_batch(&r33[0], &angles[0], &axes[0], n);
+    get_rot_mat44_batch(&r44[0], &angles[0], &axes[0], n);
+    get_transform_mat44_batch(&t44[0], &angles[0], &axes[0], &d[0], n);
+
+    for (i = 0; i < n; ++i) {
+        Matrix33<TypeParam> m33;
+        Matrix44<TypeParam> m44, mt;
+        get_rot_mat33(m33, angles[i], axes[i]);
+        get_rot_mat44(m44, angles[i], axes[i]);
+        get_transform_mat44(mt, angles[i], axes[i], d[i]);
+        unsigned int k;
+        for (k = 0; k < 9; ++k)
+            EXPECT_NEAR( m33[k], r33[i][k], 1e-6 ) << "3x3 " << i << " element " << k;
+        for (k = 0; k < 16; ++k) {
+            EXPECT_NEAR( m44[k], r44[i][k], 1e-6 ) << "4x4 " << i << " element " << k;
+            EXPECT_NEAR( mt[k], t44[i][k], 1e-6 ) << "transform " << i << " element " << k;
+            }
+        }
+
+    Matrix33<TypeParam> identity;
+    identity.setidentity();
+    EXPECT_TRUE( r33[5] == identity );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Structure of arrays containers
+
+template <typename T>
+class SoATest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( SoATest, MyTypes );
+
+TYPED_TEST( SoATest, ConversionsAndBulkOperations ) {
+    size_t i, n;
+    bool const is_integer = std::numeric_limits<TypeParam>::is_integer;
+    double const eps = 1e-5;
+
+    // Every size up to a few SIMD blocks, so the tails are covered.
+    for (n = 0; n <= 13; ++n) {
+        std::vector< Vector2<TypeParam> > a2(n), b2(n), r2(n);
+        std::vector< Vector3<TypeParam> > a3(n), b3(n), r3(n);
+        std::vector< Vector4<TypeParam> > a4(n), b4(n), r4(n);
+        for (i = 0; i < n; ++i) {
+            a3[i].assign( (TypeParam) i, (TypeParam) (1.5 - i), (TypeParam) (0.5 * i) );
+            b3[i].assign( (TypeParam) 2, (TypeParam) (i + 0.5), (TypeParam) (-1.0 * i) );
+            a2[i].assign( a3[i].x, a3[i].y );
+            b2[i].assign( b3[i].x, b3[i].y );
+            a4[i].assign( a3[i].x, a3[i].y, a3[i].z, (TypeParam) 3 );
+            b4[i].assign( b3[i].x, b3[i].y, b3[i].z, (TypeParam) (0.5 * i) );
+            }
+        // The zero vector must survive normalize().
+        if (n > 5)
+            a3[5].assign( 0, 0, 0 );
+
+        Vector2SoA<TypeParam> sa2, sb2, sr2;
+        Vector3SoA<TypeParam> sa3, sb3, sr3;
+        Vector4SoA<TypeParam> sa4, sb4, sr4;
+        sa2.assign(a2.data(), n); sb2.assign(b2.data(), n);
+        sa3.assign(a3.data(), n); sb3.assign(b3.data(), n);
+        sa4.assign(a4.data(), n); sb4.assign(b4.data(), n);
+        ASSERT_EQ( n, sa3.size() );
+
+        // Round trip
+        sa2.copy_to(r2.data());
+        sa3.copy_to(r3.data());
+        sa4.copy_to(r4.data());
+        for (i = 0; i < n; ++i) {
+            ASSERT_TRUE( r2[i] == a2[i] );
+            ASSERT_TRUE( r3[i] == a3[i] );
+            ASSERT_TRUE( r4[i] == a4[i] );
+            ASSERT_TRUE( sa3.get(i) == a3[i] );
+            }
+
+        // Element wise arithmetic, which must match the Vector operators exactly.
+        std::vector<TypeParam> d(n + 1);
+        sa3.dot(sb3, &d[0]);
+        for (i = 0; i < n; ++i)
+            EXPECT_EQ( a3[i].dot(b3[i]), d[i] );
+        sa4.dot(sb4, &d[0]);
+        for (i = 0; i < n; ++i)
+            EXPECT_EQ( a4[i].dot(b4[i]), d[i] );
+
+        sr3 = sa3 + sb3;
+        for (i = 0; i < n; ++i)
+            EXPECT_TRUE( sr3.get(i) == a3[i] + b3[i] );
+        sr2 = sa2 - sb2;
+        for (i = 0; i < n; ++i)
+            EXPECT_TRUE( sr2.get(i) == a2[i] - b2[i] );
+        sr4 = sa4 * (TypeParam) 3;
+        for (i = 0; i < n; ++i)
+            EXPECT_TRUE( sr4.get(i) == a4[i] * (TypeParam) 3 );
+        sa3.cross(sb3, sr3);
+        for (i = 0; i < n; ++i)
+            EXPECT_TRUE( sr3.get(i) == a3[i].cross(b3[i]) );
+
+        if (is_integer)
+            continue;
+
+        // length(), normalize(), and proj() are computed in T, where the
+        // Vector versions go through double.
+        sa3.length(&d[0]);
+        for (i = 0; i < n; ++i)
+            EXPECT_NEAR( a3[i].length(), d[i], eps * (1 + d[i]) );
+
+        sr3 = sa3;
+        sr3.normalize();
+        for (i = 0; i < n; ++i) {
+            Vector3<TypeParam> v = a3[i];
+            v.normalize();
+            Vector3<TypeParam> w = sr3.get(i);
+            EXPECT_NEAR( v.x, w.x, eps );
+            EXPECT_NEAR( v.y, w.y, eps );
+            EXPECT_NEAR( v.z, w.z, eps );
+            }
+
+        sa4.proj(sb4, sr4);
+        for (i = 0; i < n; ++i) {
+            Vector4<TypeParam> v = a4[i].proj(b4[i]);
+            Vector4<TypeParam> w = sr4.get(i);
+            EXPECT_NEAR( v.x, w.x, eps * (1 + fabs(v.x)) );
+            EXPECT_NEAR( v.y, w.y, eps * (1 + fabs(v.y)) );
+            EXPECT_NEAR( v.z, w.z, eps * (1 + fabs(v.z)) );
+            EXPECT_NEAR( v.w, w.w, eps * (1 + fabs(v.w)) );
+            }
+        }
+
+    // resize() keeps the values and zeroes the new vectors.
+    Vector3SoA<TypeParam> v(3);
+    v.set(2, Vector3<TypeParam>( 1, 2, 3 ));
+    v.resize(40);
+    EXPECT_TRUE( v.get(2) == Vector3<TypeParam>( 1, 2, 3 ) );
+    EXPECT_TRUE( v.get(39) == Vector3<TypeParam>( 0, 0, 0 ) );
+    EXPECT_EQ( 0u, ((size_t) v.z()) % 32 );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Run time SIMD dispatch
+
+// Every level the CPU supports must give the same results as the baseline,
+// for sizes that exercise the wide blocks, the SSE blocks, and the scalar
+// tails.
+TEST( DispatchTest, AllLevelsMatch ) {
+    SimdLevel const saved = simd_level();
+    EXPECT_LE( saved, simd_supported() );
+    EXPECT_STRNE( "", simd_level_name(saved) );
+
+    Matrix44f m;
+    get_transform_mat44(m, 0.7f, Vector3f( 1, 2, -1 ), Vector3f( 3, -2, 5 ));
+    size_t const n = 16 + 8 + 4 + 3;
+    std::vector<Vector3f> in(n);
+    Vector3SoA<float> a(n), b(n);
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        in[i].assign( 0.25f * i - 3, 1.5f - 0.125f * i, 0.5f * i );
+        a.set(i, in[i]);
+        b.set(i, Vector3f( 2, 0.5f * i + 0.5f, -1.0f * i ));
+        }
+    a.set(9, Vector3f( 0 ));
+
+    std::vector<Vector3f> ref_points;
+    std::vector<float> ref_dot, ref_length;
+    Vector3SoA<float> ref_norm, ref_proj;
+    int level;
+    for (level = (int) SimdLevel::SCALAR; level <= (int) SimdLevel::AVX512; ++level) {
+        SimdLevel const l = set_simd_level((SimdLevel) level);
+        EXPECT_EQ( l, simd_level() );
+        if (l != (SimdLevel) level && level != (int) SimdLevel::SCALAR)
+            break;
+
+        std::vector<Vector3f> points(n);
+        transform_points(m, &in[0], &points[0], n);
+        std::vector<float> d(n), len(n);
+        a.dot(b, &d[0]);
+        a.length(&len[0]);
+        Vector3SoA<float> norm( a ), proj;
+        norm.normalize();
+        a.proj(b, proj);
+
+        if (ref_points.empty()) {
+            ref_points = points; ref_dot = d; ref_length = len;
+            ref_norm = norm; ref_proj = proj;
+            continue;
+            }
+        for (i = 0; i < n; ++i) {
+#if defined(ARDA_MATH_FMA)
+            // The compiler may have fused the baseline code.
+            EXPECT_NEAR( 0, (points[i] - ref_points[i]).length(), 1e-5 ) << simd_level_name(l) << " point " << i;
+#else
+            EXPECT_TRUE( points[i] == ref_points[i] ) << simd_level_name(l) << " point " << i;
+#endif
+            EXPECT_EQ( ref_dot[i], d[i] ) << simd_level_name(l) << " dot " << i;
+            EXPECT_EQ( ref_length[i], len[i] ) << simd_level_name(l) << " length " << i;
+            EXPECT_TRUE( norm.get(i) == ref_norm.get(i) ) << simd_level_name(l) << " normalize " << i;
+            EXPECT_TRUE( proj.get(i) == ref_proj.get(i) ) << simd_level_name(l) << " proj " << i;
+            }
+        }
+    set_simd_level(saved);
+    EXPECT_EQ( saved, simd_level() );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Fast trigonometry
+
+// Error of r in units in the last place of the float nearest ref.
+static double ulp_error( float r, double ref ) {
+    int e;
+    frexp((float) ref, &e);
+    double const ulp = ldexp(1.0, max(e - 24, -149));
+    return fabs(r - ref) / ulp;
+    }
+
+static float float_from_bits( unsigned int u ) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+    }
+
+// Every float from -limit to limit, stepping stride bit patterns at a time.
+static vector<float> sweep( float limit, unsigned int stride ) {
+    unsigned int top;
+    memcpy(&top, &limit, sizeof(top));
+    vector<float> x;
+    unsigned int u;
+    for (u = 0; u < top; u += stride) {
+        x.push_back(float_from_bits(u));
+        x.push_back(float_from_bits(u | 0x80000000u));
+        }
+    x.push_back(limit);
+    x.push_back(-limit);
+    return x;
+    }
+
+// Runs f on the arrays at every SIMD level and checks that each matches the
+// scalar version, which is what the sweeps check against libm.
+template <typename F>
+static void expect_all_levels_match( vector<float> const & scalar, F f ) {
+    SimdLevel const saved = simd_level();
+    int level;
+    for (level = (int) SimdLevel::SCALAR; level <= (int) SimdLevel::AVX512; ++level) {
+        SimdLevel const l = set_simd_level((SimdLevel) level);
+        if (l != (SimdLevel) level && level != (int) SimdLevel::SCALAR)
+            break;
+        vector<float> const out = f();
+        size_t i;
+        for (i = 0; i < scalar.size(); ++i) {
+            bool const nan = scalar[i] != scalar[i];
+#if defined(ARDA_MATH_FMA)
+            // The compiler may have fused the scalar code.
+            bool const same = nan ? out[i] != out[i] : fabs(out[i] - scalar[i]) <= 4e-7 * fabs(scalar[i]) + 1e-37;
+#else
+            bool const same = nan ? out[i] != out[i] : out[i] == scalar[i];
+#endif
+            if (!same)
+                break;
+            }
+        EXPECT_EQ( scalar.size(), i ) << simd_level_name(l) << " differs at " << i;
+        }
+    set_simd_level(saved);
+    }
+
+TEST( FastTrigTest, SinCosAndTan ) {
+    vector<float> const x = sweep(6433.0f, 1021);
+    size_t const n = x.size();
+    vector<float> s(n), c(n), t(n);
+    double worst_s = 0, worst_c = 0, worst_t = 0;
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        fast::sincos(x[i], s[i], c[i]);
+        t[i] = fast::tan(x[i]);
+        worst_s = max(worst_s, ulp_error(s[i], sin((double) x[i])));
+        worst_c = max(worst_c, ulp_error(c[i], cos((double) x[i])));
+        worst_t = max(worst_t, ulp_error(t[i], tan((double) x[i])));
+        }
+    EXPECT_LE( worst_s, 2.5 );
+    EXPECT_LE( worst_c, 2.5 );
+    EXPECT_LE( worst_t, 4.5 );
+
+    expect_all_levels_match(s, [&]() { vector<float> out(n), unused(n); fast::sincos(&x[0], &out[0], &unused[0], n); return out; });
+    expect_all_levels_match(c, [&]() { vector<float> out(n), unused(n); fast::sincos(&x[0], &unused[0], &out[0], n); return out; });
+    expect_all_levels_match(t, [&]() { vector<float> out(n); fast::tan(&x[0], &out[0], n); return out; });
+
+    float const inf = numeric_limits<float>::infinity();
+    float sv, cv;
+    fast::sincos(inf, sv, cv);
+    EXPECT_TRUE( sv != sv && cv != cv );
+    fast::sincos(numeric_limits<float>::quiet_NaN(), sv, cv);
+    EXPECT_TRUE( sv != sv && cv != cv );
+    fast::sincos(0.0f, sv, cv);
+    EXPECT_EQ( 0.0f, sv );
+    EXPECT_EQ( 1.0f, cv );
+    }
+
+TEST( FastTrigTest, AsinAndAcos ) {
+    vector<float> x = sweep(1.0f, 997);
+    x.push_back(1.5f);
+    x.push_back(-2.0f);
+    size_t const n = x.size();
+    vector<float> as(n), ac(n);
+    double worst_as = 0, worst_ac = 0;
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        as[i] = fast::asin(x[i]);
+        ac[i] = fast::acos(x[i]);
+        if (fabs(x[i]) > 1) {
+            EXPECT_NE( as[i], as[i] );
+            EXPECT_NE( ac[i], ac[i] );
+            continue;
+            }
+        worst_as = max(worst_as, ulp_error(as[i], asin((double) x[i])));
+        worst_ac = max(worst_ac, ulp_error(ac[i], acos((double) x[i])));
+        }
+    EXPECT_LE( worst_as, 2.5 );
+    EXPECT_LE( worst_ac, 1.5 );
+    EXPECT_EQ( 0.0f, fast::acos(1.0f) );
+    EXPECT_FLOAT_EQ( (float) PI, fast::acos(-1.0f) );
+
+    expect_all_levels_match(as, [&]() { vector<float> out(n); fast::asin(&x[0], &out[0], n); return out; });
+    expect_all_levels_match(ac, [&]() { vector<float> out(n); fast::acos(&x[0], &out[0], n); return out; });
+    }
+
+TEST( FastTrigTest, Atan2 ) {
+    // A grid over the whole finite range in all four quadrants.
+    unsigned int const step = 0x7f7fffffu / 700;
+    vector<float> y, x;
+    unsigned int a, b;
+    int k;
+    for (a = 0; a <= 0x7f7fffffu - step; a += step)
+        for (b = 0; b <= 0x7f7fffffu - step; b += step)
+            for (k = 0; k < 4; ++k) {
+                y.push_back(float_from_bits(a | ((k & 1) != 0 ? 0x80000000u : 0)));
+                x.push_back(float_from_bits(b | ((k & 2) != 0 ? 0x80000000u : 0)));
+                }
+    size_t const n = x.size();
+    vector<float> r(n);
+    double worst = 0;
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        r[i] = fast::atan2(y[i], x[i]);
+        worst = max(worst, ulp_error(r[i], atan2((double) y[i], (double) x[i])));
+        }
+    EXPECT_LE( worst, 3.5 );
+
+    expect_all_levels_match(r, [&]() { vector<float> out(n); fast::atan2(&y[0], &x[0], &out[0], n); return out; });
+
+    // Signed zeros and infinities, as for atan2().
+    float const inf = numeric_limits<float>::infinity();
+    EXPECT_EQ( atan2(0.0f, 0.0f), fast::atan2(0.0f, 0.0f) );
+    EXPECT_EQ( atan2(-0.0f, 0.0f), fast::atan2(-0.0f, 0.0f) );
+    EXPECT_TRUE( signbit(fast::atan2(-0.0f, 0.0f)) );
+    EXPECT_FLOAT_EQ( atan2(0.0f, -0.0f), fast::atan2(0.0f, -0.0f) );
+    EXPECT_FLOAT_EQ( atan2(-0.0f, -1.0f), fast::atan2(-0.0f, -1.0f) );
+    EXPECT_FLOAT_EQ( atan2(1.0f, inf), fast::atan2(1.0f, inf) );
+    EXPECT_FLOAT_EQ( atan2(-inf, 2.0f), fast::atan2(-inf, 2.0f) );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Packet types
+
+// Runs the generic Vector and Matrix code with packet P and checks every
+// lane against the same operation on the scalar float types.
+template <typename P>
+void check_packet_lanes() {
+    unsigned int const n = P::size;
+    float ax[8], ay[8], az[8], aw[8], bx[8], by[8], bz[8], bw[8], mm[16][8];
+    unsigned int i, k;
+    for (i = 0; i < n; ++i) {
+        ax[i] = 0.5f * i - 1; ay[i] = 2.0f - i;    az[i] = 0.25f * i; aw[i] = 1.5f;
+        bx[i] = 1.0f + i;     by[i] = 0.5f;        bz[i] = -0.75f * i; bw[i] = 2.0f - 0.5f * i;
+        for (k = 0; k < 16; ++k)
+            mm[k][i] = (float) ((k * 7 + i * 3) % 11) - 5.0f + (k % 5 == 0 ? 4.0f : 0.0f);
+        }
+    // One lane is the zero vector, which normalize() must leave alone.
+    ax[1] = ay[1] = az[1] = 0.0f;
+
+    Vector3<P> a3( P::loadu(ax), P::loadu(ay), P::loadu(az) );
+    Vector3<P> b3( P::loadu(bx), P::loadu(by), P::loadu(bz) );
+    Vector4<P> a4( a3.x, a3.y, a3.z, P::loadu(aw) );
+    Vector4<P> b4( b3.x, b3.y, b3.z, P::loadu(bw) );
+    Matrix44<P> m44;
+    Matrix33<P> m33;
+    for (k = 0; k < 16; ++k)
+        m44[k] = P::loadu(mm[k]);
+    for (k = 0; k < 9; ++k)
+        m33[k] = m44[k];
+
+    P const dot = a3.dot(b3);
+    P const len = b3.length();
+    Vector3<P> const cross = a3.cross(b3);
+    Vector3<P> const sum = a3 + b3 * 2 - b3 / 4.0;
+    Vector4<P> const proj = a4.proj(b4);
+    Vector4<P> const mv = m44 * a4;
+    Matrix44<P> const mm44 = m44 * transpose(m44);
+    P const d33 = det(m33);
+    P const d44 = det(m44);
+    Vector3<P> norm = a3;
+    norm.normalize();
+    Matrix44<P> const inv44 = inverse(m44);
+
+    for (i = 0; i < n; ++i) {
+        Vector3f sa3( ax[i], ay[i], az[i] ), sb3( bx[i], by[i], bz[i] );
+        Vector4f sa4( ax[i], ay[i], az[i], aw[i] ), sb4( bx[i], by[i], bz[i], bw[i] );
+        Matrix44f s44;
+        Matrix33f s33;
+        for (k = 0; k < 16; ++k)
+            s44[k] = mm[k][i];
+        for (k = 0; k < 9; ++k)
+            s33[k] = mm[k][i];
+
+        EXPECT_FLOAT_EQ( sa3.dot(sb3), dot[i] ) << "lane " << i;
+        EXPECT_FLOAT_EQ( (float) sb3.length(), len[i] ) << "lane " << i;
+        Vector3f sc = sa3.cross(sb3);
+        EXPECT_FLOAT_EQ( sc.x, cross.x[i] );
+        EXPECT_FLOAT_EQ( sc.y, cross.y[i] );
+        EXPECT_FLOAT_EQ( sc.z, cross.z[i] );
+        Vector3f ss = sa3 + sb3 * 2 - sb3 / 4.0;
+        EXPECT_FLOAT_EQ( ss.x, sum.x[i] );
+        EXPECT_FLOAT_EQ( ss.z, sum.z[i] );
+        Vector4f sp = sa4.proj(sb4);
+        EXPECT_NEAR( sp.x, proj.x[i], 1e-5 );
+        EXPECT_NEAR( sp.w, proj.w[i], 1e-5 );
+        Vector4f smv = s44 * sa4;
+        EXPECT_FLOAT_EQ( smv.y, mv.y[i] );
+        EXPECT_FLOAT_EQ( smv.w, mv.w[i] );
+        Matrix44f smm = s44 * transpose(s44);
+        for (k = 0; k < 16; ++k)
+            EXPECT_FLOAT_EQ( smm[k], mm44[k][i] );
+        EXPECT_FLOAT_EQ( (float) det(s33), d33[i] ) << "lane " << i;
+        EXPECT_FLOAT_EQ( (float) det(s44), d44[i] ) << "lane " << i;
+        Matrix44f sinv = inverse(s44);
+        for (k = 0; k < 16; ++k)
+            EXPECT_NEAR( sinv[k], inv44[k][i], 1e-5 * (1 + fabs(sinv[k])) ) << "lane " << i;
+        Vector3f sn = sa3;
+        sn.normalize();
+        EXPECT_NEAR( sn.x, norm.x[i], 1e-6 );
+        EXPECT_NEAR( sn.y, norm.y[i], 1e-6 );
+        EXPECT_NEAR( sn.z, norm.z[i], 1e-6 );
+        }
+
+    EXPECT_TRUE( a3 == a3 );
+    EXPECT_FALSE( a3 == b3 );
+    EXPECT_FALSE( all(cmpge(a3.x, P(0.0f))) );
+    EXPECT_FALSE( all(cmplt(a3.x, P(0.0f))) );
+    }
+
+#if defined(ARDA_MATH_SSE2)
+TEST( PacketTest, Packet4fMatchesScalarLanes ) {
+    check_packet_lanes<Packet4f>();
+    }
+#endif
+
+#if defined(ARDA_MATH_AVX)
+TEST( PacketTest, Packet8fMatchesScalarLanes ) {
+    check_packet_lanes<Packet8f>();
+    }
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Quaternions
+
+template <typename T>
+class QuaternionTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( QuaternionTest, RealTypes );
+
+TYPED_TEST( QuaternionTest, MatchesRotationMatrices ) {
+    typedef TypeParam T;
+    Vector3<T> const axis1( 1, -2, 0.5 ), axis2( -0.3, 0.4, 2 ), v( 3, -1, 2 );
+    Quaternion<T> q1, q2;
+    Matrix33<T> m1, m2, mq;
+    get_rot_quat(q1, 0.7f, axis1);
+    get_rot_quat(q2, -2.1f, axis2);
+    get_rot_mat33(m1, 0.7f, axis1);
+    get_rot_mat33(m2, -2.1f, axis2);
+
+    // Conversion to a matrix, rotate(), and composition.
+    get_rot_mat33(mq, q1);
+    int i;
+    for (i = 0; i < 9; ++i)
+        EXPECT_NEAR( m1[i], mq[i], 1e-6 ) << "element " << i;
+    Vector3<T> const r = q1.rotate(v), rm = m1 * v;
+    EXPECT_NEAR( rm.x, r.x, 1e-5 );
+    EXPECT_NEAR( rm.y, r.y, 1e-5 );
+    EXPECT_NEAR( rm.z, r.z, 1e-5 );
+
+    Quaternion<T> q12 = q1 * q2;
+    get_rot_mat33(mq, q12);
+    Matrix33<T> const m12 = m1 * m2;
+    for (i = 0; i < 9; ++i)
+        EXPECT_NEAR( m12[i], mq[i], 1e-6 ) << "element " << i;
+    q12 = q1;
+    q12 *= q2;
+    EXPECT_TRUE( q12 == q1 * q2 );
+
+    // The inverse undoes the rotation.
+    Vector3<T> const back = conjugate(q1).rotate(r);
+    EXPECT_NEAR( v.x, back.x, 1e-5 );
+    EXPECT_NEAR( v.y, back.y, 1e-5 );
+    EXPECT_NEAR( v.z, back.z, 1e-5 );
+    Quaternion<T> const p( 1, 2, -3, 4 ), pi = p * inverse(p);
+    EXPECT_NEAR( 0, pi.x, 1e-6 );
+    EXPECT_NEAR( 0, pi.y, 1e-6 );
+    EXPECT_NEAR( 0, pi.z, 1e-6 );
+    EXPECT_NEAR( 1, pi.w, 1e-6 );
+
+    // Exact cases: quarter turns about z.
+    Quaternion<T> const qa( 0, 0, 1, 1 ), qb( 1, 0, 0, 0 );
+    EXPECT_TRUE( qa * qb == Quaternion<T>( 1, 1, 0, 0 ) );
+    EXPECT_TRUE( qb * qa == Quaternion<T>( 1, -1, 0, 0 ) );
+    }
+
+TYPED_TEST( QuaternionTest, FromMatrix ) {
+    typedef TypeParam T;
+    // Large angles about each axis exercise every branch of the conversion;
+    // the small one takes the positive trace branch.
+    Vector3<T> const axes[4] = { Vector3<T>( 1, 0.1, -0.2 ), Vector3<T>( 0.1, 1, 0.2 ),
+                                 Vector3<T>( -0.2, 0.1, 1 ), Vector3<T>( 1, 2, 3 ) };
+    float const angles[4] = { 3.0f, -3.1f, 2.9f, 0.4f };
+    int k, i;
+    for (k = 0; k < 4; ++k) {
+        Quaternion<T> q, qm;
+        Matrix33<T> m33;
+        Matrix44<T> m44;
+        get_rot_quat(q, angles[k], axes[k]);
+        get_rot_mat33(m33, angles[k], axes[k]);
+        get_rot_mat44(m44, q);
+        get_rot_quat(qm, m33);
+        // q and -q are the same rotation.
+        T const s = q.dot(qm) < 0 ? -1 : 1;
+        for (i = 0; i < 4; ++i)
+            EXPECT_NEAR( q[i], s * qm[i], 1e-6 ) << "case " << k << " element " << i;
+        get_rot_quat(qm, m44);
+        T const s4 = q.dot(qm) < 0 ? -1 : 1;
+        for (i = 0; i < 4; ++i)
+            EXPECT_NEAR( q[i], s4 * qm[i], 1e-6 ) << "case " << k << " element " << i;
+        EXPECT_EQ( 1, m44[15] );
+        EXPECT_EQ( 0, m44[12] );
+        }
+    }
+
+TYPED_TEST( QuaternionTest, Interpolation ) {
+    typedef TypeParam T;
+    Vector3<T> const axis( 0.5, -1, 2 );
+    Quaternion<T> q0, q1, qh;
+    get_rot_quat(q0, 0.2f, axis);
+    get_rot_quat(q1, 1.4f, axis);
+    get_rot_quat(qh, 0.8f, axis);
+
+    Quaternion<T> const s0 = slerp(q0, q1, T(0)), s1 = slerp(q0, q1, T(1));
+    Quaternion<T> const sh = slerp(q0, q1, T(0.5)), nh = nlerp(q0, q1, T(0.5));
+    int i;
+    for (i = 0; i < 4; ++i) {
+        EXPECT_NEAR( q0[i], s0[i], 1e-6 );
+        EXPECT_NEAR( q1[i], s1[i], 1e-6 );
+        // Both are exact at the midpoint.
+        EXPECT_NEAR( qh[i], sh[i], 1e-6 );
+        EXPECT_NEAR( qh[i], nh[i], 1e-6 );
+        }
+
+    // slerp() moves at a constant rate; a quarter of the way is 0.5 radians.
+    Quaternion<T> qq;
+    get_rot_quat(qq, 0.5f, axis);
+    Quaternion<T> const sq = slerp(q0, q1, T(0.25)), nq = nlerp(q0, q1, T(0.25));
+    for (i = 0; i < 4; ++i)
+        EXPECT_NEAR( qq[i], sq[i], 1e-6 );
+    EXPECT_NEAR( 1, nq.length(), 1e-6 );
+
+    // Both take the short way round when given the negated end point.
+    Quaternion<T> const sn = slerp(q0, -q1, T(0.5)), nn = nlerp(q0, -q1, T(0.5));
+    for (i = 0; i < 4; ++i) {
+        EXPECT_NEAR( qh[i], sn[i], 1e-6 );
+        EXPECT_NEAR( qh[i], nn[i], 1e-6 );
+        }
+
+    // Nearly equal end points fall back to nlerp().
+    Quaternion<T> qc;
+    get_rot_quat(qc, 0.2001f, axis);
+    Quaternion<T> const sc = slerp(q0, qc, T(0.5));
+    EXPECT_NEAR( 1, sc.length(), 1e-6 );
+    EXPECT_NEAR( q0.x, sc.x, 1e-4 );
+    }
+
+template <typename T>
+class DualQuaternionTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( DualQuaternionTest, RealTypes );
+
+TYPED_TEST( DualQuaternionTest, MatchesRigidMatrices ) {
+    typedef TypeParam T;
+    Vector3<T> const axis1( 1, -2, 0.5 ), axis2( -0.3, 0.4, 2 );
+    Vector3<T> const t1( 4, 5, -6 ), t2( -1, 0.5, 2 ), p( 3, -1, 2 );
+    Quaternion<T> r1, r2;
+    get_rot_quat(r1, 0.7f, axis1);
+    get_rot_quat(r2, -2.1f, axis2);
+    DualQuaternion<T> const dq1( r1, t1 ), dq2( r2, t2 );
+    Matrix44<T> m1, m2, mdq;
+    get_transform_mat44(m1, 0.7f, axis1, t1);
+    get_transform_mat44(m2, -2.1f, axis2, t2);
+
+    get_transform_mat44(mdq, dq1);
+    int i;
+    for (i = 0; i < 16; ++i)
+        EXPECT_NEAR( m1[i], mdq[i], 1e-5 ) << "element " << i;
+    Vector3<T> const tr = dq1.get_translation();
+    EXPECT_NEAR( t1.x, tr.x, 1e-5 );
+    EXPECT_NEAR( t1.y, tr.y, 1e-5 );
+    EXPECT_NEAR( t1.z, tr.z, 1e-5 );
+
+    // Composition and transforming points.
+    Matrix44<T> const m12 = m1 * m2;
+    get_transform_mat44(mdq, dq1 * dq2);
+    for (i = 0; i < 16; ++i)
+        EXPECT_NEAR( m12[i], mdq[i], 1e-5 ) << "element " << i;
+    Vector4<T> const mp = m12 * Vector4<T>( p.x, p.y, p.z, 1 );
+    Vector3<T> const dp = (dq1 * dq2).transform_point(p);
+    EXPECT_NEAR( mp.x, dp.x, 1e-5 );
+    EXPECT_NEAR( mp.y, dp.y, 1e-5 );
+    EXPECT_NEAR( mp.z, dp.z, 1e-5 );
+
+    // Inverse and round trip through a matrix.
+    Vector3<T> const back = inverse(dq1).transform_point(dq1.transform_point(p));
+    EXPECT_NEAR( p.x, back.x, 1e-5 );
+    EXPECT_NEAR( p.y, back.y, 1e-5 );
+    EXPECT_NEAR( p.z, back.z, 1e-5 );
+    DualQuaternion<T> dqm;
+    get_dual_quat(dqm, m1);
+    T const s = dqm.real.dot(dq1.real) < 0 ? -1 : 1;
+    for (i = 0; i < 4; ++i) {
+        EXPECT_NEAR( dq1.real[i], s * dqm.real[i], 1e-5 );
+        EXPECT_NEAR( dq1.dual[i], s * dqm.dual[i], 1e-5 );
+        }
+    DualQuaternion<T> id;
+    id.setidentity();
+    DualQuaternion<T> const idq = id * dq1;
+    for (i = 0; i < 4; ++i) {
+        EXPECT_NEAR( dq1.real[i], idq.real[i], 1e-6 );
+        EXPECT_NEAR( dq1.dual[i], idq.dual[i], 1e-6 );
+        }
+    }
+
+TYPED_TEST( DualQuaternionTest, BlendAndSkin ) {
+    typedef TypeParam T;
+    Vector3<T> const axis( 0.5, -1, 2 ), t( 1, 2, 3 );
+    Quaternion<T> r0, r1, rh;
+    get_rot_quat(r0, 0.2f, axis);
+    get_rot_quat(r1, 1.4f, axis);
+    get_rot_quat(rh, 0.8f, axis);
+    // The second bone is given in the other hemisphere, which must not
+    // change the blend.
+    DualQuaternion<T> const bones[3] = { DualQuaternion<T>( r0, t ), -DualQuaternion<T>( r1, t ),
+                                         DualQuaternion<T>( rh, Vector3<T>( -2, 0, 1 ) ) };
+
+    // Equal weights of two rotations about the same axis with the same
+    // translation give the rotation half way between.
+    T const half[2] = { 0.5, 0.5 };
+    DualQuaternion<T> const b = blend(bones, half, 2), expect( rh, t );
+    int i;
+    for (i = 0; i < 4; ++i) {
+        EXPECT_NEAR( expect.real[i], b.real[i], 1e-5 );
+        EXPECT_NEAR( expect.dual[i], b.dual[i], 1e-5 );
+        }
+
+    // skin_points() matches blend() and transform_point() per vertex.
+    size_t const n = 7;
+    unsigned int const k = 3;
+    std::vector< Vector3<T> > in(n), out(n);
+    std::vector<unsigned int> index(n * k);
+    std::vector<T> weight(n * k);
+    size_t v;
+    unsigned int j;
+    for (v = 0; v < n; ++v) {
+        in[v] = Vector3<T>( T(v), T(1) - T(v), T(2) );
+        for (j = 0; j < k; ++j) {
+            index[v*k + j] = (unsigned int) ((v + j) % 3);
+            weight[v*k + j] = T((j + 1) * (v + 1)) / 10;
+            }
+        }
+    skin_points(bones, &index[0], &weight[0], k, &in[0], &out[0], n);
+    for (v = 0; v < n; ++v) {
+        DualQuaternion<T> const dq[3] = { bones[index[v*k]], bones[index[v*k + 1]], bones[index[v*k + 2]] };
+        Vector3<T> const e = blend(dq, &weight[v*k], k).transform_point(in[v]);
+        EXPECT_NEAR( e.x, out[v].x, 1e-5 ) << "vertex " << v;
+        EXPECT_NEAR( e.y, out[v].y, 1e-5 ) << "vertex " << v;
+        EXPECT_NEAR( e.z, out[v].z, 1e-5 ) << "vertex " << v;
+        }
+
+    // In place.
+    skin_points(bones, &index[0], &weight[0], k, &in[0], &in[0], n);
+    for (v = 0; v < n; ++v)
+        EXPECT_NEAR( out[v].y, in[v].y, 1e-6 );
+    }
+
+template <typename T>
+class TransformTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( TransformTest, RealTypes );
+
+TYPED_TEST( TransformTest, MatchesMatrices ) {
+    typedef TypeParam T;
+    Vector3<T> const axis1( 1, -2, 0.5 ), axis2( -0.3, 0.4, 2 );
+    Vector3<T> const t1( 4, 5, -6 ), t2( -1, 0.5, 2 ), s2( 2, 0.5, 3 ), p( 3, -1, 2 );
+    Quaternion<T> r1, r2;
+    get_rot_quat(r1, 0.7f, axis1);
+    get_rot_quat(r2, -2.1f, axis2);
+    // a has uniform scale, so compose(a, b) and inverse(a) are exact.
+    Transform<T> const a( t1, r1, T(1.5) ), b( t2, r2, s2 );
+
+    Matrix44<T> ma, mb, ms, m;
+    get_transform_mat44(ma, 0.7f, axis1, t1);
+    get_scale_mat44(ms, Vector3<T>( 1.5, 1.5, 1.5 ));
+    ma = ma * ms;
+    get_transform_mat44(mb, -2.1f, axis2, t2);
+    get_scale_mat44(ms, s2);
+    mb = mb * ms;
+
+    a.to_matrix44(m);
+    int i;
+    for (i = 0; i < 16; ++i)
+        EXPECT_NEAR( ma[i], m[i], 1e-5 ) << "element " << i;
+    b.to_matrix44(m);
+    for (i = 0; i < 16; ++i)
+        EXPECT_NEAR( mb[i], m[i], 1e-5 ) << "element " << i;
+
+    Vector4<T> const mp = mb * Vector4<T>( p.x, p.y, p.z, 1 );
+    Vector3<T> const bp = b.transform_point(p);
+    EXPECT_NEAR( mp.x, bp.x, 1e-5 );
+    EXPECT_NEAR( mp.y, bp.y, 1e-5 );
+    EXPECT_NEAR( mp.z, bp.z, 1e-5 );
+
+    Matrix44<T> const mab = ma * mb;
+    compose(a, b).to_matrix44(m);
+    for (i = 0; i < 16; ++i)
+        EXPECT_NEAR( mab[i], m[i], 1e-5 ) << "element " << i;
+
+    Matrix44<T> const mai = inverse(ma);
+    inverse(a).to_matrix44(m);
+    for (i = 0; i < 16; ++i)
+        EXPECT_NEAR( mai[i], m[i], 1e-5 ) << "element " << i;
+
+    Transform<T> id;
+    id.setidentity();
+    Vector3<T> const ip = compose(id, b).transform_point(p);
+    EXPECT_NEAR( bp.x, ip.x, 1e-5 );
+    EXPECT_NEAR( bp.y, ip.y, 1e-5 );
+    EXPECT_NEAR( bp.z, ip.z, 1e-5 );
+
+    // Interpolation.
+    Transform<T> const l0 = lerp(a, b, T(0)), lh = lerp(a, b, T(0.5));
+    EXPECT_NEAR( t1.x, l0.translation.x, 1e-6 );
+    EXPECT_NEAR( 1.5, l0.scale.y, 1e-6 );
+    EXPECT_NEAR( 1.5, lh.translation.x, 1e-6 );
+    EXPECT_NEAR( 2.25, lh.scale.z, 1e-6 );
+    Quaternion<T> const rh = nlerp(r1, r2, T(0.5));
+    for (i = 0; i < 4; ++i)
+        EXPECT_NEAR( rh[i], lh.rotation[i], 1e-6 );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Transform hierarchies
+
+template <typename T>
+class HierarchyTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( HierarchyTest, RealTypes );
+
+// world(node) computed directly from the parent chain.
+template <typename T>
+static Matrix44<T> reference_world( TransformHierarchy<T> const & h, unsigned int node ) {
+    unsigned int const p = h.parent(node);
+    if (p == TransformHierarchy<T>::NONE)
+        return h.local(node);
+    return reference_world(h, p) * h.local(node);
+    }
+
+TYPED_TEST( HierarchyTest, IncrementalUpdates ) {
+    typedef TransformHierarchy<TypeParam> H;
+    H h;
+    std::vector<unsigned int> nodes;
+    Matrix44<TypeParam> m;
+
+    // Parents picked pseudo randomly, so the nodes are not added in depth
+    // order and the first update() has to sort them.
+    unsigned int seed = 12345;
+    size_t i;
+    for (i = 0; i < 2000; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned int const parent = i < 3 ? H::NONE : nodes[(seed >> 8) % nodes.size()];
+        get_transform_mat44(m, 0.01f * i, Vector3<TypeParam>( 1, (TypeParam) (0.5 * (i % 3)), 2 ),
+                            Vector3<TypeParam>( (TypeParam) (i % 5), 1, (TypeParam) -0.5 ));
+        nodes.push_back(h.add(parent, m));
+        }
+    EXPECT_EQ( nodes.size(), h.size() );
+    h.update();
+    for (i = 0; i < nodes.size(); ++i) {
+        ASSERT_TRUE( h.world(nodes[i]) == reference_world(h, nodes[i]) ) << "node " << i;
+        if (h.parent(nodes[i]) != H::NONE) {
+            EXPECT_EQ( h.depth(h.parent(nodes[i])) + 1, h.depth(nodes[i]) );
+            }
+        }
+    for (i = 1; i < h.size(); ++i)
+        ASSERT_LE( h.depth(h.node_at(i - 1)), h.depth(h.node_at(i)) );
+    EXPECT_TRUE( h.worlds()[5] == h.world(h.node_at(5)) );
+
+    // Change a few nodes, serially and then on 3 threads, and then enough
+    // nodes that update() goes through all of them.
+    int pass;
+    for (pass = 0; pass < 3; ++pass) {
+        for (i = pass; i < nodes.size(); i += (pass < 2 ? 37 : 3)) {
+            get_rot_mat44(m, 0.1f * (pass + 1), Vector3<TypeParam>( 0, 1, (TypeParam) (i % 4) ));
+            h.set_local(nodes[i], m);
+            }
+        if (pass == 0)
+            h.update();
+        else
+            h.update([](size_t begin, size_t end, auto const & body) {
+                size_t const step = (end - begin + 2) / 3;
+                std::vector<std::thread> threads;
+                size_t b;
+                for (b = begin; b < end; b += step)
+                    threads.push_back(std::thread(body, b, std::min(b + step, end)));
+                for (auto & t : threads)
+                    t.join();
+                });
+        for (i = 0; i < nodes.size(); ++i)
+            ASSERT_TRUE( h.world(nodes[i]) == reference_world(h, nodes[i]) ) << "pass " << pass << " node " << i;
+        }
+
+    // Adding to an updated hierarchy keeps the earlier handles.
+    Matrix44<TypeParam> const before = h.world(nodes[100]);
+    unsigned int const leaf = h.add(nodes[7], m);
+    h.update();
+    EXPECT_TRUE( h.world(nodes[100]) == before );
+    EXPECT_TRUE( h.world(leaf) == h.world(nodes[7]) * m );
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Bounding volumes
+
+template <typename T>
+class BoundsTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( BoundsTest, RealTypes );
+
+TYPED_TEST( BoundsTest, AABBOperations ) {
+    typedef AABB<TypeParam> B;
+    typedef Vector3<TypeParam> V;
+
+    B e;
+    EXPECT_TRUE( e.empty() );
+    e.merge(V( 1, 2, 3 ));
+    EXPECT_FALSE( e.empty() );
+    EXPECT_TRUE( e.min == V( 1, 2, 3 ) && e.max == V( 1, 2, 3 ) );
+
+    B const a( V( 0, 0, 0 ), V( 2, 4, 6 ) ), b( V( 1, -1, 5 ), V( 3, 1, 8 ) );
+    EXPECT_TRUE( a.center() == V( 1, 2, 3 ) );
+    EXPECT_TRUE( a.size() == V( 2, 4, 6 ) );
+    EXPECT_TRUE( a.extents() == V( 1, 2, 3 ) );
+    B const u = a.merged(b), i = a.intersection(b);
+    EXPECT_TRUE( u.min == V( 0, -1, 0 ) && u.max == V( 3, 4, 8 ) );
+    EXPECT_TRUE( i.min == V( 1, 0, 5 ) && i.max == V( 2, 1, 6 ) );
+    EXPECT_TRUE( B().merge(a).merge(b).min == u.min );
+    EXPECT_TRUE( a.overlaps(b) && b.overlaps(a) );
+    EXPECT_TRUE( a.overlaps(B( V( 2, 4, 6 ), V( 3, 5, 7 ) )) );
+    EXPECT_FALSE( a.overlaps(B( V( 2, 5, 6 ), V( 3, 5, 7 ) )) );
+    EXPECT_TRUE( a.intersection(B( V( 2, 5, 6 ), V( 3, 5, 7 ) )).empty() );
+    EXPECT_TRUE( u.contains(a) && u.contains(b) && !a.contains(u) );
+    EXPECT_TRUE( a.contains(V( 2, 0, 3 )) );
+    EXPECT_FALSE( a.contains(V( 2, (TypeParam) -0.01, 3 )) );
+
+    // Arvo's transform gives the bounds of the 8 transformed corners.
+    Matrix44<TypeParam> M;
+    get_transform_mat44(M, 0.8f, V( 1, -2, 3 ), V( 5, 6, -7 ));
+    B const t = b.transformed(M);
+    B corners;
+    int k;
+    for (k = 0; k < 8; ++k) {
+        V const c( (k & 1) ? b.max.x : b.min.x, (k & 2) ? b.max.y : b.min.y, (k & 4) ? b.max.z : b.min.z );
+        Vector4<TypeParam> const r = M * Vector4<TypeParam>( c.x, c.y, c.z, 1 );
+        corners.merge(V( r.x, r.y, r.z ));
+        }
+    EXPECT_NEAR( 0, (t.min - corners.min).length(), 1e-4 );
+    EXPECT_NEAR( 0, (t.max - corners.max).length(), 1e-4 );
+    EXPECT_TRUE( B().transformed(M).empty() );
+
+    Matrix44<TypeParam> P;
+    get_ortho_mat44(P, (TypeParam) 1, (TypeParam) 10, (TypeParam) -1, (TypeParam) 1, (TypeParam) -1, (TypeParam) 1);
+    Frustum<TypeParam> const f(P);
+    EXPECT_TRUE( f.intersects(B( V( 0, 0, -12 ), V( 2, 2, -9 ) )) );
+    EXPECT_FALSE( f.intersects(B( V( 0, 0, -12 ), V( 2, 2, -11 ) )) );
+    }
+
+// The array bounds match merging the points one at a time, at every SIMD
+// level and for sizes that leave each kind of tail.
+TYPED_TEST( BoundsTest, ArrayBounds ) {
+    typedef Vector3<TypeParam> V;
+    size_t const sizes[] = { 0, 1, 3, 4, 5, 8, 9, 17, 100, 1001 };
+    SimdLevel const saved = simd_level();
+    for (size_t n : sizes) {
+        std::vector<V> points(n);
+        Vector3SoA<TypeParam> soa(n);
+        AABB<TypeParam> ref;
+        size_t i;
+        for (i = 0; i < n; ++i) {
+            points[i].assign( (TypeParam) std::sin(0.37 * i) * i, (TypeParam) std::cos(1.3 * i) * 3, (TypeParam) (0.25 * i) - 7 );
+            soa.set(i, points[i]);
+            ref.merge(points[i]);
+            }
+        int level;
+        for (level = (int) SimdLevel::SCALAR; level <= (int) SimdLevel::AVX512; ++level) {
+            if (set_simd_level((SimdLevel) level) != (SimdLevel) level && level != (int) SimdLevel::SCALAR)
+                break;
+            AABB<TypeParam> const b = bounds(n ? &points[0] : 0, n), s = bounds(soa);
+            EXPECT_EQ( n == 0, b.empty() );
+            EXPECT_TRUE( b.min == ref.min && b.max == ref.max ) << "n = " << n << ", level " << level;
+            EXPECT_TRUE( s.min == ref.min && s.max == ref.max ) << "n = " << n << ", level " << level;
+            }
+        }
+    set_simd_level(saved);
+    }
+
+TYPED_TEST( BoundsTest, SpheresAndOBBs ) {
+    typedef Vector3<TypeParam> V;
+    typedef OBB<TypeParam> O;
+
+    Sphere<TypeParam> s;
+    EXPECT_TRUE( s.empty() );
+    EXPECT_FALSE( s.contains(V( 0, 0, 0 )) );
+    EXPECT_FALSE( s.contains(s) || s.overlaps(s) );
+    s.merge(V( 1, 0, 0 ));
+    EXPECT_TRUE( s.center == V( 1, 0, 0 ) && s.radius == 0 );
+    s.merge(V( -1, 0, 0 ));
+    EXPECT_TRUE( s.center == V( 0, 0, 0 ) && s.radius == 1 );
+    s.merge(Sphere<TypeParam>( V( 0, 0, (TypeParam) 0.5 ), (TypeParam) 0.25 ));
+    EXPECT_EQ( 1, s.radius );
+    EXPECT_TRUE( s.contains(V( 0, (TypeParam) 0.9, 0 )) && !s.contains(V( 0, (TypeParam) 0.9, (TypeParam) 0.9 )) );
+    EXPECT_TRUE( s.overlaps(Sphere<TypeParam>( V( 3, 0, 0 ), (TypeParam) 2.5 )) );
+    EXPECT_FALSE( s.overlaps(Sphere<TypeParam>( V( 3, 0, 0 ), (TypeParam) 1.5 )) );
+    EXPECT_TRUE( s.aabb().max == V( 1, 1, 1 ) );
+
+    // Two boxes that only the separating axis test can tell apart: b is
+    // turned 45 degrees about z and moved along the diagonal, so its bounding
+    // box overlaps a's, but a face of b separates them.
+    O const a( AABB<TypeParam>( V( -1 ), V( 1 ) ) );
+    Matrix33<TypeParam> R;
+    get_rot_mat33(R, 0.785398163f, V( 0, 0, 1 ));
+    O b( V( 2, 2, 0 ), R, V( 1 ) );
+    EXPECT_TRUE( a.aabb().overlaps(b.aabb()) );
+    EXPECT_FALSE( a.overlaps(b) );
+    b.center = V( (TypeParam) 1.6, (TypeParam) 1.6, 0 );
+    EXPECT_TRUE( a.overlaps(b) && b.overlaps(a) );
+    EXPECT_NEAR( 1.6 - std::sqrt(2.0), b.aabb().min.x, 1e-5 );
+    EXPECT_TRUE( b.contains(V( 1, 1, 0 )) );
+    EXPECT_FALSE( b.contains(V( (TypeParam) 0.5, (TypeParam) 0.5, 0 )) );
+
+    // Random pairs: overlaps() is symmetric, and a point of one inside the
+    // other means they overlap.
+    unsigned int seed = 99;
+    auto random = [&seed](double lo, double hi) {
+        seed = seed * 1103515245u + 12345u;
+        return (TypeParam) (lo + (hi - lo) * ((seed >> 8) & 0xffff) / 65535.0);
+        };
+    int pair, k, overlapping = 0;
+    for (pair = 0; pair < 200; ++pair) {
+        O p[2];
+        for (k = 0; k < 2; ++k) {
+            get_rot_mat33(R, random(0, 6.3), V( random(-1, 1), random(-1, 1), random(0.1, 1) ));
+            p[k] = O( V( random(-2, 2), random(-2, 2), random(-2, 2) ), R, V( random(0.1, 2), random(0.1, 2), random(0.1, 2) ) );
+            }
+        bool const o = p[0].overlaps(p[1]);
+        EXPECT_EQ( o, p[1].overlaps(p[0]) );
+        overlapping += o;
+        for (k = 0; k < 27; ++k) {
+            V const q = p[0].center + p[0].axis(0) * (p[0].extents.x * (k % 3 - 1))
+                + p[0].axis(1) * (p[0].extents.y * (k / 3 % 3 - 1)) + p[0].axis(2) * (p[0].extents.z * (k / 9 - 1));
+            if (p[1].contains(q)) {
+                EXPECT_TRUE( o ) << "pair " << pair;
+                }
+            }
+        }
+    EXPECT_TRUE( overlapping > 20 && overlapping < 180 ) << overlapping;
+    }
+
+// Points filling a long thin box at an angle: the OBB should find it, and
+// both fits must contain every point, at every SIMD level.
+TYPED_TEST( BoundsTest, Fitting ) {
+    typedef Vector3<TypeParam> V;
+    Matrix33<TypeParam> R;
+    get_rot_mat33(R, 0.6f, V( 1, 2, 3 ));
+    V const center( 100, -50, 20 ), half( 5, 2, (TypeParam) 0.5 );
+    size_t const n = 1003;
+    std::vector<V> points(n);
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        V const u( (TypeParam) std::sin(1.7 * i), (TypeParam) std::cos(2.9 * i), (TypeParam) std::sin(0.61 * i + 1) );
+        V const l( u.x * half.x, u.y * half.y, u.z * half.z );
+        points[i] = center + R * l;
+        }
+    for (i = 0; i < 8; ++i)
+        points[i] = center + R * V( (i & 1) ? half.x : -half.x, (i & 2) ? half.y : -half.y, (i & 4) ? half.z : -half.z );
+
+    EXPECT_TRUE( fit_sphere((V const *) 0, 0).empty() );
+    EXPECT_TRUE( fit_obb((V const *) 0, 0).empty() );
+
+    SimdLevel const saved = simd_level();
+    int level;
+    for (level = (int) SimdLevel::SCALAR; level <= (int) SimdLevel::AVX512; ++level) {
+        if (set_simd_level((SimdLevel) level) != (SimdLevel) level && level != (int) SimdLevel::SCALAR)
+            break;
+        Sphere<TypeParam> const s = fit_sphere(&points[0], n);
+        OBB<TypeParam> const b = fit_obb(&points[0], n);
+        double const diagonal = std::sqrt(half.dot(half));
+        EXPECT_GE( s.radius, diagonal * (1 - 1e-5) );
+        EXPECT_LE( s.radius, diagonal * 1.2 );
+        // The samples aren't quite uniform, so the axes are a little off.
+        EXPECT_NEAR( 5, b.extents.x, 0.05 ) << level;
+        EXPECT_NEAR( 2, b.extents.y, 0.02 ) << level;
+        EXPECT_NEAR( 0.5, b.extents.z, 0.005 ) << level;
+        EXPECT_NEAR( 0, (b.center - center).length(), 0.01 ) << level;
+        EXPECT_NEAR( 1, det(b.axes), 1e-5 );
+        EXPECT_NEAR( 1, std::fabs(b.axis(0).dot(R.getcol(0))), 1e-4 );
+        for (i = 0; i < n; ++i) {
+            V const d = points[i] - s.center;
+            EXPECT_LE( std::sqrt(d.dot(d)), s.radius * (1 + 1e-5) ) << i;
+            OBB<TypeParam> grown( b );
+            grown.extents = grown.extents + V( (TypeParam) 1e-3 );
+            EXPECT_TRUE( grown.contains(points[i]) ) << i;
+            }
+        }
+    set_simd_level(saved);
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// View frustum culling
+
+template <typename T>
+class FrustumTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( FrustumTest, RealTypes );
+
+TYPED_TEST( FrustumTest, PlanesAndSingleTests ) {
+    typedef Frustum<TypeParam> F;
+    double const eps = 1e-5;
+
+    // The box -1 <= x, y <= 1, -10 <= z <= -1.
+    Matrix44<TypeParam> M;
+    get_ortho_mat44(M, (TypeParam) 1, (TypeParam) 10, (TypeParam) -1, (TypeParam) 1, (TypeParam) -1, (TypeParam) 1);
+    F f(M);
+    EXPECT_NEAR( 1, f.planes[F::PLANE_LEFT].x, eps );
+    EXPECT_NEAR( 1, f.planes[F::PLANE_LEFT].w, eps );
+    EXPECT_NEAR( 1, f.planes[F::PLANE_TOP].w, eps );
+    EXPECT_NEAR( -1, f.planes[F::PLANE_NEAR].z, eps );
+    EXPECT_NEAR( -1, f.planes[F::PLANE_NEAR].w, eps );
+    EXPECT_NEAR( 1, f.planes[F::PLANE_FAR].z, eps );
+    EXPECT_NEAR( 10, f.planes[F::PLANE_FAR].w, eps );
+    EXPECT_NEAR( -2, f.distance(F::PLANE_FAR, 0, 0, -12), eps );
+    EXPECT_TRUE( f.contains(Vector3<TypeParam>( 0, 0, -5 )) );
+    EXPECT_TRUE( f.contains(Vector3<TypeParam>( (TypeParam) 0.99, (TypeParam) -0.99, (TypeParam) -1.01 )) );
+    EXPECT_FALSE( f.contains(Vector3<TypeParam>( 0, 0, (TypeParam) -0.5 )) );
+    EXPECT_FALSE( f.contains(Vector3<TypeParam>( 0, 0, -11 )) );
+    EXPECT_FALSE( f.contains(Vector3<TypeParam>( (TypeParam) 1.5, 0, -5 )) );
+    EXPECT_TRUE( f.intersects(Vector3<TypeParam>( (TypeParam) 1.5, 0, -5 ), (TypeParam) 0.75) );
+    EXPECT_FALSE( f.intersects(Vector3<TypeParam>( (TypeParam) 1.5, 0, -5 ), (TypeParam) 0.25) );
+    EXPECT_TRUE( f.intersects(Vector3<TypeParam>( 0, 0, -12 ), Vector3<TypeParam>( 2, 2, -9 )) );
+    EXPECT_FALSE( f.intersects(Vector3<TypeParam>( 0, 0, -12 ), Vector3<TypeParam>( 2, 2, -11 )) );
+    EXPECT_FALSE( f.intersects(Vector3<TypeParam>( -3, -3, -5 ), Vector3<TypeParam>( -2, 3, -4 )) );
+
+    // A perspective frustum seen from elsewhere agrees with clipping the
+    // points, away from its boundary.
+    Matrix44<TypeParam> P, V;
+    get_persp_mat44(P, (TypeParam) 0.5, (TypeParam) 50, (TypeParam) -0.4, (TypeParam) 0.6, (TypeParam) -0.3, (TypeParam) 0.3);
+    get_transform_mat44(V, 0.6f, Vector3<TypeParam>( 1, 2, -1 ), Vector3<TypeParam>( 3, -2, 5 ));
+    M = P * V;
+    f.set(M);
+    int x, y, z, inside = 0;
+    for (x = -20; x <= 20; ++x)
+        for (y = -20; y <= 20; ++y)
+            for (z = -20; z <= 20; ++z) {
+                Vector4<TypeParam> const p( (TypeParam) x, (TypeParam) y, (TypeParam) (2 * z), 1 );
+                TypeParam c[4];
+                int k;
+                for (k = 0; k < 4; ++k) {
+                    Vector4<TypeParam> const r = M.getrow(k);
+                    c[k] = r.x * p.x + r.y * p.y + r.z * p.z + r.w;
+                    }
+                TypeParam const margin = std::min(std::min(c[3] - std::fabs(c[0]), c[3] - std::fabs(c[1])),
+                                                  c[3] - std::fabs(c[2]));
+                if (std::fabs(margin) < 1e-3)
+                    continue;
+                bool const in = f.contains(Vector3<TypeParam>( p.x, p.y, p.z ));
+                EXPECT_EQ( margin > 0, in ) << x << " " << y << " " << z;
+                inside += in;
+                }
+    EXPECT_GT( inside, 100 );
+
+    // Nothing is beyond the far plane at infinity.
+    get_persp_inf_mat44(P, (TypeParam) 1, (TypeParam) 10, (TypeParam) -1, (TypeParam) 1, (TypeParam) -1, (TypeParam) 1);
+    f.set(P);
+    EXPECT_TRUE( f.contains(Vector3<TypeParam>( 0, 0, (TypeParam) -1e6 )) );
+    EXPECT_FALSE( f.contains(Vector3<TypeParam>( 0, 0, (TypeParam) -0.5 )) );
+    }
+
+// The masks and index lists match the single object tests, at every SIMD
+// level and for sizes that leave each kind of tail.
+TYPED_TEST( FrustumTest, BatchCulling ) {
+    Matrix44<TypeParam> P, V;
+    get_persp_mat44(P, (TypeParam) 1, (TypeParam) 20, (TypeParam) -1, (TypeParam) 1, (TypeParam) -0.75, (TypeParam) 0.75);
+    get_transform_mat44(V, -0.3f, Vector3<TypeParam>( 0, 1, 0 ), Vector3<TypeParam>( 1, 0, 2 ));
+    Frustum<TypeParam> const f(P * V);
+
+    size_t const sizes[] = { 0, 3, 7, 8, 13, 37, 64, 100 };
+    SimdLevel const saved = simd_level();
+    unsigned int seed = 777;
+    auto random = [&seed](double lo, double hi) {
+        seed = seed * 1103515245u + 12345u;
+        return (TypeParam) (lo + (hi - lo) * ((seed >> 8) & 0xffff) / 65535.0);
+        };
+    for (size_t n : sizes) {
+        Vector3SoA<TypeParam> centers(n), lo(n), hi(n);
+        std::vector<TypeParam> radii(n);
+        std::vector<unsigned char> sphere_ref((n + 7) / 8, 0), box_ref((n + 7) / 8, 0);
+        size_t i;
+        for (i = 0; i < n; ++i) {
+            Vector3<TypeParam> const c( random(-15, 15), random(-15, 15), random(-25, 5) );
+            Vector3<TypeParam> const e( random(0, 3), random(0, 3), random(0, 3) );
+            centers.set(i, c);
+            radii[i] = random(0, 4);
+            lo.set(i, c - e);
+            hi.set(i, c + e);
+            if (f.intersects(c, radii[i]))
+                sphere_ref[i >> 3] |= 1 << (i & 7);
+            if (f.intersects(c - e, c + e))
+                box_ref[i >> 3] |= 1 << (i & 7);
+            }
+
+        int level;
+        for (level = (int) SimdLevel::SCALAR; level <= (int) SimdLevel::AVX512; ++level) {
+            if (set_simd_level((SimdLevel) level) != (SimdLevel) level && level != (int) SimdLevel::SCALAR)
+                break;
+            std::vector<unsigned char> mask((n + 7) / 8, 0xff);
+            std::vector<unsigned int> indices(n);
+            f.cull_spheres(centers, n ? &radii[0] : 0, mask.empty() ? 0 : &mask[0]);
+            EXPECT_TRUE( mask == sphere_ref ) << "spheres, n = " << n << ", level " << level;
+            size_t count = f.visible_spheres(centers, n ? &radii[0] : 0, indices.empty() ? 0 : &indices[0]);
+            size_t k = 0;
+            for (i = 0; i < n; ++i)
+                if (sphere_ref[i >> 3] & (1 << (i & 7))) {
+                    EXPECT_EQ( i, indices[k++] );
+                    }
+            EXPECT_EQ( k, count );
+
+            std::fill(mask.begin(), mask.end(), 0xff);
+            f.cull_boxes(lo, hi, mask.empty() ? 0 : &mask[0]);
+            EXPECT_TRUE( mask == box_ref ) << "boxes, n = " << n << ", level " << level;
+            count = f.visible_boxes(lo, hi, indices.empty() ? 0 : &indices[0]);
+            k = 0;
+            for (i = 0; i < n; ++i)
+                if (box_ref[i >> 3] & (1 << (i & 7))) {
+                    EXPECT_EQ( i, indices[k++] );
+                    }
+            EXPECT_EQ( k, count );
+            if (n == 100) {
+                EXPECT_TRUE( count > 5 && count < 95 ) << count;
+                }
+            }
+        }
+    set_simd_level(saved);
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Rays
+
+template <typename T>
+class RayTest : public ::testing::Test {
+    };
+
+TYPED_TEST_CASE( RayTest, RealTypes );
+
+// The slab test written out with explicit cases for zero directions, in
+// double.  near_miss is set when the ray only just hits or misses, where
+// rounding can go either way.
+static bool reference_hit( Vector3d const & o, Vector3d const & d, double t0, double t1,
+                           Vector3d const & lo, Vector3d const & hi, bool & near_miss ) {
+    int k;
+    for (k = 0; k < 3; ++k) {
+        if (d[k] == 0) {
+            if (o[k] < lo[k] || o[k] > hi[k])
+                return near_miss = false;
+            continue;
+            }
+        double a = (lo[k] - o[k]) / d[k], b = (hi[k] - o[k]) / d[k];
+        if (a > b)
+            std::swap(a, b);
+        t0 = std::max(t0, a);
+        t1 = std::min(t1, b);
+        }
+    near_miss = std::fabs(t1 - t0) < 1e-3;
+    return t0 <= t1;
+    }
+
+TYPED_TEST( RayTest, SlabTest ) {
+    typedef Vector3<TypeParam> V;
+    typedef Ray<TypeParam> R;
+    AABB<TypeParam> const box( V( -1 ), V( 1 ) );
+    TypeParam t;
+
+    R r( V( 0, 0, -5 ), V( 0, 0, 2 ) );
+    EXPECT_TRUE( intersects(r, box, t) );
+    EXPECT_EQ( 2, t );
+    EXPECT_TRUE( r.at(t) == V( 0, 0, -1 ) );
+    r.tmax = (TypeParam) 1.5;
+    EXPECT_FALSE( intersects(r, box) );
+    r = R( V( 0, 0, 5 ), V( 0, 0, 1 ) );
+    EXPECT_FALSE( intersects(r, box) );
+    r = R( V( (TypeParam) 0.5, 0, 0 ), V( 1, 1, 0 ) );
+    EXPECT_TRUE( intersects(r, box, t) );
+    EXPECT_EQ( 0, t );
+    EXPECT_FALSE( intersects(r, AABB<TypeParam>()) );
+    EXPECT_FALSE( intersects(R( V( 0 ), V( 1, 0, 0 ) ), AABB<TypeParam>()) );
+
+    // Along a face, with either sign of zero, hits; just outside it misses.
+    r = R( V( 0, 1, -5 ), V( 0, 0, 1 ) );
+    EXPECT_TRUE( intersects(r, box, t) );
+    EXPECT_EQ( 4, t );
+    r = R( V( -1, 0, -5 ), V( (TypeParam) -0.0, (TypeParam) -0.0, 1 ) );
+    EXPECT_TRUE( intersects(r, box) );
+    r = R( V( 1, 1, 5 ), V( 0, 0, -1 ) );
+    EXPECT_TRUE( intersects(r, box) );
+    r = R( V( 0, (TypeParam) 1.001, -5 ), V( 0, 0, 1 ) );
+    EXPECT_FALSE( intersects(r, box) );
+    r = R( V( 0, (TypeParam) -1.001, -5 ), V( (TypeParam) -0.0, (TypeParam) -0.0, 1 ) );
+    EXPECT_FALSE( intersects(r, box) );
+
+    // Random rays, some with zero direction elements.
+    unsigned int seed = 4242;
+    auto random = [&seed](double lo, double hi) {
+        seed = seed * 1103515245u + 12345u;
+        return (TypeParam) (lo + (hi - lo) * ((seed >> 8) & 0xffff) / 65535.0);
+        };
+    int i, hits = 0;
+    for (i = 0; i < 2000; ++i) {
+        // Aimed roughly at the box, so about half hit.
+        V const o( random(-4, 4), random(-4, 4), random(-4, 4) );
+        V const c( random(-2, 2), random(-2, 2), random(-2, 2) );
+        V const e( random(0, 2), random(0, 2), random(0, 2) );
+        V d = c - o + V( random(-2, 2), random(-2, 2), random(-2, 2) );
+        if (i % 4 == 0)
+            d[i / 4 % 3] = (i % 8 == 0) ? (TypeParam) 0 : (TypeParam) -0.0;
+        AABB<TypeParam> const b( c - e, c + e );
+        R const ray( o, d, 0, random(0.5, 2) );
+        bool near_miss;
+        bool const ref = reference_hit(Vector3d( o.x, o.y, o.z ), Vector3d( d.x, d.y, d.z ), ray.tmin, ray.tmax,
+                                       Vector3d( b.min.x, b.min.y, b.min.z ), Vector3d( b.max.x, b.max.y, b.max.z ), near_miss);
+        if (near_miss)
+            continue;
+        EXPECT_EQ( ref, intersects(ray, b, t) ) << "ray " << i;
+        // The entry point is on (or, from inside, in) the box.
+        if (ref) {
+            EXPECT_TRUE( AABB<TypeParam>( b.min - V( (TypeParam) 1e-4 ), b.max + V( (TypeParam) 1e-4 ) ).contains(ray.at(t)) ) << "ray " << i;
+            }
+        hits += ref;
+        }
+    EXPECT_TRUE( hits > 200 && hits < 1800 ) << hits;
+    }
+
+#if defined(ARDA_MATH_SSE2)
+// Every packet combination gives, lane for lane, the same hits and
+// distances as the scalar test.
+template <typename P>
+static void check_ray_packets() {
+    unsigned int const N = P::size;
+    unsigned int seed = 31337;
+    auto random = [&seed](double lo, double hi) {
+        seed = seed * 1103515245u + 12345u;
+        return (float) (lo + (hi - lo) * ((seed >> 8) & 0xffff) / 65535.0);
+        };
+    int round;
+    unsigned int i, k, total = 0;
+    for (round = 0; round < 200; ++round) {
+        Rayf rays[8];
+        AABBf boxes[8];
+        alignas(32) float o[3][8], d[3][8], t0[8], t1[8], lo[3][8], hi[3][8];
+        for (i = 0; i < N; ++i) {
+            Vector3f const origin( random(-4, 4), random(-4, 4), random(-4, 4) );
+            Vector3f const c( random(-2, 2), random(-2, 2), random(-2, 2) );
+            Vector3f const e( random(0, 2), random(0, 2), random(0, 2) );
+            Vector3f dir = c - origin + Vector3f( random(-2, 2), random(-2, 2), random(-2, 2) );
+            if ((round + i) % 3 == 0)
+                dir[(round + i) % 3] = (i & 1) ? 0.0f : -0.0f;
+            rays[i] = Rayf( origin, dir, random(0, 0.5), random(0.5, 2) );
+            boxes[i] = AABBf( c - e, c + e );
+            if (round % 7 == 0 && i == 1)
+                boxes[i] = AABBf();
+            for (k = 0; k < 3; ++k) {
+                o[k][i] = rays[i].origin[k];
+                d[k][i] = rays[i].direction[k];
+                lo[k][i] = boxes[i].min[k];
+                hi[k][i] = boxes[i].max[k];
+                }
+            t0[i] = rays[i].tmin;
+            t1[i] = rays[i].tmax;
+            }
+        Ray<P> const packet( Vector3<P>( P::load(o[0]), P::load(o[1]), P::load(o[2]) ),
+                             Vector3<P>( P::load(d[0]), P::load(d[1]), P::load(d[2]) ), P::load(t0), P::load(t1) );
+        AABB<P> const node( Vector3<P>( P::load(lo[0]), P::load(lo[1]), P::load(lo[2]) ),
+                            Vector3<P>( P::load(hi[0]), P::load(hi[1]), P::load(hi[2]) ) );
+        P t;
+
+        // Lane by lane.
+        unsigned int const lanes = intersects(packet, node, t);
+        for (i = 0; i < N; ++i) {
+            float ts;
+            bool const hit = intersects(rays[i], boxes[i], ts);
+            EXPECT_EQ( hit, ((lanes >> i) & 1) != 0 ) << round << " " << i;
+            if (hit) {
+                EXPECT_EQ( ts, t[i] );
+                }
+            total += hit;
+            }
+
+        // Every ray against box 0, and ray 0 against every box.
+        unsigned int const rays_hit = intersects(packet, boxes[0], t);
+        for (i = 0; i < N; ++i) {
+            float ts;
+            bool const hit = intersects(rays[i], boxes[0], ts);
+            EXPECT_EQ( hit, ((rays_hit >> i) & 1) != 0 ) << round << " " << i;
+            if (hit) {
+                EXPECT_EQ( ts, t[i] );
+                }
+            }
+        unsigned int const boxes_hit = intersects(rays[0], node, t);
+        for (i = 0; i < N; ++i) {
+            float ts;
+            bool const hit = intersects(rays[0], boxes[i], ts);
+            EXPECT_EQ( hit, ((boxes_hit >> i) & 1) != 0 ) << round << " " << i;
+            if (hit) {
+                EXPECT_EQ( ts, t[i] );
+                }
+            }
+        EXPECT_EQ( intersects(rays[0], node), boxes_hit );
+        }
+    EXPECT_GT( total, 20 * N );
+    }
+
+TEST( RayTest, Packet4f ) {
+    check_ray_packets<Packet4f>();
+    }
+
+#if defined(ARDA_MATH_AVX)
+TEST( RayTest, Packet8f ) {
+    check_ray_packets<Packet8f>();
+    }
+#endif
+#endif // ARDA_MATH_SSE2
+
+////////////////////////////////////////////////////////////////////////////////
+// Compile time evaluation
+
+// Everything here is checked by the compiler; the test just records that it
+// compiled.
+constexpr Vector3i cv1( 1, 2, 3 ), cv2( -2, 0, 5 );
+static_assert( cv1.cross(cv2) == Vector3i( 10, -11, 4 ), "cross" );
+static_assert( (cv1 + cv2 * 2).dot(cv1) == 40, "vector arithmetic" );
+static_assert( Vector4d( Vector3d( 1, 2, 3 ) ).w == 0, "conversion" );
+static_assert( Vector2d( 3, 4 ).proj(Vector2d( 2, 0 )) == Vector2d( 3, 0 ), "proj" );
+
+constexpr Matrix33i cm33( 2, 0, 1,  1, 3, 0,  0, 1, 4 );
+static_assert( det(cm33) == 25, "det 33" );
+static_assert( transpose(cm33)[1] == 1 && transpose(cm33)[3] == 0, "transpose" );
+static_assert( (cm33 * Matrix33i( 1 ))[0] == 3, "33 product" );
+static_assert( (Matrix22f( 1, 2, 3, 4 ) * Matrix22f( 0, 1, 1, 0 ))[0] == 3.0f, "22 product" );
+
+constexpr Matrix<int, 2, 3> cm23( 1, 2,  3, 4,  5, 6 );
+static_assert( (cm23 * transpose(cm23))[0] == 35 && (transpose(cm23) * cm23)[0] == 5, "23 product" );
+static_assert( Vector<int, 5>( 1, 2, 3, 4, 5 ).dot(Vector<int, 5>( 1 )) == 15, "5 element dot" );
+
+constexpr Matrix44i ct44 = get_trans_mat44(Vector3i( 3, -2, 5 ));
+constexpr Matrix44i cs44 = get_scale_mat44(Vector3i( 2, 3, 4 ));
+static_assert( (ct44 * cs44)[12] == 3 && (ct44 * cs44)[5] == 3, "44 product" );
+static_assert( det(ct44 * cs44) == 24, "det 44" );
+static_assert( get_shear_mat44<int>(0, 1, 2)[4] == 2, "shear" );
+
+constexpr Matrix44f cp44 = get_ortho_mat44(-1.0f, 1.0f, -2.0f, 2.0f, -4.0f, 4.0f);
+static_assert( cp44[0] == 0.5f && cp44[5] == 0.25f && cp44[10] == -1.0f && cp44[15] == 1.0f, "ortho" );
+static_assert( get_scale_mat44<double>(2)[10] == 2.0 && det(get_scale_mat44<double>(2)) == 8.0, "scale" );
+
+TEST( ConstexprTest, BuildersMatchRuntimeVersions ) {
+    Matrix44f m;
+    get_ortho_mat44(m, -1.0f, 1.0f, -2.0f, 2.0f, -4.0f, 4.0f);
+    EXPECT_TRUE( m == cp44 );
+    get_trans_mat44(m, Vector3f( 3, -2, 5 ));
+    EXPECT_TRUE( m == get_trans_mat44(Vector3f( 3, -2, 5 )) );
+    get_scale_mat44(m, 2.0f);
+    EXPECT_TRUE( m == get_scale_mat44<float>(2) );
+    get_shear_mat44(m, 2, 0, 0.5f);
+    EXPECT_EQ( 0.5f, m[2] );
+    }
+
 ////////////////////////////////////////////////////////////////////////////////
 
 int main(int argc, char **argv) {